@@ -0,0 +1,293 @@
+#include "stdafx.h"
+#include "CommandRecorder.h"
+
+#include "JobSystem.h"
+#include "MemoryUtils.h"
+#include "Utils.h"
+
+// one chunk slot's command buffers for one frame in flight
+typedef struct recorder_pool_t {
+	VkCommandPool commandPool;
+	// allocated as needed and reused every time the frame comes around
+	uint32_t commandBufferCount;
+	uint32_t commandBufferCapacity;
+	VkCommandBuffer* paCommandBuffers;
+	// how many have been handed out since the pool was last reset
+	uint32_t usedCount;
+} RecorderPool;
+
+// what the chunks of a CommandRecorder_Record share
+typedef struct record_job_t {
+	RecordFunction function;
+	void* pUserData;
+	const VkCommandBufferInheritanceInfo* pInheritanceInfo;
+	uint32_t itemCount;
+	uint32_t chunkCount;
+	const VkCommandBuffer* aCommandBuffers;
+} RecordJob;
+
+// the JobSystem's user data for recording one chunk
+typedef struct record_chunk_t {
+	const RecordJob* pJob;
+	uint32_t chunkIndex;
+} RecordChunk;
+
+struct command_recorder_t {
+	VkDevice device;
+	JobSystem* pJobSystem;
+	uint32_t frameCount;
+	// the most chunks a recording is split into, one per JobSystem thread
+	uint32_t maxChunkCount;
+	// frameCount * maxChunkCount, grouped by frame
+	RecorderPool* paPools;
+	uint32_t currentFrame;
+
+	// maxChunkCount of each, for the chunks of the current recording
+	RecordChunk* paChunks;
+	Job** papChunkJobs;
+};
+
+VkCommandBuffer CommandRecorder_NextCommandBuffer(
+	CommandRecorder* pThis,
+	uint32_t chunkIndex);
+void CommandRecorder_RecordChunk(const RecordJob* pJob, uint32_t chunkIndex);
+void CommandRecorder_ChunkMain(void* pUserData);
+
+/*!
+ * \brief	creates a pool per chunk for every frame in flight
+ *
+ * \param	queueFamilyIndex the family the secondaries' primaries are submitted to
+ * \param	frameCount how many frames may be in flight, each gets its own pools
+ * \param	pJobSystem records the chunks, a recording is split into at most
+ *			one chunk per thread it has
+ */
+CommandRecorder* CommandRecorder_Create(
+	VkDevice device,
+	uint32_t queueFamilyIndex,
+	uint32_t frameCount,
+	JobSystem* pJobSystem) {
+	assert(device);
+	assert(frameCount > 0);
+	assert(pJobSystem);
+
+	CommandRecorder* pCommandRecorder = (CommandRecorder*)malloc(sizeof(CommandRecorder));
+	memset(pCommandRecorder, 0, sizeof(CommandRecorder));
+
+	uint32_t maxChunkCount = JobSystem_GetThreadCount(pJobSystem);
+	pCommandRecorder->device = device;
+	pCommandRecorder->pJobSystem = pJobSystem;
+	pCommandRecorder->frameCount = frameCount;
+	pCommandRecorder->maxChunkCount = maxChunkCount;
+
+	// buffers only ever live for a frame and are reset all at once
+	VkCommandPoolCreateInfo commandPoolCreateInfo = { 0 };
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.pNext = NULL;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+	uint32_t poolCount = frameCount * maxChunkCount;
+	pCommandRecorder->paPools = SAFE_ALLOCATE_ARRAY(RecorderPool, poolCount);
+	memset(pCommandRecorder->paPools, 0, sizeof(RecorderPool) * poolCount);
+	for (uint32_t i = 0; i < poolCount; i++) {
+		REQUIRE_VK_SUCCESS(
+			vkCreateCommandPool(
+				device,
+				&commandPoolCreateInfo,
+				NULL,
+				&pCommandRecorder->paPools[i].commandPool)
+		);
+	}
+
+	pCommandRecorder->paChunks = SAFE_ALLOCATE_ARRAY(RecordChunk, maxChunkCount);
+	pCommandRecorder->papChunkJobs = SAFE_ALLOCATE_ARRAY(Job*, maxChunkCount);
+
+	return pCommandRecorder;
+}
+
+/*!
+ * \brief	destroys every pool
+ *
+ * None of the recorded command buffers may still be in use by the gpu.
+ */
+void CommandRecorder_Destroy(CommandRecorder* pThis) {
+	assert(pThis);
+
+	SAFE_FREE(pThis->paChunks);
+	SAFE_FREE(pThis->papChunkJobs);
+
+	for (uint32_t i = 0; i < pThis->frameCount * pThis->maxChunkCount; i++) {
+		RecorderPool* pPool = &pThis->paPools[i];
+		// destroying the pool frees its command buffers
+		vkDestroyCommandPool(pThis->device, pPool->commandPool, NULL);
+		SAFE_FREE(pPool->paCommandBuffers);
+	}
+	SAFE_FREE(pThis->paPools);
+
+	free(pThis);
+}
+
+/*!
+ * \brief	recycles every command buffer recorded for \a frameIndex
+ *
+ * Call once the gpu is done with that frame, before recording it again.
+ */
+void CommandRecorder_BeginFrame(CommandRecorder* pThis, uint32_t frameIndex) {
+	assert(pThis);
+	assert(frameIndex < pThis->frameCount);
+
+	pThis->currentFrame = frameIndex;
+	for (uint32_t i = 0; i < pThis->maxChunkCount; i++) {
+		RecorderPool* pPool = &pThis->paPools[frameIndex * pThis->maxChunkCount + i];
+		if (pPool->usedCount == 0) {
+			continue;
+		}
+
+		REQUIRE_VK_SUCCESS(vkResetCommandPool(pThis->device, pPool->commandPool, 0));
+		pPool->usedCount = 0;
+	}
+}
+
+/*!
+ * \brief	records \a itemCount items into secondaries, in parallel
+ *
+ * The items are split into contiguous chunks of at least \a minItemsPerChunk,
+ * one per JobSystem thread at most, so small jobs don't pay for waking threads that
+ * have nothing to do. Blocks until every chunk is recorded.
+ *
+ * \param	pInheritanceInfo the render pass, subpass and framebuffer the
+ *			secondaries run in, has to stay valid during this call
+ * \param	aCommandBuffersOut receives the ended secondaries in item order,
+ *			needs room for CommandRecorder_GetMaxChunkCount
+ * \return	how many secondaries were recorded, 0 if there were no items
+ */
+uint32_t CommandRecorder_Record(
+	CommandRecorder* pThis,
+	const VkCommandBufferInheritanceInfo* pInheritanceInfo,
+	uint32_t itemCount,
+	uint32_t minItemsPerChunk,
+	RecordFunction function,
+	void* pUserData,
+	VkCommandBuffer* aCommandBuffersOut) {
+	assert(pThis);
+	assert(pInheritanceInfo);
+	assert(function);
+	assert(aCommandBuffersOut);
+
+	if (itemCount == 0) {
+		return 0;
+	}
+
+	if (minItemsPerChunk == 0) {
+		minItemsPerChunk = 1;
+	}
+	uint32_t chunkCount = (itemCount + minItemsPerChunk - 1) / minItemsPerChunk;
+	if (chunkCount > pThis->maxChunkCount) {
+		chunkCount = pThis->maxChunkCount;
+	}
+
+	// a chunk's pool is only touched by the one job recording that chunk
+	for (uint32_t i = 0; i < chunkCount; i++) {
+		aCommandBuffersOut[i] = CommandRecorder_NextCommandBuffer(pThis, i);
+	}
+
+	RecordJob job;
+	job.function = function;
+	job.pUserData = pUserData;
+	job.pInheritanceInfo = pInheritanceInfo;
+	job.itemCount = itemCount;
+	job.chunkCount = chunkCount;
+	job.aCommandBuffers = aCommandBuffersOut;
+
+	if (chunkCount == 1) {
+		CommandRecorder_RecordChunk(&job, 0);
+		return chunkCount;
+	}
+
+	for (uint32_t i = 1; i < chunkCount; i++) {
+		pThis->paChunks[i].pJob = &job;
+		pThis->paChunks[i].chunkIndex = i;
+		pThis->papChunkJobs[i] = JobSystem_Run(
+			pThis->pJobSystem,
+			CommandRecorder_ChunkMain,
+			&pThis->paChunks[i],
+			JOB_FLAG_NONE);
+	}
+
+	// the first chunk is ours, then help with the rest until they're done
+	CommandRecorder_RecordChunk(&job, 0);
+	for (uint32_t i = 1; i < chunkCount; i++) {
+		JobSystem_Wait(pThis->pJobSystem, pThis->papChunkJobs[i]);
+		pThis->papChunkJobs[i] = NULL;
+	}
+
+	return chunkCount;
+}
+
+// the most secondaries a single CommandRecorder_Record returns
+uint32_t CommandRecorder_GetMaxChunkCount(const CommandRecorder* pThis) {
+	assert(pThis);
+	return pThis->maxChunkCount;
+}
+
+// Private Interface!
+
+VkCommandBuffer CommandRecorder_NextCommandBuffer(
+	CommandRecorder* pThis,
+	uint32_t chunkIndex) {
+	RecorderPool* pPool = &pThis->paPools[pThis->currentFrame * pThis->maxChunkCount + chunkIndex];
+
+	if (pPool->usedCount == pPool->commandBufferCount) {
+		if (pPool->commandBufferCount == pPool->commandBufferCapacity) {
+			pPool->commandBufferCapacity = pPool->commandBufferCapacity
+				? pPool->commandBufferCapacity * 2
+				: 4;
+			pPool->paCommandBuffers = (VkCommandBuffer*)realloc(
+				pPool->paCommandBuffers,
+				sizeof(VkCommandBuffer) * pPool->commandBufferCapacity);
+			assert(pPool->paCommandBuffers);
+		}
+
+		VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
+		commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferAllocateInfo.pNext = NULL;
+		commandBufferAllocateInfo.commandPool = pPool->commandPool;
+		commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		commandBufferAllocateInfo.commandBufferCount = 1;
+		REQUIRE_VK_SUCCESS(
+			vkAllocateCommandBuffers(
+				pThis->device,
+				&commandBufferAllocateInfo,
+				&pPool->paCommandBuffers[pPool->commandBufferCount])
+		);
+		pPool->commandBufferCount++;
+	}
+
+	return pPool->paCommandBuffers[pPool->usedCount++];
+}
+
+void CommandRecorder_RecordChunk(const RecordJob* pJob, uint32_t chunkIndex) {
+	assert(chunkIndex < pJob->chunkCount);
+
+	// spread the remainder so chunks differ by at most one item
+	uint32_t firstItem = (uint32_t)((uint64_t)pJob->itemCount * chunkIndex / pJob->chunkCount);
+	uint32_t endItem = (uint32_t)((uint64_t)pJob->itemCount * (chunkIndex + 1) / pJob->chunkCount);
+	VkCommandBuffer commandBuffer = pJob->aCommandBuffers[chunkIndex];
+
+	VkCommandBufferBeginInfo beginInfo = { 0 };
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.pNext = NULL;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT
+		| VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = pJob->pInheritanceInfo;
+	REQUIRE_VK_SUCCESS(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+	pJob->function(pJob->pUserData, commandBuffer, firstItem, endItem - firstItem);
+
+	REQUIRE_VK_SUCCESS(vkEndCommandBuffer(commandBuffer));
+}
+
+void CommandRecorder_ChunkMain(void* pUserData) {
+	const RecordChunk* pChunk = (const RecordChunk*)pUserData;
+	CommandRecorder_RecordChunk(pChunk->pJob, pChunk->chunkIndex);
+}
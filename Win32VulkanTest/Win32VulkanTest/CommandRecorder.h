@@ -0,0 +1,57 @@
+#ifndef __COMMAND_RECORDER_H
+#define __COMMAND_RECORDER_H
+
+#include "JobSystem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Records secondary command buffers on several threads at once.
+ *
+ * A recording splits a range of items into contiguous chunks, at most one
+ * per JobSystem thread, and records each as a job. Every chunk has its own
+ * command pool for every frame in flight and only one job ever records into
+ * it, so recording never contends on a pool. The secondaries are executed
+ * from the frame's primary with vkCmdExecuteCommands.
+ *
+ * Only one thread may record with a recorder at a time.
+ */
+typedef struct command_recorder_t CommandRecorder;
+
+/*!
+ * Records items [firstItem, firstItem + itemCount) into \a commandBuffer,
+ * which is already begun inside the render pass. Called on any JobSystem
+ * thread, so it may only read shared state.
+ */
+typedef void (*RecordFunction)(
+	void* pUserData,
+	VkCommandBuffer commandBuffer,
+	uint32_t firstItem,
+	uint32_t itemCount);
+
+CommandRecorder* CommandRecorder_Create(
+	VkDevice device,
+	uint32_t queueFamilyIndex,
+	uint32_t frameCount,
+	JobSystem* pJobSystem);
+void CommandRecorder_Destroy(CommandRecorder* pThis);
+
+void CommandRecorder_BeginFrame(CommandRecorder* pThis, uint32_t frameIndex);
+uint32_t CommandRecorder_Record(
+	CommandRecorder* pThis,
+	const VkCommandBufferInheritanceInfo* pInheritanceInfo,
+	uint32_t itemCount,
+	uint32_t minItemsPerChunk,
+	RecordFunction function,
+	void* pUserData,
+	VkCommandBuffer* aCommandBuffersOut);
+
+uint32_t CommandRecorder_GetMaxChunkCount(const CommandRecorder* pThis);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__COMMAND_RECORDER_H
@@ -0,0 +1,633 @@
+#include "stdafx.h"
+#include "DescriptorAllocator.h"
+
+#include "MemoryUtils.h"
+#include "Utils.h"
+
+// the first pool in a chain holds this many sets, each one after twice the last
+#define INITIAL_POOL_SET_COUNT 64
+#define MAX_POOL_SET_COUNT 4096
+
+// the bindless arrays are this big, or the device's limit if that's lower
+#define BINDLESS_MAX_IMAGES 16384
+#define BINDLESS_MAX_BUFFERS 16384
+
+const char* const kaszBindlessDeviceExtensions[DESCRIPTOR_ALLOCATOR_BINDLESS_EXTENSION_COUNT] = {
+	VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+};
+
+// how many descriptors of a type a pool has room for, per set it holds
+typedef struct pool_size_ratio_t {
+	VkDescriptorType type;
+	uint32_t countPerSet;
+} PoolSizeRatio;
+
+const PoolSizeRatio kaPoolSizeRatios[] = {
+	{ VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+	{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+};
+#define POOL_SIZE_RATIO_COUNT (sizeof(kaPoolSizeRatios) / sizeof(PoolSizeRatio))
+
+// pools allocated from in order, another is added when the last is full
+typedef struct pool_chain_t {
+	uint32_t poolCount;
+	uint32_t poolCapacity;
+	VkDescriptorPool* paPools;
+	// the one sets come from, poolCount once they're all full
+	uint32_t currentPool;
+	// how many sets the next pool made holds
+	uint32_t nextPoolSetCount;
+} PoolChain;
+
+// the slots of one bindless binding
+typedef struct bindless_array_t {
+	uint32_t capacity;
+	// slots from here on have never been handed out
+	uint32_t highWater;
+	// slots given back, reused before highWater moves on
+	uint32_t freeCount;
+	uint32_t* paFreeSlots;
+} BindlessArray;
+
+struct descriptor_allocator_t {
+	VkDevice device;
+
+	PoolChain persistentPools;
+	uint32_t frameCount;
+	PoolChain* paFramePools;
+	uint32_t currentFrame;
+
+	// all VK_NULL_HANDLE without bindless
+	VkDescriptorSetLayout bindlessLayout;
+	VkDescriptorPool bindlessPool;
+	VkDescriptorSet bindlessSet;
+	BindlessArray bindlessImages;
+	BindlessArray bindlessBuffers;
+};
+
+VkDescriptorSet PoolChain_Allocate(
+	PoolChain* pThis,
+	VkDevice device,
+	VkDescriptorSetLayout layout);
+void PoolChain_AddPool(PoolChain* pThis, VkDevice device);
+void PoolChain_Reset(PoolChain* pThis, VkDevice device);
+void PoolChain_Destroy(PoolChain* pThis, VkDevice device);
+
+void DescriptorAllocator_CreateBindless(
+	DescriptorAllocator* pThis,
+	VkPhysicalDevice physicalDevice);
+uint32_t BindlessArray_Acquire(BindlessArray* pThis);
+void BindlessArray_Release(BindlessArray* pThis, uint32_t index);
+uint32_t MinUint32(uint32_t a, uint32_t b);
+
+/*!
+ * \brief	checks whether \a physicalDevice can do bindless
+ *
+ * The instance must have VK_KHR_get_physical_device_properties2 enabled, or
+ * the device will be reported as unsupported.
+ *
+ * \param	pFeaturesOut receives just the features bindless needs, to chain
+ *			into VkDeviceCreateInfo. Its pNext is NULL
+ * \return	FALSE if an extension or feature bindless needs is missing
+ */
+BOOL DescriptorAllocator_QueryBindlessSupport(
+	VkInstance instance,
+	VkPhysicalDevice physicalDevice,
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT* pFeaturesOut) {
+	assert(instance);
+	assert(physicalDevice);
+	assert(pFeaturesOut);
+
+	memset(pFeaturesOut, 0, sizeof(VkPhysicalDeviceDescriptorIndexingFeaturesEXT));
+	pFeaturesOut->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	pFeaturesOut->pNext = NULL;
+
+	PFN_vkGetPhysicalDeviceFeatures2KHR pfnGetPhysicalDeviceFeatures2
+		= (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(
+			instance,
+			"vkGetPhysicalDeviceFeatures2KHR");
+	if (!pfnGetPhysicalDeviceFeatures2) {
+		return FALSE;
+	}
+
+	uint32_t extensionCount;
+	REQUIRE_VK_SUCCESS(
+		vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL));
+	VkExtensionProperties* paExtensions
+		= SAFE_ALLOCATE_ARRAY(VkExtensionProperties, extensionCount);
+	REQUIRE_VK_SUCCESS(
+		vkEnumerateDeviceExtensionProperties(
+			physicalDevice,
+			NULL,
+			&extensionCount,
+			paExtensions));
+	uint32_t foundCount = 0;
+	for (uint32_t i = 0; i < DESCRIPTOR_ALLOCATOR_BINDLESS_EXTENSION_COUNT; i++) {
+		for (uint32_t j = 0; j < extensionCount; j++) {
+			if (strcmp(paExtensions[j].extensionName, kaszBindlessDeviceExtensions[i]) == 0) {
+				foundCount++;
+				break;
+			}
+		}
+	}
+	SAFE_FREE(paExtensions);
+	if (foundCount < DESCRIPTOR_ALLOCATOR_BINDLESS_EXTENSION_COUNT) {
+		return FALSE;
+	}
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supportedFeatures = { 0 };
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	supportedFeatures.pNext = NULL;
+	VkPhysicalDeviceFeatures2KHR features = { 0 };
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+	features.pNext = &supportedFeatures;
+	pfnGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+	if (!supportedFeatures.runtimeDescriptorArray
+		|| !supportedFeatures.descriptorBindingPartiallyBound
+		|| !supportedFeatures.descriptorBindingUpdateUnusedWhilePending
+		|| !supportedFeatures.descriptorBindingSampledImageUpdateAfterBind
+		|| !supportedFeatures.descriptorBindingStorageBufferUpdateAfterBind
+		|| !supportedFeatures.shaderSampledImageArrayNonUniformIndexing
+		|| !supportedFeatures.shaderStorageBufferArrayNonUniformIndexing) {
+
+		return FALSE;
+	}
+
+	pFeaturesOut->runtimeDescriptorArray = VK_TRUE;
+	pFeaturesOut->descriptorBindingPartiallyBound = VK_TRUE;
+	pFeaturesOut->descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	pFeaturesOut->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	pFeaturesOut->descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+	pFeaturesOut->shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	pFeaturesOut->shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+	return TRUE;
+}
+
+/*!
+ * \brief	creates an allocator, its pools are made as they're needed
+ *
+ * \param	frameCount how many frames in flight have their own pools
+ * \param	bindless whether to create the bindless set, which the device
+ *			has to have been made for, see DescriptorAllocator_QueryBindlessSupport
+ */
+DescriptorAllocator* DescriptorAllocator_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	uint32_t frameCount,
+	BOOL bindless) {
+	assert(physicalDevice);
+	assert(device);
+	assert(frameCount > 0);
+
+	DescriptorAllocator* pDescriptorAllocator
+		= (DescriptorAllocator*)malloc(sizeof(DescriptorAllocator));
+	memset(pDescriptorAllocator, 0, sizeof(DescriptorAllocator));
+
+	pDescriptorAllocator->device = device;
+	pDescriptorAllocator->persistentPools.nextPoolSetCount = INITIAL_POOL_SET_COUNT;
+	pDescriptorAllocator->frameCount = frameCount;
+	pDescriptorAllocator->paFramePools = SAFE_ALLOCATE_ARRAY(PoolChain, frameCount);
+	memset(pDescriptorAllocator->paFramePools, 0, sizeof(PoolChain) * frameCount);
+	for (uint32_t i = 0; i < frameCount; i++) {
+		pDescriptorAllocator->paFramePools[i].nextPoolSetCount = INITIAL_POOL_SET_COUNT;
+	}
+
+	if (bindless) {
+		DescriptorAllocator_CreateBindless(pDescriptorAllocator, physicalDevice);
+	}
+
+	return pDescriptorAllocator;
+}
+
+/*!
+ * \brief	destroys every pool and so every set, which the gpu must have
+ *			finished using
+ */
+void DescriptorAllocator_Destroy(DescriptorAllocator* pThis) {
+	assert(pThis);
+
+	PoolChain_Destroy(&pThis->persistentPools, pThis->device);
+	for (uint32_t i = 0; i < pThis->frameCount; i++) {
+		PoolChain_Destroy(&pThis->paFramePools[i], pThis->device);
+	}
+	SAFE_FREE(pThis->paFramePools);
+
+	// the set goes with its pool
+	vkDestroyDescriptorPool(pThis->device, pThis->bindlessPool, NULL);
+	vkDestroyDescriptorSetLayout(pThis->device, pThis->bindlessLayout, NULL);
+	SAFE_FREE(pThis->bindlessImages.paFreeSlots);
+	SAFE_FREE(pThis->bindlessBuffers.paFreeSlots);
+
+	free(pThis);
+}
+
+/*!
+ * \brief	allocates a set that lives as long as the allocator
+ */
+VkDescriptorSet DescriptorAllocator_Allocate(
+	DescriptorAllocator* pThis,
+	VkDescriptorSetLayout layout) {
+	assert(pThis);
+	assert(layout);
+
+	return PoolChain_Allocate(&pThis->persistentPools, pThis->device, layout);
+}
+
+/*!
+ * \brief	resets \a frameIndex's pools, freeing every set allocated for it
+ *
+ * The gpu has to have finished the frame that last used them.
+ */
+void DescriptorAllocator_BeginFrame(DescriptorAllocator* pThis, uint32_t frameIndex) {
+	assert(pThis);
+	assert(frameIndex < pThis->frameCount);
+
+	pThis->currentFrame = frameIndex;
+	PoolChain_Reset(&pThis->paFramePools[frameIndex], pThis->device);
+}
+
+/*!
+ * \brief	allocates a set for the current frame only
+ *
+ * It's freed by the next DescriptorAllocator_BeginFrame for the same frame.
+ */
+VkDescriptorSet DescriptorAllocator_AllocateForFrame(
+	DescriptorAllocator* pThis,
+	VkDescriptorSetLayout layout) {
+	assert(pThis);
+	assert(layout);
+
+	return PoolChain_Allocate(&pThis->paFramePools[pThis->currentFrame], pThis->device, layout);
+}
+
+BOOL DescriptorAllocator_HasBindless(const DescriptorAllocator* pThis) {
+	assert(pThis);
+
+	return pThis->bindlessSet != VK_NULL_HANDLE;
+}
+
+VkDescriptorSetLayout DescriptorAllocator_GetBindlessLayout(const DescriptorAllocator* pThis) {
+	assert(pThis);
+
+	return pThis->bindlessLayout;
+}
+
+VkDescriptorSet DescriptorAllocator_GetBindlessSet(const DescriptorAllocator* pThis) {
+	assert(pThis);
+
+	return pThis->bindlessSet;
+}
+
+/*!
+ * \brief	puts an image in the bindless set
+ *
+ * May be called while the set is bound in command buffers that are pending,
+ * as long as they don't read the slot.
+ *
+ * \return	the image's index in the DESCRIPTOR_ALLOCATOR_BINDLESS_IMAGE_BINDING
+ *			array, or DESCRIPTOR_ALLOCATOR_INVALID_INDEX if it's full
+ */
+uint32_t DescriptorAllocator_AddBindlessImage(
+	DescriptorAllocator* pThis,
+	VkSampler sampler,
+	VkImageView imageView,
+	VkImageLayout imageLayout) {
+	assert(pThis);
+	assert(pThis->bindlessSet);
+	assert(imageView);
+
+	uint32_t index = BindlessArray_Acquire(&pThis->bindlessImages);
+	if (index == DESCRIPTOR_ALLOCATOR_INVALID_INDEX) {
+		return index;
+	}
+
+	VkDescriptorImageInfo imageInfo = { 0 };
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = imageView;
+	imageInfo.imageLayout = imageLayout;
+
+	VkWriteDescriptorSet descriptorSetWrite = { 0 };
+	descriptorSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorSetWrite.pNext = NULL;
+	descriptorSetWrite.dstSet = pThis->bindlessSet;
+	descriptorSetWrite.dstBinding = DESCRIPTOR_ALLOCATOR_BINDLESS_IMAGE_BINDING;
+	descriptorSetWrite.dstArrayElement = index;
+	descriptorSetWrite.descriptorCount = 1;
+	descriptorSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorSetWrite.pImageInfo = &imageInfo;
+	descriptorSetWrite.pBufferInfo = NULL;
+	descriptorSetWrite.pTexelBufferView = NULL;
+	vkUpdateDescriptorSets(pThis->device, 1, &descriptorSetWrite, 0, NULL);
+
+	return index;
+}
+
+/*!
+ * \brief	frees an image's slot for reuse, the gpu must have finished every
+ *			frame that read it
+ */
+void DescriptorAllocator_RemoveBindlessImage(DescriptorAllocator* pThis, uint32_t index) {
+	assert(pThis);
+
+	BindlessArray_Release(&pThis->bindlessImages, index);
+}
+
+/*!
+ * \brief	puts a storage buffer in the bindless set, like
+ *			DescriptorAllocator_AddBindlessImage
+ *
+ * \return	the buffer's index in the DESCRIPTOR_ALLOCATOR_BINDLESS_BUFFER_BINDING
+ *			array, or DESCRIPTOR_ALLOCATOR_INVALID_INDEX if it's full
+ */
+uint32_t DescriptorAllocator_AddBindlessBuffer(
+	DescriptorAllocator* pThis,
+	VkBuffer buffer,
+	VkDeviceSize offset,
+	VkDeviceSize range) {
+	assert(pThis);
+	assert(pThis->bindlessSet);
+	assert(buffer);
+
+	uint32_t index = BindlessArray_Acquire(&pThis->bindlessBuffers);
+	if (index == DESCRIPTOR_ALLOCATOR_INVALID_INDEX) {
+		return index;
+	}
+
+	VkDescriptorBufferInfo bufferInfo = { 0 };
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = offset;
+	bufferInfo.range = range;
+
+	VkWriteDescriptorSet descriptorSetWrite = { 0 };
+	descriptorSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorSetWrite.pNext = NULL;
+	descriptorSetWrite.dstSet = pThis->bindlessSet;
+	descriptorSetWrite.dstBinding = DESCRIPTOR_ALLOCATOR_BINDLESS_BUFFER_BINDING;
+	descriptorSetWrite.dstArrayElement = index;
+	descriptorSetWrite.descriptorCount = 1;
+	descriptorSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorSetWrite.pImageInfo = NULL;
+	descriptorSetWrite.pBufferInfo = &bufferInfo;
+	descriptorSetWrite.pTexelBufferView = NULL;
+	vkUpdateDescriptorSets(pThis->device, 1, &descriptorSetWrite, 0, NULL);
+
+	return index;
+}
+
+/*!
+ * \brief	frees a buffer's slot for reuse, the gpu must have finished every
+ *			frame that read it
+ */
+void DescriptorAllocator_RemoveBindlessBuffer(DescriptorAllocator* pThis, uint32_t index) {
+	assert(pThis);
+
+	BindlessArray_Release(&pThis->bindlessBuffers, index);
+}
+
+// Private Interface!
+
+/*!
+ * \brief	allocates from the current pool, moving on to the next, or a new
+ *			one, whenever it's full
+ */
+VkDescriptorSet PoolChain_Allocate(
+	PoolChain* pThis,
+	VkDevice device,
+	VkDescriptorSetLayout layout) {
+	for (;;) {
+		BOOL newPool = pThis->currentPool == pThis->poolCount;
+		if (newPool) {
+			PoolChain_AddPool(pThis, device);
+		}
+
+		VkDescriptorSetAllocateInfo descriptorAllocateInfo = { 0 };
+		descriptorAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptorAllocateInfo.pNext = NULL;
+		descriptorAllocateInfo.descriptorPool = pThis->paPools[pThis->currentPool];
+		descriptorAllocateInfo.descriptorSetCount = 1;
+		descriptorAllocateInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkResult result = vkAllocateDescriptorSets(
+			device,
+			&descriptorAllocateInfo,
+			&descriptorSet);
+		if (result == VK_SUCCESS) {
+			return descriptorSet;
+		}
+
+		// a full pool is the only failure moving on fixes
+		REQUIRE(
+			result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL,
+			GetResultName(result));
+		REQUIRE(!newPool, "a descriptor set layout needs more than a whole pool holds");
+		pThis->currentPool++;
+	}
+}
+
+// makes the next pool, sized by kaPoolSizeRatios
+void PoolChain_AddPool(PoolChain* pThis, VkDevice device) {
+	if (pThis->poolCount == pThis->poolCapacity) {
+		pThis->poolCapacity = pThis->poolCapacity ? pThis->poolCapacity * 2 : 4;
+		pThis->paPools = (VkDescriptorPool*)realloc(
+			pThis->paPools,
+			sizeof(VkDescriptorPool) * pThis->poolCapacity);
+		assert(pThis->paPools);
+	}
+
+	uint32_t setCount = pThis->nextPoolSetCount;
+	VkDescriptorPoolSize aPoolSizes[POOL_SIZE_RATIO_COUNT] = { 0 };
+	for (uint32_t i = 0; i < POOL_SIZE_RATIO_COUNT; i++) {
+		aPoolSizes[i].type = kaPoolSizeRatios[i].type;
+		aPoolSizes[i].descriptorCount = kaPoolSizeRatios[i].countPerSet * setCount;
+	}
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = { 0 };
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.pNext = NULL;
+	// sets are never freed one at a time, only with their pool
+	poolCreateInfo.flags = 0;
+	poolCreateInfo.maxSets = setCount;
+	poolCreateInfo.poolSizeCount = POOL_SIZE_RATIO_COUNT;
+	poolCreateInfo.pPoolSizes = aPoolSizes;
+
+	REQUIRE_VK_SUCCESS(
+		vkCreateDescriptorPool(
+			device,
+			&poolCreateInfo,
+			NULL,
+			&pThis->paPools[pThis->poolCount])
+	);
+	pThis->poolCount++;
+
+	if (pThis->nextPoolSetCount < MAX_POOL_SET_COUNT) {
+		pThis->nextPoolSetCount *= 2;
+	}
+}
+
+// frees every set but keeps the pools, allocation starts from the first again
+void PoolChain_Reset(PoolChain* pThis, VkDevice device) {
+	// untouched pools have nothing to free
+	uint32_t usedCount = pThis->currentPool < pThis->poolCount
+		? pThis->currentPool + 1
+		: pThis->poolCount;
+	for (uint32_t i = 0; i < usedCount; i++) {
+		REQUIRE_VK_SUCCESS(vkResetDescriptorPool(device, pThis->paPools[i], 0));
+	}
+	pThis->currentPool = 0;
+}
+
+void PoolChain_Destroy(PoolChain* pThis, VkDevice device) {
+	for (uint32_t i = 0; i < pThis->poolCount; i++) {
+		vkDestroyDescriptorPool(device, pThis->paPools[i], NULL);
+	}
+	SAFE_FREE(pThis->paPools);
+	pThis->poolCount = 0;
+	pThis->poolCapacity = 0;
+	pThis->currentPool = 0;
+}
+
+/*!
+ * \brief	creates the bindless layout, its pool and the one set
+ *
+ * Both arrays are partially bound and update after bind, so slots may be
+ * written while the set is in use and unwritten ones are never an error.
+ */
+void DescriptorAllocator_CreateBindless(
+	DescriptorAllocator* pThis,
+	VkPhysicalDevice physicalDevice) {
+	// the update after bind limits are at least these
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	const VkPhysicalDeviceLimits* pLimits = &deviceProperties.limits;
+
+	uint32_t imageCount = BINDLESS_MAX_IMAGES;
+	imageCount = MinUint32(imageCount, pLimits->maxPerStageDescriptorSampledImages);
+	imageCount = MinUint32(imageCount, pLimits->maxPerStageDescriptorSamplers);
+	imageCount = MinUint32(imageCount, pLimits->maxDescriptorSetSampledImages);
+	imageCount = MinUint32(imageCount, pLimits->maxDescriptorSetSamplers);
+	uint32_t bufferCount = BINDLESS_MAX_BUFFERS;
+	bufferCount = MinUint32(bufferCount, pLimits->maxPerStageDescriptorStorageBuffers);
+	bufferCount = MinUint32(bufferCount, pLimits->maxDescriptorSetStorageBuffers);
+	// both arrays count against every stage's resources
+	imageCount = MinUint32(imageCount, pLimits->maxPerStageResources / 2);
+	bufferCount = MinUint32(bufferCount, pLimits->maxPerStageResources / 2);
+
+	VkDescriptorSetLayoutBinding aLayoutBindings[2] = { 0 };
+	aLayoutBindings[0].binding = DESCRIPTOR_ALLOCATOR_BINDLESS_IMAGE_BINDING;
+	aLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	aLayoutBindings[0].descriptorCount = imageCount;
+	aLayoutBindings[0].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+	aLayoutBindings[0].pImmutableSamplers = NULL;
+	aLayoutBindings[1].binding = DESCRIPTOR_ALLOCATOR_BINDLESS_BUFFER_BINDING;
+	aLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	aLayoutBindings[1].descriptorCount = bufferCount;
+	aLayoutBindings[1].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+	aLayoutBindings[1].pImmutableSamplers = NULL;
+
+	VkDescriptorBindingFlagsEXT bindingFlags
+		= VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+		| VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+		| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+	VkDescriptorBindingFlagsEXT aBindingFlags[2] = { bindingFlags, bindingFlags };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo = { 0 };
+	bindingFlagsCreateInfo.sType
+		= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsCreateInfo.pNext = NULL;
+	bindingFlagsCreateInfo.bindingCount = 2;
+	bindingFlagsCreateInfo.pBindingFlags = aBindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = { 0 };
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	layoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layoutCreateInfo.bindingCount = 2;
+	layoutCreateInfo.pBindings = aLayoutBindings;
+
+	REQUIRE_VK_SUCCESS(
+		vkCreateDescriptorSetLayout(
+			pThis->device,
+			&layoutCreateInfo,
+			NULL,
+			&pThis->bindlessLayout)
+	);
+
+	VkDescriptorPoolSize aPoolSizes[2] = { 0 };
+	aPoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	aPoolSizes[0].descriptorCount = imageCount;
+	aPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	aPoolSizes[1].descriptorCount = bufferCount;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = { 0 };
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.pNext = NULL;
+	poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 2;
+	poolCreateInfo.pPoolSizes = aPoolSizes;
+
+	REQUIRE_VK_SUCCESS(
+		vkCreateDescriptorPool(
+			pThis->device,
+			&poolCreateInfo,
+			NULL,
+			&pThis->bindlessPool)
+	);
+
+	VkDescriptorSetAllocateInfo descriptorAllocateInfo = { 0 };
+	descriptorAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorAllocateInfo.pNext = NULL;
+	descriptorAllocateInfo.descriptorPool = pThis->bindlessPool;
+	descriptorAllocateInfo.descriptorSetCount = 1;
+	descriptorAllocateInfo.pSetLayouts = &pThis->bindlessLayout;
+
+	REQUIRE_VK_SUCCESS(
+		vkAllocateDescriptorSets(
+			pThis->device,
+			&descriptorAllocateInfo,
+			&pThis->bindlessSet)
+	);
+
+	pThis->bindlessImages.capacity = imageCount;
+	pThis->bindlessImages.paFreeSlots = SAFE_ALLOCATE_ARRAY(uint32_t, imageCount);
+	pThis->bindlessBuffers.capacity = bufferCount;
+	pThis->bindlessBuffers.paFreeSlots = SAFE_ALLOCATE_ARRAY(uint32_t, bufferCount);
+
+	Log_Write(
+		LOG_SEVERITY_INFO,
+		"descriptors",
+		"bindless set holds %u images and %u buffers",
+		imageCount,
+		bufferCount);
+}
+
+// the most recently freed slot, or a new one
+uint32_t BindlessArray_Acquire(BindlessArray* pThis) {
+	if (pThis->freeCount > 0) {
+		return pThis->paFreeSlots[--pThis->freeCount];
+	}
+	if (pThis->highWater == pThis->capacity) {
+		return DESCRIPTOR_ALLOCATOR_INVALID_INDEX;
+	}
+	return pThis->highWater++;
+}
+
+void BindlessArray_Release(BindlessArray* pThis, uint32_t index) {
+	assert(index < pThis->highWater);
+	assert(pThis->freeCount < pThis->highWater);
+
+	pThis->paFreeSlots[pThis->freeCount++] = index;
+}
+
+uint32_t MinUint32(uint32_t a, uint32_t b) {
+	return a < b ? a : b;
+}
@@ -0,0 +1,78 @@
+#ifndef __DESCRIPTOR_ALLOCATOR_H
+#define __DESCRIPTOR_ALLOCATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Hands out descriptor sets from pools it grows as they fill, in three ways.
+ *
+ * DescriptorAllocator_Allocate gives sets that live as long as the allocator.
+ * DescriptorAllocator_AllocateForFrame gives sets that only last until the
+ * frame's next DescriptorAllocator_BeginFrame, which resets all of that
+ * frame's pools at once instead of freeing sets one at a time.
+ *
+ * With bindless on there's also one set of large arrays, combined image
+ * samplers at DESCRIPTOR_ALLOCATOR_BINDLESS_IMAGE_BINDING and storage buffers
+ * at DESCRIPTOR_ALLOCATOR_BINDLESS_BUFFER_BINDING, that stays bound while
+ * shaders pick their resources by index. Adding a resource only writes its
+ * slot, so binding costs the same however many materials there are.
+ * Bindless needs the device made with the features from
+ * DescriptorAllocator_QueryBindlessSupport and kaszBindlessDeviceExtensions.
+ *
+ * Not thread safe.
+ */
+typedef struct descriptor_allocator_t DescriptorAllocator;
+
+#define DESCRIPTOR_ALLOCATOR_BINDLESS_IMAGE_BINDING 0
+#define DESCRIPTOR_ALLOCATOR_BINDLESS_BUFFER_BINDING 1
+// returned when a bindless array is full
+#define DESCRIPTOR_ALLOCATOR_INVALID_INDEX UINT32_MAX
+
+// the device extensions bindless needs
+#define DESCRIPTOR_ALLOCATOR_BINDLESS_EXTENSION_COUNT 2
+extern const char* const kaszBindlessDeviceExtensions[DESCRIPTOR_ALLOCATOR_BINDLESS_EXTENSION_COUNT];
+
+BOOL DescriptorAllocator_QueryBindlessSupport(
+	VkInstance instance,
+	VkPhysicalDevice physicalDevice,
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT* pFeaturesOut);
+
+DescriptorAllocator* DescriptorAllocator_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	uint32_t frameCount,
+	BOOL bindless);
+void DescriptorAllocator_Destroy(DescriptorAllocator* pThis);
+
+VkDescriptorSet DescriptorAllocator_Allocate(
+	DescriptorAllocator* pThis,
+	VkDescriptorSetLayout layout);
+
+void DescriptorAllocator_BeginFrame(DescriptorAllocator* pThis, uint32_t frameIndex);
+VkDescriptorSet DescriptorAllocator_AllocateForFrame(
+	DescriptorAllocator* pThis,
+	VkDescriptorSetLayout layout);
+
+BOOL DescriptorAllocator_HasBindless(const DescriptorAllocator* pThis);
+VkDescriptorSetLayout DescriptorAllocator_GetBindlessLayout(const DescriptorAllocator* pThis);
+VkDescriptorSet DescriptorAllocator_GetBindlessSet(const DescriptorAllocator* pThis);
+uint32_t DescriptorAllocator_AddBindlessImage(
+	DescriptorAllocator* pThis,
+	VkSampler sampler,
+	VkImageView imageView,
+	VkImageLayout imageLayout);
+void DescriptorAllocator_RemoveBindlessImage(DescriptorAllocator* pThis, uint32_t index);
+uint32_t DescriptorAllocator_AddBindlessBuffer(
+	DescriptorAllocator* pThis,
+	VkBuffer buffer,
+	VkDeviceSize offset,
+	VkDeviceSize range);
+void DescriptorAllocator_RemoveBindlessBuffer(DescriptorAllocator* pThis, uint32_t index);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__DESCRIPTOR_ALLOCATOR_H
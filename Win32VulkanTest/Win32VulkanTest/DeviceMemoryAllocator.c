@@ -0,0 +1,787 @@
+#include "stdafx.h"
+#include "DeviceMemoryAllocator.h"
+
+#include "MemoryUtils.h"
+#include "Utils.h"
+
+// returned by DeviceMemoryAllocator_FindMemoryType when nothing fits
+#define INVALID_MEMORY_TYPE UINT32_MAX
+
+// blockIndex of allocations too big to share a block, they get their own memory
+#define DEDICATED_BLOCK UINT32_MAX
+
+// each memory type has a pool for buffers and one for optimally tiled images
+#define POOL_COUNT (VK_MAX_MEMORY_TYPES * 2)
+
+typedef struct memory_block_t {
+	// VK_NULL_HANDLE once released by DeviceMemoryAllocator_Defragment, the
+	// slot gets reused by the next block in the pool
+	VkDeviceMemory memory;
+	void* pMappedData;
+	uint32_t allocationCount;
+	VkDeviceSize usedBytes;
+
+	// DEVICE_MEMORY_STRATEGY_LINEAR: where the next range may start
+	VkDeviceSize linearHead;
+
+	// DEVICE_MEMORY_STRATEGY_BUDDY: a complete binary tree over the block with
+	// the whole block at the root. Each node holds one more than the order of
+	// the largest free range beneath it, or 0 when there's nothing free
+	uint8_t* paBuddyTree;
+} MemoryBlock;
+
+typedef struct memory_pool_t {
+	uint32_t blockCount;
+	MemoryBlock* paBlocks;
+} MemoryPool;
+
+struct device_memory_allocator_t {
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize nonCoherentAtomSize;
+	uint32_t maxMemoryAllocationCount;
+
+	DeviceMemoryStrategy strategy;
+	VkDeviceSize blockSize;
+	// the order of a whole block, DEVICE_MEMORY_BUDDY_MIN_SIZE is order 0
+	uint32_t buddyMaxOrder;
+
+	MemoryPool aPools[POOL_COUNT];
+
+	DeviceMemoryStats stats;
+};
+
+BOOL DeviceMemoryAllocator_AllocateDedicated(
+	DeviceMemoryAllocator* pThis,
+	uint32_t poolIndex,
+	VkDeviceSize size,
+	DeviceMemoryAllocation* pAllocationOut);
+BOOL DeviceMemoryAllocator_CreateBlock(
+	DeviceMemoryAllocator* pThis,
+	uint32_t poolIndex,
+	uint32_t* pBlockIndexOut);
+void DeviceMemoryAllocator_FreeBlock(DeviceMemoryAllocator* pThis, MemoryBlock* pBlock);
+BOOL DeviceMemoryAllocator_AllocateFromBlock(
+	DeviceMemoryAllocator* pThis,
+	MemoryBlock* pBlock,
+	VkDeviceSize size,
+	VkDeviceSize alignment,
+	VkDeviceSize* pOffsetOut,
+	VkDeviceSize* pReservedSizeOut);
+VkMappedMemoryRange DeviceMemoryAllocator_GetMappedRange(
+	DeviceMemoryAllocator* pThis,
+	const DeviceMemoryAllocation* pAllocation);
+BOOL DeviceMemoryAllocator_IsHostCoherent(
+	const DeviceMemoryAllocator* pThis,
+	uint32_t poolIndex);
+
+uint32_t BuddyOrderForSize(VkDeviceSize size);
+void BuddyTreeInitialize(uint8_t* paTree, uint32_t maxOrder);
+BOOL BuddyTreeAllocate(
+	uint8_t* paTree,
+	uint32_t maxOrder,
+	uint32_t order,
+	VkDeviceSize* pOffsetOut);
+void BuddyTreeFree(
+	uint8_t* paTree,
+	uint32_t maxOrder,
+	uint32_t order,
+	VkDeviceSize offset);
+void BuddyTreeUpdateParents(uint8_t* paTree, uint32_t node, uint32_t nodeOrder);
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment);
+
+/*!
+ * \brief	creates an allocator for \a device
+ *
+ * \param	physicalDevice the device \a device was created from, for its memory types and limits
+ * \param	device where the memory will be allocated
+ * \param	blockSize how much to take from the device at a time. The buddy
+ *			strategy rounds this up to a power of two
+ * \param	strategy how ranges are found within a block
+ */
+DeviceMemoryAllocator* DeviceMemoryAllocator_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	VkDeviceSize blockSize,
+	DeviceMemoryStrategy strategy) {
+	assert(physicalDevice);
+	assert(device);
+	assert(blockSize >= DEVICE_MEMORY_BUDDY_MIN_SIZE);
+
+	DeviceMemoryAllocator* pAllocator
+		= (DeviceMemoryAllocator*)malloc(sizeof(DeviceMemoryAllocator));
+	memset(pAllocator, 0, sizeof(DeviceMemoryAllocator));
+
+	pAllocator->device = device;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &pAllocator->memoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	pAllocator->nonCoherentAtomSize = deviceProperties.limits.nonCoherentAtomSize;
+	pAllocator->maxMemoryAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+
+	pAllocator->strategy = strategy;
+	if (strategy == DEVICE_MEMORY_STRATEGY_BUDDY) {
+		pAllocator->buddyMaxOrder = BuddyOrderForSize(blockSize);
+		blockSize = (VkDeviceSize)DEVICE_MEMORY_BUDDY_MIN_SIZE << pAllocator->buddyMaxOrder;
+	}
+	pAllocator->blockSize = blockSize;
+
+	return pAllocator;
+}
+
+/*!
+ * \brief	gives every block back to the device
+ *
+ * Everything allocated must have been freed first.
+ */
+void DeviceMemoryAllocator_Destroy(DeviceMemoryAllocator* pThis) {
+	assert(pThis);
+	assert(pThis->stats.allocationCount == 0);
+
+	for (uint32_t i = 0; i < POOL_COUNT; i++) {
+		MemoryPool* pPool = &pThis->aPools[i];
+		for (uint32_t j = 0; j < pPool->blockCount; j++) {
+			DeviceMemoryAllocator_FreeBlock(pThis, &pPool->paBlocks[j]);
+		}
+		SAFE_FREE(pPool->paBlocks);
+		pPool->blockCount = 0;
+	}
+
+	free(pThis);
+}
+
+/*!
+ * \brief	finds a memory type allowed by \a memoryTypeBits that has all of \a requiredProperties
+ * \return	the memory type index, or UINT32_MAX if there isn't one
+ */
+uint32_t DeviceMemoryAllocator_FindMemoryType(
+	const DeviceMemoryAllocator* pThis,
+	uint32_t memoryTypeBits,
+	VkMemoryPropertyFlags requiredProperties) {
+	assert(pThis);
+
+	const VkPhysicalDeviceMemoryProperties* pMemoryProperties = &pThis->memoryProperties;
+	for (uint32_t i = 0; i < pMemoryProperties->memoryTypeCount; i++) {
+		if ((memoryTypeBits & (1u << i))
+			&& (pMemoryProperties->memoryTypes[i].propertyFlags & requiredProperties)
+				== requiredProperties) {
+
+			return i;
+		}
+	}
+	return INVALID_MEMORY_TYPE;
+}
+
+/*!
+ * \brief	finds a range of memory meeting \a pMemoryRequirements
+ *
+ * \param	requiredProperties what the memory type must support
+ * \param	optimalTiling TRUE for images with VK_IMAGE_TILING_OPTIMAL, these
+ *			never share a block with buffers or linear images
+ * \param	pAllocationOut receives the range, bind it at its memory and offset
+ * \return	FALSE if no memory type fits or the device is out of memory
+ */
+BOOL DeviceMemoryAllocator_Allocate(
+	DeviceMemoryAllocator* pThis,
+	const VkMemoryRequirements* pMemoryRequirements,
+	VkMemoryPropertyFlags requiredProperties,
+	BOOL optimalTiling,
+	DeviceMemoryAllocation* pAllocationOut) {
+	assert(pThis);
+	assert(pMemoryRequirements);
+	assert(pMemoryRequirements->size > 0);
+	assert(pAllocationOut);
+
+	memset(pAllocationOut, 0, sizeof(DeviceMemoryAllocation));
+
+	uint32_t memoryTypeIndex = DeviceMemoryAllocator_FindMemoryType(
+		pThis,
+		pMemoryRequirements->memoryTypeBits,
+		requiredProperties);
+	if (memoryTypeIndex == INVALID_MEMORY_TYPE) {
+		return FALSE;
+	}
+	uint32_t poolIndex = memoryTypeIndex * 2 + (optimalTiling ? 1 : 0);
+
+	// big resources would waste most of a block, give them their own memory
+	VkDeviceSize size = pMemoryRequirements->size;
+	if (AlignUp(size, pMemoryRequirements->alignment) > pThis->blockSize / 2) {
+		return DeviceMemoryAllocator_AllocateDedicated(
+			pThis,
+			poolIndex,
+			size,
+			pAllocationOut);
+	}
+
+	MemoryPool* pPool = &pThis->aPools[poolIndex];
+	VkDeviceSize offset;
+	VkDeviceSize reservedSize;
+	uint32_t blockIndex;
+	for (blockIndex = 0; blockIndex < pPool->blockCount; blockIndex++) {
+		MemoryBlock* pBlock = &pPool->paBlocks[blockIndex];
+		if (pBlock->memory
+			&& DeviceMemoryAllocator_AllocateFromBlock(
+				pThis,
+				pBlock,
+				size,
+				pMemoryRequirements->alignment,
+				&offset,
+				&reservedSize)) {
+
+			break;
+		}
+	}
+
+	// every block is full, start another
+	if (blockIndex == pPool->blockCount) {
+		if (!DeviceMemoryAllocator_CreateBlock(pThis, poolIndex, &blockIndex)) {
+			return FALSE;
+		}
+		BOOL allocated = DeviceMemoryAllocator_AllocateFromBlock(
+			pThis,
+			&pPool->paBlocks[blockIndex],
+			size,
+			pMemoryRequirements->alignment,
+			&offset,
+			&reservedSize);
+		assert(allocated);
+	}
+
+	MemoryBlock* pBlock = &pPool->paBlocks[blockIndex];
+	pBlock->allocationCount++;
+	pBlock->usedBytes += reservedSize;
+	pThis->stats.allocationCount++;
+	pThis->stats.usedBytes += reservedSize;
+
+	pAllocationOut->memory = pBlock->memory;
+	pAllocationOut->offset = offset;
+	pAllocationOut->size = size;
+	pAllocationOut->pMappedData = pBlock->pMappedData
+		? (uint8_t*)pBlock->pMappedData + offset
+		: NULL;
+	pAllocationOut->poolIndex = poolIndex;
+	pAllocationOut->blockIndex = blockIndex;
+	pAllocationOut->reservedSize = reservedSize;
+	return TRUE;
+}
+
+/*!
+ * \brief	allocates memory for \a buffer and binds it
+ */
+BOOL DeviceMemoryAllocator_AllocateForBuffer(
+	DeviceMemoryAllocator* pThis,
+	VkBuffer buffer,
+	VkMemoryPropertyFlags requiredProperties,
+	DeviceMemoryAllocation* pAllocationOut) {
+	assert(pThis);
+	assert(buffer);
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(pThis->device, buffer, &memoryRequirements);
+	if (!DeviceMemoryAllocator_Allocate(
+		pThis,
+		&memoryRequirements,
+		requiredProperties,
+		FALSE,
+		pAllocationOut)) {
+
+		return FALSE;
+	}
+
+	REQUIRE_VK_SUCCESS(
+		vkBindBufferMemory(
+			pThis->device,
+			buffer,
+			pAllocationOut->memory,
+			pAllocationOut->offset)
+	);
+	return TRUE;
+}
+
+/*!
+ * \brief	allocates memory for \a image and binds it
+ *
+ * \a image must use VK_IMAGE_TILING_OPTIMAL, linear images should go through
+ * DeviceMemoryAllocator_Allocate.
+ */
+BOOL DeviceMemoryAllocator_AllocateForImage(
+	DeviceMemoryAllocator* pThis,
+	VkImage image,
+	VkMemoryPropertyFlags requiredProperties,
+	DeviceMemoryAllocation* pAllocationOut) {
+	assert(pThis);
+	assert(image);
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(pThis->device, image, &memoryRequirements);
+	if (!DeviceMemoryAllocator_Allocate(
+		pThis,
+		&memoryRequirements,
+		requiredProperties,
+		TRUE,
+		pAllocationOut)) {
+
+		return FALSE;
+	}
+
+	REQUIRE_VK_SUCCESS(
+		vkBindImageMemory(
+			pThis->device,
+			image,
+			pAllocationOut->memory,
+			pAllocationOut->offset)
+	);
+	return TRUE;
+}
+
+/*!
+ * \brief	returns \a pAllocation to its block
+ *
+ * Emptied blocks are kept for reuse until DeviceMemoryAllocator_Defragment.
+ * The resource bound to the range must already be destroyed.
+ */
+void DeviceMemoryAllocator_Free(
+	DeviceMemoryAllocator* pThis,
+	DeviceMemoryAllocation* pAllocation) {
+	assert(pThis);
+	assert(pAllocation);
+
+	if (!pAllocation->memory) {
+		return;
+	}
+
+	pThis->stats.allocationCount--;
+	pThis->stats.usedBytes -= pAllocation->reservedSize;
+
+	if (pAllocation->blockIndex == DEDICATED_BLOCK) {
+		vkFreeMemory(pThis->device, pAllocation->memory, NULL);
+		pThis->stats.deviceAllocationCount--;
+		pThis->stats.dedicatedAllocationCount--;
+		pThis->stats.reservedBytes -= pAllocation->reservedSize;
+	}
+	else {
+		MemoryPool* pPool = &pThis->aPools[pAllocation->poolIndex];
+		assert(pAllocation->blockIndex < pPool->blockCount);
+		MemoryBlock* pBlock = &pPool->paBlocks[pAllocation->blockIndex];
+		assert(pBlock->memory == pAllocation->memory);
+		assert(pBlock->allocationCount > 0);
+
+		pBlock->allocationCount--;
+		pBlock->usedBytes -= pAllocation->reservedSize;
+
+		switch (pThis->strategy) {
+		case DEVICE_MEMORY_STRATEGY_LINEAR:
+			// the space only comes back once the whole block is empty
+			if (pBlock->allocationCount == 0) {
+				pBlock->linearHead = 0;
+			}
+			break;
+		case DEVICE_MEMORY_STRATEGY_BUDDY:
+			BuddyTreeFree(
+				pBlock->paBuddyTree,
+				pThis->buddyMaxOrder,
+				BuddyOrderForSize(pAllocation->reservedSize),
+				pAllocation->offset);
+			break;
+		}
+	}
+
+	memset(pAllocation, 0, sizeof(DeviceMemoryAllocation));
+}
+
+/*!
+ * \brief	makes host writes to \a pAllocation visible to the device
+ *
+ * Does nothing for host coherent memory.
+ */
+void DeviceMemoryAllocator_Flush(
+	DeviceMemoryAllocator* pThis,
+	const DeviceMemoryAllocation* pAllocation) {
+	assert(pThis);
+	assert(pAllocation);
+	assert(pAllocation->pMappedData);
+
+	if (DeviceMemoryAllocator_IsHostCoherent(pThis, pAllocation->poolIndex)) {
+		return;
+	}
+
+	VkMappedMemoryRange range = DeviceMemoryAllocator_GetMappedRange(pThis, pAllocation);
+	REQUIRE_VK_SUCCESS(vkFlushMappedMemoryRanges(pThis->device, 1, &range));
+}
+
+/*!
+ * \brief	makes device writes to \a pAllocation visible to the host
+ *
+ * Does nothing for host coherent memory.
+ */
+void DeviceMemoryAllocator_Invalidate(
+	DeviceMemoryAllocator* pThis,
+	const DeviceMemoryAllocation* pAllocation) {
+	assert(pThis);
+	assert(pAllocation);
+	assert(pAllocation->pMappedData);
+
+	if (DeviceMemoryAllocator_IsHostCoherent(pThis, pAllocation->poolIndex)) {
+		return;
+	}
+
+	VkMappedMemoryRange range = DeviceMemoryAllocator_GetMappedRange(pThis, pAllocation);
+	REQUIRE_VK_SUCCESS(vkInvalidateMappedMemoryRanges(pThis->device, 1, &range));
+}
+
+/*!
+ * \brief	gives empty blocks back to the device
+ *
+ * Live allocations never move, resources would have to be recreated and
+ * rebound for that, so this only helps once whole blocks drain. Call it
+ * after unloading a level or a batch of meshes.
+ *
+ * \return	how many bytes were released
+ */
+VkDeviceSize DeviceMemoryAllocator_Defragment(DeviceMemoryAllocator* pThis) {
+	assert(pThis);
+
+	VkDeviceSize releasedBytes = 0;
+	for (uint32_t i = 0; i < POOL_COUNT; i++) {
+		MemoryPool* pPool = &pThis->aPools[i];
+		for (uint32_t j = 0; j < pPool->blockCount; j++) {
+			MemoryBlock* pBlock = &pPool->paBlocks[j];
+			if (pBlock->memory && pBlock->allocationCount == 0) {
+				DeviceMemoryAllocator_FreeBlock(pThis, pBlock);
+				releasedBytes += pThis->blockSize;
+			}
+		}
+
+		// trailing empty slots can go, allocations only refer to live blocks
+		while (pPool->blockCount > 0 && !pPool->paBlocks[pPool->blockCount - 1].memory) {
+			pPool->blockCount--;
+		}
+		if (pPool->blockCount == 0) {
+			SAFE_FREE(pPool->paBlocks);
+		}
+	}
+	return releasedBytes;
+}
+
+DeviceMemoryStats DeviceMemoryAllocator_GetStats(const DeviceMemoryAllocator* pThis) {
+	assert(pThis);
+
+	return pThis->stats;
+}
+
+BOOL DeviceMemoryAllocator_AllocateDedicated(
+	DeviceMemoryAllocator* pThis,
+	uint32_t poolIndex,
+	VkDeviceSize size,
+	DeviceMemoryAllocation* pAllocationOut) {
+	assert(pThis);
+	assert(pAllocationOut);
+
+	if (pThis->stats.deviceAllocationCount >= pThis->maxMemoryAllocationCount) {
+		return FALSE;
+	}
+
+	uint32_t memoryTypeIndex = poolIndex / 2;
+
+	VkMemoryAllocateInfo allocateInfo = { 0 };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.pNext = NULL;
+	allocateInfo.allocationSize = size;
+	allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory;
+	VkResult result = vkAllocateMemory(pThis->device, &allocateInfo, NULL, &memory);
+	if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) {
+		return FALSE;
+	}
+	REQUIRE_VK_SUCCESS(result);
+
+	void* pMappedData = NULL;
+	if (pThis->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags
+		& VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+
+		REQUIRE_VK_SUCCESS(
+			vkMapMemory(pThis->device, memory, 0, VK_WHOLE_SIZE, 0, &pMappedData)
+		);
+	}
+
+	pThis->stats.deviceAllocationCount++;
+	pThis->stats.dedicatedAllocationCount++;
+	pThis->stats.allocationCount++;
+	pThis->stats.reservedBytes += size;
+	pThis->stats.usedBytes += size;
+
+	pAllocationOut->memory = memory;
+	pAllocationOut->offset = 0;
+	pAllocationOut->size = size;
+	pAllocationOut->pMappedData = pMappedData;
+	pAllocationOut->poolIndex = poolIndex;
+	pAllocationOut->blockIndex = DEDICATED_BLOCK;
+	pAllocationOut->reservedSize = size;
+	return TRUE;
+}
+
+BOOL DeviceMemoryAllocator_CreateBlock(
+	DeviceMemoryAllocator* pThis,
+	uint32_t poolIndex,
+	uint32_t* pBlockIndexOut) {
+	assert(pThis);
+	assert(pBlockIndexOut);
+
+	if (pThis->stats.deviceAllocationCount >= pThis->maxMemoryAllocationCount) {
+		return FALSE;
+	}
+
+	uint32_t memoryTypeIndex = poolIndex / 2;
+
+	VkMemoryAllocateInfo allocateInfo = { 0 };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.pNext = NULL;
+	allocateInfo.allocationSize = pThis->blockSize;
+	allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory;
+	VkResult result = vkAllocateMemory(pThis->device, &allocateInfo, NULL, &memory);
+	if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) {
+		return FALSE;
+	}
+	REQUIRE_VK_SUCCESS(result);
+
+	// reuse a slot Defragment emptied before growing the pool
+	MemoryPool* pPool = &pThis->aPools[poolIndex];
+	uint32_t blockIndex;
+	for (blockIndex = 0; blockIndex < pPool->blockCount; blockIndex++) {
+		if (!pPool->paBlocks[blockIndex].memory) {
+			break;
+		}
+	}
+	if (blockIndex == pPool->blockCount) {
+		pPool->paBlocks = (MemoryBlock*)realloc(
+			pPool->paBlocks,
+			sizeof(MemoryBlock) * (pPool->blockCount + 1));
+		pPool->blockCount++;
+	}
+
+	MemoryBlock* pBlock = &pPool->paBlocks[blockIndex];
+	memset(pBlock, 0, sizeof(MemoryBlock));
+	pBlock->memory = memory;
+
+	if (pThis->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags
+		& VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+
+		REQUIRE_VK_SUCCESS(
+			vkMapMemory(pThis->device, memory, 0, VK_WHOLE_SIZE, 0, &pBlock->pMappedData)
+		);
+	}
+
+	if (pThis->strategy == DEVICE_MEMORY_STRATEGY_BUDDY) {
+		size_t nodeCount = ((size_t)2 << pThis->buddyMaxOrder) - 1;
+		pBlock->paBuddyTree = SAFE_ALLOCATE_ARRAY(uint8_t, nodeCount);
+		BuddyTreeInitialize(pBlock->paBuddyTree, pThis->buddyMaxOrder);
+	}
+
+	pThis->stats.deviceAllocationCount++;
+	pThis->stats.blockCount++;
+	pThis->stats.reservedBytes += pThis->blockSize;
+
+	*pBlockIndexOut = blockIndex;
+	return TRUE;
+}
+
+void DeviceMemoryAllocator_FreeBlock(DeviceMemoryAllocator* pThis, MemoryBlock* pBlock) {
+	assert(pThis);
+	assert(pBlock);
+
+	if (!pBlock->memory) {
+		return;
+	}
+
+	// freeing mapped memory unmaps it
+	vkFreeMemory(pThis->device, pBlock->memory, NULL);
+	SAFE_FREE(pBlock->paBuddyTree);
+	memset(pBlock, 0, sizeof(MemoryBlock));
+
+	pThis->stats.deviceAllocationCount--;
+	pThis->stats.blockCount--;
+	pThis->stats.reservedBytes -= pThis->blockSize;
+}
+
+BOOL DeviceMemoryAllocator_AllocateFromBlock(
+	DeviceMemoryAllocator* pThis,
+	MemoryBlock* pBlock,
+	VkDeviceSize size,
+	VkDeviceSize alignment,
+	VkDeviceSize* pOffsetOut,
+	VkDeviceSize* pReservedSizeOut) {
+	assert(pThis);
+	assert(pBlock);
+	assert(pOffsetOut);
+	assert(pReservedSizeOut);
+
+	switch (pThis->strategy) {
+	case DEVICE_MEMORY_STRATEGY_LINEAR:
+	{
+		VkDeviceSize offset = AlignUp(pBlock->linearHead, alignment);
+		if (offset + size > pThis->blockSize) {
+			return FALSE;
+		}
+
+		// the padding is charged to this allocation so it's handed back with it
+		*pOffsetOut = offset;
+		*pReservedSizeOut = offset + size - pBlock->linearHead;
+		pBlock->linearHead = offset + size;
+		return TRUE;
+	}
+	case DEVICE_MEMORY_STRATEGY_BUDDY:
+	{
+		// buddy ranges are aligned to their own size, so ask for enough to be aligned
+		uint32_t order = BuddyOrderForSize(size > alignment ? size : alignment);
+		if (order > pThis->buddyMaxOrder) {
+			return FALSE;
+		}
+		if (!BuddyTreeAllocate(pBlock->paBuddyTree, pThis->buddyMaxOrder, order, pOffsetOut)) {
+			return FALSE;
+		}
+		*pReservedSizeOut = (VkDeviceSize)DEVICE_MEMORY_BUDDY_MIN_SIZE << order;
+		return TRUE;
+	}
+	}
+
+	assert(FALSE);
+	return FALSE;
+}
+
+/*!
+ * \brief	widens \a pAllocation to nonCoherentAtomSize as flushes and invalidates require
+ */
+VkMappedMemoryRange DeviceMemoryAllocator_GetMappedRange(
+	DeviceMemoryAllocator* pThis,
+	const DeviceMemoryAllocation* pAllocation) {
+	assert(pThis);
+	assert(pAllocation);
+
+	VkDeviceSize memorySize = pAllocation->blockIndex == DEDICATED_BLOCK
+		? pAllocation->reservedSize
+		: pThis->blockSize;
+	VkDeviceSize atomSize = pThis->nonCoherentAtomSize;
+	VkDeviceSize begin = pAllocation->offset - (pAllocation->offset % atomSize);
+	VkDeviceSize end = AlignUp(pAllocation->offset + pAllocation->size, atomSize);
+	if (end > memorySize) {
+		end = memorySize;
+	}
+
+	VkMappedMemoryRange range = { 0 };
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.pNext = NULL;
+	range.memory = pAllocation->memory;
+	range.offset = begin;
+	range.size = end - begin;
+	return range;
+}
+
+BOOL DeviceMemoryAllocator_IsHostCoherent(
+	const DeviceMemoryAllocator* pThis,
+	uint32_t poolIndex) {
+	assert(pThis);
+
+	uint32_t memoryTypeIndex = poolIndex / 2;
+	return (pThis->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags
+		& VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+/*!
+ * \brief	the smallest buddy order that holds \a size bytes
+ */
+uint32_t BuddyOrderForSize(VkDeviceSize size) {
+	uint32_t order = 0;
+	while (((VkDeviceSize)DEVICE_MEMORY_BUDDY_MIN_SIZE << order) < size) {
+		order++;
+	}
+	return order;
+}
+
+void BuddyTreeInitialize(uint8_t* paTree, uint32_t maxOrder) {
+	assert(paTree);
+
+	// everything starts free, so each node's best is its own order
+	size_t node = 0;
+	for (uint32_t depth = 0; depth <= maxOrder; depth++) {
+		size_t nodesAtDepth = (size_t)1 << depth;
+		memset(paTree + node, (int)(maxOrder - depth + 1), nodesAtDepth);
+		node += nodesAtDepth;
+	}
+}
+
+BOOL BuddyTreeAllocate(
+	uint8_t* paTree,
+	uint32_t maxOrder,
+	uint32_t order,
+	VkDeviceSize* pOffsetOut) {
+	assert(paTree);
+	assert(order <= maxOrder);
+	assert(pOffsetOut);
+
+	if (paTree[0] < order + 1) {
+		return FALSE;
+	}
+
+	// walk down to a free node of the right order, preferring the left
+	uint32_t node = 0;
+	uint32_t nodeOrder = maxOrder;
+	while (nodeOrder > order) {
+		uint32_t left = node * 2 + 1;
+		node = paTree[left] >= order + 1 ? left : left + 1;
+		nodeOrder--;
+	}
+	paTree[node] = 0;
+	BuddyTreeUpdateParents(paTree, node, order);
+
+	uint32_t firstNodeAtDepth = (1u << (maxOrder - order)) - 1;
+	*pOffsetOut = (VkDeviceSize)(node - firstNodeAtDepth) * ((VkDeviceSize)DEVICE_MEMORY_BUDDY_MIN_SIZE << order);
+	return TRUE;
+}
+
+void BuddyTreeFree(
+	uint8_t* paTree,
+	uint32_t maxOrder,
+	uint32_t order,
+	VkDeviceSize offset) {
+	assert(paTree);
+	assert(order <= maxOrder);
+
+	uint32_t firstNodeAtDepth = (1u << (maxOrder - order)) - 1;
+	uint32_t node = firstNodeAtDepth
+		+ (uint32_t)(offset / ((VkDeviceSize)DEVICE_MEMORY_BUDDY_MIN_SIZE << order));
+	assert(paTree[node] == 0);
+
+	paTree[node] = (uint8_t)(order + 1);
+	BuddyTreeUpdateParents(paTree, node, order);
+}
+
+/*!
+ * \brief	recomputes the ancestors of \a node after it changed, merging free buddies
+ */
+void BuddyTreeUpdateParents(uint8_t* paTree, uint32_t node, uint32_t nodeOrder) {
+	while (node > 0) {
+		node = (node - 1) / 2;
+		nodeOrder++;
+
+		uint8_t left = paTree[node * 2 + 1];
+		uint8_t right = paTree[node * 2 + 2];
+		if (left == nodeOrder && right == nodeOrder) {
+			// both halves are untouched so the whole range is free again
+			paTree[node] = (uint8_t)(nodeOrder + 1);
+		}
+		else {
+			paTree[node] = left > right ? left : right;
+		}
+	}
+}
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	if (alignment == 0) {
+		return value;
+	}
+	return (value + alignment - 1) / alignment * alignment;
+}
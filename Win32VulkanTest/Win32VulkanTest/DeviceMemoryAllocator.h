@@ -0,0 +1,102 @@
+#ifndef __DEVICE_MEMORY_ALLOCATOR_H
+#define __DEVICE_MEMORY_ALLOCATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Hands out ranges of a few large VkDeviceMemory blocks instead of making a
+ * vkAllocateMemory call per resource.
+ *
+ * Blocks are kept per memory type, and buffers are kept apart from optimally
+ * tiled images so bufferImageGranularity never has to be considered. Host
+ * visible blocks stay mapped for their whole life.
+ */
+typedef struct device_memory_allocator_t DeviceMemoryAllocator;
+
+#define DEVICE_MEMORY_DEFAULT_BLOCK_SIZE (64 * 1024 * 1024)
+
+// the smallest range the buddy strategy will hand out
+#define DEVICE_MEMORY_BUDDY_MIN_SIZE 256
+
+typedef enum device_memory_strategy_t {
+	// bumps an offset through each block, a block's space only comes back once
+	// everything in it is freed. Cheapest when resources live and die together
+	DEVICE_MEMORY_STRATEGY_LINEAR,
+	// power of two ranges that merge with their buddy when freed
+	DEVICE_MEMORY_STRATEGY_BUDDY,
+} DeviceMemoryStrategy;
+
+typedef struct device_memory_allocation_t {
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	// points at offset when the memory is host visible, otherwise NULL
+	void* pMappedData;
+
+	// bookkeeping for the allocator
+	uint32_t poolIndex;
+	uint32_t blockIndex;
+	VkDeviceSize reservedSize;
+} DeviceMemoryAllocation;
+
+typedef struct device_memory_stats_t {
+	// live vkAllocateMemory calls, compare against maxMemoryAllocationCount
+	uint32_t deviceAllocationCount;
+	uint32_t blockCount;
+	uint32_t dedicatedAllocationCount;
+	uint32_t allocationCount;
+	// memory taken from the device
+	VkDeviceSize reservedBytes;
+	// memory handed out, including alignment and rounding
+	VkDeviceSize usedBytes;
+} DeviceMemoryStats;
+
+DeviceMemoryAllocator* DeviceMemoryAllocator_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	VkDeviceSize blockSize,
+	DeviceMemoryStrategy strategy);
+void DeviceMemoryAllocator_Destroy(DeviceMemoryAllocator* pThis);
+
+uint32_t DeviceMemoryAllocator_FindMemoryType(
+	const DeviceMemoryAllocator* pThis,
+	uint32_t memoryTypeBits,
+	VkMemoryPropertyFlags requiredProperties);
+
+BOOL DeviceMemoryAllocator_Allocate(
+	DeviceMemoryAllocator* pThis,
+	const VkMemoryRequirements* pMemoryRequirements,
+	VkMemoryPropertyFlags requiredProperties,
+	BOOL optimalTiling,
+	DeviceMemoryAllocation* pAllocationOut);
+BOOL DeviceMemoryAllocator_AllocateForBuffer(
+	DeviceMemoryAllocator* pThis,
+	VkBuffer buffer,
+	VkMemoryPropertyFlags requiredProperties,
+	DeviceMemoryAllocation* pAllocationOut);
+BOOL DeviceMemoryAllocator_AllocateForImage(
+	DeviceMemoryAllocator* pThis,
+	VkImage image,
+	VkMemoryPropertyFlags requiredProperties,
+	DeviceMemoryAllocation* pAllocationOut);
+void DeviceMemoryAllocator_Free(
+	DeviceMemoryAllocator* pThis,
+	DeviceMemoryAllocation* pAllocation);
+
+void DeviceMemoryAllocator_Flush(
+	DeviceMemoryAllocator* pThis,
+	const DeviceMemoryAllocation* pAllocation);
+void DeviceMemoryAllocator_Invalidate(
+	DeviceMemoryAllocator* pThis,
+	const DeviceMemoryAllocation* pAllocation);
+
+VkDeviceSize DeviceMemoryAllocator_Defragment(DeviceMemoryAllocator* pThis);
+DeviceMemoryStats DeviceMemoryAllocator_GetStats(const DeviceMemoryAllocator* pThis);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__DEVICE_MEMORY_ALLOCATOR_H
@@ -0,0 +1,29 @@
+#ifndef __EMBEDDED_SHADERS_H
+#define __EMBEDDED_SHADERS_H
+
+#include "ShaderManager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * SPIR-V compiled into the executable by the CMake build when
+ * SHADERS_EMBED is on, which also defines SHADER_MANAGER_EMBEDDED_SHADERS.
+ * The table itself is generated from cmake/EmbeddedShaders.c.in.
+ */
+typedef struct embedded_shader_t {
+	const char* szName;
+	ShaderStage stage;
+	const uint32_t* pCode;
+	size_t codeSize;
+} EmbeddedShader;
+
+extern const EmbeddedShader kaEmbeddedShaders[];
+extern const uint32_t kEmbeddedShaderCount;
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__EMBEDDED_SHADERS_H
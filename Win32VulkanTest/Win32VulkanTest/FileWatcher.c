@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include "FileWatcher.h"
+
+#include "Thread.h"
+#include "Utils.h"
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif//__linux__
+
+struct file_watcher_t {
+#if defined(_WIN32)
+	HANDLE hChangeNotification;
+#elif defined(__linux__)
+	int inotifyDescriptor;
+#else
+	int unused;
+#endif
+};
+
+/*!
+ * \brief	starts watching the files directly in \a szDirectory
+ * \return	the watcher, or NULL if the directory can't be watched
+ */
+FileWatcher* FileWatcher_Create(const char* szDirectory) {
+	assert(szDirectory);
+
+	FileWatcher* pFileWatcher = (FileWatcher*)malloc(sizeof(FileWatcher));
+	memset(pFileWatcher, 0, sizeof(FileWatcher));
+
+#if defined(_WIN32)
+	pFileWatcher->hChangeNotification = FindFirstChangeNotificationA(
+		szDirectory,
+		FALSE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+	if (pFileWatcher->hChangeNotification == INVALID_HANDLE_VALUE) {
+		free(pFileWatcher);
+		return NULL;
+	}
+#elif defined(__linux__)
+	pFileWatcher->inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	// editors either rewrite files in place or rename a new one over the top
+	if (pFileWatcher->inotifyDescriptor < 0
+		|| inotify_add_watch(
+			pFileWatcher->inotifyDescriptor,
+			szDirectory,
+			IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+
+		if (pFileWatcher->inotifyDescriptor >= 0) {
+			close(pFileWatcher->inotifyDescriptor);
+		}
+		free(pFileWatcher);
+		return NULL;
+	}
+#endif
+
+	return pFileWatcher;
+}
+
+void FileWatcher_Destroy(FileWatcher* pThis) {
+	assert(pThis);
+
+#if defined(_WIN32)
+	FindCloseChangeNotification(pThis->hChangeNotification);
+#elif defined(__linux__)
+	close(pThis->inotifyDescriptor);
+#endif
+
+	free(pThis);
+}
+
+/*!
+ * \brief	blocks until something in the directory changes or the timeout passes
+ * \return	TRUE if there was a change
+ */
+BOOL FileWatcher_Wait(FileWatcher* pThis, uint32_t timeoutMilliseconds) {
+	assert(pThis);
+
+#if defined(_WIN32)
+	if (WaitForSingleObject(pThis->hChangeNotification, timeoutMilliseconds) != WAIT_OBJECT_0) {
+		return FALSE;
+	}
+	FindNextChangeNotification(pThis->hChangeNotification);
+	return TRUE;
+#elif defined(__linux__)
+	struct pollfd pollDescriptor = { 0 };
+	pollDescriptor.fd = pThis->inotifyDescriptor;
+	pollDescriptor.events = POLLIN;
+	if (poll(&pollDescriptor, 1, (int)timeoutMilliseconds) <= 0) {
+		return FALSE;
+	}
+
+	// only whether something changed matters, drain the events
+	char aEventBuffer[4096];
+	while (read(pThis->inotifyDescriptor, aEventBuffer, sizeof(aEventBuffer)) > 0) {
+	}
+	return TRUE;
+#else
+	Thread_Sleep(timeoutMilliseconds);
+	return TRUE;
+#endif
+}
@@ -0,0 +1,26 @@
+#ifndef __FILE_WATCHER_H
+#define __FILE_WATCHER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Waits for files in a directory to be written, created or renamed.
+ *
+ * Uses inotify on linux and change notifications on windows. Elsewhere every
+ * wait reports a change once its timeout passes, so callers should always
+ * check what actually changed.
+ */
+typedef struct file_watcher_t FileWatcher;
+
+FileWatcher* FileWatcher_Create(const char* szDirectory);
+void FileWatcher_Destroy(FileWatcher* pThis);
+
+BOOL FileWatcher_Wait(FileWatcher* pThis, uint32_t timeoutMilliseconds);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__FILE_WATCHER_H
@@ -0,0 +1,421 @@
+#include "stdafx.h"
+#include "GpuProfiler.h"
+
+#include "MemoryUtils.h"
+#include "Utils.h"
+
+// the chrome trace's thread ids for each timeline
+#define TRACE_CPU_THREAD 0
+#define TRACE_GPU_THREAD 1
+
+// one frame in flight's queries, and the scopes recorded into them
+typedef struct profiler_slot_t {
+	// submitted but not read back yet
+	BOOL pending;
+	// scopes begun and not yet ended, only for catching mistakes
+	uint32_t openScopeCount;
+	GpuProfilerFrame frame;
+} ProfilerSlot;
+
+struct gpu_profiler_t {
+	VkDevice device;
+	// VK_NULL_HANDLE if the queue family can't write timestamps
+	VkQueryPool queryPool;
+	// nanoseconds per timestamp tick
+	float timestampPeriod;
+	// the bits of a timestamp that are valid
+	uint64_t timestampMask;
+
+	uint32_t frameCount;
+	ProfilerSlot* paSlots;
+	uint32_t currentSlot;
+	uint64_t nextFrameNumber;
+
+	// the most recent finished frames, a ring starting at historyStart
+	GpuProfilerFrame* paHistory;
+	uint32_t historyStart;
+	uint32_t historyCount;
+};
+
+uint32_t GpuProfiler_GetFirstQuery(uint32_t slot, uint32_t scope);
+void GpuProfiler_Collect(GpuProfiler* pThis, ProfilerSlot* pSlot, uint32_t slot);
+void GpuProfiler_WriteEvent(
+	FILE* pFile,
+	const char* szName,
+	uint32_t threadId,
+	double beginTime,
+	double duration,
+	uint64_t frameNumber);
+
+/*!
+ * \brief	creates the queries for every frame in flight
+ *
+ * Queue families without timestamp support still get cpu times, see
+ * GpuProfiler_HasGpuTimes.
+ *
+ * \param	queueFamilyIndex the family of the queue the profiled command
+ *			buffers are submitted to
+ * \param	frameCount how many frames may be in flight, each gets its own queries
+ */
+GpuProfiler* GpuProfiler_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	uint32_t queueFamilyIndex,
+	uint32_t frameCount) {
+	assert(physicalDevice);
+	assert(device);
+	assert(frameCount > 0);
+
+	GpuProfiler* pGpuProfiler = (GpuProfiler*)malloc(sizeof(GpuProfiler));
+	memset(pGpuProfiler, 0, sizeof(GpuProfiler));
+
+	pGpuProfiler->device = device;
+	pGpuProfiler->frameCount = frameCount;
+	pGpuProfiler->paSlots = SAFE_ALLOCATE_ARRAY(ProfilerSlot, frameCount);
+	memset(pGpuProfiler->paSlots, 0, sizeof(ProfilerSlot) * frameCount);
+	pGpuProfiler->paHistory = SAFE_ALLOCATE_ARRAY(GpuProfilerFrame, GPU_PROFILER_HISTORY_LENGTH);
+
+	uint32_t queueFamilyPropertyCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, NULL);
+	VkQueueFamilyProperties* paQueueFamilyProperties = SAFE_ALLOCATE_ARRAY(
+		VkQueueFamilyProperties,
+		queueFamilyPropertyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(
+		physicalDevice,
+		&queueFamilyPropertyCount,
+		paQueueFamilyProperties);
+	assert(queueFamilyIndex < queueFamilyPropertyCount);
+	uint32_t timestampValidBits = paQueueFamilyProperties[queueFamilyIndex].timestampValidBits;
+	SAFE_FREE(paQueueFamilyProperties);
+
+	if (timestampValidBits == 0) {
+		Log_Write(
+			LOG_SEVERITY_INFO,
+			"profiler",
+			"the queue has no timestamps, only cpu times are recorded");
+		return pGpuProfiler;
+	}
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	pGpuProfiler->timestampPeriod = deviceProperties.limits.timestampPeriod;
+	pGpuProfiler->timestampMask = timestampValidBits >= 64
+		? UINT64_MAX
+		: ((uint64_t)1 << timestampValidBits) - 1;
+
+	VkQueryPoolCreateInfo queryPoolCreateInfo = { 0 };
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.pNext = NULL;
+	queryPoolCreateInfo.flags = 0;
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolCreateInfo.queryCount = GpuProfiler_GetFirstQuery(frameCount, 0);
+	queryPoolCreateInfo.pipelineStatistics = 0;
+	REQUIRE_VK_SUCCESS(
+		vkCreateQueryPool(
+			device,
+			&queryPoolCreateInfo,
+			NULL,
+			&pGpuProfiler->queryPool)
+	);
+
+	return pGpuProfiler;
+}
+
+/*!
+ * \brief	destroys the queries, none of them may still be in use by the gpu
+ */
+void GpuProfiler_Destroy(GpuProfiler* pThis) {
+	assert(pThis);
+
+	vkDestroyQueryPool(pThis->device, pThis->queryPool, NULL);
+	SAFE_FREE(pThis->paSlots);
+	SAFE_FREE(pThis->paHistory);
+	free(pThis);
+}
+
+/*!
+ * \brief	starts profiling frame \a frameIndex and its "frame" scope
+ *
+ * Call once the gpu has finished with the frame that last used \a frameIndex,
+ * as that frame's results are read back here, and before anything in
+ * \a commandBuffer is timed. It resets the frame's queries, so it has to be
+ * outside a render pass.
+ *
+ * \param	commandBuffer the frame's primary, already begun
+ */
+void GpuProfiler_BeginFrame(
+	GpuProfiler* pThis,
+	uint32_t frameIndex,
+	VkCommandBuffer commandBuffer) {
+	assert(pThis);
+	assert(frameIndex < pThis->frameCount);
+	assert(commandBuffer);
+
+	ProfilerSlot* pSlot = &pThis->paSlots[frameIndex];
+	if (pSlot->pending) {
+		GpuProfiler_Collect(pThis, pSlot, frameIndex);
+	}
+
+	pThis->currentSlot = frameIndex;
+	pSlot->pending = FALSE;
+	pSlot->openScopeCount = 0;
+	pSlot->frame.frameNumber = pThis->nextFrameNumber++;
+	pSlot->frame.scopeCount = 0;
+
+	if (pThis->queryPool) {
+		vkCmdResetQueryPool(
+			commandBuffer,
+			pThis->queryPool,
+			GpuProfiler_GetFirstQuery(frameIndex, 0),
+			GPU_PROFILER_MAX_SCOPES * 2);
+	}
+
+	uint32_t frameScope = GpuProfiler_BeginScope(pThis, commandBuffer, "frame");
+	assert(frameScope == 0);
+}
+
+/*!
+ * \brief	ends the "frame" scope, every other scope has to be ended already
+ *
+ * The frame is read back by the GpuProfiler_BeginFrame that next reuses its
+ * index.
+ */
+void GpuProfiler_EndFrame(GpuProfiler* pThis, VkCommandBuffer commandBuffer) {
+	assert(pThis);
+
+	ProfilerSlot* pSlot = &pThis->paSlots[pThis->currentSlot];
+	assert(pSlot->openScopeCount == 1 && "a scope was begun but never ended");
+
+	GpuProfiler_EndScope(pThis, commandBuffer, 0);
+	pSlot->pending = TRUE;
+}
+
+/*!
+ * \brief	starts timing everything recorded into \a commandBuffer from here
+ *
+ * Scopes may nest. Allowed inside a render pass, the timestamp is written
+ * once the work before it has started.
+ *
+ * \param	szName has to stay valid for as long as the profiler
+ * \return	the scope to end, GPU_PROFILER_INVALID_SCOPE once the frame has
+ *			GPU_PROFILER_MAX_SCOPES
+ */
+uint32_t GpuProfiler_BeginScope(
+	GpuProfiler* pThis,
+	VkCommandBuffer commandBuffer,
+	const char* szName) {
+	assert(pThis);
+	assert(commandBuffer);
+	assert(szName);
+
+	ProfilerSlot* pSlot = &pThis->paSlots[pThis->currentSlot];
+	if (pSlot->frame.scopeCount == GPU_PROFILER_MAX_SCOPES) {
+		return GPU_PROFILER_INVALID_SCOPE;
+	}
+
+	uint32_t scope = pSlot->frame.scopeCount++;
+	GpuProfilerScope* pScope = &pSlot->frame.aScopes[scope];
+	memset(pScope, 0, sizeof(GpuProfilerScope));
+	pScope->szName = szName;
+	pScope->cpuBeginTime = GetTimeMicroseconds();
+	pSlot->openScopeCount++;
+
+	if (pThis->queryPool) {
+		vkCmdWriteTimestamp(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			pThis->queryPool,
+			GpuProfiler_GetFirstQuery(pThis->currentSlot, scope));
+	}
+
+	return scope;
+}
+
+/*!
+ * \brief	stops timing \a scope once everything recorded before this has finished
+ */
+void GpuProfiler_EndScope(
+	GpuProfiler* pThis,
+	VkCommandBuffer commandBuffer,
+	uint32_t scope) {
+	assert(pThis);
+	assert(commandBuffer);
+
+	if (scope == GPU_PROFILER_INVALID_SCOPE) {
+		return;
+	}
+
+	ProfilerSlot* pSlot = &pThis->paSlots[pThis->currentSlot];
+	assert(scope < pSlot->frame.scopeCount);
+	assert(pSlot->openScopeCount > 0);
+
+	pSlot->frame.aScopes[scope].cpuEndTime = GetTimeMicroseconds();
+	pSlot->openScopeCount--;
+
+	if (pThis->queryPool) {
+		vkCmdWriteTimestamp(
+			commandBuffer,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			pThis->queryPool,
+			GpuProfiler_GetFirstQuery(pThis->currentSlot, scope) + 1);
+	}
+}
+
+// FALSE if the queue can't write timestamps, and every gpu time is 0
+BOOL GpuProfiler_HasGpuTimes(const GpuProfiler* pThis) {
+	assert(pThis);
+	return pThis->queryPool != VK_NULL_HANDLE;
+}
+
+/*!
+ * \brief	the most recent frame the gpu has finished, NULL before the first
+ *
+ * Valid until the next GpuProfiler_BeginFrame.
+ */
+const GpuProfilerFrame* GpuProfiler_GetLatestFrame(const GpuProfiler* pThis) {
+	assert(pThis);
+
+	if (pThis->historyCount == 0) {
+		return NULL;
+	}
+	uint32_t latest = (pThis->historyStart + pThis->historyCount - 1) % GPU_PROFILER_HISTORY_LENGTH;
+	return &pThis->paHistory[latest];
+}
+
+/*!
+ * \brief	writes the frames in the history as a chrome://tracing json file
+ *
+ * Cpu and gpu scopes are on separate threads of the trace. The gpu has its
+ * own clock, so its timeline is lined up by treating the oldest frame as
+ * having started on the gpu the moment the cpu finished recording it.
+ *
+ * \return	FALSE if the file couldn't be written
+ */
+BOOL GpuProfiler_WriteChromeTrace(const GpuProfiler* pThis, const char* szFilePath) {
+	assert(pThis);
+	assert(szFilePath);
+
+	FILE* pFile = NULL;
+	if (fopen_s(&pFile, szFilePath, "w") != 0 || !pFile) {
+		return FALSE;
+	}
+
+	fputs("{\"traceEvents\":[\n", pFile);
+	fprintf(
+		pFile,
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"cpu\"}},\n",
+		TRACE_CPU_THREAD);
+	fprintf(
+		pFile,
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"gpu\"}}",
+		TRACE_GPU_THREAD);
+
+	double gpuTimeOffset = 0.0;
+	if (pThis->historyCount > 0) {
+		const GpuProfilerFrame* pOldest = &pThis->paHistory[pThis->historyStart];
+		gpuTimeOffset = (double)pOldest->aScopes[0].cpuEndTime - pOldest->aScopes[0].gpuBeginTime;
+	}
+
+	for (uint32_t i = 0; i < pThis->historyCount; i++) {
+		const GpuProfilerFrame* pFrame
+			= &pThis->paHistory[(pThis->historyStart + i) % GPU_PROFILER_HISTORY_LENGTH];
+		for (uint32_t scope = 0; scope < pFrame->scopeCount; scope++) {
+			const GpuProfilerScope* pScope = &pFrame->aScopes[scope];
+			GpuProfiler_WriteEvent(
+				pFile,
+				pScope->szName,
+				TRACE_CPU_THREAD,
+				(double)pScope->cpuBeginTime,
+				(double)(pScope->cpuEndTime - pScope->cpuBeginTime),
+				pFrame->frameNumber);
+			if (pThis->queryPool) {
+				GpuProfiler_WriteEvent(
+					pFile,
+					pScope->szName,
+					TRACE_GPU_THREAD,
+					pScope->gpuBeginTime + gpuTimeOffset,
+					pScope->gpuEndTime - pScope->gpuBeginTime,
+					pFrame->frameNumber);
+			}
+		}
+	}
+
+	fputs("\n]}\n", pFile);
+	BOOL written = !ferror(pFile);
+	written = (fclose(pFile) == 0) && written;
+	return written;
+}
+
+// Private Interface!
+
+// the begin query of a scope, its end query follows it
+uint32_t GpuProfiler_GetFirstQuery(uint32_t slot, uint32_t scope) {
+	return (slot * GPU_PROFILER_MAX_SCOPES + scope) * 2;
+}
+
+/*!
+ * \brief	reads back a finished frame's timestamps and adds it to the history
+ *
+ * Never waits, a frame whose queries somehow aren't available is dropped.
+ */
+void GpuProfiler_Collect(GpuProfiler* pThis, ProfilerSlot* pSlot, uint32_t slot) {
+	GpuProfilerFrame* pFrame = &pSlot->frame;
+
+	if (pThis->queryPool) {
+		uint64_t aTimestamps[GPU_PROFILER_MAX_SCOPES * 2];
+		VkResult result = vkGetQueryPoolResults(
+			pThis->device,
+			pThis->queryPool,
+			GpuProfiler_GetFirstQuery(slot, 0),
+			pFrame->scopeCount * 2,
+			sizeof(uint64_t) * pFrame->scopeCount * 2,
+			aTimestamps,
+			sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT);
+		// a lost device is the renderer's to recover from, the frame is just dropped
+		if (result == VK_NOT_READY || result == VK_ERROR_DEVICE_LOST) {
+			return;
+		}
+		REQUIRE_VK_SUCCESS(result);
+
+		double microsecondsPerTick = (double)pThis->timestampPeriod / 1000.0;
+		for (uint32_t scope = 0; scope < pFrame->scopeCount; scope++) {
+			GpuProfilerScope* pScope = &pFrame->aScopes[scope];
+			pScope->gpuBeginTime
+				= (double)(aTimestamps[scope * 2] & pThis->timestampMask) * microsecondsPerTick;
+			pScope->gpuEndTime
+				= (double)(aTimestamps[scope * 2 + 1] & pThis->timestampMask) * microsecondsPerTick;
+		}
+	}
+
+	uint32_t index;
+	if (pThis->historyCount < GPU_PROFILER_HISTORY_LENGTH) {
+		index = (pThis->historyStart + pThis->historyCount++) % GPU_PROFILER_HISTORY_LENGTH;
+	}
+	else {
+		// full, the oldest frame makes way
+		index = pThis->historyStart;
+		pThis->historyStart = (pThis->historyStart + 1) % GPU_PROFILER_HISTORY_LENGTH;
+	}
+	pThis->paHistory[index] = *pFrame;
+}
+
+// one complete event after the ones before it, names are written as is so
+// they mustn't need escaping
+void GpuProfiler_WriteEvent(
+	FILE* pFile,
+	const char* szName,
+	uint32_t threadId,
+	double beginTime,
+	double duration,
+	uint64_t frameNumber) {
+	fprintf(
+		pFile,
+		",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+		"\"args\":{\"frame\":%llu}}",
+		szName,
+		threadId,
+		beginTime,
+		duration,
+		(unsigned long long)frameNumber);
+}
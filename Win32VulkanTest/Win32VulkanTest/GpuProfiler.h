@@ -0,0 +1,77 @@
+#ifndef __GPU_PROFILER_H
+#define __GPU_PROFILER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Times named scopes of a frame's command buffer with timestamp queries.
+ *
+ * Every frame in flight has its own range of queries. A frame's results are
+ * only read back once its fence has signaled, the next time the same frame
+ * starts, so reading never waits on the gpu. Each scope also records when the
+ * cpu recorded it, so cpu and gpu times can be compared side by side.
+ *
+ * Scopes work around anything recorded into a primary command buffer:
+ * render passes, copies and compute dispatches alike. Only use a profiler
+ * from one thread.
+ */
+typedef struct gpu_profiler_t GpuProfiler;
+
+// the most scopes one frame can have, including the frame itself
+#define GPU_PROFILER_MAX_SCOPES 32
+// how many of the most recent frames are kept for GpuProfiler_WriteChromeTrace
+#define GPU_PROFILER_HISTORY_LENGTH 240
+// returned when a frame has run out of scopes, GpuProfiler_EndScope ignores it
+#define GPU_PROFILER_INVALID_SCOPE UINT32_MAX
+
+typedef struct gpu_profiler_scope_t {
+	// as passed to GpuProfiler_BeginScope
+	const char* szName;
+	// GetTimeMicroseconds when the scope began and ended recording
+	uint64_t cpuBeginTime;
+	uint64_t cpuEndTime;
+	// in microseconds on the gpu's own clock, 0 if the queue has no timestamps
+	double gpuBeginTime;
+	double gpuEndTime;
+} GpuProfilerScope;
+
+typedef struct gpu_profiler_frame_t {
+	// counts the frames begun on the profiler, starting at 0
+	uint64_t frameNumber;
+	// the first scope always covers the whole frame
+	uint32_t scopeCount;
+	GpuProfilerScope aScopes[GPU_PROFILER_MAX_SCOPES];
+} GpuProfilerFrame;
+
+GpuProfiler* GpuProfiler_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	uint32_t queueFamilyIndex,
+	uint32_t frameCount);
+void GpuProfiler_Destroy(GpuProfiler* pThis);
+
+void GpuProfiler_BeginFrame(
+	GpuProfiler* pThis,
+	uint32_t frameIndex,
+	VkCommandBuffer commandBuffer);
+void GpuProfiler_EndFrame(GpuProfiler* pThis, VkCommandBuffer commandBuffer);
+uint32_t GpuProfiler_BeginScope(
+	GpuProfiler* pThis,
+	VkCommandBuffer commandBuffer,
+	const char* szName);
+void GpuProfiler_EndScope(
+	GpuProfiler* pThis,
+	VkCommandBuffer commandBuffer,
+	uint32_t scope);
+
+BOOL GpuProfiler_HasGpuTimes(const GpuProfiler* pThis);
+const GpuProfilerFrame* GpuProfiler_GetLatestFrame(const GpuProfiler* pThis);
+BOOL GpuProfiler_WriteChromeTrace(const GpuProfiler* pThis, const char* szFilePath);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__GPU_PROFILER_H
@@ -0,0 +1,97 @@
+// HeadlessVulkanTest.c : renders the test scene without a window and writes
+// the last frame out as a PPM image, so the renderer can be run anywhere.
+//
+
+#include "stdafx.h"
+
+#include "Log.h"
+#include "MemoryUtils.h"
+#include "VulkanRenderer.h"
+
+#define HEADLESS_WIDTH 640
+#define HEADLESS_HEIGHT 480
+#define HEADLESS_FRAME_COUNT 8
+#define HEADLESS_OUTPUT_PATH "headless.ppm"
+#define HEADLESS_TRACE_PATH "headless_trace.json"
+
+BOOL WritePpm(const char* szFilePath, const uint8_t* pPixels, uint32_t width, uint32_t height);
+
+int main(int argc, char** argv) {
+	const char* szOutputPath = argc > 1 ? argv[1] : HEADLESS_OUTPUT_PATH;
+
+	// it runs from a terminal, not a debugger
+	Log_AddSink(LogSink_Stream, stderr);
+	Log_Initialize(LOG_SEVERITY_INFO);
+	JobSystem* pJobSystem = JobSystem_Create(JOB_SYSTEM_DEFAULT_WORKERS);
+	VulkanRenderer* pVulkanRenderer = VulkanRenderer_CreateHeadless(
+		HEADLESS_WIDTH,
+		HEADLESS_HEIGHT,
+		VULKAN_RENDERER_DEFAULT_FRAMES_IN_FLIGHT,
+		VULKAN_RENDERER_DEFAULT_VALIDATION,
+		pJobSystem);
+
+	// the matrices start out as identity, so this is in clip space
+	const Vertex aTriangleVertices[] = {
+		{ { 0.f, -0.5f, 0.5f }, { 1.f, 0.f, 0.f } },
+		{ { 0.5f, 0.5f, 0.5f }, { 0.f, 1.f, 0.f } },
+		{ { -0.5f, 0.5f, 0.5f }, { 0.f, 0.f, 1.f } },
+	};
+	const uint32_t aTriangleIndices[] = { 0, 1, 2 };
+	VulkanRenderer_CreateMesh(
+		pVulkanRenderer,
+		aTriangleVertices,
+		sizeof(aTriangleVertices) / sizeof(Vertex),
+		aTriangleIndices,
+		sizeof(aTriangleIndices) / sizeof(uint32_t));
+
+	// meshes are drawn once their upload finishes, which may take a few frames.
+	// a lost device is re-created by the renderer, anything worse ends the run
+	VkResult result = VK_SUCCESS;
+	for (uint32_t i = 0;
+		i < HEADLESS_FRAME_COUNT && (result >= VK_SUCCESS || result == VK_ERROR_DEVICE_LOST);
+		i++) {
+		result = VulkanRenderer_Render(pVulkanRenderer);
+	}
+
+	BOOL succeeded = FALSE;
+	if (result >= VK_SUCCESS) {
+		size_t pixelBufferSize = (size_t)HEADLESS_WIDTH * HEADLESS_HEIGHT * 4;
+		uint8_t* pPixels = SAFE_ALLOCATE_ARRAY(uint8_t, pixelBufferSize);
+		succeeded = VulkanRenderer_ReadPixels(pVulkanRenderer, pPixels, pixelBufferSize)
+			&& WritePpm(szOutputPath, pPixels, HEADLESS_WIDTH, HEADLESS_HEIGHT);
+		SAFE_FREE(pPixels);
+
+		// open in chrome://tracing to see where the frames' time went
+		GpuProfiler_WriteChromeTrace(
+			VulkanRenderer_GetProfiler(pVulkanRenderer),
+			HEADLESS_TRACE_PATH);
+	}
+
+	VulkanRenderer_Destroy(pVulkanRenderer);
+	pVulkanRenderer = NULL;
+	JobSystem_Destroy(pJobSystem);
+	pJobSystem = NULL;
+	Log_Shutdown();
+
+	return succeeded ? 0 : 1;
+}
+
+/*!
+ * \brief	writes RGBA8 pixels as a binary PPM, dropping alpha
+ */
+BOOL WritePpm(const char* szFilePath, const uint8_t* pPixels, uint32_t width, uint32_t height) {
+	FILE* pFile = NULL;
+	if (fopen_s(&pFile, szFilePath, "wb") != 0) {
+		fprintf(stderr, "can't open %s\n", szFilePath);
+		return FALSE;
+	}
+
+	fprintf(pFile, "P6\n%u %u\n255\n", width, height);
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		fwrite(&pPixels[i * 4], 1, 3, pFile);
+	}
+
+	BOOL succeeded = !ferror(pFile);
+	fclose(pFile);
+	return succeeded;
+}
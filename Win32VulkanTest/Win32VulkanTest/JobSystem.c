@@ -0,0 +1,601 @@
+#include "stdafx.h"
+#include "JobSystem.h"
+
+#include "MemoryUtils.h"
+#include "Thread.h"
+#include "Utils.h"
+
+#define JOB_DEQUE_INITIAL_CAPACITY 64
+
+// the thread that created the JobSystem
+#define MAIN_THREAD_INDEX 0
+// a thread the JobSystem didn't create and that isn't its main thread
+#define EXTERNAL_THREAD_INDEX UINT32_MAX
+
+/*!
+ * Jobs waiting to run. The owner works at the bottom, newest first so what it
+ * just queued is still in cache, and thieves take from the top, oldest first,
+ * which tends to be the biggest pieces of work.
+ */
+typedef struct job_deque_t {
+	Mutex* pMutex;
+	// index of the top, the oldest job
+	uint32_t top;
+	uint32_t count;
+	uint32_t capacity;
+	Job** papJobs;
+} JobDeque;
+
+struct job_t {
+	JobFunction function;
+	void* pUserData;
+	uint32_t flags;
+
+	// everything below is guarded by the JobSystem's pMutex
+
+	// dependencies yet to finish, plus one until the job is submitted
+	uint32_t pendingCount;
+	BOOL submitted;
+	BOOL finished;
+	// the creator's reference, and the JobSystem's until the job has run
+	uint32_t refCount;
+	// jobs that depend on this one
+	uint32_t dependentCount;
+	uint32_t dependentCapacity;
+	Job** papDependents;
+};
+
+typedef struct job_worker_t {
+	JobSystem* pJobSystem;
+	uint32_t threadIndex;
+	Thread* pThread;
+} JobWorker;
+
+struct job_system_t {
+	// the workers and the main thread
+	uint32_t threadCount;
+	// one per thread, indexed like paWorkers
+	JobDeque* paDeques;
+	// JOB_FLAG_MAIN_THREAD jobs, only the main thread takes from this
+	JobDeque mainThreadDeque;
+	// JOB_FLAG_BACKGROUND jobs, oldest first
+	JobDeque backgroundDeque;
+	// [MAIN_THREAD_INDEX] is unused, it's not our thread
+	JobWorker* paWorkers;
+
+	// guards job state and everything below
+	Mutex* pMutex;
+	// broadcast whenever a job is queued or finishes
+	ConditionVariable* pChanged;
+	// jobs in paDeques, so sleeping threads know when to look again
+	uint32_t queuedCount;
+	uint32_t mainThreadQueuedCount;
+	uint32_t backgroundQueuedCount;
+	BOOL stopping;
+};
+
+// which JobSystem the current thread belongs to and its index in it
+static THREAD_LOCAL JobSystem* tpCurrentJobSystem = NULL;
+static THREAD_LOCAL uint32_t tCurrentThreadIndex = EXTERNAL_THREAD_INDEX;
+
+void JobSystem_Enqueue(JobSystem* pThis, Job* pJob);
+Job* JobSystem_FindJob(JobSystem* pThis, uint32_t threadIndex);
+Job* JobSystem_FindBackgroundJob(JobSystem* pThis);
+void JobSystem_Execute(JobSystem* pThis, Job* pJob);
+uint32_t JobSystem_GetCurrentThreadIndex(JobSystem* pThis);
+void JobSystem_WorkerMain(void* pUserData);
+
+void JobDeque_Initialize(JobDeque* pThis);
+void JobDeque_Free(JobDeque* pThis);
+void JobDeque_PushBottom(JobDeque* pThis, Job* pJob);
+Job* JobDeque_PopBottom(JobDeque* pThis);
+Job* JobDeque_StealTop(JobDeque* pThis);
+
+/*!
+ * \brief	starts the workers, the calling thread becomes the main thread
+ * \param	workerCount threads to start besides the main thread, or
+ *			JOB_SYSTEM_DEFAULT_WORKERS for one per remaining processor.
+ *			0 runs every job on the main thread as it waits
+ */
+JobSystem* JobSystem_Create(uint32_t workerCount) {
+	assert(tpCurrentJobSystem == NULL && "this thread already belongs to a JobSystem");
+
+	if (workerCount == JOB_SYSTEM_DEFAULT_WORKERS) {
+		workerCount = Thread_GetProcessorCount() - 1;
+	}
+
+	JobSystem* pJobSystem = (JobSystem*)malloc(sizeof(JobSystem));
+	memset(pJobSystem, 0, sizeof(JobSystem));
+
+	pJobSystem->threadCount = workerCount + 1;
+	pJobSystem->pMutex = Mutex_Create();
+	pJobSystem->pChanged = ConditionVariable_Create();
+
+	pJobSystem->paDeques = SAFE_ALLOCATE_ARRAY(JobDeque, pJobSystem->threadCount);
+	for (uint32_t i = 0; i < pJobSystem->threadCount; i++) {
+		JobDeque_Initialize(&pJobSystem->paDeques[i]);
+	}
+	JobDeque_Initialize(&pJobSystem->mainThreadDeque);
+	JobDeque_Initialize(&pJobSystem->backgroundDeque);
+
+	tpCurrentJobSystem = pJobSystem;
+	tCurrentThreadIndex = MAIN_THREAD_INDEX;
+
+	pJobSystem->paWorkers = SAFE_ALLOCATE_ARRAY(JobWorker, pJobSystem->threadCount);
+	memset(pJobSystem->paWorkers, 0, sizeof(JobWorker) * pJobSystem->threadCount);
+	for (uint32_t i = 1; i < pJobSystem->threadCount; i++) {
+		JobWorker* pWorker = &pJobSystem->paWorkers[i];
+		pWorker->pJobSystem = pJobSystem;
+		pWorker->threadIndex = i;
+		pWorker->pThread = Thread_Create(JobSystem_WorkerMain, pWorker);
+	}
+
+	return pJobSystem;
+}
+
+/*!
+ * \brief	stops the workers
+ *
+ * Has to be called on the main thread once every submitted job has finished.
+ */
+void JobSystem_Destroy(JobSystem* pThis) {
+	assert(pThis);
+	assert(JobSystem_GetCurrentThreadIndex(pThis) == MAIN_THREAD_INDEX);
+
+	Mutex_Lock(pThis->pMutex);
+	assert(pThis->queuedCount == 0
+		&& pThis->mainThreadQueuedCount == 0
+		&& pThis->backgroundQueuedCount == 0);
+	pThis->stopping = TRUE;
+	ConditionVariable_WakeAll(pThis->pChanged);
+	Mutex_Unlock(pThis->pMutex);
+
+	for (uint32_t i = 1; i < pThis->threadCount; i++) {
+		Thread_Join(pThis->paWorkers[i].pThread);
+	}
+	SAFE_FREE(pThis->paWorkers);
+
+	for (uint32_t i = 0; i < pThis->threadCount; i++) {
+		JobDeque_Free(&pThis->paDeques[i]);
+	}
+	SAFE_FREE(pThis->paDeques);
+	JobDeque_Free(&pThis->mainThreadDeque);
+	JobDeque_Free(&pThis->backgroundDeque);
+
+	ConditionVariable_Destroy(pThis->pChanged);
+	Mutex_Destroy(pThis->pMutex);
+
+	tpCurrentJobSystem = NULL;
+	tCurrentThreadIndex = EXTERNAL_THREAD_INDEX;
+
+	free(pThis);
+}
+
+/*!
+ * \brief	makes a job that runs \a function once submitted
+ *
+ * Dependencies can be added until JobSystem_Submit. The returned handle has
+ * to be given back with JobSystem_Wait or JobSystem_Release.
+ *
+ * \param	flags JobFlag bits
+ */
+Job* JobSystem_CreateJob(
+	JobSystem* pThis,
+	JobFunction function,
+	void* pUserData,
+	uint32_t flags) {
+	assert(pThis);
+	assert(function);
+
+	Job* pJob = (Job*)malloc(sizeof(Job));
+	memset(pJob, 0, sizeof(Job));
+
+	pJob->function = function;
+	pJob->pUserData = pUserData;
+	pJob->flags = flags;
+	pJob->pendingCount = 1;
+	pJob->refCount = 2;
+
+	return pJob;
+}
+
+/*!
+ * \brief	holds \a pJob back until \a pDependency has finished
+ *
+ * \a pJob mustn't have been submitted yet, \a pDependency may have been and
+ * may even have finished already.
+ */
+void JobSystem_AddDependency(JobSystem* pThis, Job* pJob, Job* pDependency) {
+	assert(pThis);
+	assert(pJob);
+	assert(pDependency);
+	assert(pJob != pDependency);
+
+	Mutex_Lock(pThis->pMutex);
+	assert(!pJob->submitted);
+	if (!pDependency->finished) {
+		if (pDependency->dependentCount == pDependency->dependentCapacity) {
+			pDependency->dependentCapacity = pDependency->dependentCapacity
+				? pDependency->dependentCapacity * 2
+				: 4;
+			pDependency->papDependents = (Job**)realloc(
+				pDependency->papDependents,
+				sizeof(Job*) * pDependency->dependentCapacity);
+			assert(pDependency->papDependents);
+		}
+		pDependency->papDependents[pDependency->dependentCount++] = pJob;
+		pJob->pendingCount++;
+	}
+	Mutex_Unlock(pThis->pMutex);
+}
+
+/*!
+ * \brief	lets \a pJob run as soon as its dependencies have finished
+ */
+void JobSystem_Submit(JobSystem* pThis, Job* pJob) {
+	assert(pThis);
+	assert(pJob);
+
+	Mutex_Lock(pThis->pMutex);
+	assert(!pJob->submitted);
+	pJob->submitted = TRUE;
+	BOOL runnable = --pJob->pendingCount == 0;
+	Mutex_Unlock(pThis->pMutex);
+
+	if (runnable) {
+		JobSystem_Enqueue(pThis, pJob);
+	}
+}
+
+/*!
+ * \brief	creates and submits a job with no dependencies
+ */
+Job* JobSystem_Run(
+	JobSystem* pThis,
+	JobFunction function,
+	void* pUserData,
+	uint32_t flags) {
+	Job* pJob = JobSystem_CreateJob(pThis, function, pUserData, flags);
+	JobSystem_Submit(pThis, pJob);
+	return pJob;
+}
+
+BOOL JobSystem_IsFinished(JobSystem* pThis, const Job* pJob) {
+	assert(pThis);
+	assert(pJob);
+
+	Mutex_Lock(pThis->pMutex);
+	BOOL finished = pJob->finished;
+	Mutex_Unlock(pThis->pMutex);
+	return finished;
+}
+
+/*!
+ * \brief	runs other jobs until \a pJob has finished, then releases it
+ *
+ * Only sleeps when there's nothing this thread could run. Waiting on a
+ * JOB_FLAG_MAIN_THREAD job from a worker needs the main thread to be
+ * pumping them. JOB_FLAG_BACKGROUND jobs are only helped with while waiting
+ * on one of them, as that wait is already as long as a background job, or
+ * when there are no workers, which leaves nobody else to run them.
+ */
+void JobSystem_Wait(JobSystem* pThis, Job* pJob) {
+	assert(pThis);
+	assert(pJob);
+
+	uint32_t threadIndex = JobSystem_GetCurrentThreadIndex(pThis);
+	BOOL helpBackground = (pJob->flags & JOB_FLAG_BACKGROUND) != 0
+		|| pThis->threadCount == 1;
+	for (;;) {
+		Mutex_Lock(pThis->pMutex);
+		BOOL finished = pJob->finished;
+		Mutex_Unlock(pThis->pMutex);
+		if (finished) {
+			break;
+		}
+
+		Job* pOtherJob = JobSystem_FindJob(pThis, threadIndex);
+		if (!pOtherJob && helpBackground) {
+			pOtherJob = JobSystem_FindBackgroundJob(pThis);
+		}
+		if (pOtherJob) {
+			JobSystem_Execute(pThis, pOtherJob);
+			continue;
+		}
+
+		Mutex_Lock(pThis->pMutex);
+		while (!pJob->finished
+			&& pThis->queuedCount == 0
+			&& !(threadIndex == MAIN_THREAD_INDEX && pThis->mainThreadQueuedCount > 0)
+			&& !(helpBackground && pThis->backgroundQueuedCount > 0)) {
+
+			ConditionVariable_Wait(pThis->pChanged, pThis->pMutex);
+		}
+		Mutex_Unlock(pThis->pMutex);
+	}
+
+	JobSystem_Release(pThis, pJob);
+}
+
+/*!
+ * \brief	gives back a job handle without waiting for it
+ *
+ * The job still runs if it's been submitted.
+ */
+void JobSystem_Release(JobSystem* pThis, Job* pJob) {
+	assert(pThis);
+	assert(pJob);
+
+	Mutex_Lock(pThis->pMutex);
+	assert(pJob->submitted && "an unsubmitted job would never be freed");
+	assert(pJob->refCount > 0);
+	BOOL unreferenced = --pJob->refCount == 0;
+	Mutex_Unlock(pThis->pMutex);
+
+	if (unreferenced) {
+		free(pJob);
+	}
+}
+
+/*!
+ * \brief	runs every JOB_FLAG_MAIN_THREAD job that's ready, call on the main thread
+ *
+ * With no workers nothing else would run JOB_FLAG_BACKGROUND jobs, so one of
+ * those runs here too.
+ *
+ * \return	how many jobs ran
+ */
+uint32_t JobSystem_RunMainThreadJobs(JobSystem* pThis) {
+	assert(pThis);
+	assert(JobSystem_GetCurrentThreadIndex(pThis) == MAIN_THREAD_INDEX);
+
+	uint32_t executedCount = 0;
+	Job* pJob;
+	while ((pJob = JobDeque_StealTop(&pThis->mainThreadDeque)) != NULL) {
+		Mutex_Lock(pThis->pMutex);
+		pThis->mainThreadQueuedCount--;
+		Mutex_Unlock(pThis->pMutex);
+
+		JobSystem_Execute(pThis, pJob);
+		executedCount++;
+	}
+
+	if (pThis->threadCount == 1) {
+		pJob = JobSystem_FindBackgroundJob(pThis);
+		if (pJob) {
+			JobSystem_Execute(pThis, pJob);
+			executedCount++;
+		}
+	}
+	return executedCount;
+}
+
+// the workers plus the main thread, the most jobs that can run at once
+uint32_t JobSystem_GetThreadCount(const JobSystem* pThis) {
+	assert(pThis);
+	return pThis->threadCount;
+}
+
+// Private Interface!
+
+void JobSystem_Enqueue(JobSystem* pThis, Job* pJob) {
+	BOOL mainThreadOnly = (pJob->flags & JOB_FLAG_MAIN_THREAD) != 0;
+	BOOL background = !mainThreadOnly && (pJob->flags & JOB_FLAG_BACKGROUND) != 0;
+
+	// counted before it's pushed so the count never drops below what's queued
+	Mutex_Lock(pThis->pMutex);
+	if (mainThreadOnly) {
+		pThis->mainThreadQueuedCount++;
+	}
+	else if (background) {
+		pThis->backgroundQueuedCount++;
+	}
+	else {
+		pThis->queuedCount++;
+	}
+	Mutex_Unlock(pThis->pMutex);
+
+	if (mainThreadOnly) {
+		JobDeque_PushBottom(&pThis->mainThreadDeque, pJob);
+	}
+	else if (background) {
+		JobDeque_PushBottom(&pThis->backgroundDeque, pJob);
+	}
+	else {
+		// threads from outside hand their jobs to the main thread's deque
+		uint32_t threadIndex = JobSystem_GetCurrentThreadIndex(pThis);
+		if (threadIndex == EXTERNAL_THREAD_INDEX) {
+			threadIndex = MAIN_THREAD_INDEX;
+		}
+		JobDeque_PushBottom(&pThis->paDeques[threadIndex], pJob);
+	}
+
+	Mutex_Lock(pThis->pMutex);
+	ConditionVariable_WakeAll(pThis->pChanged);
+	Mutex_Unlock(pThis->pMutex);
+}
+
+/*!
+ * \brief	takes a job for \a threadIndex to run: main thread only jobs first
+ *			if it's the main thread, then its own newest, then the oldest
+ *			from anyone else
+ */
+Job* JobSystem_FindJob(JobSystem* pThis, uint32_t threadIndex) {
+	Job* pJob = NULL;
+
+	if (threadIndex == MAIN_THREAD_INDEX) {
+		pJob = JobDeque_StealTop(&pThis->mainThreadDeque);
+		if (pJob) {
+			Mutex_Lock(pThis->pMutex);
+			pThis->mainThreadQueuedCount--;
+			Mutex_Unlock(pThis->pMutex);
+			return pJob;
+		}
+	}
+
+	uint32_t firstVictim = 0;
+	if (threadIndex != EXTERNAL_THREAD_INDEX) {
+		pJob = JobDeque_PopBottom(&pThis->paDeques[threadIndex]);
+		firstVictim = threadIndex + 1;
+	}
+	for (uint32_t i = 0; !pJob && i < pThis->threadCount; i++) {
+		uint32_t victim = (firstVictim + i) % pThis->threadCount;
+		if (victim != threadIndex) {
+			pJob = JobDeque_StealTop(&pThis->paDeques[victim]);
+		}
+	}
+
+	if (pJob) {
+		Mutex_Lock(pThis->pMutex);
+		pThis->queuedCount--;
+		Mutex_Unlock(pThis->pMutex);
+	}
+	return pJob;
+}
+
+// takes the oldest JOB_FLAG_BACKGROUND job
+Job* JobSystem_FindBackgroundJob(JobSystem* pThis) {
+	Job* pJob = JobDeque_StealTop(&pThis->backgroundDeque);
+	if (pJob) {
+		Mutex_Lock(pThis->pMutex);
+		pThis->backgroundQueuedCount--;
+		Mutex_Unlock(pThis->pMutex);
+	}
+	return pJob;
+}
+
+/*!
+ * \brief	runs \a pJob then queues every dependent it was the last thing holding back
+ */
+void JobSystem_Execute(JobSystem* pThis, Job* pJob) {
+	pJob->function(pJob->pUserData);
+
+	Mutex_Lock(pThis->pMutex);
+	pJob->finished = TRUE;
+
+	// nothing else can add dependents now it's finished, so the list is ours
+	Job** papDependents = pJob->papDependents;
+	uint32_t dependentCount = pJob->dependentCount;
+	pJob->papDependents = NULL;
+	pJob->dependentCount = 0;
+	pJob->dependentCapacity = 0;
+
+	uint32_t runnableCount = 0;
+	for (uint32_t i = 0; i < dependentCount; i++) {
+		Job* pDependent = papDependents[i];
+		assert(pDependent->pendingCount > 0);
+		if (--pDependent->pendingCount == 0) {
+			papDependents[runnableCount++] = pDependent;
+		}
+	}
+
+	BOOL unreferenced = --pJob->refCount == 0;
+	ConditionVariable_WakeAll(pThis->pChanged);
+	Mutex_Unlock(pThis->pMutex);
+
+	if (unreferenced) {
+		free(pJob);
+	}
+	for (uint32_t i = 0; i < runnableCount; i++) {
+		JobSystem_Enqueue(pThis, papDependents[i]);
+	}
+	SAFE_FREE(papDependents);
+}
+
+uint32_t JobSystem_GetCurrentThreadIndex(JobSystem* pThis) {
+	return tpCurrentJobSystem == pThis ? tCurrentThreadIndex : EXTERNAL_THREAD_INDEX;
+}
+
+void JobSystem_WorkerMain(void* pUserData) {
+	JobWorker* pWorker = (JobWorker*)pUserData;
+	JobSystem* pThis = pWorker->pJobSystem;
+
+	tpCurrentJobSystem = pThis;
+	tCurrentThreadIndex = pWorker->threadIndex;
+
+	for (;;) {
+		// background jobs only when there's nothing else queued
+		Job* pJob = JobSystem_FindJob(pThis, pWorker->threadIndex);
+		if (!pJob) {
+			pJob = JobSystem_FindBackgroundJob(pThis);
+		}
+		if (pJob) {
+			JobSystem_Execute(pThis, pJob);
+			continue;
+		}
+
+		Mutex_Lock(pThis->pMutex);
+		while (!pThis->stopping
+			&& pThis->queuedCount == 0
+			&& pThis->backgroundQueuedCount == 0) {
+			ConditionVariable_Wait(pThis->pChanged, pThis->pMutex);
+		}
+		BOOL stopping = pThis->stopping;
+		Mutex_Unlock(pThis->pMutex);
+		if (stopping) {
+			break;
+		}
+	}
+}
+
+void JobDeque_Initialize(JobDeque* pThis) {
+	pThis->pMutex = Mutex_Create();
+	pThis->top = 0;
+	pThis->count = 0;
+	pThis->capacity = JOB_DEQUE_INITIAL_CAPACITY;
+	pThis->papJobs = SAFE_ALLOCATE_ARRAY(Job*, pThis->capacity);
+}
+
+void JobDeque_Free(JobDeque* pThis) {
+	assert(pThis->count == 0);
+	SAFE_FREE(pThis->papJobs);
+	Mutex_Destroy(pThis->pMutex);
+	pThis->pMutex = NULL;
+}
+
+void JobDeque_PushBottom(JobDeque* pThis, Job* pJob) {
+	Mutex_Lock(pThis->pMutex);
+
+	if (pThis->count == pThis->capacity) {
+		// unwrap into a bigger ring
+		Job** papJobs = SAFE_ALLOCATE_ARRAY(Job*, pThis->capacity * 2);
+		for (uint32_t i = 0; i < pThis->count; i++) {
+			papJobs[i] = pThis->papJobs[(pThis->top + i) % pThis->capacity];
+		}
+		SAFE_FREE(pThis->papJobs);
+		pThis->papJobs = papJobs;
+		pThis->top = 0;
+		pThis->capacity *= 2;
+	}
+	pThis->papJobs[(pThis->top + pThis->count) % pThis->capacity] = pJob;
+	pThis->count++;
+
+	Mutex_Unlock(pThis->pMutex);
+}
+
+Job* JobDeque_PopBottom(JobDeque* pThis) {
+	Mutex_Lock(pThis->pMutex);
+
+	Job* pJob = NULL;
+	if (pThis->count > 0) {
+		pThis->count--;
+		pJob = pThis->papJobs[(pThis->top + pThis->count) % pThis->capacity];
+	}
+
+	Mutex_Unlock(pThis->pMutex);
+	return pJob;
+}
+
+Job* JobDeque_StealTop(JobDeque* pThis) {
+	Mutex_Lock(pThis->pMutex);
+
+	Job* pJob = NULL;
+	if (pThis->count > 0) {
+		pJob = pThis->papJobs[pThis->top];
+		pThis->top = (pThis->top + 1) % pThis->capacity;
+		pThis->count--;
+	}
+
+	Mutex_Unlock(pThis->pMutex);
+	return pJob;
+}
@@ -0,0 +1,70 @@
+#ifndef __JOB_SYSTEM_H
+#define __JOB_SYSTEM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Runs small jobs across a pool of worker threads.
+ *
+ * Every worker has its own deque. It pushes and pops jobs at one end, and
+ * idle workers steal from the other end of someone else's, so work spreads
+ * without a single shared queue. The thread that creates the system is the
+ * main thread. It has a deque that anything submitted from outside the
+ * workers goes to, and it helps run jobs whenever it waits on one.
+ *
+ * A job may depend on others and only becomes runnable once they have all
+ * finished. Jobs flagged JOB_FLAG_MAIN_THREAD only ever run on the main
+ * thread, in JobSystem_Wait or JobSystem_RunMainThreadJobs, for work like
+ * window calls that has to stay there. Jobs flagged JOB_FLAG_BACKGROUND are
+ * only picked up by idle workers, never by a thread helping out while it
+ * waits on something else, so long work like compiling a pipeline can't
+ * land in the middle of a frame.
+ *
+ * A job's function may create, submit and wait on other jobs.
+ */
+typedef struct job_system_t JobSystem;
+typedef struct job_t Job;
+
+typedef void (*JobFunction)(void* pUserData);
+
+typedef enum job_flag_t {
+	JOB_FLAG_NONE = 0,
+	// only run on the thread that created the JobSystem
+	JOB_FLAG_MAIN_THREAD = 1 << 0,
+	// only run once there's nothing else to do, see JobSystem_Wait
+	JOB_FLAG_BACKGROUND = 1 << 1,
+} JobFlag;
+
+// one worker per processor besides the main thread
+#define JOB_SYSTEM_DEFAULT_WORKERS UINT32_MAX
+
+JobSystem* JobSystem_Create(uint32_t workerCount);
+void JobSystem_Destroy(JobSystem* pThis);
+
+Job* JobSystem_CreateJob(
+	JobSystem* pThis,
+	JobFunction function,
+	void* pUserData,
+	uint32_t flags);
+void JobSystem_AddDependency(JobSystem* pThis, Job* pJob, Job* pDependency);
+void JobSystem_Submit(JobSystem* pThis, Job* pJob);
+Job* JobSystem_Run(
+	JobSystem* pThis,
+	JobFunction function,
+	void* pUserData,
+	uint32_t flags);
+
+BOOL JobSystem_IsFinished(JobSystem* pThis, const Job* pJob);
+void JobSystem_Wait(JobSystem* pThis, Job* pJob);
+void JobSystem_Release(JobSystem* pThis, Job* pJob);
+
+uint32_t JobSystem_RunMainThreadJobs(JobSystem* pThis);
+uint32_t JobSystem_GetThreadCount(const JobSystem* pThis);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__JOB_SYSTEM_H
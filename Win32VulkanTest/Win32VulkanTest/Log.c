@@ -0,0 +1,532 @@
+#include "stdafx.h"
+#include "Log.h"
+
+#include <stdarg.h>
+
+#include "MemoryUtils.h"
+#include "Thread.h"
+#include "Utils.h"
+
+// the most messages the writer takes from the queue at once
+#define LOG_WRITE_BATCH 32
+// how many different recent messages are checked for repeats
+#define LOG_REPEAT_ENTRIES 32
+// how much of a repeated message its summary shows
+#define LOG_SUMMARY_TEXT_LENGTH 120
+
+typedef struct log_sink_entry_t {
+	LogSink sink;
+	void* pUserData;
+} LogSinkEntry;
+
+// a message written recently, and how often it came up again since
+typedef struct log_repeat_entry_t {
+	uint32_t hash;
+	// when the message was last written, not repeated
+	uint64_t writtenTime;
+	uint32_t repeatCount;
+	LogMessage message;
+} LogRepeatEntry;
+
+typedef struct log_state_t {
+	// everything below is only created while the writer runs
+	Mutex* pMutex;
+	// broadcast when messages are queued, written, or the writer should stop
+	ConditionVariable* pChanged;
+	Thread* pWriterThread;
+
+	// guarded by pMutex while the writer runs
+
+	BOOL running;
+	BOOL stopping;
+	LogSeverity minSeverity;
+
+	// a ring starting at queueStart
+	LogMessage* paQueue;
+	uint32_t queueStart;
+	uint32_t queueCount;
+	// taken from the queue and not written yet, so Log_Flush has to wait
+	uint32_t writingCount;
+	// lost to the rate limit or a full queue since the writer last said so
+	uint32_t droppedCount;
+	uint64_t rateWindowStart;
+	uint32_t rateWindowCount;
+
+	uint32_t sinkCount;
+	LogSinkEntry aSinks[LOG_MAX_SINKS];
+
+	// only touched by the writer
+	LogRepeatEntry aRepeats[LOG_REPEAT_ENTRIES];
+} LogState;
+
+struct log_ring_t {
+	Mutex* pMutex;
+	uint32_t capacity;
+	// a ring starting at start
+	LogMessage* paMessages;
+	uint32_t start;
+	uint32_t count;
+};
+
+static LogState sLog = { 0 };
+// the writer can't wait for itself to flush
+static THREAD_LOCAL BOOL tIsLogWriter = FALSE;
+
+const char* aszLogSeverityNames[LOG_SEVERITY_COUNT] = {
+	"debug",
+	"info",
+	"warning",
+	"error",
+	"fatal",
+};
+
+void Log_WriterMain(void* pUserData);
+void Log_WriteToSinks(const LogSinkEntry* aSinks, uint32_t sinkCount, const LogMessage* pMessage);
+BOOL Log_IsRepeat(const LogSinkEntry* aSinks, uint32_t sinkCount, const LogMessage* pMessage);
+void Log_WriteRepeatSummary(
+	const LogSinkEntry* aSinks,
+	uint32_t sinkCount,
+	LogRepeatEntry* pEntry);
+uint32_t Log_HashMessage(const LogMessage* pMessage);
+
+/*!
+ * \brief	starts the writer thread, from then on messages are queued
+ *
+ * Call once, before anything logs from more than one thread.
+ *
+ * \param	minSeverity messages below it are dropped
+ */
+void Log_Initialize(LogSeverity minSeverity) {
+	assert(!sLog.running && "the log is already running");
+	assert(minSeverity < LOG_SEVERITY_COUNT);
+
+	sLog.minSeverity = minSeverity;
+	sLog.paQueue = SAFE_ALLOCATE_ARRAY(LogMessage, LOG_QUEUE_LENGTH);
+	sLog.queueStart = 0;
+	sLog.queueCount = 0;
+	sLog.writingCount = 0;
+	sLog.droppedCount = 0;
+	sLog.rateWindowStart = 0;
+	sLog.rateWindowCount = 0;
+	memset(sLog.aRepeats, 0, sizeof(sLog.aRepeats));
+
+	sLog.pMutex = Mutex_Create();
+	sLog.pChanged = ConditionVariable_Create();
+	sLog.stopping = FALSE;
+	sLog.running = TRUE;
+	sLog.pWriterThread = Thread_Create(Log_WriterMain, NULL);
+}
+
+/*!
+ * \brief	writes everything still queued and stops the writer thread
+ *
+ * Nothing may be logging from another thread anymore.
+ */
+void Log_Shutdown(void) {
+	assert(sLog.running && "the log isn't running");
+
+	Mutex_Lock(sLog.pMutex);
+	sLog.stopping = TRUE;
+	ConditionVariable_WakeAll(sLog.pChanged);
+	Mutex_Unlock(sLog.pMutex);
+	Thread_Join(sLog.pWriterThread);
+	sLog.pWriterThread = NULL;
+
+	sLog.running = FALSE;
+	ConditionVariable_Destroy(sLog.pChanged);
+	sLog.pChanged = NULL;
+	Mutex_Destroy(sLog.pMutex);
+	sLog.pMutex = NULL;
+	SAFE_FREE(sLog.paQueue);
+}
+
+void Log_SetMinSeverity(LogSeverity minSeverity) {
+	assert(minSeverity < LOG_SEVERITY_COUNT);
+
+	if (sLog.running) {
+		Mutex_Lock(sLog.pMutex);
+	}
+	sLog.minSeverity = minSeverity;
+	if (sLog.running) {
+		Mutex_Unlock(sLog.pMutex);
+	}
+}
+
+/*!
+ * \brief	has every message from now on handed to \a sink as well
+ *
+ * \param	pUserData passed to \a sink, has to stay valid until it's removed
+ * \return	FALSE if there are LOG_MAX_SINKS already
+ */
+BOOL Log_AddSink(LogSink sink, void* pUserData) {
+	assert(sink);
+
+	if (sLog.running) {
+		Mutex_Lock(sLog.pMutex);
+	}
+	BOOL added = sLog.sinkCount < LOG_MAX_SINKS;
+	if (added) {
+		sLog.aSinks[sLog.sinkCount].sink = sink;
+		sLog.aSinks[sLog.sinkCount].pUserData = pUserData;
+		sLog.sinkCount++;
+	}
+	if (sLog.running) {
+		Mutex_Unlock(sLog.pMutex);
+	}
+	return added;
+}
+
+/*!
+ * \brief	stops handing messages to a sink added with the same arguments
+ *
+ * Messages already taken by the writer may still reach it, Log_Flush first if
+ * \a pUserData is about to go away.
+ */
+void Log_RemoveSink(LogSink sink, void* pUserData) {
+	assert(sink);
+
+	if (sLog.running) {
+		Mutex_Lock(sLog.pMutex);
+	}
+	for (uint32_t i = 0; i < sLog.sinkCount; i++) {
+		if (sLog.aSinks[i].sink == sink && sLog.aSinks[i].pUserData == pUserData) {
+			sLog.aSinks[i] = sLog.aSinks[--sLog.sinkCount];
+			break;
+		}
+	}
+	if (sLog.running) {
+		Mutex_Unlock(sLog.pMutex);
+	}
+}
+
+/*!
+ * \brief	logs a printf style message, without a trailing newline
+ *
+ * Safe to call from any thread. Only blocks for as long as it takes to copy
+ * the message into the queue, except for LOG_SEVERITY_FATAL.
+ *
+ * \param	szCategory what the message is about, has to outlive the log
+ */
+void Log_Write(LogSeverity severity, const char* szCategory, const char* szFormat, ...) {
+	assert(severity < LOG_SEVERITY_COUNT);
+	assert(szCategory);
+	assert(szFormat);
+
+	LogMessage message;
+	message.severity = severity;
+	message.szCategory = szCategory;
+	message.time = GetTimeMicroseconds();
+
+	va_list arguments;
+	va_start(arguments, szFormat);
+	vsnprintf(message.szText, sizeof(message.szText), szFormat, arguments);
+	va_end(arguments);
+
+	if (!sLog.running) {
+		if (severity >= sLog.minSeverity) {
+			Log_WriteToSinks(sLog.aSinks, sLog.sinkCount, &message);
+		}
+		return;
+	}
+
+	if (severity == LOG_SEVERITY_FATAL) {
+		// after everything before it, and without waiting on the writer for it
+		if (!tIsLogWriter) {
+			Log_Flush();
+		}
+		Mutex_Lock(sLog.pMutex);
+		LogSinkEntry aSinks[LOG_MAX_SINKS];
+		uint32_t sinkCount = sLog.sinkCount;
+		memcpy(aSinks, sLog.aSinks, sizeof(aSinks));
+		Mutex_Unlock(sLog.pMutex);
+		Log_WriteToSinks(aSinks, sinkCount, &message);
+		return;
+	}
+
+	Mutex_Lock(sLog.pMutex);
+	if (severity < sLog.minSeverity) {
+		Mutex_Unlock(sLog.pMutex);
+		return;
+	}
+
+	uint64_t now = message.time;
+	if (now - sLog.rateWindowStart >= 1000000) {
+		sLog.rateWindowStart = now;
+		sLog.rateWindowCount = 0;
+	}
+	if (sLog.rateWindowCount >= LOG_MAX_MESSAGES_PER_SECOND
+		|| sLog.queueCount == LOG_QUEUE_LENGTH) {
+		sLog.droppedCount++;
+		Mutex_Unlock(sLog.pMutex);
+		return;
+	}
+	sLog.rateWindowCount++;
+
+	uint32_t index = (sLog.queueStart + sLog.queueCount++) % LOG_QUEUE_LENGTH;
+	sLog.paQueue[index] = message;
+	ConditionVariable_WakeAll(sLog.pChanged);
+	Mutex_Unlock(sLog.pMutex);
+}
+
+/*!
+ * \brief	waits until every message queued so far has been written
+ */
+void Log_Flush(void) {
+	if (!sLog.running) {
+		return;
+	}
+	assert(!tIsLogWriter && "the writer can't wait for itself");
+
+	Mutex_Lock(sLog.pMutex);
+	while (sLog.queueCount > 0 || sLog.writingCount > 0) {
+		ConditionVariable_Wait(sLog.pChanged, sLog.pMutex);
+	}
+	Mutex_Unlock(sLog.pMutex);
+}
+
+/*!
+ * \brief	formats \a pMessage as one line, ending in a newline
+ */
+void Log_FormatMessage(const LogMessage* pMessage, char* szLineOut, size_t lineSize) {
+	assert(pMessage);
+	assert(szLineOut);
+
+	snprintf(
+		szLineOut,
+		lineSize,
+		"%10.3f %-7s %s: %s\n",
+		(double)pMessage->time / 1000000.0,
+		aszLogSeverityNames[pMessage->severity],
+		pMessage->szCategory,
+		pMessage->szText);
+}
+
+// writes to the debugger output, or stderr where there is no such thing
+void LogSink_Debugger(void* pUserData, const LogMessage* pMessage) {
+	char szLine[LOG_MAX_MESSAGE_LENGTH + 64];
+	Log_FormatMessage(pMessage, szLine, sizeof(szLine));
+	DebugPrint(szLine);
+}
+
+// writes to the FILE* it's added with, such as stderr or an open log file
+void LogSink_Stream(void* pFile, const LogMessage* pMessage) {
+	assert(pFile);
+
+	char szLine[LOG_MAX_MESSAGE_LENGTH + 64];
+	Log_FormatMessage(pMessage, szLine, sizeof(szLine));
+	fputs(szLine, (FILE*)pFile);
+	// it may be all that's left of a crash
+	if (pMessage->severity >= LOG_SEVERITY_ERROR) {
+		fflush((FILE*)pFile);
+	}
+}
+
+/*!
+ * \brief	creates a ring that keeps the last \a capacity messages
+ */
+LogRing* LogRing_Create(uint32_t capacity) {
+	assert(capacity > 0);
+
+	LogRing* pLogRing = (LogRing*)malloc(sizeof(LogRing));
+	memset(pLogRing, 0, sizeof(LogRing));
+
+	pLogRing->pMutex = Mutex_Create();
+	pLogRing->capacity = capacity;
+	pLogRing->paMessages = SAFE_ALLOCATE_ARRAY(LogMessage, capacity);
+
+	return pLogRing;
+}
+
+// the ring has to be removed from the log first
+void LogRing_Destroy(LogRing* pThis) {
+	assert(pThis);
+
+	Mutex_Destroy(pThis->pMutex);
+	SAFE_FREE(pThis->paMessages);
+	free(pThis);
+}
+
+// keeps the message in the LogRing it's added with, pushing out the oldest
+void LogSink_Ring(void* pRing, const LogMessage* pMessage) {
+	assert(pRing);
+
+	LogRing* pThis = (LogRing*)pRing;
+	Mutex_Lock(pThis->pMutex);
+	uint32_t index;
+	if (pThis->count < pThis->capacity) {
+		index = (pThis->start + pThis->count++) % pThis->capacity;
+	}
+	else {
+		index = pThis->start;
+		pThis->start = (pThis->start + 1) % pThis->capacity;
+	}
+	pThis->paMessages[index] = *pMessage;
+	Mutex_Unlock(pThis->pMutex);
+}
+
+/*!
+ * \brief	writes the messages in the ring to \a pFile, oldest first
+ * \return	FALSE if writing failed
+ */
+BOOL LogRing_Write(LogRing* pThis, FILE* pFile) {
+	assert(pThis);
+	assert(pFile);
+
+	char szLine[LOG_MAX_MESSAGE_LENGTH + 64];
+	Mutex_Lock(pThis->pMutex);
+	for (uint32_t i = 0; i < pThis->count; i++) {
+		Log_FormatMessage(
+			&pThis->paMessages[(pThis->start + i) % pThis->capacity],
+			szLine,
+			sizeof(szLine));
+		fputs(szLine, pFile);
+	}
+	Mutex_Unlock(pThis->pMutex);
+
+	return fflush(pFile) == 0 && !ferror(pFile);
+}
+
+// Private Interface!
+
+// takes messages from the queue in batches and writes them outside the lock
+void Log_WriterMain(void* pUserData) {
+	tIsLogWriter = TRUE;
+
+	LogMessage aBatch[LOG_WRITE_BATCH];
+	LogSinkEntry aSinks[LOG_MAX_SINKS];
+	uint32_t sinkCount = 0;
+
+	Mutex_Lock(sLog.pMutex);
+	for (;;) {
+		while (sLog.queueCount == 0 && !sLog.stopping) {
+			ConditionVariable_Wait(sLog.pChanged, sLog.pMutex);
+		}
+		if (sLog.queueCount == 0 && sLog.droppedCount == 0) {
+			break;
+		}
+
+		uint32_t batchCount = sLog.queueCount < LOG_WRITE_BATCH ? sLog.queueCount : LOG_WRITE_BATCH;
+		for (uint32_t i = 0; i < batchCount; i++) {
+			aBatch[i] = sLog.paQueue[(sLog.queueStart + i) % LOG_QUEUE_LENGTH];
+		}
+		sLog.queueStart = (sLog.queueStart + batchCount) % LOG_QUEUE_LENGTH;
+		sLog.queueCount -= batchCount;
+		sLog.writingCount = batchCount;
+		uint32_t droppedCount = sLog.droppedCount;
+		sLog.droppedCount = 0;
+		sinkCount = sLog.sinkCount;
+		memcpy(aSinks, sLog.aSinks, sizeof(aSinks));
+		Mutex_Unlock(sLog.pMutex);
+
+		for (uint32_t i = 0; i < batchCount; i++) {
+			if (!Log_IsRepeat(aSinks, sinkCount, &aBatch[i])) {
+				Log_WriteToSinks(aSinks, sinkCount, &aBatch[i]);
+			}
+		}
+
+		// roughly where the messages went missing
+		if (droppedCount > 0) {
+			LogMessage dropped;
+			dropped.severity = LOG_SEVERITY_WARNING;
+			dropped.szCategory = "log";
+			dropped.time = GetTimeMicroseconds();
+			snprintf(
+				dropped.szText,
+				sizeof(dropped.szText),
+				"dropped %u messages, over %d a second or the queue was full",
+				droppedCount,
+				LOG_MAX_MESSAGES_PER_SECOND);
+			Log_WriteToSinks(aSinks, sinkCount, &dropped);
+		}
+
+		Mutex_Lock(sLog.pMutex);
+		sLog.writingCount = 0;
+		ConditionVariable_WakeAll(sLog.pChanged);
+	}
+	Mutex_Unlock(sLog.pMutex);
+
+	// whatever was held back is still worth knowing about
+	for (uint32_t i = 0; i < LOG_REPEAT_ENTRIES; i++) {
+		Log_WriteRepeatSummary(aSinks, sinkCount, &sLog.aRepeats[i]);
+	}
+}
+
+void Log_WriteToSinks(const LogSinkEntry* aSinks, uint32_t sinkCount, const LogMessage* pMessage) {
+	if (sinkCount == 0) {
+		LogSink_Debugger(NULL, pMessage);
+		return;
+	}
+	for (uint32_t i = 0; i < sinkCount; i++) {
+		aSinks[i].sink(aSinks[i].pUserData, pMessage);
+	}
+}
+
+/*!
+ * \brief	TRUE if \a pMessage was written less than LOG_REPEAT_INTERVAL ago
+ *
+ * Otherwise it's remembered as written, and if it was held back meanwhile how
+ * often is written first.
+ */
+BOOL Log_IsRepeat(const LogSinkEntry* aSinks, uint32_t sinkCount, const LogMessage* pMessage) {
+	uint32_t hash = Log_HashMessage(pMessage);
+
+	LogRepeatEntry* pOldest = &sLog.aRepeats[0];
+	for (uint32_t i = 0; i < LOG_REPEAT_ENTRIES; i++) {
+		LogRepeatEntry* pEntry = &sLog.aRepeats[i];
+		if (pEntry->hash == hash
+			&& pEntry->message.severity == pMessage->severity
+			&& strcmp(pEntry->message.szText, pMessage->szText) == 0) {
+			if (pMessage->time - pEntry->writtenTime < LOG_REPEAT_INTERVAL) {
+				pEntry->repeatCount++;
+				return TRUE;
+			}
+			Log_WriteRepeatSummary(aSinks, sinkCount, pEntry);
+			pEntry->writtenTime = pMessage->time;
+			pEntry->message = *pMessage;
+			return FALSE;
+		}
+		if (pEntry->writtenTime < pOldest->writtenTime) {
+			pOldest = pEntry;
+		}
+	}
+
+	Log_WriteRepeatSummary(aSinks, sinkCount, pOldest);
+	pOldest->hash = hash;
+	pOldest->writtenTime = pMessage->time;
+	pOldest->repeatCount = 0;
+	pOldest->message = *pMessage;
+	return FALSE;
+}
+
+// writes how often the entry's message was held back, if it was at all
+void Log_WriteRepeatSummary(
+	const LogSinkEntry* aSinks,
+	uint32_t sinkCount,
+	LogRepeatEntry* pEntry) {
+	if (pEntry->repeatCount == 0) {
+		return;
+	}
+
+	LogMessage summary;
+	summary.severity = pEntry->message.severity;
+	summary.szCategory = pEntry->message.szCategory;
+	summary.time = pEntry->message.time;
+	snprintf(
+		summary.szText,
+		sizeof(summary.szText),
+		"repeated %u more times: %.*s",
+		pEntry->repeatCount,
+		LOG_SUMMARY_TEXT_LENGTH,
+		pEntry->message.szText);
+	Log_WriteToSinks(aSinks, sinkCount, &summary);
+	pEntry->repeatCount = 0;
+}
+
+// FNV-1a over the text
+uint32_t Log_HashMessage(const LogMessage* pMessage) {
+	uint32_t hash = 2166136261u;
+	for (const char* pCharacter = pMessage->szText; *pCharacter; pCharacter++) {
+		hash = (hash ^ (uint8_t)*pCharacter) * 16777619u;
+	}
+	return hash;
+}
@@ -0,0 +1,89 @@
+#ifndef __LOG_H
+#define __LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * The process wide log.
+ *
+ * Once Log_Initialize has started it, Log_Write only formats the message and
+ * copies it into a queue, a writer thread hands it to the sinks. Messages
+ * below the minimum severity are dropped, as is everything beyond
+ * LOG_MAX_MESSAGES_PER_SECOND or what doesn't fit in the queue, and the
+ * writer reports how many were lost. A message repeated within
+ * LOG_REPEAT_INTERVAL is written once, then counted until it comes up again
+ * after the interval.
+ *
+ * Before Log_Initialize and after Log_Shutdown every message is written
+ * straight away on the calling thread. Without any sinks added messages go to
+ * LogSink_Debugger.
+ */
+
+typedef enum log_severity_t {
+	LOG_SEVERITY_DEBUG,
+	LOG_SEVERITY_INFO,
+	LOG_SEVERITY_WARNING,
+	LOG_SEVERITY_ERROR,
+	// never filtered or dropped, and written before Log_Write returns since
+	// the process is about to end
+	LOG_SEVERITY_FATAL,
+	LOG_SEVERITY_COUNT,
+} LogSeverity;
+
+// longer messages are cut short
+#define LOG_MAX_MESSAGE_LENGTH 512
+// how many messages can wait for the writer
+#define LOG_QUEUE_LENGTH 256
+#define LOG_MAX_MESSAGES_PER_SECOND 200
+// in microseconds
+#define LOG_REPEAT_INTERVAL 1000000
+#define LOG_MAX_SINKS 4
+
+typedef struct log_message_t {
+	LogSeverity severity;
+	// what the message is about, a string that outlives the log
+	const char* szCategory;
+	// GetTimeMicroseconds when it was logged
+	uint64_t time;
+	char szText[LOG_MAX_MESSAGE_LENGTH];
+} LogMessage;
+
+/*!
+ * Receives every message that gets through. Only ever called on one thread at
+ * a time, the writer's once the log is started.
+ */
+typedef void (*LogSink)(void* pUserData, const LogMessage* pMessage);
+
+void Log_Initialize(LogSeverity minSeverity);
+void Log_Shutdown(void);
+void Log_SetMinSeverity(LogSeverity minSeverity);
+BOOL Log_AddSink(LogSink sink, void* pUserData);
+void Log_RemoveSink(LogSink sink, void* pUserData);
+
+void Log_Write(LogSeverity severity, const char* szCategory, const char* szFormat, ...);
+void Log_Flush(void);
+
+void Log_FormatMessage(const LogMessage* pMessage, char* szLineOut, size_t lineSize);
+
+// sinks, see Log_AddSink
+void LogSink_Debugger(void* pUserData, const LogMessage* pMessage);
+void LogSink_Stream(void* pFile, const LogMessage* pMessage);
+
+/*!
+ * Keeps the most recent messages in memory, to be written out after a crash.
+ * Add it with LogSink_Ring.
+ */
+typedef struct log_ring_t LogRing;
+
+LogRing* LogRing_Create(uint32_t capacity);
+void LogRing_Destroy(LogRing* pThis);
+void LogSink_Ring(void* pRing, const LogMessage* pMessage);
+BOOL LogRing_Write(LogRing* pThis, FILE* pFile);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__LOG_H
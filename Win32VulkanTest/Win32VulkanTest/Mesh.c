@@ -0,0 +1,323 @@
+#include "stdafx.h"
+#include "Mesh.h"
+
+#include "MemoryUtils.h"
+#include "Utils.h"
+
+struct mesh_t {
+	VkDevice device;
+	DeviceMemoryAllocator* pMemoryAllocator;
+	UploadManager* pUploadManager;
+
+	// vertices first, then the indices from indexOffset
+	VkBuffer buffer;
+	DeviceMemoryAllocation memory;
+	VkDeviceSize indexOffset;
+	VkIndexType indexType;
+	uint32_t indexCount;
+
+	// kept so the buffer can be filled again on a new device, see Mesh_Recreate
+	uint8_t* pEncodedData;
+	VkDeviceSize encodedSize;
+
+	UploadTicket uploadTicket;
+	BOOL ready;
+
+	// column major, written into the mesh's uniform block every frame
+	float modelView[16];
+	// picks the pipeline the mesh is drawn with
+	RenderState renderState;
+	// dynamic state, so any value costs no extra pipelines
+	float depthBiasConstantFactor;
+	float depthBiasSlopeFactor;
+};
+
+void Mesh_CreateResources(
+	Mesh* pThis,
+	VkDevice device,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	UploadManager* pUploadManager);
+
+/*!
+ * \brief	creates a mesh and queues its upload
+ *
+ * The format's index type is only a preference, meshes with too many vertices
+ * for 16 bit indices get 32 bit ones. The encoded vertices and indices are
+ * kept in host memory for as long as the mesh lives.
+ *
+ * \param	pUploadManager fills the mesh, resources are shared with its queue
+ * \param	pVertexFormat how the vertices and indices are stored on the gpu
+ * \param	paVertices the vertices at full precision, only needed during this call
+ * \param	paIndices three per triangle, only needed during this call
+ */
+Mesh* Mesh_Create(
+	VkDevice device,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	UploadManager* pUploadManager,
+	const VertexFormat* pVertexFormat,
+	const Vertex* paVertices,
+	uint32_t vertexCount,
+	const uint32_t* paIndices,
+	uint32_t indexCount) {
+	assert(device);
+	assert(pMemoryAllocator);
+	assert(pUploadManager);
+	assert(pVertexFormat);
+	assert(paVertices);
+	assert(vertexCount > 0);
+	assert(paIndices);
+	assert(indexCount > 0);
+
+	Mesh* pMesh = (Mesh*)malloc(sizeof(Mesh));
+	memset(pMesh, 0, sizeof(Mesh));
+
+	for (uint32_t i = 0; i < 4; i++) {
+		pMesh->modelView[i * 4 + i] = 1.0f;
+	}
+	pMesh->renderState = kRenderStateOpaque;
+
+	pMesh->indexCount = indexCount;
+	pMesh->indexType = pVertexFormat->indexType;
+	if (vertexCount > (uint32_t)UINT16_MAX + 1) {
+		pMesh->indexType = VK_INDEX_TYPE_UINT32;
+	}
+
+	// index buffer offsets have to be a multiple of the index size
+	VkDeviceSize vertexBytes = (VkDeviceSize)vertexCount * VertexFormat_GetStride(pVertexFormat);
+	VkDeviceSize indexSize = VertexFormat_GetIndexSize(pMesh->indexType);
+	pMesh->indexOffset = (vertexBytes + indexSize - 1) / indexSize * indexSize;
+	pMesh->encodedSize = pMesh->indexOffset + indexCount * indexSize;
+
+	// encoded once on the cpu, the upload manager copies it on to the staging ring
+	pMesh->pEncodedData = (uint8_t*)malloc((size_t)pMesh->encodedSize);
+	assert(pMesh->pEncodedData);
+	VertexFormat_EncodeVertices(pVertexFormat, paVertices, vertexCount, pMesh->pEncodedData);
+	memset(
+		pMesh->pEncodedData + vertexBytes,
+		0,
+		(size_t)(pMesh->indexOffset - vertexBytes));
+	VertexFormat_EncodeIndices(
+		pMesh->indexType,
+		paIndices,
+		indexCount,
+		pMesh->pEncodedData + pMesh->indexOffset);
+
+	Mesh_CreateResources(pMesh, device, pMemoryAllocator, pUploadManager);
+
+	return pMesh;
+}
+
+/*!
+ * \brief	destroys the mesh, which the gpu must have finished drawing
+ */
+void Mesh_Destroy(Mesh* pThis) {
+	assert(pThis);
+
+	Mesh_FreeResources(pThis);
+	SAFE_FREE(pThis->pEncodedData);
+
+	free(pThis);
+}
+
+/*!
+ * \brief	destroys the mesh's buffer but keeps what it was filled with, so the
+ *			device it was made on can be destroyed
+ *
+ * The mesh can't be drawn again until Mesh_Recreate. Does nothing if it
+ * already has no buffer.
+ */
+void Mesh_FreeResources(Mesh* pThis) {
+	assert(pThis);
+
+	if (!pThis->buffer) {
+		return;
+	}
+
+	// the upload may still be writing to the buffer
+	if (!pThis->ready) {
+		UploadManager_Wait(pThis->pUploadManager, pThis->uploadTicket);
+	}
+
+	vkDestroyBuffer(pThis->device, pThis->buffer, NULL);
+	pThis->buffer = VK_NULL_HANDLE;
+	DeviceMemoryAllocator_Free(pThis->pMemoryAllocator, &pThis->memory);
+
+	pThis->device = VK_NULL_HANDLE;
+	pThis->pMemoryAllocator = NULL;
+	pThis->pUploadManager = NULL;
+	pThis->ready = FALSE;
+}
+
+/*!
+ * \brief	gives a mesh freed by Mesh_FreeResources a new buffer and queues
+ *			its upload, usually on a device created after the old one was lost
+ *
+ * The new device has to support the VertexFormat the mesh was created with.
+ */
+void Mesh_Recreate(
+	Mesh* pThis,
+	VkDevice device,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	UploadManager* pUploadManager) {
+	assert(pThis);
+	assert(!pThis->buffer);
+
+	Mesh_CreateResources(pThis, device, pMemoryAllocator, pUploadManager);
+}
+
+/*!
+ * \brief	checks whether the mesh's upload has finished, without blocking
+ */
+BOOL Mesh_IsReady(Mesh* pThis) {
+	assert(pThis);
+
+	if (!pThis->ready) {
+		pThis->ready = UploadManager_IsComplete(pThis->pUploadManager, pThis->uploadTicket);
+	}
+	return pThis->ready;
+}
+
+/*!
+ * \brief	sets the column major model view matrix the mesh is drawn with,
+ *			identity until this is called
+ */
+void Mesh_SetTransform(Mesh* pThis, const float* pModelView) {
+	assert(pThis);
+	assert(pModelView);
+
+	memcpy(pThis->modelView, pModelView, sizeof(pThis->modelView));
+}
+
+const float* Mesh_GetTransform(const Mesh* pThis) {
+	assert(pThis);
+
+	return pThis->modelView;
+}
+
+/*!
+ * \brief	sets the state the mesh's pipeline is built with,
+ *			kRenderStateOpaque until this is called
+ *
+ * The mesh is drawn opaque until a pipeline for the new state has been built.
+ */
+void Mesh_SetRenderState(Mesh* pThis, const RenderState* pRenderState) {
+	assert(pThis);
+	assert(pRenderState);
+
+	pThis->renderState = *pRenderState;
+}
+
+const RenderState* Mesh_GetRenderState(const Mesh* pThis) {
+	assert(pThis);
+
+	return &pThis->renderState;
+}
+
+/*!
+ * \brief	offsets the depth the mesh is drawn at, as vkCmdSetDepthBias
+ *			would, none until this is called
+ *
+ * For decals and shadow casters, which would otherwise fight with the
+ * surfaces under them.
+ */
+void Mesh_SetDepthBias(Mesh* pThis, float constantFactor, float slopeFactor) {
+	assert(pThis);
+
+	pThis->depthBiasConstantFactor = constantFactor;
+	pThis->depthBiasSlopeFactor = slopeFactor;
+}
+
+void Mesh_GetDepthBias(
+	const Mesh* pThis,
+	float* pConstantFactorOut,
+	float* pSlopeFactorOut) {
+	assert(pThis);
+	assert(pConstantFactorOut);
+	assert(pSlopeFactorOut);
+
+	*pConstantFactorOut = pThis->depthBiasConstantFactor;
+	*pSlopeFactorOut = pThis->depthBiasSlopeFactor;
+}
+
+/*!
+ * \brief	binds the mesh and draws all of it
+ *
+ * The pipeline bound to \a commandBuffer has to have been built for the
+ * mesh's VertexFormat.
+ */
+void Mesh_RecordDraw(const Mesh* pThis, VkCommandBuffer commandBuffer) {
+	assert(pThis);
+	assert(pThis->ready);
+	assert(commandBuffer);
+
+	VkDeviceSize vertexOffset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &pThis->buffer, &vertexOffset);
+	vkCmdBindIndexBuffer(commandBuffer, pThis->buffer, pThis->indexOffset, pThis->indexType);
+	vkCmdDrawIndexed(commandBuffer, pThis->indexCount, 1, 0, 0, 0);
+}
+
+// Private Interface!
+
+// creates the buffer on \a device and uploads pEncodedData into it
+void Mesh_CreateResources(
+	Mesh* pThis,
+	VkDevice device,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	UploadManager* pUploadManager) {
+	assert(device);
+	assert(pMemoryAllocator);
+	assert(pUploadManager);
+
+	pThis->device = device;
+	pThis->pMemoryAllocator = pMemoryAllocator;
+	pThis->pUploadManager = pUploadManager;
+	pThis->ready = FALSE;
+
+	uint32_t aQueueFamilyIndices[2];
+	uint32_t queueFamilyCount = UploadManager_GetQueueFamilyIndices(
+		pUploadManager,
+		aQueueFamilyIndices);
+
+	VkBufferCreateInfo bufferCreateInfo = { 0 };
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = NULL;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = pThis->encodedSize;
+	bufferCreateInfo.usage
+		= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+		| VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if (queueFamilyCount > 1) {
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferCreateInfo.queueFamilyIndexCount = queueFamilyCount;
+		bufferCreateInfo.pQueueFamilyIndices = aQueueFamilyIndices;
+	}
+	else {
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = 0;
+		bufferCreateInfo.pQueueFamilyIndices = NULL;
+	}
+
+	REQUIRE_VK_SUCCESS(
+		vkCreateBuffer(
+			device,
+			&bufferCreateInfo,
+			NULL,
+			&pThis->buffer)
+	);
+
+	REQUIRE(
+		DeviceMemoryAllocator_AllocateForBuffer(
+			pMemoryAllocator,
+			pThis->buffer,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&pThis->memory),
+		"out of memory for a mesh");
+
+	pThis->uploadTicket = UploadManager_UploadToBuffer(
+		pUploadManager,
+		pThis->buffer,
+		0,
+		pThis->pEncodedData,
+		pThis->encodedSize);
+}
@@ -0,0 +1,57 @@
+#ifndef __MESH_H
+#define __MESH_H
+
+#include "DeviceMemoryAllocator.h"
+#include "PipelineManager.h"
+#include "UploadManager.h"
+#include "VertexFormat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Indexed geometry in device local memory, encoded in a VertexFormat.
+ *
+ * Vertices and indices share one buffer that's filled through an
+ * UploadManager, so a mesh can't be drawn until Mesh_IsReady. The encoded
+ * data stays in host memory too, so the mesh can move to a new device if its
+ * own is lost.
+ */
+typedef struct mesh_t Mesh;
+
+Mesh* Mesh_Create(
+	VkDevice device,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	UploadManager* pUploadManager,
+	const VertexFormat* pVertexFormat,
+	const Vertex* paVertices,
+	uint32_t vertexCount,
+	const uint32_t* paIndices,
+	uint32_t indexCount);
+void Mesh_Destroy(Mesh* pThis);
+
+void Mesh_FreeResources(Mesh* pThis);
+void Mesh_Recreate(
+	Mesh* pThis,
+	VkDevice device,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	UploadManager* pUploadManager);
+
+BOOL Mesh_IsReady(Mesh* pThis);
+void Mesh_SetTransform(Mesh* pThis, const float* pModelView);
+const float* Mesh_GetTransform(const Mesh* pThis);
+void Mesh_SetRenderState(Mesh* pThis, const RenderState* pRenderState);
+const RenderState* Mesh_GetRenderState(const Mesh* pThis);
+void Mesh_SetDepthBias(Mesh* pThis, float constantFactor, float slopeFactor);
+void Mesh_GetDepthBias(
+	const Mesh* pThis,
+	float* pConstantFactorOut,
+	float* pSlopeFactorOut);
+void Mesh_RecordDraw(const Mesh* pThis, VkCommandBuffer commandBuffer);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__MESH_H
@@ -0,0 +1,272 @@
+#include "stdafx.h"
+#include "PipelineCache.h"
+
+#include "MemoryUtils.h"
+#include "Utils.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif//_WIN32
+
+// VkPipelineCacheHeaderVersionOne as laid out in the cache data
+#define HEADER_SIZE 32
+#define HEADER_LENGTH_OFFSET 0
+#define HEADER_VERSION_OFFSET 4
+#define HEADER_VENDOR_ID_OFFSET 8
+#define HEADER_DEVICE_ID_OFFSET 12
+#define HEADER_UUID_OFFSET 16
+
+struct pipeline_cache_t {
+	VkDevice device;
+	VkPipelineCache pipelineCache;
+
+	char* szFilePath;
+	VkPhysicalDeviceProperties deviceProperties;
+
+	// what's on disk, so saving can be skipped when nothing was added
+	size_t savedDataSize;
+	void* pSavedData;
+};
+
+void* PipelineCache_ReadFile(const char* szFilePath, size_t* pSizeOut);
+BOOL PipelineCache_WriteFile(const char* szFilePath, const void* pData, size_t size);
+BOOL PipelineCache_HeaderMatchesDevice(
+	const PipelineCache* pThis,
+	const uint8_t* pData,
+	size_t size);
+uint32_t ReadLittleEndian32(const uint8_t* pBytes);
+
+/*!
+ * \brief	creates a pipeline cache, seeded from \a szFilePath if it was saved
+ *			by the same device and driver
+ *
+ * \param	szFilePath where the cache is loaded from and saved to (copied)
+ */
+PipelineCache* PipelineCache_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	const char* szFilePath) {
+	assert(physicalDevice);
+	assert(device);
+	assert(szFilePath);
+
+	PipelineCache* pPipelineCache = (PipelineCache*)malloc(sizeof(PipelineCache));
+	memset(pPipelineCache, 0, sizeof(PipelineCache));
+
+	pPipelineCache->device = device;
+	pPipelineCache->szFilePath = _strdup(szFilePath);
+	vkGetPhysicalDeviceProperties(physicalDevice, &pPipelineCache->deviceProperties);
+
+	size_t fileSize = 0;
+	void* pFileData = PipelineCache_ReadFile(szFilePath, &fileSize);
+	if (pFileData && !PipelineCache_HeaderMatchesDevice(pPipelineCache, pFileData, fileSize)) {
+		Log_Write(
+			LOG_SEVERITY_INFO,
+			"pipeline cache",
+			"the cache is from another device or driver, ignoring it");
+		SAFE_FREE(pFileData);
+		fileSize = 0;
+	}
+
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = { 0 };
+	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.pNext = NULL;
+	pipelineCacheCreateInfo.flags = 0;
+	pipelineCacheCreateInfo.initialDataSize = fileSize;
+	pipelineCacheCreateInfo.pInitialData = pFileData;
+
+	VkResult result = vkCreatePipelineCache(
+		device,
+		&pipelineCacheCreateInfo,
+		NULL,
+		&pPipelineCache->pipelineCache);
+	if (result != VK_SUCCESS && pFileData) {
+		// the driver didn't like the contents after all, start over empty
+		SAFE_FREE(pFileData);
+		fileSize = 0;
+		pipelineCacheCreateInfo.initialDataSize = 0;
+		pipelineCacheCreateInfo.pInitialData = NULL;
+		result = vkCreatePipelineCache(
+			device,
+			&pipelineCacheCreateInfo,
+			NULL,
+			&pPipelineCache->pipelineCache);
+	}
+	REQUIRE_VK_SUCCESS(result);
+
+	pPipelineCache->pSavedData = pFileData;
+	pPipelineCache->savedDataSize = fileSize;
+
+	return pPipelineCache;
+}
+
+/*!
+ * \brief	destroys the cache without saving it, see PipelineCache_Save
+ */
+void PipelineCache_Destroy(PipelineCache* pThis) {
+	assert(pThis);
+
+	vkDestroyPipelineCache(pThis->device, pThis->pipelineCache, NULL);
+	SAFE_FREE(pThis->pSavedData);
+	SAFE_FREE(pThis->szFilePath);
+
+	free(pThis);
+}
+
+VkPipelineCache PipelineCache_GetHandle(const PipelineCache* pThis) {
+	assert(pThis);
+
+	return pThis->pipelineCache;
+}
+
+/*!
+ * \brief	writes the cache to its file, unless it hasn't changed since it
+ *			was loaded or last saved
+ *
+ * \return	TRUE if the file holds the current contents of the cache
+ */
+BOOL PipelineCache_Save(PipelineCache* pThis) {
+	assert(pThis);
+
+	size_t dataSize = 0;
+	REQUIRE_VK_SUCCESS(
+		vkGetPipelineCacheData(pThis->device, pThis->pipelineCache, &dataSize, NULL)
+	);
+	if (dataSize == 0) {
+		return FALSE;
+	}
+
+	void* pData = malloc(dataSize);
+	assert(pData);
+	REQUIRE_VK_SUCCESS(
+		vkGetPipelineCacheData(pThis->device, pThis->pipelineCache, &dataSize, pData)
+	);
+
+	if (dataSize == pThis->savedDataSize
+		&& memcmp(pData, pThis->pSavedData, dataSize) == 0) {
+
+		free(pData);
+		return TRUE;
+	}
+
+	if (!PipelineCache_WriteFile(pThis->szFilePath, pData, dataSize)) {
+		Log_Write(LOG_SEVERITY_WARNING, "pipeline cache", "failed to save the cache");
+		free(pData);
+		return FALSE;
+	}
+
+	SAFE_FREE(pThis->pSavedData);
+	pThis->pSavedData = pData;
+	pThis->savedDataSize = dataSize;
+	return TRUE;
+}
+
+// Private Interface!
+
+/*!
+ * \brief	reads all of \a szFilePath
+ * \return	the contents, to be freed by the caller, or NULL if there's no file
+ */
+void* PipelineCache_ReadFile(const char* szFilePath, size_t* pSizeOut) {
+	FILE* pFile = NULL;
+	if (fopen_s(&pFile, szFilePath, "rb") != 0 || !pFile) {
+		return NULL;
+	}
+
+	fseek(pFile, 0, SEEK_END);
+	long fileLength = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	void* pData = NULL;
+	if (fileLength > 0) {
+		pData = malloc((size_t)fileLength);
+		assert(pData);
+		if (fread(pData, (size_t)fileLength, 1, pFile) != 1) {
+			SAFE_FREE(pData);
+		}
+	}
+	fclose(pFile);
+
+	*pSizeOut = pData ? (size_t)fileLength : 0;
+	return pData;
+}
+
+/*!
+ * \brief	replaces \a szFilePath with \a pData, all or nothing
+ *
+ * The data is written to a temporary file next to it, flushed to disk and then
+ * renamed over the original.
+ */
+BOOL PipelineCache_WriteFile(const char* szFilePath, const void* pData, size_t size) {
+	size_t filePathLength = strlen(szFilePath);
+	const char szTempExtension[] = ".tmp";
+	char* szTempPath = SAFE_ALLOCATE_ARRAY(char, filePathLength + sizeof(szTempExtension));
+	memcpy(szTempPath, szFilePath, filePathLength);
+	memcpy(szTempPath + filePathLength, szTempExtension, sizeof(szTempExtension));
+
+	FILE* pFile = NULL;
+	if (fopen_s(&pFile, szTempPath, "wb") != 0 || !pFile) {
+		SAFE_FREE(szTempPath);
+		return FALSE;
+	}
+
+	BOOL written = fwrite(pData, size, 1, pFile) == 1 && fflush(pFile) == 0;
+#ifdef _WIN32
+	written = written && _commit(_fileno(pFile)) == 0;
+#else
+	written = written && fsync(fileno(pFile)) == 0;
+#endif//_WIN32
+	written = fclose(pFile) == 0 && written;
+
+	if (written) {
+#ifdef _WIN32
+		// rename won't replace an existing file on windows
+		written = MoveFileExA(szTempPath, szFilePath, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		written = rename(szTempPath, szFilePath) == 0;
+#endif//_WIN32
+	}
+	if (!written) {
+		remove(szTempPath);
+	}
+
+	SAFE_FREE(szTempPath);
+	return written;
+}
+
+/*!
+ * \brief	checks cache data was made by this device and driver
+ */
+BOOL PipelineCache_HeaderMatchesDevice(
+	const PipelineCache* pThis,
+	const uint8_t* pData,
+	size_t size) {
+	if (size < HEADER_SIZE) {
+		return FALSE;
+	}
+
+	uint32_t headerLength = ReadLittleEndian32(pData + HEADER_LENGTH_OFFSET);
+	uint32_t headerVersion = ReadLittleEndian32(pData + HEADER_VERSION_OFFSET);
+	uint32_t vendorID = ReadLittleEndian32(pData + HEADER_VENDOR_ID_OFFSET);
+	uint32_t deviceID = ReadLittleEndian32(pData + HEADER_DEVICE_ID_OFFSET);
+
+	return headerLength >= HEADER_SIZE
+		&& headerLength <= size
+		&& headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& vendorID == pThis->deviceProperties.vendorID
+		&& deviceID == pThis->deviceProperties.deviceID
+		&& memcmp(
+			pData + HEADER_UUID_OFFSET,
+			pThis->deviceProperties.pipelineCacheUUID,
+			VK_UUID_SIZE) == 0;
+}
+
+// the cache header is always little endian, whatever the host is
+uint32_t ReadLittleEndian32(const uint8_t* pBytes) {
+	return (uint32_t)pBytes[0]
+		| ((uint32_t)pBytes[1] << 8)
+		| ((uint32_t)pBytes[2] << 16)
+		| ((uint32_t)pBytes[3] << 24);
+}
@@ -0,0 +1,33 @@
+#ifndef __PIPELINE_CACHE_H
+#define __PIPELINE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * A VkPipelineCache that lives on disk between runs.
+ *
+ * The file is only used if its header matches the device's vendor, device
+ * and pipelineCacheUUID, otherwise the cache starts out empty. Saving writes
+ * a temporary file and renames it over the old one, so a crash mid save never
+ * leaves a truncated cache behind.
+ */
+typedef struct pipeline_cache_t PipelineCache;
+
+#define PIPELINE_CACHE_DEFAULT_PATH "pipeline_cache.bin"
+
+PipelineCache* PipelineCache_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	const char* szFilePath);
+void PipelineCache_Destroy(PipelineCache* pThis);
+
+VkPipelineCache PipelineCache_GetHandle(const PipelineCache* pThis);
+BOOL PipelineCache_Save(PipelineCache* pThis);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__PIPELINE_CACHE_H
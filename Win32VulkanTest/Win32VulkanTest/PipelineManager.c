@@ -0,0 +1,974 @@
+#include "stdafx.h"
+#include "PipelineManager.h"
+
+#include "Log.h"
+#include "MemoryUtils.h"
+#include "Thread.h"
+#include "Utils.h"
+
+// slots in the hash map to start with, always a power of two
+#define INITIAL_SLOT_COUNT 64
+// the map doubles before more than this many tenths of its slots are used
+#define MAX_LOAD_TENTHS 7
+
+// set by every draw instead of being built into the pipelines
+const VkDynamicState kaCoreDynamicStates[] = {
+	VK_DYNAMIC_STATE_VIEWPORT,
+	VK_DYNAMIC_STATE_SCISSOR,
+	VK_DYNAMIC_STATE_DEPTH_BIAS,
+};
+#define CORE_DYNAMIC_STATE_COUNT (sizeof(kaCoreDynamicStates) / sizeof(VkDynamicState))
+// and with extended dynamic state, see PipelineManager_GetKey for what they replace
+const VkDynamicState kaExtendedDynamicStates[] = {
+	VK_DYNAMIC_STATE_CULL_MODE_EXT,
+	VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+	VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+	VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+	VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT,
+};
+#define EXTENDED_DYNAMIC_STATE_COUNT (sizeof(kaExtendedDynamicStates) / sizeof(VkDynamicState))
+
+const RenderState kRenderStateOpaque = {
+	VK_POLYGON_MODE_FILL,
+	VK_CULL_MODE_NONE,
+	VK_TRUE,
+	PIPELINE_BLEND_MODE_OPAQUE,
+};
+
+typedef struct pipeline_entry_t {
+	// only written before the entry is in the map
+	PipelineDescription description;
+	uint64_t hash;
+	PipelineManager* pManager;
+
+	// the rest is guarded by the manager's mutex. VK_NULL_HANDLE until the
+	// first build finishes, or if it failed
+	VkPipeline pipeline;
+	// bumped for each build asked for. a build that finishes after a newer
+	// one has is thrown away
+	uint32_t requestedGeneration;
+	uint32_t finishedGeneration;
+	// a job is building the entry until its requested generation is finished
+	BOOL building;
+	// the last build job, released when the next one starts
+	Job* pBuildJob;
+} PipelineEntry;
+
+// replaced while frames using it may still have been in flight
+typedef struct retired_pipeline_t {
+	uint64_t retiredFrame;
+	VkPipeline pipeline;
+} RetiredPipeline;
+
+struct pipeline_manager_t {
+	VkDevice device;
+	ShaderManager* pShaderManager;
+	PipelineCache* pPipelineCache;
+	JobSystem* pJobSystem;
+	uint32_t frameCount;
+
+	// the commands that set kaExtendedDynamicStates, all NULL without it
+	BOOL extendedDynamicState;
+	PFN_vkCmdSetCullModeEXT pfnCmdSetCullMode;
+	PFN_vkCmdSetFrontFaceEXT pfnCmdSetFrontFace;
+	PFN_vkCmdSetDepthTestEnableEXT pfnCmdSetDepthTestEnable;
+	PFN_vkCmdSetDepthWriteEnableEXT pfnCmdSetDepthWriteEnable;
+	PFN_vkCmdSetDepthCompareOpEXT pfnCmdSetDepthCompareOp;
+
+	// guards everything below
+	Mutex* pMutex;
+	// open addressing with linear probing, NULL slots are empty
+	uint32_t slotCount;
+	uint32_t entryCount;
+	PipelineEntry** papSlots;
+	// set by PipelineManager_StopBuilding, no more builds are started
+	BOOL stopped;
+
+	// what PipelineManager_BeginFrame was last given
+	uint64_t frameNumber;
+	uint32_t retiredCount;
+	uint32_t retiredCapacity;
+	RetiredPipeline* paRetired;
+};
+
+uint64_t PipelineDescription_Hash(const PipelineDescription* pThis);
+
+void PipelineManager_GetKey(
+	const PipelineManager* pThis,
+	const PipelineDescription* pDescription,
+	PipelineDescription* pKeyOut);
+
+uint32_t PipelineManager_FindSlot(
+	const PipelineManager* pThis,
+	const PipelineDescription* pDescription,
+	uint64_t hash);
+PipelineEntry* PipelineManager_FindOrAddEntry(
+	PipelineManager* pThis,
+	const PipelineDescription* pDescription,
+	BOOL* pAddedOut);
+void PipelineManager_Grow(PipelineManager* pThis);
+void PipelineManager_RequestBuild(PipelineManager* pThis, PipelineEntry* pEntry);
+void PipelineManager_BuildJob(void* pUserData);
+void PipelineManager_Install(
+	PipelineManager* pThis,
+	PipelineEntry* pEntry,
+	VkPipeline pipeline,
+	uint32_t generation);
+void PipelineManager_Retire(PipelineManager* pThis, VkPipeline pipeline);
+void PipelineManager_WaitForBuilds(PipelineManager* pThis);
+void PipelineManager_FillBlendAttachment(
+	PipelineBlendMode blendMode,
+	VkPipelineColorBlendAttachmentState* pAttachmentOut);
+
+/*!
+ * \brief	describes a triangle list, counter clockwise front faces, a less or
+ *			equal depth test and kRenderStateOpaque
+ *
+ * Shaders and vertex format are left empty for the caller to fill in.
+ */
+void PipelineDescription_Init(
+	PipelineDescription* pThis,
+	VkRenderPass renderPass,
+	uint32_t subpass,
+	VkPipelineLayout layout) {
+	assert(pThis);
+	assert(renderPass);
+	assert(layout);
+
+	// the padding in the shader names is hashed too
+	memset(pThis, 0, sizeof(PipelineDescription));
+	pThis->renderPass = renderPass;
+	pThis->layout = layout;
+	pThis->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	pThis->frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	pThis->depthTestEnable = VK_TRUE;
+	pThis->depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	pThis->renderState = kRenderStateOpaque;
+	pThis->subpass = subpass;
+}
+
+/*!
+ * \brief	sets the shader manager names of the vertex and fragment shaders
+ */
+void PipelineDescription_SetShaders(
+	PipelineDescription* pThis,
+	const char* szVertexShader,
+	const char* szFragmentShader) {
+	assert(pThis);
+	assert(szVertexShader);
+	assert(szFragmentShader);
+	REQUIRE(
+		strlen(szVertexShader) < PIPELINE_MANAGER_MAX_SHADER_NAME
+			&& strlen(szFragmentShader) < PIPELINE_MANAGER_MAX_SHADER_NAME,
+		"shader name too long for a pipeline description");
+
+	// strncpy zeroes the rest, keeping the hash stable
+	strncpy(pThis->szVertexShader, szVertexShader, PIPELINE_MANAGER_MAX_SHADER_NAME);
+	strncpy(pThis->szFragmentShader, szFragmentShader, PIPELINE_MANAGER_MAX_SHADER_NAME);
+}
+
+/*!
+ * \brief	checks whether \a physicalDevice can do extended dynamic state
+ *
+ * The instance must have VK_KHR_get_physical_device_properties2 enabled, or
+ * the device will be reported as unsupported.
+ *
+ * \param	pFeaturesOut receives just the feature to chain into
+ *			VkDeviceCreateInfo, with VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME
+ *			enabled. Its pNext is NULL
+ * \return	FALSE if the extension or its feature is missing
+ */
+BOOL PipelineManager_QueryExtendedDynamicState(
+	VkInstance instance,
+	VkPhysicalDevice physicalDevice,
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT* pFeaturesOut) {
+	assert(instance);
+	assert(physicalDevice);
+	assert(pFeaturesOut);
+
+	memset(pFeaturesOut, 0, sizeof(VkPhysicalDeviceExtendedDynamicStateFeaturesEXT));
+	pFeaturesOut->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+	pFeaturesOut->pNext = NULL;
+
+	PFN_vkGetPhysicalDeviceFeatures2KHR pfnGetPhysicalDeviceFeatures2
+		= (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(
+			instance,
+			"vkGetPhysicalDeviceFeatures2KHR");
+	if (!pfnGetPhysicalDeviceFeatures2) {
+		return FALSE;
+	}
+
+	uint32_t extensionCount;
+	REQUIRE_VK_SUCCESS(
+		vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL));
+	VkExtensionProperties* paExtensions
+		= SAFE_ALLOCATE_ARRAY(VkExtensionProperties, extensionCount);
+	REQUIRE_VK_SUCCESS(
+		vkEnumerateDeviceExtensionProperties(
+			physicalDevice,
+			NULL,
+			&extensionCount,
+			paExtensions));
+	BOOL found = FALSE;
+	for (uint32_t i = 0; i < extensionCount && !found; i++) {
+		found = strcmp(
+			paExtensions[i].extensionName,
+			VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) == 0;
+	}
+	SAFE_FREE(paExtensions);
+	if (!found) {
+		return FALSE;
+	}
+
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT supportedFeatures = { 0 };
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+	supportedFeatures.pNext = NULL;
+	VkPhysicalDeviceFeatures2KHR features = { 0 };
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+	features.pNext = &supportedFeatures;
+	pfnGetPhysicalDeviceFeatures2(physicalDevice, &features);
+	if (!supportedFeatures.extendedDynamicState) {
+		return FALSE;
+	}
+
+	pFeaturesOut->extendedDynamicState = VK_TRUE;
+	return TRUE;
+}
+
+/*!
+ * \brief	creates an empty manager
+ *
+ * \param	pShaderManager where the shaders in descriptions are acquired
+ * \param	pPipelineCache every pipeline is built through it
+ * \param	pJobSystem runs the background builds
+ * \param	frameCount how many frames may be in flight, replaced pipelines are
+ *			kept for this many frames
+ * \param	extendedDynamicState whether \a device was created with the
+ *			features from PipelineManager_QueryExtendedDynamicState
+ */
+PipelineManager* PipelineManager_Create(
+	VkDevice device,
+	ShaderManager* pShaderManager,
+	PipelineCache* pPipelineCache,
+	JobSystem* pJobSystem,
+	uint32_t frameCount,
+	BOOL extendedDynamicState) {
+	assert(device);
+	assert(pShaderManager);
+	assert(pPipelineCache);
+	assert(pJobSystem);
+	assert(frameCount > 0);
+
+	PipelineManager* pPipelineManager = (PipelineManager*)malloc(sizeof(PipelineManager));
+	memset(pPipelineManager, 0, sizeof(PipelineManager));
+
+	pPipelineManager->device = device;
+	pPipelineManager->pShaderManager = pShaderManager;
+	pPipelineManager->pPipelineCache = pPipelineCache;
+	pPipelineManager->pJobSystem = pJobSystem;
+	pPipelineManager->frameCount = frameCount;
+
+	pPipelineManager->extendedDynamicState = extendedDynamicState;
+	if (extendedDynamicState) {
+		pPipelineManager->pfnCmdSetCullMode = (PFN_vkCmdSetCullModeEXT)vkGetDeviceProcAddr(
+			device,
+			"vkCmdSetCullModeEXT");
+		pPipelineManager->pfnCmdSetFrontFace = (PFN_vkCmdSetFrontFaceEXT)vkGetDeviceProcAddr(
+			device,
+			"vkCmdSetFrontFaceEXT");
+		pPipelineManager->pfnCmdSetDepthTestEnable
+			= (PFN_vkCmdSetDepthTestEnableEXT)vkGetDeviceProcAddr(
+				device,
+				"vkCmdSetDepthTestEnableEXT");
+		pPipelineManager->pfnCmdSetDepthWriteEnable
+			= (PFN_vkCmdSetDepthWriteEnableEXT)vkGetDeviceProcAddr(
+				device,
+				"vkCmdSetDepthWriteEnableEXT");
+		pPipelineManager->pfnCmdSetDepthCompareOp
+			= (PFN_vkCmdSetDepthCompareOpEXT)vkGetDeviceProcAddr(
+				device,
+				"vkCmdSetDepthCompareOpEXT");
+		REQUIRE(
+			pPipelineManager->pfnCmdSetCullMode
+				&& pPipelineManager->pfnCmdSetFrontFace
+				&& pPipelineManager->pfnCmdSetDepthTestEnable
+				&& pPipelineManager->pfnCmdSetDepthWriteEnable
+				&& pPipelineManager->pfnCmdSetDepthCompareOp,
+			"the device is missing extended dynamic state commands");
+	}
+
+	pPipelineManager->pMutex = Mutex_Create();
+	pPipelineManager->slotCount = INITIAL_SLOT_COUNT;
+	pPipelineManager->papSlots = SAFE_ALLOCATE_ARRAY(PipelineEntry*, INITIAL_SLOT_COUNT);
+	memset(pPipelineManager->papSlots, 0, sizeof(PipelineEntry*) * INITIAL_SLOT_COUNT);
+
+	return pPipelineManager;
+}
+
+/*!
+ * \brief	destroys every pipeline, which the gpu must have finished using
+ *
+ * Waits for background builds first, see PipelineManager_StopBuilding.
+ */
+void PipelineManager_Destroy(PipelineManager* pThis) {
+	assert(pThis);
+
+	PipelineManager_StopBuilding(pThis);
+	PipelineManager_Clear(pThis);
+	PipelineManager_BeginFrame(pThis, UINT64_MAX);
+
+	SAFE_FREE(pThis->paRetired);
+	SAFE_FREE(pThis->papSlots);
+	Mutex_Destroy(pThis->pMutex);
+	free(pThis);
+}
+
+/*!
+ * \brief	waits for the builds in progress and starts no more
+ *
+ * For before the shader manager goes. Pipelines that never got built stay
+ * missing, anything else keeps working.
+ */
+void PipelineManager_StopBuilding(PipelineManager* pThis) {
+	assert(pThis);
+
+	Mutex_Lock(pThis->pMutex);
+	pThis->stopped = TRUE;
+	Mutex_Unlock(pThis->pMutex);
+
+	PipelineManager_WaitForBuilds(pThis);
+}
+
+/*!
+ * \brief	the pipeline for \a pDescription if it's been built, never waits
+ *
+ * The first call for a description starts its build on the JobSystem.
+ *
+ * \return	the pipeline, or VK_NULL_HANDLE while it's being built or if it
+ *			failed to build, until a reload of one of its shaders
+ */
+VkPipeline PipelineManager_GetPipeline(
+	PipelineManager* pThis,
+	const PipelineDescription* pDescription) {
+	assert(pThis);
+	assert(pDescription);
+
+	PipelineDescription key;
+	PipelineManager_GetKey(pThis, pDescription, &key);
+
+	Mutex_Lock(pThis->pMutex);
+	BOOL added;
+	PipelineEntry* pEntry = PipelineManager_FindOrAddEntry(pThis, &key, &added);
+	if (added) {
+		PipelineManager_RequestBuild(pThis, pEntry);
+	}
+	VkPipeline pipeline = pEntry->pipeline;
+	Mutex_Unlock(pThis->pMutex);
+
+	return pipeline;
+}
+
+/*!
+ * \brief	the pipeline for \a pDescription, built on this thread if it
+ *			isn't yet
+ *
+ * If a background build is already going this builds it again rather than
+ * waiting, whichever finishes first is kept.
+ *
+ * \return	the pipeline, or VK_NULL_HANDLE if it failed to build
+ */
+VkPipeline PipelineManager_GetPipelineNow(
+	PipelineManager* pThis,
+	const PipelineDescription* pDescription) {
+	assert(pThis);
+	assert(pDescription);
+
+	PipelineDescription key;
+	PipelineManager_GetKey(pThis, pDescription, &key);
+
+	Mutex_Lock(pThis->pMutex);
+	BOOL added;
+	PipelineEntry* pEntry = PipelineManager_FindOrAddEntry(pThis, &key, &added);
+	if (added) {
+		pEntry->requestedGeneration++;
+	}
+	else if (pEntry->pipeline
+		|| pEntry->finishedGeneration == pEntry->requestedGeneration) {
+		// built already, or it failed and would again
+		VkPipeline pipeline = pEntry->pipeline;
+		Mutex_Unlock(pThis->pMutex);
+		return pipeline;
+	}
+	uint32_t generation = pEntry->requestedGeneration;
+	Mutex_Unlock(pThis->pMutex);
+
+	// only PipelineManager_Clear frees entries, and it's on this thread
+	VkPipeline pipeline = PipelineManager_Build(pThis, &pEntry->description);
+
+	Mutex_Lock(pThis->pMutex);
+	PipelineManager_Install(pThis, pEntry, pipeline, generation);
+	pipeline = pEntry->pipeline;
+	Mutex_Unlock(pThis->pMutex);
+
+	return pipeline;
+}
+
+/*!
+ * \brief	builds a pipeline for \a pDescription from whatever shaders the
+ *			shader manager holds now, without caching it
+ *
+ * \return	the pipeline, which the caller owns, or VK_NULL_HANDLE if the
+ *			shaders are missing or broken
+ */
+VkPipeline PipelineManager_Build(
+	PipelineManager* pThis,
+	const PipelineDescription* pDescription) {
+	assert(pThis);
+	assert(pDescription);
+
+	// the modules stay cached in the shader manager, only the pipeline keeps them
+	VkShaderModule vertexShader = ShaderManager_AcquireShader(
+		pThis->pShaderManager,
+		pDescription->szVertexShader,
+		SHADER_STAGE_VERTEX);
+	VkShaderModule fragmentShader = ShaderManager_AcquireShader(
+		pThis->pShaderManager,
+		pDescription->szFragmentShader,
+		SHADER_STAGE_FRAGMENT);
+	if (!vertexShader || !fragmentShader) {
+		ShaderManager_ReleaseShader(pThis->pShaderManager, vertexShader);
+		ShaderManager_ReleaseShader(pThis->pShaderManager, fragmentShader);
+		return VK_NULL_HANDLE;
+	}
+
+	VkPipelineShaderStageCreateInfo aShaderStageCreateInfo[2] = { 0 };
+	aShaderStageCreateInfo[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	aShaderStageCreateInfo[0].pNext = NULL;
+	aShaderStageCreateInfo[0].flags = 0;
+	aShaderStageCreateInfo[0].stage = ShaderManager_GetStageFlag(SHADER_STAGE_VERTEX);
+	aShaderStageCreateInfo[0].module = vertexShader;
+	aShaderStageCreateInfo[0].pName = "main";
+	aShaderStageCreateInfo[0].pSpecializationInfo = NULL;
+	aShaderStageCreateInfo[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	aShaderStageCreateInfo[1].pNext = NULL;
+	aShaderStageCreateInfo[1].flags = 0;
+	aShaderStageCreateInfo[1].stage = ShaderManager_GetStageFlag(SHADER_STAGE_FRAGMENT);
+	aShaderStageCreateInfo[1].module = fragmentShader;
+	aShaderStageCreateInfo[1].pName = "main";
+	aShaderStageCreateInfo[1].pSpecializationInfo = NULL;
+
+	// the input binding and attributes come from the vertex format
+	VkVertexInputBindingDescription inputBindingDescriptions[1] = { 0 };
+	VkVertexInputAttributeDescription inputAttributeDescriptions[VERTEX_ATTRIBUTE_COUNT] = { 0 };
+	uint32_t inputAttributeCount = VertexFormat_GetInputDescriptions(
+		&pDescription->vertexFormat,
+		0,
+		&inputBindingDescriptions[0],
+		inputAttributeDescriptions);
+
+	VkPipelineVertexInputStateCreateInfo vertexInputStateInfo = { 0 };
+	vertexInputStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputStateInfo.pNext = NULL;
+	vertexInputStateInfo.flags = 0;
+	vertexInputStateInfo.vertexBindingDescriptionCount = 1;
+	vertexInputStateInfo.pVertexBindingDescriptions = inputBindingDescriptions;
+	vertexInputStateInfo.vertexAttributeDescriptionCount = inputAttributeCount;
+	vertexInputStateInfo.pVertexAttributeDescriptions = inputAttributeDescriptions;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = { 0 };
+	inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyState.pNext = NULL;
+	inputAssemblyState.flags = 0;
+	inputAssemblyState.topology = pDescription->topology;
+	inputAssemblyState.primitiveRestartEnable = VK_FALSE;
+
+	// both are dynamic, only the count is needed
+	VkPipelineViewportStateCreateInfo viewportCreateInfo = { 0 };
+	viewportCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportCreateInfo.pNext = NULL;
+	viewportCreateInfo.flags = 0;
+	viewportCreateInfo.viewportCount = 1;
+	viewportCreateInfo.pViewports = NULL;
+	viewportCreateInfo.scissorCount = 1;
+	viewportCreateInfo.pScissors = NULL;
+
+	VkPipelineRasterizationStateCreateInfo rasterizationState = { 0 };
+	rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizationState.pNext = NULL;
+	rasterizationState.flags = 0;
+	rasterizationState.depthClampEnable = VK_FALSE; // needs the depthClamp feature
+	rasterizationState.rasterizerDiscardEnable = VK_FALSE;
+	rasterizationState.polygonMode = pDescription->renderState.polygonMode;
+	rasterizationState.cullMode = pDescription->renderState.cullMode;
+	rasterizationState.frontFace = pDescription->frontFace;
+	// the factors are dynamic, zero leaves depth as it is
+	rasterizationState.depthBiasEnable = VK_TRUE;
+	rasterizationState.depthBiasConstantFactor = 0;
+	rasterizationState.depthBiasClamp = 0;
+	rasterizationState.depthBiasSlopeFactor = 0;
+	rasterizationState.lineWidth = 1.f; // must be 1 without the wideLines feature
+
+	VkPipelineMultisampleStateCreateInfo multisampleState;
+	multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampleState.pNext = NULL;
+	multisampleState.flags = 0;
+	multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampleState.sampleShadingEnable = VK_FALSE;
+	multisampleState.minSampleShading = 0;
+	multisampleState.pSampleMask = NULL;
+	multisampleState.alphaToCoverageEnable = VK_FALSE;
+	multisampleState.alphaToOneEnable = VK_FALSE;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencilState = { 0 };
+	depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilState.pNext = NULL;
+	depthStencilState.flags = 0;
+	depthStencilState.depthTestEnable = pDescription->depthTestEnable;
+	depthStencilState.depthWriteEnable = pDescription->renderState.depthWriteEnable;
+	depthStencilState.depthCompareOp = pDescription->depthCompareOp;
+	depthStencilState.depthBoundsTestEnable = VK_FALSE;
+	depthStencilState.stencilTestEnable = VK_FALSE;
+	depthStencilState.front.failOp = VK_STENCIL_OP_KEEP;
+	depthStencilState.front.passOp = VK_STENCIL_OP_KEEP;
+	depthStencilState.front.depthFailOp = VK_STENCIL_OP_KEEP;
+	depthStencilState.front.compareOp = VK_COMPARE_OP_ALWAYS;
+	depthStencilState.back.failOp = VK_STENCIL_OP_KEEP;
+	depthStencilState.back.passOp = VK_STENCIL_OP_KEEP;
+	depthStencilState.back.depthFailOp = VK_STENCIL_OP_KEEP;
+	depthStencilState.back.compareOp = VK_COMPARE_OP_ALWAYS;
+	depthStencilState.minDepthBounds = 0;
+	depthStencilState.maxDepthBounds = 0;
+
+	VkPipelineColorBlendAttachmentState aColorBlendAttachments[1] = { 0 };
+	PipelineManager_FillBlendAttachment(
+		pDescription->renderState.blendMode,
+		&aColorBlendAttachments[0]);
+
+	VkPipelineColorBlendStateCreateInfo colorBlendState = { 0 };
+	colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendState.pNext = NULL;
+	colorBlendState.flags = 0;
+	colorBlendState.logicOpEnable = VK_FALSE;
+	colorBlendState.attachmentCount = 1;
+	colorBlendState.pAttachments = aColorBlendAttachments;
+
+	VkDynamicState aDynamicStates[CORE_DYNAMIC_STATE_COUNT + EXTENDED_DYNAMIC_STATE_COUNT];
+	uint32_t dynamicStateCount = 0;
+	for (uint32_t i = 0; i < CORE_DYNAMIC_STATE_COUNT; i++) {
+		aDynamicStates[dynamicStateCount++] = kaCoreDynamicStates[i];
+	}
+	if (pThis->extendedDynamicState) {
+		for (uint32_t i = 0; i < EXTENDED_DYNAMIC_STATE_COUNT; i++) {
+			aDynamicStates[dynamicStateCount++] = kaExtendedDynamicStates[i];
+		}
+	}
+
+	VkPipelineDynamicStateCreateInfo dynamicState = { 0 };
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.pNext = NULL;
+	dynamicState.flags = 0;
+	dynamicState.dynamicStateCount = dynamicStateCount;
+	dynamicState.pDynamicStates = aDynamicStates;
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo = { 0 };
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.pNext = NULL;
+	pipelineCreateInfo.flags = 0;
+	pipelineCreateInfo.stageCount = 2;
+	pipelineCreateInfo.pStages = aShaderStageCreateInfo;
+	pipelineCreateInfo.pVertexInputState = &vertexInputStateInfo;
+	pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+	pipelineCreateInfo.pTessellationState = NULL;
+	pipelineCreateInfo.pViewportState = &viewportCreateInfo;
+	pipelineCreateInfo.pRasterizationState = &rasterizationState;
+	pipelineCreateInfo.pMultisampleState = &multisampleState;
+	pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+	pipelineCreateInfo.pColorBlendState = &colorBlendState;
+	pipelineCreateInfo.pDynamicState = &dynamicState;
+	pipelineCreateInfo.layout = pDescription->layout;
+	pipelineCreateInfo.renderPass = pDescription->renderPass;
+	pipelineCreateInfo.subpass = pDescription->subpass;
+	pipelineCreateInfo.basePipelineHandle = 0;
+	pipelineCreateInfo.basePipelineIndex = 0;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateGraphicsPipelines(
+		pThis->device,
+		PipelineCache_GetHandle(pThis->pPipelineCache),
+		1,
+		&pipelineCreateInfo,
+		VK_NULL_HANDLE,
+		&pipeline);
+	if (result != VK_SUCCESS) {
+		Log_Write(
+			LOG_SEVERITY_ERROR,
+			"pipelines",
+			"failed to build the pipeline for %s and %s: %s",
+			pDescription->szVertexShader,
+			pDescription->szFragmentShader,
+			GetResultName(result));
+		pipeline = VK_NULL_HANDLE;
+	}
+
+	ShaderManager_ReleaseShader(pThis->pShaderManager, vertexShader);
+	ShaderManager_ReleaseShader(pThis->pShaderManager, fragmentShader);
+
+	return pipeline;
+}
+
+/*!
+ * \brief	sets the parts of \a pDescription that are dynamic state rather
+ *			than part of its pipeline
+ *
+ * Only does anything with extended dynamic state. Viewport, scissor and depth
+ * bias aren't in descriptions, the caller sets those itself. May be called
+ * from any thread.
+ */
+void PipelineManager_RecordDynamicState(
+	const PipelineManager* pThis,
+	VkCommandBuffer commandBuffer,
+	const PipelineDescription* pDescription) {
+	assert(pThis);
+	assert(commandBuffer);
+	assert(pDescription);
+
+	if (!pThis->extendedDynamicState) {
+		return;
+	}
+
+	pThis->pfnCmdSetCullMode(commandBuffer, pDescription->renderState.cullMode);
+	pThis->pfnCmdSetFrontFace(commandBuffer, pDescription->frontFace);
+	pThis->pfnCmdSetDepthTestEnable(commandBuffer, pDescription->depthTestEnable);
+	pThis->pfnCmdSetDepthWriteEnable(commandBuffer, pDescription->renderState.depthWriteEnable);
+	pThis->pfnCmdSetDepthCompareOp(commandBuffer, pDescription->depthCompareOp);
+}
+
+/*!
+ * \brief	rebuilds every pipeline that uses the shader, in the background
+ *
+ * Meant for a ShaderReloadCallback. The old pipelines are used until the new
+ * ones are in, and kept if a rebuild fails.
+ */
+void PipelineManager_ReloadShader(
+	PipelineManager* pThis,
+	const char* szShaderName,
+	ShaderStage stage) {
+	assert(pThis);
+	assert(szShaderName);
+
+	Mutex_Lock(pThis->pMutex);
+	for (uint32_t i = 0; i < pThis->slotCount; i++) {
+		PipelineEntry* pEntry = pThis->papSlots[i];
+		if (!pEntry) {
+			continue;
+		}
+		const char* szUsedShaderName = stage == SHADER_STAGE_VERTEX
+			? pEntry->description.szVertexShader
+			: pEntry->description.szFragmentShader;
+		if (strcmp(szShaderName, szUsedShaderName) == 0) {
+			PipelineManager_RequestBuild(pThis, pEntry);
+		}
+	}
+	Mutex_Unlock(pThis->pMutex);
+}
+
+/*!
+ * \brief	forgets every description, retiring their pipelines
+ *
+ * Waits for the builds in progress. For when something every description
+ * shares has changed.
+ */
+void PipelineManager_Clear(PipelineManager* pThis) {
+	assert(pThis);
+
+	// an entry can't go while its job still has it
+	PipelineManager_WaitForBuilds(pThis);
+
+	Mutex_Lock(pThis->pMutex);
+	for (uint32_t i = 0; i < pThis->slotCount; i++) {
+		PipelineEntry* pEntry = pThis->papSlots[i];
+		if (!pEntry) {
+			continue;
+		}
+		assert(!pEntry->building);
+		PipelineManager_Retire(pThis, pEntry->pipeline);
+		if (pEntry->pBuildJob) {
+			JobSystem_Release(pThis->pJobSystem, pEntry->pBuildJob);
+		}
+		free(pEntry);
+		pThis->papSlots[i] = NULL;
+	}
+	pThis->entryCount = 0;
+	Mutex_Unlock(pThis->pMutex);
+}
+
+/*!
+ * \brief	destroys the pipelines no frame in flight can be using anymore
+ *
+ * \param	frameNumber how many frames have been submitted. Every frame up to
+ *			frameNumber minus the manager's frameCount must be done on the gpu
+ */
+void PipelineManager_BeginFrame(PipelineManager* pThis, uint64_t frameNumber) {
+	assert(pThis);
+
+	Mutex_Lock(pThis->pMutex);
+	pThis->frameNumber = frameNumber;
+	uint32_t keptCount = 0;
+	for (uint32_t i = 0; i < pThis->retiredCount; i++) {
+		RetiredPipeline* pRetired = &pThis->paRetired[i];
+		if (frameNumber >= pThis->frameCount
+			&& pRetired->retiredFrame <= frameNumber - pThis->frameCount) {
+			vkDestroyPipeline(pThis->device, pRetired->pipeline, NULL);
+		}
+		else {
+			pThis->paRetired[keptCount++] = *pRetired;
+		}
+	}
+	pThis->retiredCount = keptCount;
+	Mutex_Unlock(pThis->pMutex);
+}
+
+// how many descriptions there are, built or not
+uint32_t PipelineManager_GetPipelineCount(PipelineManager* pThis) {
+	assert(pThis);
+
+	Mutex_Lock(pThis->pMutex);
+	uint32_t entryCount = pThis->entryCount;
+	Mutex_Unlock(pThis->pMutex);
+	return entryCount;
+}
+
+// Private Interface!
+
+// FNV-1a over every byte
+uint64_t PipelineDescription_Hash(const PipelineDescription* pThis) {
+	uint64_t hash = 14695981039346656037ull;
+	const uint8_t* pBytes = (const uint8_t*)pThis;
+	for (size_t i = 0; i < sizeof(PipelineDescription); i++) {
+		hash = (hash ^ pBytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+/*!
+ * \brief	what a description is cached under
+ *
+ * With extended dynamic state the fields in kaExtendedDynamicStates are
+ * cleared, so descriptions that only differ in them share a pipeline.
+ */
+void PipelineManager_GetKey(
+	const PipelineManager* pThis,
+	const PipelineDescription* pDescription,
+	PipelineDescription* pKeyOut) {
+	memcpy(pKeyOut, pDescription, sizeof(PipelineDescription));
+	if (pThis->extendedDynamicState) {
+		pKeyOut->renderState.cullMode = VK_CULL_MODE_NONE;
+		pKeyOut->frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		pKeyOut->depthTestEnable = VK_FALSE;
+		pKeyOut->renderState.depthWriteEnable = VK_FALSE;
+		pKeyOut->depthCompareOp = VK_COMPARE_OP_NEVER;
+	}
+}
+
+// the slot holding \a pDescription, or the empty one it would go in
+uint32_t PipelineManager_FindSlot(
+	const PipelineManager* pThis,
+	const PipelineDescription* pDescription,
+	uint64_t hash) {
+	uint32_t mask = pThis->slotCount - 1;
+	for (uint32_t slot = (uint32_t)hash & mask;; slot = (slot + 1) & mask) {
+		const PipelineEntry* pEntry = pThis->papSlots[slot];
+		if (!pEntry
+			|| (pEntry->hash == hash
+				&& memcmp(&pEntry->description, pDescription, sizeof(PipelineDescription)) == 0)) {
+			return slot;
+		}
+	}
+}
+
+// with the mutex held. a new entry has nothing built or requested
+PipelineEntry* PipelineManager_FindOrAddEntry(
+	PipelineManager* pThis,
+	const PipelineDescription* pDescription,
+	BOOL* pAddedOut) {
+	uint64_t hash = PipelineDescription_Hash(pDescription);
+	uint32_t slot = PipelineManager_FindSlot(pThis, pDescription, hash);
+	*pAddedOut = pThis->papSlots[slot] == NULL;
+	if (!*pAddedOut) {
+		return pThis->papSlots[slot];
+	}
+
+	if ((pThis->entryCount + 1) * 10 > pThis->slotCount * MAX_LOAD_TENTHS) {
+		PipelineManager_Grow(pThis);
+		slot = PipelineManager_FindSlot(pThis, pDescription, hash);
+	}
+
+	PipelineEntry* pEntry = (PipelineEntry*)malloc(sizeof(PipelineEntry));
+	memset(pEntry, 0, sizeof(PipelineEntry));
+	memcpy(&pEntry->description, pDescription, sizeof(PipelineDescription));
+	pEntry->hash = hash;
+	pEntry->pManager = pThis;
+
+	pThis->papSlots[slot] = pEntry;
+	pThis->entryCount++;
+	return pEntry;
+}
+
+// doubles the slots, entries stay where they are in memory
+void PipelineManager_Grow(PipelineManager* pThis) {
+	uint32_t oldSlotCount = pThis->slotCount;
+	PipelineEntry** papOldSlots = pThis->papSlots;
+
+	pThis->slotCount = oldSlotCount * 2;
+	pThis->papSlots = SAFE_ALLOCATE_ARRAY(PipelineEntry*, pThis->slotCount);
+	memset(pThis->papSlots, 0, sizeof(PipelineEntry*) * pThis->slotCount);
+	for (uint32_t i = 0; i < oldSlotCount; i++) {
+		PipelineEntry* pEntry = papOldSlots[i];
+		if (pEntry) {
+			uint32_t slot = PipelineManager_FindSlot(pThis, &pEntry->description, pEntry->hash);
+			pThis->papSlots[slot] = pEntry;
+		}
+	}
+
+	SAFE_FREE(papOldSlots);
+}
+
+// with the mutex held. a job that's already building the entry picks it up
+void PipelineManager_RequestBuild(PipelineManager* pThis, PipelineEntry* pEntry) {
+	pEntry->requestedGeneration++;
+	if (pEntry->building || pThis->stopped) {
+		return;
+	}
+
+	if (pEntry->pBuildJob) {
+		JobSystem_Release(pThis->pJobSystem, pEntry->pBuildJob);
+	}
+	pEntry->building = TRUE;
+	pEntry->pBuildJob = JobSystem_Run(
+		pThis->pJobSystem,
+		PipelineManager_BuildJob,
+		pEntry,
+		JOB_FLAG_BACKGROUND);
+}
+
+// builds until the entry's newest request is done
+void PipelineManager_BuildJob(void* pUserData) {
+	PipelineEntry* pEntry = (PipelineEntry*)pUserData;
+	PipelineManager* pThis = pEntry->pManager;
+
+	Mutex_Lock(pThis->pMutex);
+	while (pEntry->finishedGeneration != pEntry->requestedGeneration && !pThis->stopped) {
+		uint32_t generation = pEntry->requestedGeneration;
+		Mutex_Unlock(pThis->pMutex);
+
+		VkPipeline pipeline = PipelineManager_Build(pThis, &pEntry->description);
+
+		Mutex_Lock(pThis->pMutex);
+		PipelineManager_Install(pThis, pEntry, pipeline, generation);
+	}
+	pEntry->building = FALSE;
+	Mutex_Unlock(pThis->pMutex);
+}
+
+/*!
+ * \brief	with the mutex held, puts a finished build in its entry
+ *
+ * A failed build leaves the last pipeline in place, one older than what's
+ * there already is destroyed.
+ */
+void PipelineManager_Install(
+	PipelineManager* pThis,
+	PipelineEntry* pEntry,
+	VkPipeline pipeline,
+	uint32_t generation) {
+	if (generation <= pEntry->finishedGeneration) {
+		vkDestroyPipeline(pThis->device, pipeline, NULL);
+		return;
+	}
+
+	pEntry->finishedGeneration = generation;
+	if (pipeline) {
+		PipelineManager_Retire(pThis, pEntry->pipeline);
+		pEntry->pipeline = pipeline;
+	}
+}
+
+// with the mutex held
+void PipelineManager_Retire(PipelineManager* pThis, VkPipeline pipeline) {
+	if (!pipeline) {
+		return;
+	}
+
+	if (pThis->retiredCount == pThis->retiredCapacity) {
+		pThis->retiredCapacity = pThis->retiredCapacity ? pThis->retiredCapacity * 2 : 8;
+		pThis->paRetired = (RetiredPipeline*)realloc(
+			pThis->paRetired,
+			sizeof(RetiredPipeline) * pThis->retiredCapacity);
+		assert(pThis->paRetired);
+	}
+	pThis->paRetired[pThis->retiredCount].retiredFrame = pThis->frameNumber;
+	pThis->paRetired[pThis->retiredCount].pipeline = pipeline;
+	pThis->retiredCount++;
+}
+
+/*!
+ * \brief	waits until no entry is being built, helping the JobSystem meanwhile
+ *
+ * A build can start again as soon as this returns, unless the manager's stopped.
+ */
+void PipelineManager_WaitForBuilds(PipelineManager* pThis) {
+	for (;;) {
+		Job* pJob = NULL;
+		Mutex_Lock(pThis->pMutex);
+		for (uint32_t i = 0; i < pThis->slotCount && !pJob; i++) {
+			PipelineEntry* pEntry = pThis->papSlots[i];
+			if (pEntry && pEntry->building && pEntry->pBuildJob) {
+				// the wait releases it
+				pJob = pEntry->pBuildJob;
+				pEntry->pBuildJob = NULL;
+			}
+		}
+		Mutex_Unlock(pThis->pMutex);
+
+		if (!pJob) {
+			break;
+		}
+		JobSystem_Wait(pThis->pJobSystem, pJob);
+	}
+}
+
+void PipelineManager_FillBlendAttachment(
+	PipelineBlendMode blendMode,
+	VkPipelineColorBlendAttachmentState* pAttachmentOut) {
+	pAttachmentOut->colorBlendOp = VK_BLEND_OP_ADD;
+	pAttachmentOut->alphaBlendOp = VK_BLEND_OP_ADD;
+	pAttachmentOut->colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+		| VK_COLOR_COMPONENT_G_BIT
+		| VK_COLOR_COMPONENT_B_BIT
+		| VK_COLOR_COMPONENT_A_BIT;
+
+	switch (blendMode) {
+	case PIPELINE_BLEND_MODE_ALPHA:
+		pAttachmentOut->blendEnable = VK_TRUE;
+		pAttachmentOut->srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		pAttachmentOut->dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		pAttachmentOut->srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		pAttachmentOut->dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		break;
+	case PIPELINE_BLEND_MODE_ADDITIVE:
+		pAttachmentOut->blendEnable = VK_TRUE;
+		pAttachmentOut->srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		pAttachmentOut->dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		pAttachmentOut->srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		pAttachmentOut->dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		break;
+	default:
+		assert(blendMode == PIPELINE_BLEND_MODE_OPAQUE);
+		pAttachmentOut->blendEnable = VK_FALSE;
+		pAttachmentOut->srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		pAttachmentOut->dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+		pAttachmentOut->srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		pAttachmentOut->dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		break;
+	}
+}
@@ -0,0 +1,137 @@
+#ifndef __PIPELINE_MANAGER_H
+#define __PIPELINE_MANAGER_H
+
+#include "JobSystem.h"
+#include "PipelineCache.h"
+#include "ShaderManager.h"
+#include "VertexFormat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Builds graphics pipelines from PipelineDescriptions and keeps them in a hash
+ * map keyed on the description.
+ *
+ * PipelineManager_GetPipeline never waits for a pipeline. The first time a
+ * description is asked for its pipeline is built as a JOB_FLAG_BACKGROUND
+ * job, and until it's done VK_NULL_HANDLE is returned so the caller can draw
+ * with a pipeline it already has. New materials can show up mid frame without
+ * a hitch, not even on a thread that's helping the JobSystem while it waits.
+ * PipelineManager_GetPipelineNow is for the few pipelines that have to exist
+ * before anything can be drawn.
+ *
+ * Viewport, scissor and depth bias are always dynamic, so nothing in a
+ * pipeline depends on the render target's size. With extended dynamic state
+ * cull mode, front face and the depth test are too, and descriptions that
+ * only differ in those share a pipeline. Draws have to set all of it, see
+ * PipelineManager_RecordDynamicState.
+ *
+ * A pipeline that's replaced, by a shader reload or PipelineManager_Clear,
+ * is destroyed once every frame in flight that could have used it is done,
+ * see PipelineManager_BeginFrame. Every function may be called from any
+ * thread, except that PipelineManager_BeginFrame, PipelineManager_Clear and
+ * PipelineManager_GetPipelineNow must all be called from the same one.
+ */
+typedef struct pipeline_manager_t PipelineManager;
+
+// longest shader name a description holds, including the terminator
+#define PIPELINE_MANAGER_MAX_SHADER_NAME 32
+
+typedef enum pipeline_blend_mode_t {
+	// replaces what's there
+	PIPELINE_BLEND_MODE_OPAQUE,
+	// blended over what's there by the source alpha
+	PIPELINE_BLEND_MODE_ALPHA,
+	// added to what's there, scaled by the source alpha
+	PIPELINE_BLEND_MODE_ADDITIVE,
+} PipelineBlendMode;
+
+// the part of a pipeline a material picks, each mesh has one
+typedef struct render_state_t {
+	// anything but VK_POLYGON_MODE_FILL needs the fillModeNonSolid feature
+	VkPolygonMode polygonMode;
+	VkCullModeFlags cullMode;
+	VkBool32 depthWriteEnable;
+	PipelineBlendMode blendMode;
+} RenderState;
+
+// filled, unculled, depth written and not blended
+extern const RenderState kRenderStateOpaque;
+
+/*!
+ * Everything a pipeline is built from.
+ *
+ * Hashed and compared byte for byte, so descriptions must start out from
+ * PipelineDescription_Init and be copied whole. The fields are ordered so
+ * there's no padding for garbage to hide in.
+ */
+typedef struct pipeline_description_t {
+	VkRenderPass renderPass;
+	VkPipelineLayout layout;
+	char szVertexShader[PIPELINE_MANAGER_MAX_SHADER_NAME];
+	char szFragmentShader[PIPELINE_MANAGER_MAX_SHADER_NAME];
+	VertexFormat vertexFormat;
+	VkPrimitiveTopology topology;
+	VkFrontFace frontFace;
+	VkBool32 depthTestEnable;
+	VkCompareOp depthCompareOp;
+	RenderState renderState;
+	uint32_t subpass;
+} PipelineDescription;
+
+void PipelineDescription_Init(
+	PipelineDescription* pThis,
+	VkRenderPass renderPass,
+	uint32_t subpass,
+	VkPipelineLayout layout);
+void PipelineDescription_SetShaders(
+	PipelineDescription* pThis,
+	const char* szVertexShader,
+	const char* szFragmentShader);
+
+BOOL PipelineManager_QueryExtendedDynamicState(
+	VkInstance instance,
+	VkPhysicalDevice physicalDevice,
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT* pFeaturesOut);
+
+PipelineManager* PipelineManager_Create(
+	VkDevice device,
+	ShaderManager* pShaderManager,
+	PipelineCache* pPipelineCache,
+	JobSystem* pJobSystem,
+	uint32_t frameCount,
+	BOOL extendedDynamicState);
+void PipelineManager_Destroy(PipelineManager* pThis);
+void PipelineManager_StopBuilding(PipelineManager* pThis);
+
+VkPipeline PipelineManager_GetPipeline(
+	PipelineManager* pThis,
+	const PipelineDescription* pDescription);
+VkPipeline PipelineManager_GetPipelineNow(
+	PipelineManager* pThis,
+	const PipelineDescription* pDescription);
+VkPipeline PipelineManager_Build(
+	PipelineManager* pThis,
+	const PipelineDescription* pDescription);
+
+void PipelineManager_RecordDynamicState(
+	const PipelineManager* pThis,
+	VkCommandBuffer commandBuffer,
+	const PipelineDescription* pDescription);
+
+void PipelineManager_ReloadShader(
+	PipelineManager* pThis,
+	const char* szShaderName,
+	ShaderStage stage);
+void PipelineManager_Clear(PipelineManager* pThis);
+void PipelineManager_BeginFrame(PipelineManager* pThis, uint64_t frameNumber);
+
+uint32_t PipelineManager_GetPipelineCount(PipelineManager* pThis);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__PIPELINE_MANAGER_H
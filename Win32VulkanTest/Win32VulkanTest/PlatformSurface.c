@@ -0,0 +1,270 @@
+#include "stdafx.h"
+#include "PlatformSurface.h"
+
+#include "Utils.h"
+
+struct platform_surface_t {
+	PlatformSurfaceType type;
+
+	// only the member matching type is valid
+	union {
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+		struct {
+			HINSTANCE hInstance;
+			HWND hWnd;
+		} win32;
+#endif//VK_USE_PLATFORM_WIN32_KHR
+#ifdef VK_USE_PLATFORM_XLIB_KHR
+		struct {
+			Display* pDisplay;
+			Window window;
+		} xlib;
+#endif//VK_USE_PLATFORM_XLIB_KHR
+#ifdef VK_USE_PLATFORM_XCB_KHR
+		struct {
+			xcb_connection_t* pConnection;
+			xcb_window_t window;
+		} xcb;
+#endif//VK_USE_PLATFORM_XCB_KHR
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+		struct {
+			struct wl_display* pDisplay;
+			struct wl_surface* pSurface;
+		} wayland;
+#endif//VK_USE_PLATFORM_WAYLAND_KHR
+		int unused; // keeps the union valid when no window system is built in
+	};
+};
+
+PlatformSurface* PlatformSurface_Allocate(PlatformSurfaceType type);
+
+/*!
+ * \brief	creates a surface description for rendering with no window at all
+ */
+PlatformSurface* PlatformSurface_CreateHeadless(void) {
+	return PlatformSurface_Allocate(PLATFORM_SURFACE_TYPE_HEADLESS);
+}
+
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+/*!
+ * \brief	creates a surface description for a win32 window
+ * \param	hInstance the instance that registered the window's class
+ * \param	hWnd the window to present to
+ */
+PlatformSurface* PlatformSurface_CreateWin32(HINSTANCE hInstance, HWND hWnd) {
+	assert(hInstance);
+	assert(hWnd);
+
+	PlatformSurface* pPlatformSurface = PlatformSurface_Allocate(PLATFORM_SURFACE_TYPE_WIN32);
+	pPlatformSurface->win32.hInstance = hInstance;
+	pPlatformSurface->win32.hWnd = hWnd;
+	return pPlatformSurface;
+}
+#endif//VK_USE_PLATFORM_WIN32_KHR
+
+#ifdef VK_USE_PLATFORM_XLIB_KHR
+/*!
+ * \brief	creates a surface description for an Xlib window
+ * \param	pDisplay the connection to the X server
+ * \param	window the window to present to
+ */
+PlatformSurface* PlatformSurface_CreateXlib(Display* pDisplay, Window window) {
+	assert(pDisplay);
+	assert(window);
+
+	PlatformSurface* pPlatformSurface = PlatformSurface_Allocate(PLATFORM_SURFACE_TYPE_XLIB);
+	pPlatformSurface->xlib.pDisplay = pDisplay;
+	pPlatformSurface->xlib.window = window;
+	return pPlatformSurface;
+}
+#endif//VK_USE_PLATFORM_XLIB_KHR
+
+#ifdef VK_USE_PLATFORM_XCB_KHR
+/*!
+ * \brief	creates a surface description for an XCB window
+ * \param	pConnection the connection to the X server
+ * \param	window the window to present to
+ */
+PlatformSurface* PlatformSurface_CreateXcb(
+	xcb_connection_t* pConnection,
+	xcb_window_t window) {
+	assert(pConnection);
+	assert(window);
+
+	PlatformSurface* pPlatformSurface = PlatformSurface_Allocate(PLATFORM_SURFACE_TYPE_XCB);
+	pPlatformSurface->xcb.pConnection = pConnection;
+	pPlatformSurface->xcb.window = window;
+	return pPlatformSurface;
+}
+#endif//VK_USE_PLATFORM_XCB_KHR
+
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+/*!
+ * \brief	creates a surface description for a Wayland surface
+ * \param	pDisplay the connection to the compositor
+ * \param	pSurface the surface to present to
+ */
+PlatformSurface* PlatformSurface_CreateWayland(
+	struct wl_display* pDisplay,
+	struct wl_surface* pSurface) {
+	assert(pDisplay);
+	assert(pSurface);
+
+	PlatformSurface* pPlatformSurface = PlatformSurface_Allocate(PLATFORM_SURFACE_TYPE_WAYLAND);
+	pPlatformSurface->wayland.pDisplay = pDisplay;
+	pPlatformSurface->wayland.pSurface = pSurface;
+	return pPlatformSurface;
+}
+#endif//VK_USE_PLATFORM_WAYLAND_KHR
+
+/*!
+ * \brief	frees the description, the window itself belongs to the caller
+ */
+void PlatformSurface_Destroy(PlatformSurface* pThis) {
+	assert(pThis);
+
+	free(pThis);
+}
+
+PlatformSurfaceType PlatformSurface_GetType(const PlatformSurface* pThis) {
+	assert(pThis);
+
+	return pThis->type;
+}
+
+/*!
+ * \brief	the instance extension needed to create this kind of surface
+ * \return	the extension name, or NULL for headless surfaces
+ */
+const char* PlatformSurface_GetInstanceExtension(const PlatformSurface* pThis) {
+	assert(pThis);
+
+	switch (pThis->type) {
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	case PLATFORM_SURFACE_TYPE_WIN32:
+		return VK_KHR_WIN32_SURFACE_EXTENSION_NAME;
+#endif//VK_USE_PLATFORM_WIN32_KHR
+#ifdef VK_USE_PLATFORM_XLIB_KHR
+	case PLATFORM_SURFACE_TYPE_XLIB:
+		return VK_KHR_XLIB_SURFACE_EXTENSION_NAME;
+#endif//VK_USE_PLATFORM_XLIB_KHR
+#ifdef VK_USE_PLATFORM_XCB_KHR
+	case PLATFORM_SURFACE_TYPE_XCB:
+		return VK_KHR_XCB_SURFACE_EXTENSION_NAME;
+#endif//VK_USE_PLATFORM_XCB_KHR
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+	case PLATFORM_SURFACE_TYPE_WAYLAND:
+		return VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME;
+#endif//VK_USE_PLATFORM_WAYLAND_KHR
+	default:
+		return NULL;
+	}
+}
+
+/*!
+ * \brief	creates the vulkan surface for this window
+ *
+ * \a instance must have been created with VK_KHR_surface and
+ * PlatformSurface_GetInstanceExtension enabled. Headless surfaces have
+ * nothing to create.
+ *
+ * \return	the new surface, owned by the caller
+ */
+VkSurfaceKHR PlatformSurface_CreateVkSurface(
+	const PlatformSurface* pThis,
+	VkInstance instance) {
+	assert(pThis);
+	assert(instance);
+	assert(pThis->type != PLATFORM_SURFACE_TYPE_HEADLESS);
+
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	switch (pThis->type) {
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	case PLATFORM_SURFACE_TYPE_WIN32:
+	{
+		VkWin32SurfaceCreateInfoKHR createInfo = { 0 };
+		createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+		createInfo.pNext = NULL;
+		createInfo.flags = 0;
+		createInfo.hinstance = pThis->win32.hInstance;
+		createInfo.hwnd = pThis->win32.hWnd;
+		REQUIRE_VK_SUCCESS(
+			vkCreateWin32SurfaceKHR(
+				instance,
+				&createInfo,
+				NULL,
+				&surface)
+		);
+		break;
+	}
+#endif//VK_USE_PLATFORM_WIN32_KHR
+#ifdef VK_USE_PLATFORM_XLIB_KHR
+	case PLATFORM_SURFACE_TYPE_XLIB:
+	{
+		VkXlibSurfaceCreateInfoKHR createInfo = { 0 };
+		createInfo.sType = VK_STRUCTURE_TYPE_XLIB_SURFACE_CREATE_INFO_KHR;
+		createInfo.pNext = NULL;
+		createInfo.flags = 0;
+		createInfo.dpy = pThis->xlib.pDisplay;
+		createInfo.window = pThis->xlib.window;
+		REQUIRE_VK_SUCCESS(
+			vkCreateXlibSurfaceKHR(
+				instance,
+				&createInfo,
+				NULL,
+				&surface)
+		);
+		break;
+	}
+#endif//VK_USE_PLATFORM_XLIB_KHR
+#ifdef VK_USE_PLATFORM_XCB_KHR
+	case PLATFORM_SURFACE_TYPE_XCB:
+	{
+		VkXcbSurfaceCreateInfoKHR createInfo = { 0 };
+		createInfo.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
+		createInfo.pNext = NULL;
+		createInfo.flags = 0;
+		createInfo.connection = pThis->xcb.pConnection;
+		createInfo.window = pThis->xcb.window;
+		REQUIRE_VK_SUCCESS(
+			vkCreateXcbSurfaceKHR(
+				instance,
+				&createInfo,
+				NULL,
+				&surface)
+		);
+		break;
+	}
+#endif//VK_USE_PLATFORM_XCB_KHR
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+	case PLATFORM_SURFACE_TYPE_WAYLAND:
+	{
+		VkWaylandSurfaceCreateInfoKHR createInfo = { 0 };
+		createInfo.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
+		createInfo.pNext = NULL;
+		createInfo.flags = 0;
+		createInfo.display = pThis->wayland.pDisplay;
+		createInfo.surface = pThis->wayland.pSurface;
+		REQUIRE_VK_SUCCESS(
+			vkCreateWaylandSurfaceKHR(
+				instance,
+				&createInfo,
+				NULL,
+				&surface)
+		);
+		break;
+	}
+#endif//VK_USE_PLATFORM_WAYLAND_KHR
+	default:
+		assert(FALSE); // not built with support for this window system
+		break;
+	}
+	return surface;
+}
+
+PlatformSurface* PlatformSurface_Allocate(PlatformSurfaceType type) {
+	PlatformSurface* pPlatformSurface = (PlatformSurface*)malloc(sizeof(PlatformSurface));
+	memset(pPlatformSurface, 0, sizeof(PlatformSurface));
+	pPlatformSurface->type = type;
+	return pPlatformSurface;
+}
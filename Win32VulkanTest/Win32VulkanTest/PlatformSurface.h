@@ -0,0 +1,54 @@
+#ifndef __PLATFORM_SURFACE_H
+#define __PLATFORM_SURFACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Describes where the renderer presents to.
+ *
+ * Each windowing system gets its own constructor, compiled in when the
+ * matching VK_USE_PLATFORM_*_KHR is defined, so several can be built in and
+ * picked between at run time. The headless one presents nowhere.
+ */
+typedef struct platform_surface_t PlatformSurface;
+
+typedef enum platform_surface_type_t {
+	PLATFORM_SURFACE_TYPE_HEADLESS,
+	PLATFORM_SURFACE_TYPE_WIN32,
+	PLATFORM_SURFACE_TYPE_XLIB,
+	PLATFORM_SURFACE_TYPE_XCB,
+	PLATFORM_SURFACE_TYPE_WAYLAND,
+} PlatformSurfaceType;
+
+PlatformSurface* PlatformSurface_CreateHeadless(void);
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+PlatformSurface* PlatformSurface_CreateWin32(HINSTANCE hInstance, HWND hWnd);
+#endif//VK_USE_PLATFORM_WIN32_KHR
+#ifdef VK_USE_PLATFORM_XLIB_KHR
+PlatformSurface* PlatformSurface_CreateXlib(Display* pDisplay, Window window);
+#endif//VK_USE_PLATFORM_XLIB_KHR
+#ifdef VK_USE_PLATFORM_XCB_KHR
+PlatformSurface* PlatformSurface_CreateXcb(
+	xcb_connection_t* pConnection,
+	xcb_window_t window);
+#endif//VK_USE_PLATFORM_XCB_KHR
+#ifdef VK_USE_PLATFORM_WAYLAND_KHR
+PlatformSurface* PlatformSurface_CreateWayland(
+	struct wl_display* pDisplay,
+	struct wl_surface* pSurface);
+#endif//VK_USE_PLATFORM_WAYLAND_KHR
+void PlatformSurface_Destroy(PlatformSurface* pThis);
+
+PlatformSurfaceType PlatformSurface_GetType(const PlatformSurface* pThis);
+const char* PlatformSurface_GetInstanceExtension(const PlatformSurface* pThis);
+VkSurfaceKHR PlatformSurface_CreateVkSurface(
+	const PlatformSurface* pThis,
+	VkInstance instance);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__PLATFORM_SURFACE_H
@@ -0,0 +1,469 @@
+#include "stdafx.h"
+#include "RenderCounters.h"
+
+#include "MemoryUtils.h"
+#include "Utils.h"
+
+// RenderCounters_FillInheritance's activePass while no pass is being counted
+#define NO_ACTIVE_PASS UINT32_MAX
+
+// everything counted for a pass, in the order the statistics are written in
+typedef enum render_counter_t {
+	RENDER_COUNTER_INPUT_ASSEMBLY_VERTICES,
+	RENDER_COUNTER_INPUT_ASSEMBLY_PRIMITIVES,
+	RENDER_COUNTER_VERTEX_SHADER_INVOCATIONS,
+	RENDER_COUNTER_CLIPPING_INVOCATIONS,
+	RENDER_COUNTER_CLIPPING_PRIMITIVES,
+	RENDER_COUNTER_FRAGMENT_SHADER_INVOCATIONS,
+	RENDER_COUNTER_STATISTICS_COUNT,
+	RENDER_COUNTER_SAMPLES_PASSED = RENDER_COUNTER_STATISTICS_COUNT,
+	RENDER_COUNTER_COUNT
+} RenderCounter;
+
+// results are written in bit order, which is the order of RenderCounter
+static const VkQueryPipelineStatisticFlags kPipelineStatistics
+	= VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+// one frame's counts for every pass it counted
+typedef struct counter_sample_t {
+	uint32_t passMask;
+	uint64_t aaValues[RENDER_COUNTERS_MAX_PASSES][RENDER_COUNTER_COUNT];
+} CounterSample;
+
+// one frame in flight's queries
+typedef struct counter_slot_t {
+	// submitted but not read back yet
+	BOOL pending;
+	// the passes begun in the frame
+	uint32_t passMask;
+} CounterSlot;
+
+struct render_counters_t {
+	VkDevice device;
+	// VK_NULL_HANDLE without inheritedQueries
+	VkQueryPool occlusionQueryPool;
+	// VK_NULL_HANDLE without inheritedQueries and pipelineStatisticsQuery
+	VkQueryPool statisticsQueryPool;
+	VkQueryControlFlags occlusionControlFlags;
+
+	// as set, and as the current frame was begun with
+	BOOL enabled;
+	BOOL frameEnabled;
+
+	uint32_t frameCount;
+	CounterSlot* paSlots;
+	uint32_t currentSlot;
+	uint32_t activePass;
+	const char* aszPassNames[RENDER_COUNTERS_MAX_PASSES];
+
+	// the most recent frames, a ring starting at windowStart, with the sum
+	// of their values and how many of them counted each pass
+	CounterSample* paWindow;
+	uint32_t windowStart;
+	uint32_t windowCount;
+	uint64_t aaWindowSums[RENDER_COUNTERS_MAX_PASSES][RENDER_COUNTER_COUNT];
+	uint32_t aWindowPassCounts[RENDER_COUNTERS_MAX_PASSES];
+};
+
+uint32_t RenderCounters_GetQuery(uint32_t slot, uint32_t pass);
+void RenderCounters_Collect(RenderCounters* pThis, CounterSlot* pSlot, uint32_t slot);
+void RenderCounters_AddSample(RenderCounters* pThis, const CounterSample* pSample);
+void RenderCounters_ClearWindow(RenderCounters* pThis);
+
+/*!
+ * \brief	creates the queries for every frame in flight, disabled
+ *
+ * \param	frameCount how many frames may be in flight, each gets its own queries
+ * \param	pEnabledFeatures the features the device was created with, which
+ *			decide what can be counted
+ */
+RenderCounters* RenderCounters_Create(
+	VkDevice device,
+	uint32_t frameCount,
+	const VkPhysicalDeviceFeatures* pEnabledFeatures) {
+	assert(device);
+	assert(frameCount > 0);
+	assert(pEnabledFeatures);
+
+	RenderCounters* pRenderCounters = (RenderCounters*)malloc(sizeof(RenderCounters));
+	memset(pRenderCounters, 0, sizeof(RenderCounters));
+
+	pRenderCounters->device = device;
+	pRenderCounters->frameCount = frameCount;
+	pRenderCounters->activePass = NO_ACTIVE_PASS;
+	pRenderCounters->paSlots = SAFE_ALLOCATE_ARRAY(CounterSlot, frameCount);
+	memset(pRenderCounters->paSlots, 0, sizeof(CounterSlot) * frameCount);
+	pRenderCounters->paWindow = SAFE_ALLOCATE_ARRAY(CounterSample, RENDER_COUNTERS_WINDOW_LENGTH);
+
+	if (!pEnabledFeatures->inheritedQueries) {
+		Log_Write(
+			LOG_SEVERITY_INFO,
+			"counters",
+			"no inheritedQueries, the counters are unavailable");
+		return pRenderCounters;
+	}
+
+	VkQueryPoolCreateInfo queryPoolCreateInfo = { 0 };
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.pNext = NULL;
+	queryPoolCreateInfo.flags = 0;
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+	queryPoolCreateInfo.queryCount = RenderCounters_GetQuery(frameCount, 0);
+	queryPoolCreateInfo.pipelineStatistics = 0;
+	REQUIRE_VK_SUCCESS(
+		vkCreateQueryPool(
+			device,
+			&queryPoolCreateInfo,
+			NULL,
+			&pRenderCounters->occlusionQueryPool)
+	);
+	// otherwise the count may only be told apart from 0
+	if (pEnabledFeatures->occlusionQueryPrecise) {
+		pRenderCounters->occlusionControlFlags = VK_QUERY_CONTROL_PRECISE_BIT;
+	}
+
+	if (!pEnabledFeatures->pipelineStatisticsQuery) {
+		Log_Write(
+			LOG_SEVERITY_INFO,
+			"counters",
+			"no pipelineStatisticsQuery, only samples passed are counted");
+		return pRenderCounters;
+	}
+
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	queryPoolCreateInfo.pipelineStatistics = kPipelineStatistics;
+	REQUIRE_VK_SUCCESS(
+		vkCreateQueryPool(
+			device,
+			&queryPoolCreateInfo,
+			NULL,
+			&pRenderCounters->statisticsQueryPool)
+	);
+
+	return pRenderCounters;
+}
+
+/*!
+ * \brief	destroys the queries, none of them may still be in use by the gpu
+ */
+void RenderCounters_Destroy(RenderCounters* pThis) {
+	assert(pThis);
+
+	vkDestroyQueryPool(pThis->device, pThis->statisticsQueryPool, NULL);
+	vkDestroyQueryPool(pThis->device, pThis->occlusionQueryPool, NULL);
+	SAFE_FREE(pThis->paSlots);
+	SAFE_FREE(pThis->paWindow);
+	free(pThis);
+}
+
+// FALSE if the device can't count the renderer's secondaries
+BOOL RenderCounters_IsAvailable(const RenderCounters* pThis) {
+	assert(pThis);
+	return pThis->occlusionQueryPool != VK_NULL_HANDLE;
+}
+
+/*!
+ * \brief	turns counting on or off from the next RenderCounters_BeginFrame
+ *
+ * Turning it back on starts the averages over.
+ *
+ * \return	FALSE if counting was asked for but isn't available
+ */
+BOOL RenderCounters_SetEnabled(RenderCounters* pThis, BOOL enabled) {
+	assert(pThis);
+
+	if (enabled && !RenderCounters_IsAvailable(pThis)) {
+		return FALSE;
+	}
+	pThis->enabled = enabled;
+	return TRUE;
+}
+
+BOOL RenderCounters_IsEnabled(const RenderCounters* pThis) {
+	assert(pThis);
+	return pThis->enabled;
+}
+
+/*!
+ * \brief	starts counting frame \a frameIndex, if enabled
+ *
+ * Call once the gpu has finished with the frame that last used \a frameIndex,
+ * as that frame's counts are read back here. It resets the frame's queries,
+ * so it has to be outside a render pass.
+ *
+ * \param	commandBuffer the frame's primary, already begun
+ */
+void RenderCounters_BeginFrame(
+	RenderCounters* pThis,
+	uint32_t frameIndex,
+	VkCommandBuffer commandBuffer) {
+	assert(pThis);
+	assert(frameIndex < pThis->frameCount);
+	assert(commandBuffer);
+	assert(pThis->activePass == NO_ACTIVE_PASS && "a pass was begun but never ended");
+
+	if (pThis->enabled && !pThis->frameEnabled) {
+		// whatever is still pending was counted before the gap
+		for (uint32_t slot = 0; slot < pThis->frameCount; slot++) {
+			pThis->paSlots[slot].pending = FALSE;
+		}
+		RenderCounters_ClearWindow(pThis);
+	}
+	pThis->frameEnabled = pThis->enabled;
+	pThis->currentSlot = frameIndex;
+
+	CounterSlot* pSlot = &pThis->paSlots[frameIndex];
+	if (pSlot->pending) {
+		RenderCounters_Collect(pThis, pSlot, frameIndex);
+		pSlot->pending = FALSE;
+	}
+	if (!pThis->frameEnabled) {
+		return;
+	}
+
+	pSlot->passMask = 0;
+	vkCmdResetQueryPool(
+		commandBuffer,
+		pThis->occlusionQueryPool,
+		RenderCounters_GetQuery(frameIndex, 0),
+		RENDER_COUNTERS_MAX_PASSES);
+	if (pThis->statisticsQueryPool) {
+		vkCmdResetQueryPool(
+			commandBuffer,
+			pThis->statisticsQueryPool,
+			RenderCounters_GetQuery(frameIndex, 0),
+			RENDER_COUNTERS_MAX_PASSES);
+	}
+}
+
+/*!
+ * \brief	starts counting everything drawn into \a commandBuffer as \a pass
+ *
+ * Begin it before vkCmdBeginRenderPass and end it after vkCmdEndRenderPass,
+ * queries can't be begun in a subpass that only executes secondaries. Every
+ * secondary executed meanwhile needs RenderCounters_FillInheritance. Passes
+ * don't nest, and each can only be counted once a frame.
+ *
+ * \param	szName has to stay valid for as long as the counters
+ */
+void RenderCounters_BeginPass(
+	RenderCounters* pThis,
+	VkCommandBuffer commandBuffer,
+	uint32_t pass,
+	const char* szName) {
+	assert(pThis);
+	assert(commandBuffer);
+	assert(pass < RENDER_COUNTERS_MAX_PASSES);
+	assert(szName);
+
+	if (!pThis->frameEnabled) {
+		return;
+	}
+
+	CounterSlot* pSlot = &pThis->paSlots[pThis->currentSlot];
+	assert(pThis->activePass == NO_ACTIVE_PASS && "passes can't nest");
+	assert(!(pSlot->passMask & (1u << pass)) && "the pass was already counted this frame");
+
+	pThis->activePass = pass;
+	pThis->aszPassNames[pass] = szName;
+	pSlot->passMask |= 1u << pass;
+
+	uint32_t query = RenderCounters_GetQuery(pThis->currentSlot, pass);
+	vkCmdBeginQuery(commandBuffer, pThis->occlusionQueryPool, query, pThis->occlusionControlFlags);
+	if (pThis->statisticsQueryPool) {
+		vkCmdBeginQuery(commandBuffer, pThis->statisticsQueryPool, query, 0);
+	}
+}
+
+/*!
+ * \brief	stops counting the pass begun last
+ */
+void RenderCounters_EndPass(RenderCounters* pThis, VkCommandBuffer commandBuffer) {
+	assert(pThis);
+	assert(commandBuffer);
+
+	if (!pThis->frameEnabled) {
+		return;
+	}
+	assert(pThis->activePass != NO_ACTIVE_PASS);
+
+	CounterSlot* pSlot = &pThis->paSlots[pThis->currentSlot];
+	uint32_t query = RenderCounters_GetQuery(pThis->currentSlot, pThis->activePass);
+	vkCmdEndQuery(commandBuffer, pThis->occlusionQueryPool, query);
+	if (pThis->statisticsQueryPool) {
+		vkCmdEndQuery(commandBuffer, pThis->statisticsQueryPool, query);
+	}
+
+	pThis->activePass = NO_ACTIVE_PASS;
+	pSlot->pending = TRUE;
+}
+
+/*!
+ * \brief	sets the query fields of a secondary's inheritance info
+ *
+ * Secondaries executed while a pass is counted have to inherit its queries,
+ * any other time they're cleared.
+ */
+void RenderCounters_FillInheritance(
+	const RenderCounters* pThis,
+	VkCommandBufferInheritanceInfo* pInheritanceInfo) {
+	assert(pThis);
+	assert(pInheritanceInfo);
+
+	if (pThis->activePass == NO_ACTIVE_PASS) {
+		pInheritanceInfo->occlusionQueryEnable = VK_FALSE;
+		pInheritanceInfo->queryFlags = 0;
+		pInheritanceInfo->pipelineStatistics = 0;
+		return;
+	}
+
+	pInheritanceInfo->occlusionQueryEnable = VK_TRUE;
+	pInheritanceInfo->queryFlags = pThis->occlusionControlFlags;
+	pInheritanceInfo->pipelineStatistics = pThis->statisticsQueryPool ? kPipelineStatistics : 0;
+}
+
+/*!
+ * \brief	\a pass's counts per frame, averaged over the frames in the window
+ *
+ * Statistics stay 0 without pipelineStatisticsQuery.
+ *
+ * \return	FALSE if none of the frames in the window counted \a pass
+ */
+BOOL RenderCounters_GetPassCounters(
+	const RenderCounters* pThis,
+	uint32_t pass,
+	PassCounters* pCountersOut) {
+	assert(pThis);
+	assert(pass < RENDER_COUNTERS_MAX_PASSES);
+	assert(pCountersOut);
+
+	memset(pCountersOut, 0, sizeof(PassCounters));
+	pCountersOut->szName = pThis->aszPassNames[pass];
+	pCountersOut->frameCount = pThis->aWindowPassCounts[pass];
+	if (pCountersOut->frameCount == 0) {
+		return FALSE;
+	}
+
+	const uint64_t* aSums = pThis->aaWindowSums[pass];
+	double frameCount = (double)pCountersOut->frameCount;
+	pCountersOut->inputAssemblyVertices
+		= (double)aSums[RENDER_COUNTER_INPUT_ASSEMBLY_VERTICES] / frameCount;
+	pCountersOut->inputAssemblyPrimitives
+		= (double)aSums[RENDER_COUNTER_INPUT_ASSEMBLY_PRIMITIVES] / frameCount;
+	pCountersOut->vertexShaderInvocations
+		= (double)aSums[RENDER_COUNTER_VERTEX_SHADER_INVOCATIONS] / frameCount;
+	pCountersOut->clippingInvocations
+		= (double)aSums[RENDER_COUNTER_CLIPPING_INVOCATIONS] / frameCount;
+	pCountersOut->clippingPrimitives
+		= (double)aSums[RENDER_COUNTER_CLIPPING_PRIMITIVES] / frameCount;
+	pCountersOut->fragmentShaderInvocations
+		= (double)aSums[RENDER_COUNTER_FRAGMENT_SHADER_INVOCATIONS] / frameCount;
+	pCountersOut->samplesPassed
+		= (double)aSums[RENDER_COUNTER_SAMPLES_PASSED] / frameCount;
+	return TRUE;
+}
+
+// Private Interface!
+
+// a pass's query, the same index in both pools
+uint32_t RenderCounters_GetQuery(uint32_t slot, uint32_t pass) {
+	return slot * RENDER_COUNTERS_MAX_PASSES + pass;
+}
+
+/*!
+ * \brief	reads back a finished frame's counts and adds them to the window
+ *
+ * Never waits, a frame whose queries somehow aren't available is dropped.
+ */
+void RenderCounters_Collect(RenderCounters* pThis, CounterSlot* pSlot, uint32_t slot) {
+	CounterSample sample;
+	memset(&sample, 0, sizeof(CounterSample));
+	sample.passMask = pSlot->passMask;
+
+	for (uint32_t pass = 0; pass < RENDER_COUNTERS_MAX_PASSES; pass++) {
+		if (!(pSlot->passMask & (1u << pass))) {
+			continue;
+		}
+		uint64_t* aValues = sample.aaValues[pass];
+		uint32_t query = RenderCounters_GetQuery(slot, pass);
+
+		VkResult result = vkGetQueryPoolResults(
+			pThis->device,
+			pThis->occlusionQueryPool,
+			query,
+			1,
+			sizeof(uint64_t),
+			&aValues[RENDER_COUNTER_SAMPLES_PASSED],
+			sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT);
+		// a lost device is the renderer's to recover from, the frame is just dropped
+		if (result == VK_NOT_READY || result == VK_ERROR_DEVICE_LOST) {
+			return;
+		}
+		REQUIRE_VK_SUCCESS(result);
+
+		if (pThis->statisticsQueryPool) {
+			result = vkGetQueryPoolResults(
+				pThis->device,
+				pThis->statisticsQueryPool,
+				query,
+				1,
+				sizeof(uint64_t) * RENDER_COUNTER_STATISTICS_COUNT,
+				aValues,
+				sizeof(uint64_t) * RENDER_COUNTER_STATISTICS_COUNT,
+				VK_QUERY_RESULT_64_BIT);
+			if (result == VK_NOT_READY || result == VK_ERROR_DEVICE_LOST) {
+				return;
+			}
+			REQUIRE_VK_SUCCESS(result);
+		}
+	}
+
+	RenderCounters_AddSample(pThis, &sample);
+}
+
+// adds a frame to the window and its sums, pushing out the oldest once full
+void RenderCounters_AddSample(RenderCounters* pThis, const CounterSample* pSample) {
+	uint32_t index;
+	if (pThis->windowCount < RENDER_COUNTERS_WINDOW_LENGTH) {
+		index = (pThis->windowStart + pThis->windowCount++) % RENDER_COUNTERS_WINDOW_LENGTH;
+	}
+	else {
+		index = pThis->windowStart;
+		pThis->windowStart = (pThis->windowStart + 1) % RENDER_COUNTERS_WINDOW_LENGTH;
+
+		const CounterSample* pOldest = &pThis->paWindow[index];
+		for (uint32_t pass = 0; pass < RENDER_COUNTERS_MAX_PASSES; pass++) {
+			if (!(pOldest->passMask & (1u << pass))) {
+				continue;
+			}
+			for (uint32_t counter = 0; counter < RENDER_COUNTER_COUNT; counter++) {
+				pThis->aaWindowSums[pass][counter] -= pOldest->aaValues[pass][counter];
+			}
+			pThis->aWindowPassCounts[pass]--;
+		}
+	}
+
+	pThis->paWindow[index] = *pSample;
+	for (uint32_t pass = 0; pass < RENDER_COUNTERS_MAX_PASSES; pass++) {
+		if (!(pSample->passMask & (1u << pass))) {
+			continue;
+		}
+		for (uint32_t counter = 0; counter < RENDER_COUNTER_COUNT; counter++) {
+			pThis->aaWindowSums[pass][counter] += pSample->aaValues[pass][counter];
+		}
+		pThis->aWindowPassCounts[pass]++;
+	}
+}
+
+void RenderCounters_ClearWindow(RenderCounters* pThis) {
+	pThis->windowStart = 0;
+	pThis->windowCount = 0;
+	memset(pThis->aaWindowSums, 0, sizeof(pThis->aaWindowSums));
+	memset(pThis->aWindowPassCounts, 0, sizeof(pThis->aWindowPassCounts));
+}
@@ -0,0 +1,81 @@
+#ifndef __RENDER_COUNTERS_H
+#define __RENDER_COUNTERS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Counts the work each render pass does with pipeline statistics and
+ * occlusion queries, to find overdraw and wasted geometry.
+ *
+ * Off by default. While off nothing is recorded at all, so it costs a branch
+ * per call. While on, each pass of each frame is counted, read back once the
+ * frame's index comes around again without waiting on the gpu, and averaged
+ * over the last RENDER_COUNTERS_WINDOW_LENGTH frames.
+ *
+ * The renderer draws everything from secondaries, which only count towards
+ * queries with the inheritedQueries feature, so without it the counters are
+ * unavailable. Pipeline statistics also need pipelineStatisticsQuery, without
+ * it only samples passed are counted. Only use it from one thread.
+ */
+typedef struct render_counters_t RenderCounters;
+
+// pass indices have to be below this
+#define RENDER_COUNTERS_MAX_PASSES 8
+// how many frames the counters are averaged over
+#define RENDER_COUNTERS_WINDOW_LENGTH 60
+
+// a pass's work per frame, averaged over the frames in the window
+typedef struct pass_counters_t {
+	// as passed to RenderCounters_BeginPass
+	const char* szName;
+	// how many frames went into the averages, 0 if the pass hasn't been counted
+	uint32_t frameCount;
+
+	double inputAssemblyVertices;
+	double inputAssemblyPrimitives;
+	double vertexShaderInvocations;
+	// primitives that reached clipping and that came out of it
+	double clippingInvocations;
+	double clippingPrimitives;
+	double fragmentShaderInvocations;
+	// how many samples passed the depth test. fragment shader invocations
+	// over this is roughly how much each pixel was overdrawn
+	double samplesPassed;
+} PassCounters;
+
+RenderCounters* RenderCounters_Create(
+	VkDevice device,
+	uint32_t frameCount,
+	const VkPhysicalDeviceFeatures* pEnabledFeatures);
+void RenderCounters_Destroy(RenderCounters* pThis);
+
+BOOL RenderCounters_IsAvailable(const RenderCounters* pThis);
+BOOL RenderCounters_SetEnabled(RenderCounters* pThis, BOOL enabled);
+BOOL RenderCounters_IsEnabled(const RenderCounters* pThis);
+
+void RenderCounters_BeginFrame(
+	RenderCounters* pThis,
+	uint32_t frameIndex,
+	VkCommandBuffer commandBuffer);
+void RenderCounters_BeginPass(
+	RenderCounters* pThis,
+	VkCommandBuffer commandBuffer,
+	uint32_t pass,
+	const char* szName);
+void RenderCounters_EndPass(RenderCounters* pThis, VkCommandBuffer commandBuffer);
+void RenderCounters_FillInheritance(
+	const RenderCounters* pThis,
+	VkCommandBufferInheritanceInfo* pInheritanceInfo);
+
+BOOL RenderCounters_GetPassCounters(
+	const RenderCounters* pThis,
+	uint32_t pass,
+	PassCounters* pCountersOut);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__RENDER_COUNTERS_H
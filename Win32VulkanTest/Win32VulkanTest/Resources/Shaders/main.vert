@@ -2,10 +2,19 @@
 
 precision mediump float;
 
+// the main.push_constants variant gets the matrices pushed with each draw,
+// the plain one reads them from the uniform ring
+#ifdef PUSH_CONSTANTS
+layout (push_constant) uniform Transforms {
+	mat4 uModelView;
+	mat4 uProjection;
+} transforms;
+#else
 layout (binding = 0) uniform UBO {
 	mat4 uModelView;
 	mat4 uProjection;
-} ubo;
+} transforms;
+#endif
 
 layout (location = 0) in vec3 inPosition;
 layout (location = 1) in vec3 inColor;
@@ -14,5 +23,5 @@ layout (location = 0) out vec3 color;
 
 void main() {
 	color = inColor;
-	gl_Position = ubo.uProjection * ubo.uModelView * vec4(inPosition, 1);
+	gl_Position = transforms.uProjection * transforms.uModelView * vec4(inPosition, 1);
 }
@@ -1,126 +1,506 @@
 #include "stdafx.h"
 #include "ShaderManager.h"
 
+#ifdef SHADER_MANAGER_EMBEDDED_SHADERS
+#include "EmbeddedShaders.h"
+#endif//SHADER_MANAGER_EMBEDDED_SHADERS
+#include "FileWatcher.h"
 #include "MemoryUtils.h"
-#include "VulkanRenderer.h"
+#include "Thread.h"
+#include "Utils.h"
+
+#include <ctype.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif//_WIN32
+
+// the first word of every SPIR-V module, in host byte order
+#define SPIRV_MAGIC 0x07230203
+#define SPIRV_MAGIC_SWAPPED 0x03022307
+// magic, version, generator, bound and schema
+#define SPIRV_HEADER_WORDS 5
+
+// how often the watching thread checks whether it should stop
+#define WATCH_TIMEOUT_MILLISECONDS 100
+// editors often save in several writes, give them time to finish
+#define WATCH_SETTLE_MILLISECONDS 50
+
+// the spirv extensions end in this, the rest is the source's extension
+#define SPIRV_EXTENSION ".spv"
+
+typedef struct shader_entry_t {
+	char* szName;
+	ShaderStage stage;
+	VkShaderModule module;
+	uint32_t refCount;
+
+	// replaced by a reloaded module, destroyed once the last holder releases it
+	BOOL stale;
+	// when the source was last seen to change, 0 if it doesn't exist
+	time_t sourceModifiedTime;
+} ShaderEntry;
+
+// what the watching thread checks without holding the lock
+typedef struct watched_shader_t {
+	char* szName;
+	ShaderStage stage;
+	time_t sourceModifiedTime;
+} WatchedShader;
+
+// a read only view of a whole file
+typedef struct mapped_file_t {
+	const void* pData;
+	size_t size;
+} MappedFile;
 
 struct shader_manager_t {
-	VulkanRenderer* pVulkanRenderer;
+	VkDevice device;
 
 	char* szShaderDirectory;
-	char* szVertexExtension;
-	char* szFragmentExtension;
+	char* aszExtensions[SHADER_STAGE_COUNT];
+	// GLSL source extensions, NULL when a stage has no source to compile
+	char* aszSourceExtensions[SHADER_STAGE_COUNT];
+
+	// guards everything below
+	Mutex* pMutex;
+	uint32_t entryCount;
+	uint32_t entryCapacity;
+	ShaderEntry* paEntries;
+
+	// hot reload
+	FileWatcher* pFileWatcher;
+	Thread* pWatchThread;
+	BOOL stopWatching;
+	ShaderReloadCallback reloadCallback;
+	void* pReloadUserData;
 };
 
-FILE* ShaderManager_OpenShader(
+ShaderEntry* ShaderManager_FindEntry(
+	ShaderManager* pThis,
+	const char* szShaderName,
+	ShaderStage stage);
+void ShaderManager_AddEntry(
+	ShaderManager* pThis,
+	const char* szShaderName,
+	ShaderStage stage,
+	VkShaderModule shaderModule,
+	uint32_t refCount,
+	time_t sourceModifiedTime);
+void ShaderManager_RemoveEntry(ShaderManager* pThis, uint32_t entryIndex);
+VkShaderModule ShaderManager_CreateModule(ShaderManager* pThis, const char* szFilePath);
+VkShaderModule ShaderManager_CreateModuleFromCode(
+	ShaderManager* pThis,
+	const uint32_t* pCode,
+	size_t codeSize);
+#ifdef SHADER_MANAGER_EMBEDDED_SHADERS
+const EmbeddedShader* FindEmbeddedShader(const char* szShaderName, ShaderStage stage);
+#endif//SHADER_MANAGER_EMBEDDED_SHADERS
+time_t ShaderManager_GetSourceModifiedTime(
+	ShaderManager* pThis,
+	const char* szShaderName,
+	ShaderStage stage);
+char* ShaderManager_BuildPath(
 	ShaderManager* pThis,
 	const char* szFileName,
 	const char* szExtension);
-void ShaderManager_CloseShader(ShaderManager* pThis, FILE* pShaderFile);
+char* ShaderManager_BuildSourcePath(
+	ShaderManager* pThis,
+	const char* szShaderName,
+	const char* szExtension);
+void ShaderManager_WatchMain(void* pUserData);
+void ShaderManager_ReloadChanged(ShaderManager* pThis);
+BOOL ShaderManager_Compile(
+	const char* szShaderName,
+	const char* szSourcePath,
+	const char* szOutputPath);
+
+BOOL MapFile(const char* szFilePath, MappedFile* pMappedFileOut);
+void UnmapFile(MappedFile* pMappedFile);
+BOOL ValidateSpirv(const MappedFile* pMappedFile, const char* szFilePath);
+time_t GetModifiedTime(const char* szFilePath);
+char* StripExtension(const char* szExtension, const char* szSuffix);
 
 /*!
- * \brief	creates a manager to load and save shaders
+ * \brief	creates a manager to load and cache shaders
  *
- * A simple manager to create track shader objects
- *
- * \param	pVulkanRenderer the vulkan renderer to use
+ * \param	device where shader modules are created
  * \param	szShaderDirectory where to look for shaders (copied)
  * \param	szVertexExtension the extension on vertex shaders (copied)
  * \param	szFragmentExtension the extension on fragment shaders (copied)
- * \param	vertexShaderCount the number of vertex shaders we will support
- * \param	fragmentShaderCount the number of fragment shaders we will support
  */
 ShaderManager* ShaderManager_Create(
+	VkDevice device,
 	const char* szShaderDirectory,
 	const char* szVertexExtension,
 	const char* szFragmentExtension) {
+	assert(device);
 
 	ShaderManager* pShaderManager = (ShaderManager*)malloc(sizeof(ShaderManager));
 	memset(pShaderManager, 0, sizeof(ShaderManager));
 
+	pShaderManager->device = device;
 	pShaderManager->szShaderDirectory = _strdup(szShaderDirectory);
-	pShaderManager->szVertexExtension = _strdup(szVertexExtension);
-	pShaderManager->szFragmentExtension = _strdup(szFragmentExtension);
+	pShaderManager->aszExtensions[SHADER_STAGE_VERTEX] = _strdup(szVertexExtension);
+	pShaderManager->aszExtensions[SHADER_STAGE_FRAGMENT] = _strdup(szFragmentExtension);
+	for (uint32_t i = 0; i < SHADER_STAGE_COUNT; i++) {
+		pShaderManager->aszSourceExtensions[i] = StripExtension(
+			pShaderManager->aszExtensions[i],
+			SPIRV_EXTENSION);
+	}
+	pShaderManager->pMutex = Mutex_Create();
 
 	return pShaderManager;
 }
 
+/*!
+ * \brief	stops watching for changes and destroys every cached module
+ *
+ * Every acquired shader has to have been released.
+ */
 void ShaderManager_Destroy(ShaderManager* pThis) {
 	assert(pThis);
 
+	if (pThis->pWatchThread) {
+		Mutex_Lock(pThis->pMutex);
+		pThis->stopWatching = TRUE;
+		Mutex_Unlock(pThis->pMutex);
+		Thread_Join(pThis->pWatchThread);
+		pThis->pWatchThread = NULL;
+		FileWatcher_Destroy(pThis->pFileWatcher);
+		pThis->pFileWatcher = NULL;
+	}
+
+	for (uint32_t i = 0; i < pThis->entryCount; i++) {
+		ShaderEntry* pEntry = &pThis->paEntries[i];
+		assert(pEntry->refCount == 0);
+		vkDestroyShaderModule(pThis->device, pEntry->module, NULL);
+		SAFE_FREE(pEntry->szName);
+	}
+	SAFE_FREE(pThis->paEntries);
+
 	SAFE_FREE(pThis->szShaderDirectory);
-	SAFE_FREE(pThis->szVertexExtension);
-	SAFE_FREE(pThis->szFragmentExtension);
+	for (uint32_t i = 0; i < SHADER_STAGE_COUNT; i++) {
+		SAFE_FREE(pThis->aszExtensions[i]);
+		SAFE_FREE(pThis->aszSourceExtensions[i]);
+	}
+	Mutex_Destroy(pThis->pMutex);
 
 	free(pThis);
 }
 
-ShaderCode ShaderManager_GetVertexShader(
+/*!
+ * \brief	gets the module for \a szShaderName, loading it on first use
+ *
+ * Every successful acquire has to be matched by a ShaderManager_ReleaseShader.
+ *
+ * \return	the module, or VK_NULL_HANDLE if the file is missing or isn't SPIR-V
+ */
+VkShaderModule ShaderManager_AcquireShader(
 	ShaderManager* pThis,
-	const char* szShaderName) {
+	const char* szShaderName,
+	ShaderStage stage) {
+	assert(pThis);
+	assert(szShaderName);
+	assert(stage < SHADER_STAGE_COUNT);
+
+	Mutex_Lock(pThis->pMutex);
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	ShaderEntry* pEntry = ShaderManager_FindEntry(pThis, szShaderName, stage);
+	if (pEntry) {
+		pEntry->refCount++;
+		shaderModule = pEntry->module;
+	}
+	else {
+#ifdef SHADER_MANAGER_EMBEDDED_SHADERS
+		const EmbeddedShader* pEmbeddedShader = FindEmbeddedShader(szShaderName, stage);
+		if (pEmbeddedShader) {
+			shaderModule = ShaderManager_CreateModuleFromCode(
+				pThis,
+				pEmbeddedShader->pCode,
+				pEmbeddedShader->codeSize);
+		}
+#endif//SHADER_MANAGER_EMBEDDED_SHADERS
+		if (!shaderModule) {
+			char* szFilePath = ShaderManager_BuildPath(
+				pThis,
+				szShaderName,
+				pThis->aszExtensions[stage]);
+			shaderModule = ShaderManager_CreateModule(pThis, szFilePath);
+			SAFE_FREE(szFilePath);
+		}
+
+		if (shaderModule) {
+			ShaderManager_AddEntry(
+				pThis,
+				szShaderName,
+				stage,
+				shaderModule,
+				1,
+				pThis->pFileWatcher
+					? ShaderManager_GetSourceModifiedTime(pThis, szShaderName, stage)
+					: 0);
+		}
+	}
+
+	Mutex_Unlock(pThis->pMutex);
+	return shaderModule;
+}
 
-	FILE* pShaderFile = ShaderManager_OpenShader(
-		pThis,
-		szShaderName,
-		pThis->szVertexExtension);
+/*!
+ * \brief	gives back a module from ShaderManager_AcquireShader
+ *
+ * The module stays cached, so pipelines built from it later don't reload it,
+ * unless it's been replaced by a hot reload.
+ */
+void ShaderManager_ReleaseShader(ShaderManager* pThis, VkShaderModule shaderModule) {
+	assert(pThis);
 
-	fseek(pShaderFile, 0, SEEK_END);
-	fpos_t fileLength;
-	fgetpos(pShaderFile, &fileLength);
-	fseek(pShaderFile, 0, SEEK_SET);
+	if (!shaderModule) {
+		return;
+	}
+
+	Mutex_Lock(pThis->pMutex);
+
+	BOOL found = FALSE;
+	for (uint32_t i = 0; i < pThis->entryCount; i++) {
+		ShaderEntry* pEntry = &pThis->paEntries[i];
+		if (pEntry->module != shaderModule) {
+			continue;
+		}
+
+		assert(pEntry->refCount > 0);
+		pEntry->refCount--;
+		if (pEntry->stale && pEntry->refCount == 0) {
+			ShaderManager_RemoveEntry(pThis, i);
+		}
+		found = TRUE;
+		break;
+	}
+	assert(found && "shaderModule wasn't acquired from this manager");
+
+	Mutex_Unlock(pThis->pMutex);
+}
 
-	assert(fileLength > 0);
+/*!
+ * \brief	destroys every cached module that nothing holds
+ * \return	how many modules were destroyed
+ */
+uint32_t ShaderManager_PurgeUnused(ShaderManager* pThis) {
+	assert(pThis);
 
-	char* szFileContents = SAFE_ALLOCATE_ARRAY(char, fileLength);
+	Mutex_Lock(pThis->pMutex);
 
-	fread(szFileContents, (size_t)fileLength, 1, pShaderFile);
+	uint32_t purgedCount = 0;
+	uint32_t i = 0;
+	while (i < pThis->entryCount) {
+		if (pThis->paEntries[i].refCount > 0) {
+			i++;
+			continue;
+		}
 
-	ShaderManager_CloseShader(pThis, pShaderFile);
+		ShaderManager_RemoveEntry(pThis, i);
+		purgedCount++;
+	}
 
-	return (ShaderCode) {
-		(uint32_t*)szFileContents,
-		fileLength
-	};
+	Mutex_Unlock(pThis->pMutex);
+	return purgedCount;
 }
 
-ShaderCode ShaderManager_GetFragmentShader(
+/*!
+ * \brief	starts a thread that reloads shaders whose files change
+ *
+ * Stages whose extension ends in .spv are recompiled from the file without
+ * it, main.vert.spv from main.vert for example, using SHADER_COMPILER_COMMAND.
+ * Other stages reload when the shader file itself changes. Only shaders that
+ * are in the cache are watched.
+ *
+ * \param	callback told about each reloaded shader, on the watching thread
+ * \return	FALSE if the shader directory can't be watched
+ */
+BOOL ShaderManager_EnableHotReload(
 	ShaderManager* pThis,
-	const char* szShaderName) {
-	// TODO: virtually copy/paste from GetVertexShader
+	ShaderReloadCallback callback,
+	void* pUserData) {
+	assert(pThis);
+	assert(!pThis->pWatchThread);
+
+	FileWatcher* pFileWatcher = FileWatcher_Create(pThis->szShaderDirectory);
+	if (!pFileWatcher) {
+		Log_Write(
+			LOG_SEVERITY_WARNING,
+			"shaders",
+			"can't watch the shader directory, hot reload is off");
+		return FALSE;
+	}
+
+	// sources are only looked at once something's watching them
+	Mutex_Lock(pThis->pMutex);
+	pThis->pFileWatcher = pFileWatcher;
+	for (uint32_t i = 0; i < pThis->entryCount; i++) {
+		ShaderEntry* pEntry = &pThis->paEntries[i];
+		pEntry->sourceModifiedTime = ShaderManager_GetSourceModifiedTime(
+			pThis,
+			pEntry->szName,
+			pEntry->stage);
+	}
+	Mutex_Unlock(pThis->pMutex);
+
+	pThis->reloadCallback = callback;
+	pThis->pReloadUserData = pUserData;
+	pThis->stopWatching = FALSE;
+	pThis->pWatchThread = Thread_Create(ShaderManager_WatchMain, pThis);
+	return TRUE;
+}
 
-	FILE* pShaderFile = ShaderManager_OpenShader(
-		pThis,
-		szShaderName,
-		pThis->szFragmentExtension);
+VkShaderStageFlagBits ShaderManager_GetStageFlag(ShaderStage stage) {
+	switch (stage) {
+	case SHADER_STAGE_VERTEX:
+		return VK_SHADER_STAGE_VERTEX_BIT;
+	case SHADER_STAGE_FRAGMENT:
+		return VK_SHADER_STAGE_FRAGMENT_BIT;
+	default:
+		assert(!"unknown shader stage");
+		return VK_SHADER_STAGE_ALL;
+	}
+}
 
-	fseek(pShaderFile, 0, SEEK_END);
-	fpos_t fileLength;
-	fgetpos(pShaderFile, &fileLength);
-	fseek(pShaderFile, 0, SEEK_SET);
+// Private Interface!
 
-	assert(fileLength > 0);
+// the current module for a shader, stale ones are only kept to be released
+ShaderEntry* ShaderManager_FindEntry(
+	ShaderManager* pThis,
+	const char* szShaderName,
+	ShaderStage stage) {
+	for (uint32_t i = 0; i < pThis->entryCount; i++) {
+		ShaderEntry* pEntry = &pThis->paEntries[i];
+		if (!pEntry->stale
+			&& pEntry->stage == stage
+			&& strcmp(pEntry->szName, szShaderName) == 0) {
+
+			return pEntry;
+		}
+	}
+	return NULL;
+}
+
+void ShaderManager_AddEntry(
+	ShaderManager* pThis,
+	const char* szShaderName,
+	ShaderStage stage,
+	VkShaderModule shaderModule,
+	uint32_t refCount,
+	time_t sourceModifiedTime) {
+	if (pThis->entryCount == pThis->entryCapacity) {
+		pThis->entryCapacity = pThis->entryCapacity ? pThis->entryCapacity * 2 : 8;
+		pThis->paEntries = (ShaderEntry*)realloc(
+			pThis->paEntries,
+			sizeof(ShaderEntry) * pThis->entryCapacity);
+		assert(pThis->paEntries);
+	}
+
+	ShaderEntry* pEntry = &pThis->paEntries[pThis->entryCount++];
+	pEntry->szName = _strdup(szShaderName);
+	pEntry->stage = stage;
+	pEntry->module = shaderModule;
+	pEntry->refCount = refCount;
+	pEntry->stale = FALSE;
+	pEntry->sourceModifiedTime = sourceModifiedTime;
+}
 
-	char* szFileContents = SAFE_ALLOCATE_ARRAY(char, fileLength);
+// destroys the entry's module, the last entry moves into its place
+void ShaderManager_RemoveEntry(ShaderManager* pThis, uint32_t entryIndex) {
+	assert(entryIndex < pThis->entryCount);
 
-	fread(szFileContents, (size_t)fileLength, 1, pShaderFile);
+	ShaderEntry* pEntry = &pThis->paEntries[entryIndex];
+	vkDestroyShaderModule(pThis->device, pEntry->module, NULL);
+	SAFE_FREE(pEntry->szName);
+	*pEntry = pThis->paEntries[--pThis->entryCount];
+}
 
-	ShaderManager_CloseShader(pThis, pShaderFile);
+/*!
+ * \brief	creates a module straight from the mapped file, without copying it
+ */
+VkShaderModule ShaderManager_CreateModule(ShaderManager* pThis, const char* szFilePath) {
+	MappedFile mappedFile;
+	if (!MapFile(szFilePath, &mappedFile)) {
+		Log_Write(LOG_SEVERITY_ERROR, "shaders", "failed to open %s", szFilePath);
+		return VK_NULL_HANDLE;
+	}
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	if (ValidateSpirv(&mappedFile, szFilePath)) {
+		shaderModule = ShaderManager_CreateModuleFromCode(
+			pThis,
+			(const uint32_t*)mappedFile.pData,
+			mappedFile.size);
+	}
+
+	UnmapFile(&mappedFile);
+
+	return shaderModule;
+}
 
-	return (ShaderCode) {
-		(uint32_t*)szFileContents,
-			fileLength
-	};
+VkShaderModule ShaderManager_CreateModuleFromCode(
+	ShaderManager* pThis,
+	const uint32_t* pCode,
+	size_t codeSize) {
+	VkShaderModuleCreateInfo shaderModuleCreateInfo = { 0 };
+	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCreateInfo.pNext = NULL;
+	shaderModuleCreateInfo.flags = 0;
+	shaderModuleCreateInfo.codeSize = codeSize;
+	shaderModuleCreateInfo.pCode = pCode;
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	REQUIRE_VK_SUCCESS(
+		vkCreateShaderModule(
+			pThis->device,
+			&shaderModuleCreateInfo,
+			NULL,
+			&shaderModule)
+	);
+	return shaderModule;
 }
 
-void ShaderManager_CleanupShaderCode(ShaderCode shaderCode) {
-	assert(shaderCode.pCode);
-	assert(shaderCode.codeSize > 0);
+#ifdef SHADER_MANAGER_EMBEDDED_SHADERS
+// the shader compiled into the executable, NULL if it has to be loaded from disk
+const EmbeddedShader* FindEmbeddedShader(const char* szShaderName, ShaderStage stage) {
+	for (uint32_t i = 0; i < kEmbeddedShaderCount; i++) {
+		const EmbeddedShader* pEmbeddedShader = &kaEmbeddedShaders[i];
+		if (pEmbeddedShader->stage == stage
+			&& strcmp(pEmbeddedShader->szName, szShaderName) == 0) {
+
+			return pEmbeddedShader;
+		}
+	}
+	return NULL;
+}
+#endif//SHADER_MANAGER_EMBEDDED_SHADERS
 
-	SAFE_FREE(shaderCode.pCode);
-	shaderCode.codeSize = 0;
+// when the file a shader is compiled from changed, or the shader itself if it has no source
+time_t ShaderManager_GetSourceModifiedTime(
+	ShaderManager* pThis,
+	const char* szShaderName,
+	ShaderStage stage) {
+	char* szSourcePath = pThis->aszSourceExtensions[stage]
+		? ShaderManager_BuildSourcePath(pThis, szShaderName, pThis->aszSourceExtensions[stage])
+		: ShaderManager_BuildPath(pThis, szShaderName, pThis->aszExtensions[stage]);
+	time_t modifiedTime = GetModifiedTime(szSourcePath);
+	SAFE_FREE(szSourcePath);
+	return modifiedTime;
 }
 
-FILE* ShaderManager_OpenShader(
+/*!
+ * \brief	joins the shader directory, \a szFileName and \a szExtension
+ * \return	the path, to be freed by the caller
+ */
+char* ShaderManager_BuildPath(
 	ShaderManager* pThis,
 	const char* szFileName,
 	const char* szExtension) {
@@ -144,15 +524,335 @@ FILE* ShaderManager_OpenShader(
 	szFilePath[writeHead++] = '\0';
 	assert(writeHead == filePathBufferLength);
 
-	FILE* pFile;
-	fopen_s(&pFile, szFilePath, "rb");
-	assert(pFile);
+	return szFilePath;
+}
 
-	SAFE_FREE(szFilePath);
+/*!
+ * \brief	like ShaderManager_BuildPath, but leaves off the shader's variant so
+ *			every variant finds the source they share
+ */
+char* ShaderManager_BuildSourcePath(
+	ShaderManager* pThis,
+	const char* szShaderName,
+	const char* szExtension) {
+	const char* szVariant = strchr(szShaderName, SHADER_VARIANT_SEPARATOR);
+	if (!szVariant) {
+		return ShaderManager_BuildPath(pThis, szShaderName, szExtension);
+	}
+
+	size_t sourceNameLength = (size_t)(szVariant - szShaderName);
+	char* szSourceName = SAFE_ALLOCATE_ARRAY(char, sourceNameLength + 1);
+	memcpy(szSourceName, szShaderName, sourceNameLength);
+	szSourceName[sourceNameLength] = '\0';
+
+	char* szSourcePath = ShaderManager_BuildPath(pThis, szSourceName, szExtension);
+	SAFE_FREE(szSourceName);
+	return szSourcePath;
+}
 
-	return pFile;
+void ShaderManager_WatchMain(void* pUserData) {
+	ShaderManager* pThis = (ShaderManager*)pUserData;
+
+	for (;;) {
+		Mutex_Lock(pThis->pMutex);
+		BOOL stopWatching = pThis->stopWatching;
+		Mutex_Unlock(pThis->pMutex);
+		if (stopWatching) {
+			break;
+		}
+
+		if (FileWatcher_Wait(pThis->pFileWatcher, WATCH_TIMEOUT_MILLISECONDS)) {
+			Thread_Sleep(WATCH_SETTLE_MILLISECONDS);
+			ShaderManager_ReloadChanged(pThis);
+		}
+	}
 }
 
-void ShaderManager_CloseShader(ShaderManager* pThis, FILE* pShaderFile) {
-	fclose(pShaderFile);
+/*!
+ * \brief	recompiles and reloads every cached shader whose source changed
+ *
+ * Compiling happens without the lock held, so acquiring shaders never waits
+ * on the compiler. A shader that fails to compile keeps its old module.
+ */
+void ShaderManager_ReloadChanged(ShaderManager* pThis) {
+	Mutex_Lock(pThis->pMutex);
+	uint32_t watchedCount = 0;
+	WatchedShader* paWatched = SAFE_ALLOCATE_ARRAY(WatchedShader, pThis->entryCount + 1);
+	for (uint32_t i = 0; i < pThis->entryCount; i++) {
+		ShaderEntry* pEntry = &pThis->paEntries[i];
+		if (pEntry->stale) {
+			continue;
+		}
+		paWatched[watchedCount].szName = _strdup(pEntry->szName);
+		paWatched[watchedCount].stage = pEntry->stage;
+		paWatched[watchedCount].sourceModifiedTime = pEntry->sourceModifiedTime;
+		watchedCount++;
+	}
+	Mutex_Unlock(pThis->pMutex);
+
+	for (uint32_t i = 0; i < watchedCount; i++) {
+		WatchedShader* pWatched = &paWatched[i];
+		time_t modifiedTime = ShaderManager_GetSourceModifiedTime(
+			pThis,
+			pWatched->szName,
+			pWatched->stage);
+		if (modifiedTime == 0 || modifiedTime == pWatched->sourceModifiedTime) {
+			continue;
+		}
+
+		char* szFilePath = ShaderManager_BuildPath(
+			pThis,
+			pWatched->szName,
+			pThis->aszExtensions[pWatched->stage]);
+		BOOL compiled = TRUE;
+		if (pThis->aszSourceExtensions[pWatched->stage]) {
+			char* szSourcePath = ShaderManager_BuildSourcePath(
+				pThis,
+				pWatched->szName,
+				pThis->aszSourceExtensions[pWatched->stage]);
+			compiled = ShaderManager_Compile(pWatched->szName, szSourcePath, szFilePath);
+			SAFE_FREE(szSourcePath);
+		}
+		VkShaderModule shaderModule = compiled
+			? ShaderManager_CreateModule(pThis, szFilePath)
+			: VK_NULL_HANDLE;
+		SAFE_FREE(szFilePath);
+
+		Mutex_Lock(pThis->pMutex);
+		ShaderEntry* pEntry = ShaderManager_FindEntry(pThis, pWatched->szName, pWatched->stage);
+		if (pEntry) {
+			// don't retry a broken source until it's saved again
+			pEntry->sourceModifiedTime = modifiedTime;
+		}
+		if (pEntry && shaderModule) {
+			pEntry->stale = TRUE;
+			if (pEntry->refCount == 0) {
+				ShaderManager_RemoveEntry(pThis, (uint32_t)(pEntry - pThis->paEntries));
+			}
+			ShaderManager_AddEntry(
+				pThis,
+				pWatched->szName,
+				pWatched->stage,
+				shaderModule,
+				0,
+				modifiedTime);
+		}
+		else if (shaderModule) {
+			// purged while we were compiling, nobody wants it
+			vkDestroyShaderModule(pThis->device, shaderModule, NULL);
+			shaderModule = VK_NULL_HANDLE;
+		}
+		Mutex_Unlock(pThis->pMutex);
+
+		if (shaderModule && pThis->reloadCallback) {
+			pThis->reloadCallback(pThis->pReloadUserData, pWatched->szName, pWatched->stage);
+		}
+	}
+
+	for (uint32_t i = 0; i < watchedCount; i++) {
+		SAFE_FREE(paWatched[i].szName);
+	}
+	SAFE_FREE(paWatched);
+}
+
+/*!
+ * \brief	runs SHADER_COMPILER_COMMAND as a separate process
+ *
+ * A variant of \a szShaderName is compiled with its name in upper case defined.
+ *
+ * \return	TRUE if the compiler succeeded
+ */
+BOOL ShaderManager_Compile(
+	const char* szShaderName,
+	const char* szSourcePath,
+	const char* szOutputPath) {
+	const char* szVariant = strchr(szShaderName, SHADER_VARIANT_SEPARATOR);
+	size_t definesLength = 0;
+	if (szVariant) {
+		szVariant++;
+		definesLength = strlen(SHADER_COMPILER_DEFINE) + strlen(szVariant);
+	}
+	char* szDefines = SAFE_ALLOCATE_ARRAY(char, definesLength + 1);
+	if (szVariant) {
+		size_t writeHead = strlen(SHADER_COMPILER_DEFINE);
+		memcpy(szDefines, SHADER_COMPILER_DEFINE, writeHead);
+		for (const char* pCharacter = szVariant; *pCharacter; pCharacter++) {
+			szDefines[writeHead++] = (char)toupper((unsigned char)*pCharacter);
+		}
+		assert(writeHead == definesLength);
+	}
+	szDefines[definesLength] = '\0';
+
+	size_t commandLength = strlen(SHADER_COMPILER_COMMAND)
+		+ definesLength
+		+ strlen(szSourcePath)
+		+ strlen(szOutputPath)
+		+ 1;
+	char* szCommand = SAFE_ALLOCATE_ARRAY(char, commandLength);
+	snprintf(
+		szCommand,
+		commandLength,
+		SHADER_COMPILER_COMMAND,
+		szDefines,
+		szSourcePath,
+		szOutputPath);
+	SAFE_FREE(szDefines);
+
+	BOOL compiled = system(szCommand) == 0;
+	if (!compiled) {
+		Log_Write(LOG_SEVERITY_ERROR, "shaders", "failed to compile %s", szSourcePath);
+	}
+
+	SAFE_FREE(szCommand);
+	return compiled;
+}
+
+/*!
+ * \brief	maps all of \a szFilePath read only
+ *
+ * Mappings start on a page boundary, so the data is aligned for SPIR-V words.
+ * Nothing but the view needs to be kept, the OS holds the file open until
+ * UnmapFile.
+ *
+ * \return	FALSE if the file doesn't exist, is empty or can't be mapped
+ */
+BOOL MapFile(const char* szFilePath, MappedFile* pMappedFileOut) {
+	pMappedFileOut->pData = NULL;
+	pMappedFileOut->size = 0;
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(
+		szFilePath,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		return FALSE;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart <= 0) {
+		CloseHandle(hFile);
+		return FALSE;
+	}
+
+	HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(hFile);
+	if (!hMapping) {
+		return FALSE;
+	}
+
+	const void* pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(hMapping);
+	if (!pData) {
+		return FALSE;
+	}
+
+	pMappedFileOut->pData = pData;
+	pMappedFileOut->size = (size_t)fileSize.QuadPart;
+#else
+	int fileDescriptor = open(szFilePath, O_RDONLY);
+	if (fileDescriptor < 0) {
+		return FALSE;
+	}
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size <= 0) {
+		close(fileDescriptor);
+		return FALSE;
+	}
+
+	void* pData = mmap(
+		NULL,
+		(size_t)fileStat.st_size,
+		PROT_READ,
+		MAP_PRIVATE,
+		fileDescriptor,
+		0);
+	close(fileDescriptor);
+	if (pData == MAP_FAILED) {
+		return FALSE;
+	}
+
+	pMappedFileOut->pData = pData;
+	pMappedFileOut->size = (size_t)fileStat.st_size;
+#endif//_WIN32
+
+	return TRUE;
+}
+
+void UnmapFile(MappedFile* pMappedFile) {
+	if (!pMappedFile->pData) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(pMappedFile->pData);
+#else
+	munmap((void*)pMappedFile->pData, pMappedFile->size);
+#endif//_WIN32
+	pMappedFile->pData = NULL;
+	pMappedFile->size = 0;
+}
+
+/*!
+ * \brief	checks the file looks like a SPIR-V module vkCreateShaderModule can take
+ */
+BOOL ValidateSpirv(const MappedFile* pMappedFile, const char* szFilePath) {
+	const char* szProblem = NULL;
+	if (((uintptr_t)pMappedFile->pData % sizeof(uint32_t)) != 0) {
+		szProblem = "isn't aligned to 4 bytes";
+	}
+	else if (pMappedFile->size % sizeof(uint32_t) != 0) {
+		szProblem = "isn't a whole number of words";
+	}
+	else if (pMappedFile->size < SPIRV_HEADER_WORDS * sizeof(uint32_t)) {
+		szProblem = "is too small to be SPIR-V";
+	}
+	else {
+		uint32_t magic = ((const uint32_t*)pMappedFile->pData)[0];
+		if (magic == SPIRV_MAGIC_SWAPPED) {
+			szProblem = "is SPIR-V of the wrong endianness";
+		}
+		else if (magic != SPIRV_MAGIC) {
+			szProblem = "isn't SPIR-V";
+		}
+	}
+
+	if (szProblem) {
+		Log_Write(LOG_SEVERITY_ERROR, "shaders", "%s %s", szFilePath, szProblem);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// 0 if the file doesn't exist
+time_t GetModifiedTime(const char* szFilePath) {
+	struct stat fileStat;
+	if (stat(szFilePath, &fileStat) != 0) {
+		return 0;
+	}
+	return fileStat.st_mtime;
+}
+
+/*!
+ * \brief	removes \a szSuffix from the end of \a szExtension
+ * \return	the shortened copy, or NULL if \a szExtension doesn't end with \a szSuffix
+ */
+char* StripExtension(const char* szExtension, const char* szSuffix) {
+	size_t extensionLength = strlen(szExtension);
+	size_t suffixLength = strlen(szSuffix);
+	if (extensionLength <= suffixLength
+		|| strcmp(szExtension + extensionLength - suffixLength, szSuffix) != 0) {
+
+		return NULL;
+	}
+
+	char* szStripped = SAFE_ALLOCATE_ARRAY(char, extensionLength - suffixLength + 1);
+	memcpy(szStripped, szExtension, extensionLength - suffixLength);
+	szStripped[extensionLength - suffixLength] = '\0';
+	return szStripped;
 }
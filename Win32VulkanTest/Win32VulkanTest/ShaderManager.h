@@ -1,4 +1,3 @@
-
 #ifndef __SHADER_MANAGER_H
 #define __SHADER_MANAGER_H
 
@@ -6,27 +5,68 @@
 extern "C" {
 #endif//__cplusplus
 
+/*!
+ * Loads SPIR-V shaders and keeps their VkShaderModules around.
+ *
+ * Files are memory mapped and handed straight to vkCreateShaderModule, and
+ * each module is cached by name and stage. Acquiring a shader that's already
+ * cached never touches the filesystem. Modules stay cached after their last
+ * release until ShaderManager_PurgeUnused or ShaderManager_Destroy.
+ *
+ * A shader name may pick a variant of its source after a '.', so
+ * main.push_constants is main compiled with PUSH_CONSTANTS defined. Each
+ * variant is its own module loaded from its own file, main.push_constants.vert.spv
+ * for example, and hot reload recompiles every variant of a source that changes.
+ *
+ * Built with SHADER_MANAGER_EMBEDDED_SHADERS, shaders compiled into the
+ * executable (see EmbeddedShaders.h) are used before looking on disk.
+ *
+ * With hot reload enabled a background thread watches the shader directory,
+ * recompiles sources that change and swaps the new modules into the cache.
+ * Every function may be called from any thread.
+ */
 typedef struct shader_manager_t ShaderManager;
 
-typedef struct shader_code_t {
-	uint32_t* pCode;
-	size_t codeSize;
-} ShaderCode;
+typedef enum shader_stage_t {
+	SHADER_STAGE_VERTEX,
+	SHADER_STAGE_FRAGMENT,
+	SHADER_STAGE_COUNT,
+} ShaderStage;
+
+// run with the defines, source and output paths to turn GLSL into SPIR-V
+#define SHADER_COMPILER_COMMAND "glslangValidator -V%s \"%s\" -o \"%s\""
+#define SHADER_COMPILER_DEFINE " -D"
+
+// splits a shader name from its variant
+#define SHADER_VARIANT_SEPARATOR '.'
+
+
+// called on the watching thread once a shader's new module is in the cache
+typedef void (*ShaderReloadCallback)(
+	void* pUserData,
+	const char* szShaderName,
+	ShaderStage stage);
 
 ShaderManager* ShaderManager_Create(
+	VkDevice device,
 	const char* szShaderDirectory,
 	const char* szVertexExtension,
 	const char* szFragmentExtension);
 void ShaderManager_Destroy(ShaderManager* pThis);
 
-ShaderCode ShaderManager_GetVertexShader(
+VkShaderModule ShaderManager_AcquireShader(
 	ShaderManager* pThis,
-	const char* szShaderName);
-ShaderCode ShaderManager_GetFragmentShader(
+	const char* szShaderName,
+	ShaderStage stage);
+void ShaderManager_ReleaseShader(ShaderManager* pThis, VkShaderModule shaderModule);
+uint32_t ShaderManager_PurgeUnused(ShaderManager* pThis);
+
+BOOL ShaderManager_EnableHotReload(
 	ShaderManager* pThis,
-	const char* szShaderName);
+	ShaderReloadCallback callback,
+	void* pUserData);
 
-void ShaderManager_CleanupShaderCode(ShaderCode shaderCode);
+VkShaderStageFlagBits ShaderManager_GetStageFlag(ShaderStage stage);
 
 #ifdef __cplusplus
 }
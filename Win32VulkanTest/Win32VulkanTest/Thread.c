@@ -0,0 +1,229 @@
+#include "stdafx.h"
+#include "Thread.h"
+
+#include "Utils.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif//_WIN32
+
+struct thread_t {
+	ThreadFunction function;
+	void* pUserData;
+#ifdef _WIN32
+	HANDLE hThread;
+#else
+	pthread_t thread;
+#endif//_WIN32
+};
+
+struct mutex_t {
+#ifdef _WIN32
+	CRITICAL_SECTION criticalSection;
+#else
+	pthread_mutex_t mutex;
+#endif//_WIN32
+};
+
+struct condition_variable_t {
+#ifdef _WIN32
+	CONDITION_VARIABLE conditionVariable;
+#else
+	pthread_cond_t condition;
+#endif//_WIN32
+};
+
+#ifdef _WIN32
+DWORD WINAPI Thread_Main(LPVOID pParameter);
+#else
+void* Thread_Main(void* pParameter);
+#endif//_WIN32
+
+/*!
+ * \brief	starts a thread running \a function
+ *
+ * Every thread has to be joined with Thread_Join, which also frees it.
+ */
+Thread* Thread_Create(ThreadFunction function, void* pUserData) {
+	assert(function);
+
+	Thread* pThread = (Thread*)malloc(sizeof(Thread));
+	memset(pThread, 0, sizeof(Thread));
+
+	pThread->function = function;
+	pThread->pUserData = pUserData;
+
+#ifdef _WIN32
+	pThread->hThread = CreateThread(NULL, 0, Thread_Main, pThread, 0, NULL);
+	REQUIRE(pThread->hThread, "failed to create a thread");
+#else
+	REQUIRE(
+		pthread_create(&pThread->thread, NULL, Thread_Main, pThread) == 0,
+		"failed to create a thread");
+#endif//_WIN32
+
+	return pThread;
+}
+
+/*!
+ * \brief	waits for the thread's function to return and frees the thread
+ */
+void Thread_Join(Thread* pThis) {
+	assert(pThis);
+
+#ifdef _WIN32
+	WaitForSingleObject(pThis->hThread, INFINITE);
+	CloseHandle(pThis->hThread);
+#else
+	pthread_join(pThis->thread, NULL);
+#endif//_WIN32
+
+	free(pThis);
+}
+
+void Thread_Sleep(uint32_t milliseconds) {
+#ifdef _WIN32
+	Sleep(milliseconds);
+#else
+	struct timespec duration;
+	duration.tv_sec = milliseconds / 1000;
+	duration.tv_nsec = (long)(milliseconds % 1000) * 1000000;
+	nanosleep(&duration, NULL);
+#endif//_WIN32
+}
+
+// how many threads can run at once, at least 1
+uint32_t Thread_GetProcessorCount(void) {
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	long processorCount = (long)systemInfo.dwNumberOfProcessors;
+#else
+	long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+#endif//_WIN32
+	return processorCount > 0 ? (uint32_t)processorCount : 1;
+}
+
+Mutex* Mutex_Create(void) {
+	Mutex* pMutex = (Mutex*)malloc(sizeof(Mutex));
+	memset(pMutex, 0, sizeof(Mutex));
+
+#ifdef _WIN32
+	InitializeCriticalSection(&pMutex->criticalSection);
+#else
+	pthread_mutex_init(&pMutex->mutex, NULL);
+#endif//_WIN32
+
+	return pMutex;
+}
+
+void Mutex_Destroy(Mutex* pThis) {
+	assert(pThis);
+
+#ifdef _WIN32
+	DeleteCriticalSection(&pThis->criticalSection);
+#else
+	pthread_mutex_destroy(&pThis->mutex);
+#endif//_WIN32
+
+	free(pThis);
+}
+
+void Mutex_Lock(Mutex* pThis) {
+	assert(pThis);
+
+#ifdef _WIN32
+	EnterCriticalSection(&pThis->criticalSection);
+#else
+	pthread_mutex_lock(&pThis->mutex);
+#endif//_WIN32
+}
+
+void Mutex_Unlock(Mutex* pThis) {
+	assert(pThis);
+
+#ifdef _WIN32
+	LeaveCriticalSection(&pThis->criticalSection);
+#else
+	pthread_mutex_unlock(&pThis->mutex);
+#endif//_WIN32
+}
+
+ConditionVariable* ConditionVariable_Create(void) {
+	ConditionVariable* pConditionVariable = (ConditionVariable*)malloc(sizeof(ConditionVariable));
+	memset(pConditionVariable, 0, sizeof(ConditionVariable));
+
+#ifdef _WIN32
+	InitializeConditionVariable(&pConditionVariable->conditionVariable);
+#else
+	pthread_cond_init(&pConditionVariable->condition, NULL);
+#endif//_WIN32
+
+	return pConditionVariable;
+}
+
+void ConditionVariable_Destroy(ConditionVariable* pThis) {
+	assert(pThis);
+
+#ifndef _WIN32
+	// win32 condition variables need no cleanup
+	pthread_cond_destroy(&pThis->condition);
+#endif//_WIN32
+
+	free(pThis);
+}
+
+/*!
+ * \brief	releases \a pMutex until woken, then takes it back
+ *
+ * May wake without being signaled, so always wait in a loop that checks
+ * whatever is being waited for.
+ */
+void ConditionVariable_Wait(ConditionVariable* pThis, Mutex* pMutex) {
+	assert(pThis);
+	assert(pMutex);
+
+#ifdef _WIN32
+	SleepConditionVariableCS(&pThis->conditionVariable, &pMutex->criticalSection, INFINITE);
+#else
+	pthread_cond_wait(&pThis->condition, &pMutex->mutex);
+#endif//_WIN32
+}
+
+void ConditionVariable_WakeOne(ConditionVariable* pThis) {
+	assert(pThis);
+
+#ifdef _WIN32
+	WakeConditionVariable(&pThis->conditionVariable);
+#else
+	pthread_cond_signal(&pThis->condition);
+#endif//_WIN32
+}
+
+void ConditionVariable_WakeAll(ConditionVariable* pThis) {
+	assert(pThis);
+
+#ifdef _WIN32
+	WakeAllConditionVariable(&pThis->conditionVariable);
+#else
+	pthread_cond_broadcast(&pThis->condition);
+#endif//_WIN32
+}
+
+// Private Interface!
+
+#ifdef _WIN32
+DWORD WINAPI Thread_Main(LPVOID pParameter) {
+	Thread* pThread = (Thread*)pParameter;
+	pThread->function(pThread->pUserData);
+	return 0;
+}
+#else
+void* Thread_Main(void* pParameter) {
+	Thread* pThread = (Thread*)pParameter;
+	pThread->function(pThread->pUserData);
+	return NULL;
+}
+#endif//_WIN32
@@ -0,0 +1,44 @@
+#ifndef __THREAD_H
+#define __THREAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * The little bit of threading the renderer needs, on win32 threads or pthreads.
+ */
+typedef struct thread_t Thread;
+typedef struct mutex_t Mutex;
+typedef struct condition_variable_t ConditionVariable;
+
+typedef void (*ThreadFunction)(void* pUserData);
+
+// gives each thread its own copy of a static variable
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif//_MSC_VER
+
+Thread* Thread_Create(ThreadFunction function, void* pUserData);
+void Thread_Join(Thread* pThis);
+void Thread_Sleep(uint32_t milliseconds);
+uint32_t Thread_GetProcessorCount(void);
+
+Mutex* Mutex_Create(void);
+void Mutex_Destroy(Mutex* pThis);
+void Mutex_Lock(Mutex* pThis);
+void Mutex_Unlock(Mutex* pThis);
+
+ConditionVariable* ConditionVariable_Create(void);
+void ConditionVariable_Destroy(ConditionVariable* pThis);
+void ConditionVariable_Wait(ConditionVariable* pThis, Mutex* pMutex);
+void ConditionVariable_WakeOne(ConditionVariable* pThis);
+void ConditionVariable_WakeAll(ConditionVariable* pThis);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__THREAD_H
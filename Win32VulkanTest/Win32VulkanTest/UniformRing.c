@@ -0,0 +1,169 @@
+#include "stdafx.h"
+#include "UniformRing.h"
+
+#include "Utils.h"
+
+struct uniform_ring_t {
+	VkDevice device;
+	DeviceMemoryAllocator* pMemoryAllocator;
+
+	VkBuffer buffer;
+	// persistently mapped
+	DeviceMemoryAllocation memory;
+	VkDeviceSize alignment;
+
+	uint32_t frameCount;
+	// already a multiple of alignment
+	VkDeviceSize frameSize;
+	// the partition being allocated from, and how much of it is taken
+	uint32_t currentFrame;
+	VkDeviceSize frameUsed;
+};
+
+/*!
+ * \brief	creates a ring with a \a frameSize partition for each of \a frameCount frames
+ *
+ * \param	pMemoryAllocator where the buffer's memory comes from
+ * \param	frameSize the most uniform data one frame can allocate, including
+ *			the padding that aligns each allocation
+ */
+UniformRing* UniformRing_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	uint32_t frameCount,
+	VkDeviceSize frameSize) {
+	assert(physicalDevice);
+	assert(device);
+	assert(pMemoryAllocator);
+	assert(frameCount > 0);
+	assert(frameSize > 0);
+
+	UniformRing* pUniformRing = (UniformRing*)malloc(sizeof(UniformRing));
+	memset(pUniformRing, 0, sizeof(UniformRing));
+
+	pUniformRing->device = device;
+	pUniformRing->pMemoryAllocator = pMemoryAllocator;
+	pUniformRing->frameCount = frameCount;
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	pUniformRing->alignment = deviceProperties.limits.minUniformBufferOffsetAlignment;
+	if (pUniformRing->alignment == 0) {
+		pUniformRing->alignment = 1;
+	}
+	pUniformRing->frameSize
+		= (frameSize + pUniformRing->alignment - 1)
+		/ pUniformRing->alignment
+		* pUniformRing->alignment;
+
+	VkBufferCreateInfo bufferCreateInfo = { 0 };
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = NULL;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = pUniformRing->frameSize * frameCount;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 0;
+	bufferCreateInfo.pQueueFamilyIndices = NULL;
+	REQUIRE_VK_SUCCESS(
+		vkCreateBuffer(
+			device,
+			&bufferCreateInfo,
+			NULL,
+			&pUniformRing->buffer)
+	);
+
+	// device local and host visible memory is read fastest by the gpu where
+	// there is some, coherent memory saves a flush per frame
+	const VkMemoryPropertyFlags aMemoryPreferences[] = {
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+			| VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+			| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+	};
+	BOOL allocated = FALSE;
+	for (uint32_t i = 0;
+		i < sizeof(aMemoryPreferences) / sizeof(VkMemoryPropertyFlags) && !allocated;
+		i++) {
+		allocated = DeviceMemoryAllocator_AllocateForBuffer(
+			pMemoryAllocator,
+			pUniformRing->buffer,
+			aMemoryPreferences[i],
+			&pUniformRing->memory);
+	}
+	REQUIRE(allocated, "out of memory for the uniform ring");
+	assert(pUniformRing->memory.pMappedData);
+
+	return pUniformRing;
+}
+
+/*!
+ * \brief	frees the ring, which the gpu must have finished reading
+ */
+void UniformRing_Destroy(UniformRing* pThis) {
+	assert(pThis);
+
+	vkDestroyBuffer(pThis->device, pThis->buffer, NULL);
+	DeviceMemoryAllocator_Free(pThis->pMemoryAllocator, &pThis->memory);
+
+	free(pThis);
+}
+
+/*!
+ * \brief	starts allocating from the start of \a frameIndex's partition
+ *
+ * Whatever was allocated there before is overwritten, the frame that used it
+ * has to have finished on the gpu.
+ */
+void UniformRing_BeginFrame(UniformRing* pThis, uint32_t frameIndex) {
+	assert(pThis);
+	assert(frameIndex < pThis->frameCount);
+
+	pThis->currentFrame = frameIndex;
+	pThis->frameUsed = 0;
+}
+
+/*!
+ * \brief	takes \a size bytes from the current frame's partition
+ *
+ * \param	pOffsetOut receives the dynamic offset to bind the allocation with
+ * \return	where to write the data, or NULL if the partition is full
+ */
+void* UniformRing_Allocate(UniformRing* pThis, VkDeviceSize size, uint32_t* pOffsetOut) {
+	assert(pThis);
+	assert(size > 0);
+	assert(pOffsetOut);
+
+	VkDeviceSize alignedSize = (size + pThis->alignment - 1) / pThis->alignment * pThis->alignment;
+	if (pThis->frameUsed + alignedSize > pThis->frameSize) {
+		return NULL;
+	}
+
+	VkDeviceSize offset = pThis->currentFrame * pThis->frameSize + pThis->frameUsed;
+	pThis->frameUsed += alignedSize;
+
+	*pOffsetOut = (uint32_t)offset;
+	return (uint8_t*)pThis->memory.pMappedData + offset;
+}
+
+/*!
+ * \brief	makes everything written this frame visible to the gpu, call before
+ *			submitting the frame
+ *
+ * Does nothing for host coherent memory.
+ */
+void UniformRing_Flush(UniformRing* pThis) {
+	assert(pThis);
+
+	if (pThis->frameUsed > 0) {
+		DeviceMemoryAllocator_Flush(pThis->pMemoryAllocator, &pThis->memory);
+	}
+}
+
+VkBuffer UniformRing_GetBuffer(const UniformRing* pThis) {
+	assert(pThis);
+
+	return pThis->buffer;
+}
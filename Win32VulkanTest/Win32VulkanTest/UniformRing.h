@@ -0,0 +1,42 @@
+#ifndef __UNIFORM_RING_H
+#define __UNIFORM_RING_H
+
+#include "DeviceMemoryAllocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Per frame uniform data in one persistently mapped buffer, meant to be bound
+ * once as a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor with each
+ * draw picking its block by dynamic offset.
+ *
+ * The buffer is split into a partition per frame in flight. UniformRing_BeginFrame
+ * starts handing out the frame's partition from the top again, so it may only
+ * be called once the gpu has finished the frame that last used it. Allocations
+ * are aligned to minUniformBufferOffsetAlignment. Not thread safe.
+ */
+typedef struct uniform_ring_t UniformRing;
+
+#define UNIFORM_RING_DEFAULT_FRAME_SIZE (1024 * 1024)
+
+UniformRing* UniformRing_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	uint32_t frameCount,
+	VkDeviceSize frameSize);
+void UniformRing_Destroy(UniformRing* pThis);
+
+void UniformRing_BeginFrame(UniformRing* pThis, uint32_t frameIndex);
+void* UniformRing_Allocate(UniformRing* pThis, VkDeviceSize size, uint32_t* pOffsetOut);
+void UniformRing_Flush(UniformRing* pThis);
+
+VkBuffer UniformRing_GetBuffer(const UniformRing* pThis);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__UNIFORM_RING_H
@@ -0,0 +1,586 @@
+#include "stdafx.h"
+#include "UploadManager.h"
+
+#include "MemoryUtils.h"
+#include "Utils.h"
+
+// how many batches may be in flight before recording has to wait for one
+#define UPLOAD_BATCH_COUNT 4
+
+// keeps every staged copy aligned for any texel size up to 16 bytes
+#define MIN_COPY_ALIGNMENT 16
+
+// timeout in nanoseconds
+#define FENCE_TIMEOUT 100000000
+
+typedef struct upload_batch_t {
+	VkCommandBuffer commandBuffer;
+	VkFence fence;
+	UploadTicket ticket;
+	// the staging ring write position just past this batch's data
+	uint64_t ringEnd;
+	BOOL submitted;
+} UploadBatch;
+
+struct upload_manager_t {
+	VkDevice device;
+	VkQueue queue;
+	uint32_t queueFamilyIndex;
+	uint32_t renderQueueFamilyIndex;
+	DeviceMemoryAllocator* pMemoryAllocator;
+
+	VkCommandPool commandPool;
+
+	VkBuffer stagingBuffer;
+	DeviceMemoryAllocation stagingMemory;
+	VkDeviceSize stagingSize;
+	VkDeviceSize copyAlignment;
+	// running byte counts, the offset into the ring is these modulo stagingSize.
+	// everything from ringRetiredPosition to ringWritePosition may still be read
+	uint64_t ringWritePosition;
+	uint64_t ringRetiredPosition;
+
+	UploadBatch aBatches[UPLOAD_BATCH_COUNT];
+	// the batch new uploads are recorded into
+	uint32_t currentBatch;
+	BOOL currentBatchRecording;
+	UploadTicket nextTicket;
+	UploadTicket completedTicket;
+	// once set nothing more is submitted and batches retire without waiting,
+	// as their fences will never signal
+	BOOL deviceLost;
+};
+
+VkDeviceSize UploadManager_Stage(
+	UploadManager* pThis,
+	const void* pData,
+	VkDeviceSize size);
+VkCommandBuffer UploadManager_BeginBatch(UploadManager* pThis);
+BOOL UploadManager_RetireOldestBatch(UploadManager* pThis, BOOL wait);
+void UploadManager_Poll(UploadManager* pThis);
+
+/*!
+ * \brief	creates an upload manager that submits to \a queue
+ *
+ * \param	queue where copies are submitted, ideally from a transfer only family
+ * \param	queueFamilyIndex the family \a queue belongs to
+ * \param	renderQueueFamilyIndex the family that will read what's uploaded
+ * \param	pMemoryAllocator where the staging ring comes from
+ * \param	stagingSize the size of the staging ring, bigger images can't be uploaded
+ */
+UploadManager* UploadManager_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	VkQueue queue,
+	uint32_t queueFamilyIndex,
+	uint32_t renderQueueFamilyIndex,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	VkDeviceSize stagingSize) {
+	assert(physicalDevice);
+	assert(device);
+	assert(queue);
+	assert(pMemoryAllocator);
+	assert(stagingSize > 0);
+
+	UploadManager* pUploadManager = (UploadManager*)malloc(sizeof(UploadManager));
+	memset(pUploadManager, 0, sizeof(UploadManager));
+
+	pUploadManager->device = device;
+	pUploadManager->queue = queue;
+	pUploadManager->queueFamilyIndex = queueFamilyIndex;
+	pUploadManager->renderQueueFamilyIndex = renderQueueFamilyIndex;
+	pUploadManager->pMemoryAllocator = pMemoryAllocator;
+	pUploadManager->stagingSize = stagingSize;
+	pUploadManager->nextTicket = 1;
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	pUploadManager->copyAlignment = MIN_COPY_ALIGNMENT;
+	if (deviceProperties.limits.optimalBufferCopyOffsetAlignment > pUploadManager->copyAlignment) {
+		pUploadManager->copyAlignment = deviceProperties.limits.optimalBufferCopyOffsetAlignment;
+	}
+
+	VkCommandPoolCreateInfo commandPoolCreateInfo = { 0 };
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.pNext = NULL;
+	commandPoolCreateInfo.flags
+		= VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+		| VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+	REQUIRE_VK_SUCCESS(
+		vkCreateCommandPool(
+			device,
+			&commandPoolCreateInfo,
+			NULL,
+			&pUploadManager->commandPool)
+	);
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = NULL;
+	commandBufferAllocateInfo.commandPool = pUploadManager->commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	VkFenceCreateInfo fenceCreateInfo = { 0 };
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.pNext = NULL;
+	fenceCreateInfo.flags = 0;
+
+	for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++) {
+		UploadBatch* pBatch = &pUploadManager->aBatches[i];
+		REQUIRE_VK_SUCCESS(
+			vkAllocateCommandBuffers(
+				device,
+				&commandBufferAllocateInfo,
+				&pBatch->commandBuffer)
+		);
+		REQUIRE_VK_SUCCESS(
+			vkCreateFence(device, &fenceCreateInfo, NULL, &pBatch->fence)
+		);
+	}
+
+	VkBufferCreateInfo bufferCreateInfo = { 0 };
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = NULL;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = stagingSize;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 0;
+	bufferCreateInfo.pQueueFamilyIndices = NULL;
+	REQUIRE_VK_SUCCESS(
+		vkCreateBuffer(
+			device,
+			&bufferCreateInfo,
+			NULL,
+			&pUploadManager->stagingBuffer)
+	);
+
+	// coherent memory saves a flush per batch when there is some
+	BOOL allocated = DeviceMemoryAllocator_AllocateForBuffer(
+		pMemoryAllocator,
+		pUploadManager->stagingBuffer,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&pUploadManager->stagingMemory);
+	if (!allocated) {
+		allocated = DeviceMemoryAllocator_AllocateForBuffer(
+			pMemoryAllocator,
+			pUploadManager->stagingBuffer,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			&pUploadManager->stagingMemory);
+	}
+	REQUIRE(allocated, "out of memory for the staging ring");
+	assert(pUploadManager->stagingMemory.pMappedData);
+
+	return pUploadManager;
+}
+
+/*!
+ * \brief	waits for every submitted upload then frees everything
+ *
+ * Uploads that were never flushed are dropped.
+ */
+void UploadManager_Destroy(UploadManager* pThis) {
+	assert(pThis);
+
+	while (UploadManager_RetireOldestBatch(pThis, TRUE)) {
+	}
+
+	for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++) {
+		vkDestroyFence(pThis->device, pThis->aBatches[i].fence, NULL);
+	}
+	// takes the command buffers with it
+	vkDestroyCommandPool(pThis->device, pThis->commandPool, NULL);
+
+	vkDestroyBuffer(pThis->device, pThis->stagingBuffer, NULL);
+	DeviceMemoryAllocator_Free(pThis->pMemoryAllocator, &pThis->stagingMemory);
+
+	free(pThis);
+}
+
+/*!
+ * \brief	copies \a pData into \a buffer at \a bufferOffset
+ *
+ * Data larger than half the staging ring goes over in several copies.
+ *
+ * \return	the ticket to wait on before the render queue reads \a buffer
+ */
+UploadTicket UploadManager_UploadToBuffer(
+	UploadManager* pThis,
+	VkBuffer buffer,
+	VkDeviceSize bufferOffset,
+	const void* pData,
+	VkDeviceSize size) {
+	assert(pThis);
+	assert(buffer);
+	assert(pData);
+	assert(size > 0);
+
+	// half the ring always fits once it drains, so this can't wait forever
+	VkDeviceSize maxChunkSize = pThis->stagingSize / 2;
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	while (size > 0) {
+		VkDeviceSize chunkSize = size < maxChunkSize ? size : maxChunkSize;
+		VkDeviceSize stagingOffset = UploadManager_Stage(pThis, pBytes, chunkSize);
+
+		VkBufferCopy copyRegion = { 0 };
+		copyRegion.srcOffset = stagingOffset;
+		copyRegion.dstOffset = bufferOffset;
+		copyRegion.size = chunkSize;
+		vkCmdCopyBuffer(
+			UploadManager_BeginBatch(pThis),
+			pThis->stagingBuffer,
+			buffer,
+			1,
+			&copyRegion);
+
+		pBytes += chunkSize;
+		bufferOffset += chunkSize;
+		size -= chunkSize;
+	}
+
+	return pThis->aBatches[pThis->currentBatch].ticket;
+}
+
+/*!
+ * \brief	fills the first mip and layer of \a image with tightly packed \a pData
+ *
+ * \param	aspectMask which aspect of \a image \a pData is for
+ * \param	size the size of \a pData, no more than the staging ring
+ * \param	finalLayout the layout \a image is left in for the render queue
+ * \return	the ticket to wait on before the render queue reads \a image
+ */
+UploadTicket UploadManager_UploadToImage(
+	UploadManager* pThis,
+	VkImage image,
+	VkImageAspectFlags aspectMask,
+	uint32_t width,
+	uint32_t height,
+	const void* pData,
+	VkDeviceSize size,
+	VkImageLayout finalLayout) {
+	assert(pThis);
+	assert(image);
+	assert(pData);
+	assert(size > 0 && size <= pThis->stagingSize);
+
+	VkDeviceSize stagingOffset = UploadManager_Stage(pThis, pData, size);
+	VkCommandBuffer commandBuffer = UploadManager_BeginBatch(pThis);
+
+	VkImageMemoryBarrier imageMemoryBarrier = { 0 };
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.pNext = NULL;
+	imageMemoryBarrier.srcAccessMask = 0;
+	imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange.aspectMask = aspectMask;
+	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+	imageMemoryBarrier.subresourceRange.levelCount = 1;
+	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+	imageMemoryBarrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, NULL,
+		0, NULL,
+		1, &imageMemoryBarrier);
+
+	VkBufferImageCopy copyRegion = { 0 };
+	copyRegion.bufferOffset = stagingOffset;
+	copyRegion.bufferRowLength = 0; // tightly packed
+	copyRegion.bufferImageHeight = 0;
+	copyRegion.imageSubresource.aspectMask = aspectMask;
+	copyRegion.imageSubresource.mipLevel = 0;
+	copyRegion.imageSubresource.baseArrayLayer = 0;
+	copyRegion.imageSubresource.layerCount = 1;
+	copyRegion.imageOffset.x = 0;
+	copyRegion.imageOffset.y = 0;
+	copyRegion.imageOffset.z = 0;
+	copyRegion.imageExtent.width = width;
+	copyRegion.imageExtent.height = height;
+	copyRegion.imageExtent.depth = 1;
+	vkCmdCopyBufferToImage(
+		commandBuffer,
+		pThis->stagingBuffer,
+		image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1,
+		&copyRegion);
+
+	// a transfer queue can't name the render queue's stages, the ticket's
+	// fence orders the copy before any later render submission anyway
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.dstAccessMask = 0;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageMemoryBarrier.newLayout = finalLayout;
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0, NULL,
+		0, NULL,
+		1, &imageMemoryBarrier);
+
+	return pThis->aBatches[pThis->currentBatch].ticket;
+}
+
+/*!
+ * \brief	submits everything uploaded since the last flush
+ * \return	the ticket of the submitted batch, or of the last one if there was nothing to submit
+ */
+UploadTicket UploadManager_Flush(UploadManager* pThis) {
+	assert(pThis);
+
+	if (!pThis->currentBatchRecording) {
+		return pThis->nextTicket - 1;
+	}
+
+	UploadBatch* pBatch = &pThis->aBatches[pThis->currentBatch];
+	REQUIRE_VK_SUCCESS(vkEndCommandBuffer(pBatch->commandBuffer));
+
+	DeviceMemoryAllocator_Flush(pThis->pMemoryAllocator, &pThis->stagingMemory);
+
+	VkSubmitInfo submitInfo = { 0 };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = NULL;
+	submitInfo.waitSemaphoreCount = 0;
+	submitInfo.pWaitSemaphores = NULL;
+	submitInfo.pWaitDstStageMask = NULL;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &pBatch->commandBuffer;
+	submitInfo.signalSemaphoreCount = 0;
+	submitInfo.pSignalSemaphores = NULL;
+	if (!pThis->deviceLost) {
+		VkResult result = vkQueueSubmit(pThis->queue, 1, &submitInfo, pBatch->fence);
+		if (result == VK_ERROR_DEVICE_LOST) {
+			// still counts as submitted, so it retires in order
+			pThis->deviceLost = TRUE;
+		}
+		else {
+			REQUIRE_VK_SUCCESS(result);
+		}
+	}
+
+	pBatch->ringEnd = pThis->ringWritePosition;
+	pBatch->submitted = TRUE;
+	pThis->currentBatchRecording = FALSE;
+	pThis->currentBatch = (pThis->currentBatch + 1) % UPLOAD_BATCH_COUNT;
+
+	return pBatch->ticket;
+}
+
+/*!
+ * \brief	checks without blocking whether \a ticket has finished on the gpu
+ */
+BOOL UploadManager_IsComplete(UploadManager* pThis, UploadTicket ticket) {
+	assert(pThis);
+
+	if (ticket <= pThis->completedTicket) {
+		return TRUE;
+	}
+	UploadManager_Poll(pThis);
+	return ticket <= pThis->completedTicket;
+}
+
+/*!
+ * \brief	blocks until \a ticket has finished, flushing it first if needed
+ */
+void UploadManager_Wait(UploadManager* pThis, UploadTicket ticket) {
+	assert(pThis);
+	assert(ticket < pThis->nextTicket);
+
+	if (pThis->currentBatchRecording
+		&& ticket >= pThis->aBatches[pThis->currentBatch].ticket) {
+
+		UploadManager_Flush(pThis);
+	}
+
+	while (ticket > pThis->completedTicket) {
+		BOOL retired = UploadManager_RetireOldestBatch(pThis, TRUE);
+		assert(retired);
+	}
+}
+
+/*!
+ * \brief	whether a submit or wait found the device lost
+ *
+ * From then on every ticket counts as complete, so nothing waits forever on
+ * uploads that will never happen. What they were writing has to be created
+ * again on a new device.
+ */
+BOOL UploadManager_IsDeviceLost(const UploadManager* pThis) {
+	assert(pThis);
+
+	return pThis->deviceLost;
+}
+
+/*!
+ * \brief	the queue families that touch uploaded resources
+ *
+ * \param	aQueueFamilyIndicesOut receives up to two family indices
+ * \return	2 if resources need VK_SHARING_MODE_CONCURRENT over the returned
+ *			families, 1 if the upload and render queues share a family
+ */
+uint32_t UploadManager_GetQueueFamilyIndices(
+	const UploadManager* pThis,
+	uint32_t* aQueueFamilyIndicesOut) {
+	assert(pThis);
+	assert(aQueueFamilyIndicesOut);
+
+	aQueueFamilyIndicesOut[0] = pThis->renderQueueFamilyIndex;
+	if (pThis->queueFamilyIndex == pThis->renderQueueFamilyIndex) {
+		return 1;
+	}
+	aQueueFamilyIndicesOut[1] = pThis->queueFamilyIndex;
+	return 2;
+}
+
+/*!
+ * \brief	copies \a pData into the staging ring
+ *
+ * Waits for old batches to retire if the ring is full, flushing the current
+ * batch if that's what is holding the space.
+ *
+ * \return	the offset of the copy in the staging buffer
+ */
+VkDeviceSize UploadManager_Stage(
+	UploadManager* pThis,
+	const void* pData,
+	VkDeviceSize size) {
+	assert(pThis);
+	assert(pData);
+	assert(size <= pThis->stagingSize);
+
+	uint64_t position;
+	for (;;) {
+		position = pThis->ringWritePosition + pThis->copyAlignment - 1;
+		position -= position % pThis->copyAlignment;
+
+		// copies never wrap, skip to the start of the ring instead
+		if (position % pThis->stagingSize + size > pThis->stagingSize) {
+			position += pThis->stagingSize - position % pThis->stagingSize;
+		}
+
+		if (position + size - pThis->ringRetiredPosition <= pThis->stagingSize) {
+			break;
+		}
+
+		if (UploadManager_RetireOldestBatch(pThis, TRUE)) {
+			continue;
+		}
+		if (pThis->currentBatchRecording) {
+			UploadManager_Flush(pThis);
+			continue;
+		}
+
+		// nothing is in flight, so the whole ring is free
+		pThis->ringWritePosition = 0;
+		pThis->ringRetiredPosition = 0;
+	}
+
+	VkDeviceSize offset = (VkDeviceSize)(position % pThis->stagingSize);
+	memcpy((uint8_t*)pThis->stagingMemory.pMappedData + offset, pData, (size_t)size);
+	pThis->ringWritePosition = position + size;
+	return offset;
+}
+
+/*!
+ * \brief	the command buffer of the current batch, begun if it wasn't already
+ */
+VkCommandBuffer UploadManager_BeginBatch(UploadManager* pThis) {
+	assert(pThis);
+
+	UploadBatch* pBatch = &pThis->aBatches[pThis->currentBatch];
+	if (pThis->currentBatchRecording) {
+		return pBatch->commandBuffer;
+	}
+
+	// every slot is in use, the oldest has to finish before it can be reused
+	while (pBatch->submitted) {
+		UploadManager_RetireOldestBatch(pThis, TRUE);
+	}
+
+	VkCommandBufferBeginInfo beginInfo = { 0 };
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.pNext = NULL;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = NULL;
+	REQUIRE_VK_SUCCESS(vkBeginCommandBuffer(pBatch->commandBuffer, &beginInfo));
+
+	pBatch->ticket = pThis->nextTicket++;
+	pThis->currentBatchRecording = TRUE;
+	return pBatch->commandBuffer;
+}
+
+/*!
+ * \brief	releases the oldest submitted batch and its staging space once it's finished
+ *
+ * Batches are retired in submission order so the ring is only ever released
+ * from its tail.
+ *
+ * \param	wait whether to block until the batch finishes
+ * \return	FALSE if nothing was submitted or, when not waiting, it hasn't finished
+ */
+BOOL UploadManager_RetireOldestBatch(UploadManager* pThis, BOOL wait) {
+	assert(pThis);
+
+	// slots are used round robin, so age decreases walking forward from the
+	// current one. it can only be submitted itself when it isn't recording
+	UploadBatch* pOldest = NULL;
+	for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++) {
+		UploadBatch* pBatch = &pThis->aBatches[(pThis->currentBatch + i) % UPLOAD_BATCH_COUNT];
+		if (pBatch->submitted) {
+			pOldest = pBatch;
+			break;
+		}
+	}
+	if (!pOldest) {
+		return FALSE;
+	}
+
+	VkResult result = VK_ERROR_DEVICE_LOST;
+	if (pThis->deviceLost) {
+		// nothing will ever signal the fence
+	}
+	else if (wait) {
+		do {
+			result = vkWaitForFences(pThis->device, 1, &pOldest->fence, VK_TRUE, FENCE_TIMEOUT);
+		} while (result == VK_TIMEOUT);
+	}
+	else {
+		result = vkGetFenceStatus(pThis->device, pOldest->fence);
+		if (result == VK_NOT_READY) {
+			return FALSE;
+		}
+	}
+
+	if (result == VK_ERROR_DEVICE_LOST) {
+		pThis->deviceLost = TRUE;
+	}
+	else {
+		REQUIRE_VK_SUCCESS(result);
+		REQUIRE_VK_SUCCESS(vkResetFences(pThis->device, 1, &pOldest->fence));
+	}
+	pOldest->submitted = FALSE;
+	pThis->completedTicket = pOldest->ticket;
+	pThis->ringRetiredPosition = pOldest->ringEnd;
+	return TRUE;
+}
+
+/*!
+ * \brief	retires every batch that has finished without blocking
+ */
+void UploadManager_Poll(UploadManager* pThis) {
+	assert(pThis);
+
+	while (UploadManager_RetireOldestBatch(pThis, FALSE)) {
+	}
+}
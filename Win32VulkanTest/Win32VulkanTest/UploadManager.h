@@ -0,0 +1,68 @@
+#ifndef __UPLOAD_MANAGER_H
+#define __UPLOAD_MANAGER_H
+
+#include "DeviceMemoryAllocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+/*!
+ * Streams data into device local buffers and images through a persistently
+ * mapped staging ring, on its own queue so loading never waits on rendering.
+ *
+ * Uploads are batched into one command buffer until UploadManager_Flush, and
+ * every upload returns the ticket of its batch. A resource may be used once
+ * UploadManager_IsComplete says its ticket has finished, or the device was
+ * lost, see UploadManager_IsDeviceLost.
+ *
+ * Resources written here and read on the render queue should be created with
+ * VK_SHARING_MODE_CONCURRENT over UploadManager_GetQueueFamilyIndices so no
+ * ownership transfer is needed. Not thread safe.
+ */
+typedef struct upload_manager_t UploadManager;
+
+typedef uint64_t UploadTicket;
+
+#define UPLOAD_MANAGER_DEFAULT_STAGING_SIZE (16 * 1024 * 1024)
+
+UploadManager* UploadManager_Create(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	VkQueue queue,
+	uint32_t queueFamilyIndex,
+	uint32_t renderQueueFamilyIndex,
+	DeviceMemoryAllocator* pMemoryAllocator,
+	VkDeviceSize stagingSize);
+void UploadManager_Destroy(UploadManager* pThis);
+
+UploadTicket UploadManager_UploadToBuffer(
+	UploadManager* pThis,
+	VkBuffer buffer,
+	VkDeviceSize bufferOffset,
+	const void* pData,
+	VkDeviceSize size);
+UploadTicket UploadManager_UploadToImage(
+	UploadManager* pThis,
+	VkImage image,
+	VkImageAspectFlags aspectMask,
+	uint32_t width,
+	uint32_t height,
+	const void* pData,
+	VkDeviceSize size,
+	VkImageLayout finalLayout);
+
+UploadTicket UploadManager_Flush(UploadManager* pThis);
+BOOL UploadManager_IsComplete(UploadManager* pThis, UploadTicket ticket);
+void UploadManager_Wait(UploadManager* pThis, UploadTicket ticket);
+BOOL UploadManager_IsDeviceLost(const UploadManager* pThis);
+
+uint32_t UploadManager_GetQueueFamilyIndices(
+	const UploadManager* pThis,
+	uint32_t* aQueueFamilyIndicesOut);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__UPLOAD_MANAGER_H
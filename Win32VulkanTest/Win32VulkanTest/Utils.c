@@ -1,35 +1,96 @@
 #include "stdafx.h"
 #include "Utils.h"
 
-#define PRINT_VK_RESULT(result) case result: OutputDebugStringA( STRINGIFY(result) "\n"); break;
+#ifndef _WIN32
+#include <time.h>
+#endif//_WIN32
 
-void PrintResult(VkResult result) {
-	OutputDebugStringA("Vulkan Result: ");
+#define RESULT_NAME(result) case result: return STRINGIFY(result);
+
+// the name of \a result's enumerant, for logging
+const char* GetResultName(VkResult result) {
 	switch (result) {
-		PRINT_VK_RESULT(VK_SUCCESS);
-		PRINT_VK_RESULT(VK_NOT_READY);
-		PRINT_VK_RESULT(VK_TIMEOUT);
-		PRINT_VK_RESULT(VK_EVENT_SET);
-		PRINT_VK_RESULT(VK_EVENT_RESET);
-		PRINT_VK_RESULT(VK_INCOMPLETE);
-		PRINT_VK_RESULT(VK_SUBOPTIMAL_KHR);
-		PRINT_VK_RESULT(VK_ERROR_OUT_OF_HOST_MEMORY);
-		PRINT_VK_RESULT(VK_ERROR_OUT_OF_DEVICE_MEMORY);
-		PRINT_VK_RESULT(VK_ERROR_INITIALIZATION_FAILED);
-		PRINT_VK_RESULT(VK_ERROR_MEMORY_MAP_FAILED);
-		PRINT_VK_RESULT(VK_ERROR_DEVICE_LOST);
-		PRINT_VK_RESULT(VK_ERROR_EXTENSION_NOT_PRESENT);
-		PRINT_VK_RESULT(VK_ERROR_FEATURE_NOT_PRESENT);
-		PRINT_VK_RESULT(VK_ERROR_LAYER_NOT_PRESENT);
-		PRINT_VK_RESULT(VK_ERROR_INCOMPATIBLE_DRIVER);
-		PRINT_VK_RESULT(VK_ERROR_TOO_MANY_OBJECTS);
-		PRINT_VK_RESULT(VK_ERROR_FORMAT_NOT_SUPPORTED);
-		PRINT_VK_RESULT(VK_ERROR_SURFACE_LOST_KHR);
-		PRINT_VK_RESULT(VK_ERROR_OUT_OF_DATE_KHR);
-		PRINT_VK_RESULT(VK_ERROR_INCOMPATIBLE_DISPLAY_KHR);
-		PRINT_VK_RESULT(VK_ERROR_NATIVE_WINDOW_IN_USE_KHR);
-		PRINT_VK_RESULT(VK_ERROR_VALIDATION_FAILED_EXT);
+		RESULT_NAME(VK_SUCCESS);
+		RESULT_NAME(VK_NOT_READY);
+		RESULT_NAME(VK_TIMEOUT);
+		RESULT_NAME(VK_EVENT_SET);
+		RESULT_NAME(VK_EVENT_RESET);
+		RESULT_NAME(VK_INCOMPLETE);
+		RESULT_NAME(VK_SUBOPTIMAL_KHR);
+		RESULT_NAME(VK_ERROR_OUT_OF_HOST_MEMORY);
+		RESULT_NAME(VK_ERROR_OUT_OF_DEVICE_MEMORY);
+		RESULT_NAME(VK_ERROR_INITIALIZATION_FAILED);
+		RESULT_NAME(VK_ERROR_MEMORY_MAP_FAILED);
+		RESULT_NAME(VK_ERROR_DEVICE_LOST);
+		RESULT_NAME(VK_ERROR_EXTENSION_NOT_PRESENT);
+		RESULT_NAME(VK_ERROR_FEATURE_NOT_PRESENT);
+		RESULT_NAME(VK_ERROR_LAYER_NOT_PRESENT);
+		RESULT_NAME(VK_ERROR_INCOMPATIBLE_DRIVER);
+		RESULT_NAME(VK_ERROR_TOO_MANY_OBJECTS);
+		RESULT_NAME(VK_ERROR_FORMAT_NOT_SUPPORTED);
+		RESULT_NAME(VK_ERROR_SURFACE_LOST_KHR);
+		RESULT_NAME(VK_ERROR_OUT_OF_DATE_KHR);
+		RESULT_NAME(VK_ERROR_INCOMPATIBLE_DISPLAY_KHR);
+		RESULT_NAME(VK_ERROR_NATIVE_WINDOW_IN_USE_KHR);
+		RESULT_NAME(VK_ERROR_VALIDATION_FAILED_EXT);
 	default:
-		OutputDebugStringA("Unknown Result\n");
+		return "unknown VkResult";
+	}
+}
+
+/*!
+ * \brief	writes \a szMessage to the debugger output, or stderr where there is no such thing
+ *
+ * Synchronous and unfiltered, LogSink_Debugger's output. Log with Log_Write.
+ */
+void DebugPrint(const char* szMessage) {
+#ifdef _WIN32
+	OutputDebugStringA(szMessage);
+#else//_WIN32
+	fputs(szMessage, stderr);
+#endif//_WIN32
+}
+
+/*!
+ * \brief	reads a monotonic clock, only useful for measuring the time between two calls
+ */
+uint64_t GetTimeMicroseconds(void) {
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	// split so the multiply can't overflow on long uptimes
+	uint64_t seconds = (uint64_t)counter.QuadPart / (uint64_t)frequency.QuadPart;
+	uint64_t remainder = (uint64_t)counter.QuadPart % (uint64_t)frequency.QuadPart;
+	return seconds * 1000000 + remainder * 1000000 / (uint64_t)frequency.QuadPart;
+#else//_WIN32
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+#endif//_WIN32
+}
+
+/*!
+ * \brief	copies the environment variable \a szName into \a szValueOut
+ * \param	valueSize the size of \a szValueOut, including the terminator
+ * \return	FALSE if the variable isn't set or doesn't fit
+ */
+BOOL GetEnvironmentString(const char* szName, char* szValueOut, size_t valueSize) {
+	assert(szName);
+	assert(szValueOut);
+	assert(valueSize > 0);
+
+#ifdef _WIN32
+	// getenv is deprecated by the crt
+	DWORD length = GetEnvironmentVariableA(szName, szValueOut, (DWORD)valueSize);
+	return length > 0 && length < valueSize;
+#else//_WIN32
+	const char* szValue = getenv(szName);
+	if (!szValue || strlen(szValue) >= valueSize) {
+		return FALSE;
 	}
+	strcpy(szValueOut, szValue);
+	return TRUE;
+#endif//_WIN32
 }
@@ -1,6 +1,8 @@
 #ifndef __UTILS_H
 #define __UTILS_H
 
+#include "Log.h"
+
 typedef enum VkResult VkResult;
 
 #define STRINGIFY(s) STR(s)
@@ -9,11 +11,32 @@ typedef enum VkResult VkResult;
 #define REQUIRE_VK_SUCCESS(cmd) { \
 	VkResult __result__ = (cmd);\
 	if (__result__ != VK_SUCCESS) {\
-		PrintResult(__result__);\
+		Log_Write(LOG_SEVERITY_FATAL, __FILE__, "line %d: %s", __LINE__, GetResultName(__result__));\
+		exit(1);\
+	}\
+}
+
+// for results the caller can recover from, such as a lost device. returns the
+// failure from the enclosing function, which has to return a VkResult
+#define RETURN_VK_FAILURE(cmd) { \
+	VkResult __result__ = (cmd);\
+	if (__result__ != VK_SUCCESS) {\
+		Log_Write(LOG_SEVERITY_ERROR, __FILE__, "line %d: %s", __LINE__, GetResultName(__result__));\
+		return __result__;\
+	}\
+}
+
+// for failures that aren't a VkResult, such as running out of device memory
+#define REQUIRE(condition, szMessage) { \
+	if (!(condition)) {\
+		Log_Write(LOG_SEVERITY_FATAL, __FILE__, "line %d: %s", __LINE__, szMessage);\
 		exit(1);\
 	}\
 }
 
-void PrintResult(VkResult result);
+const char* GetResultName(VkResult result);
+void DebugPrint(const char* szMessage);
+uint64_t GetTimeMicroseconds(void);
+BOOL GetEnvironmentString(const char* szName, char* szValueOut, size_t valueSize);
 
 #endif//__UTILS_H
@@ -0,0 +1,319 @@
+#include "stdafx.h"
+#include "VertexFormat.h"
+
+const VertexFormat kVertexFormatFull = {
+	{
+		VERTEX_ENCODING_FLOAT32, // VERTEX_ATTRIBUTE_POSITION
+		VERTEX_ENCODING_FLOAT32, // VERTEX_ATTRIBUTE_COLOR
+	},
+	VK_INDEX_TYPE_UINT32,
+};
+
+const VertexFormat kVertexFormatCompact = {
+	{
+		VERTEX_ENCODING_FLOAT16, // VERTEX_ATTRIBUTE_POSITION
+		VERTEX_ENCODING_UNORM8, // VERTEX_ATTRIBUTE_COLOR
+	},
+	VK_INDEX_TYPE_UINT16,
+};
+
+VkFormat VertexEncodingFormat(VertexEncoding encoding);
+uint32_t VertexEncodingSize(VertexEncoding encoding);
+const float* VertexAttributeData(const Vertex* pVertex, VertexAttribute attribute);
+void EncodeAttribute(VertexEncoding encoding, const float* pValues, uint8_t* pOut);
+uint16_t FloatToHalf(float value);
+uint8_t FloatToUnorm8(float value);
+
+/*!
+ * \brief	the distance in bytes between consecutive vertices
+ */
+uint32_t VertexFormat_GetStride(const VertexFormat* pThis) {
+	assert(pThis);
+
+	uint32_t stride = 0;
+	for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++) {
+		stride += VertexEncodingSize(pThis->aEncodings[i]);
+	}
+	return stride;
+}
+
+/*!
+ * \brief	where \a attribute starts within a vertex
+ */
+uint32_t VertexFormat_GetAttributeOffset(
+	const VertexFormat* pThis,
+	VertexAttribute attribute) {
+	assert(pThis);
+	assert(attribute < VERTEX_ATTRIBUTE_COUNT);
+
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < (uint32_t)attribute; i++) {
+		offset += VertexEncodingSize(pThis->aEncodings[i]);
+	}
+	return offset;
+}
+
+uint32_t VertexFormat_GetIndexSize(VkIndexType indexType) {
+	assert(indexType == VK_INDEX_TYPE_UINT16 || indexType == VK_INDEX_TYPE_UINT32);
+
+	return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+/*!
+ * \brief	checks \a physicalDevice can fetch every attribute of this format
+ *
+ * Only VK_FORMAT_R32G32B32_SFLOAT and VK_FORMAT_R8G8B8A8_UNORM are guaranteed,
+ * so anything using VERTEX_ENCODING_FLOAT16 should be checked before use.
+ */
+BOOL VertexFormat_IsSupported(
+	const VertexFormat* pThis,
+	VkPhysicalDevice physicalDevice) {
+	assert(pThis);
+	assert(physicalDevice);
+
+	for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++) {
+		if (pThis->aEncodings[i] == VERTEX_ENCODING_NONE) {
+			continue;
+		}
+
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(
+			physicalDevice,
+			VertexEncodingFormat(pThis->aEncodings[i]),
+			&formatProperties);
+		if (!(formatProperties.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*!
+ * \brief	fills in the pipeline's vertex input state for this format
+ *
+ * \param	binding the vertex buffer binding the attributes are read from
+ * \param	pBindingDescriptionOut receives the description of \a binding
+ * \param	aAttributeDescriptionsOut receives one description per stored
+ *			attribute, needs room for VERTEX_ATTRIBUTE_COUNT
+ * \return	the number of attribute descriptions written
+ */
+uint32_t VertexFormat_GetInputDescriptions(
+	const VertexFormat* pThis,
+	uint32_t binding,
+	VkVertexInputBindingDescription* pBindingDescriptionOut,
+	VkVertexInputAttributeDescription* aAttributeDescriptionsOut) {
+	assert(pThis);
+	assert(pBindingDescriptionOut);
+	assert(aAttributeDescriptionsOut);
+
+	pBindingDescriptionOut->binding = binding;
+	pBindingDescriptionOut->stride = VertexFormat_GetStride(pThis);
+	pBindingDescriptionOut->inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	uint32_t attributeCount = 0;
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++) {
+		VertexEncoding encoding = pThis->aEncodings[i];
+		if (encoding == VERTEX_ENCODING_NONE) {
+			continue;
+		}
+
+		aAttributeDescriptionsOut[attributeCount].location = i;
+		aAttributeDescriptionsOut[attributeCount].binding = binding;
+		aAttributeDescriptionsOut[attributeCount].format = VertexEncodingFormat(encoding);
+		aAttributeDescriptionsOut[attributeCount].offset = offset;
+		attributeCount++;
+		offset += VertexEncodingSize(encoding);
+	}
+	return attributeCount;
+}
+
+/*!
+ * \brief	packs \a paVertices into this format
+ * \param	pVerticesOut receives vertexCount * VertexFormat_GetStride bytes
+ */
+void VertexFormat_EncodeVertices(
+	const VertexFormat* pThis,
+	const Vertex* paVertices,
+	uint32_t vertexCount,
+	void* pVerticesOut) {
+	assert(pThis);
+	assert(paVertices);
+	assert(pVerticesOut);
+
+	uint8_t* pOut = (uint8_t*)pVerticesOut;
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		for (uint32_t attribute = 0; attribute < VERTEX_ATTRIBUTE_COUNT; attribute++) {
+			VertexEncoding encoding = pThis->aEncodings[attribute];
+			EncodeAttribute(
+				encoding,
+				VertexAttributeData(&paVertices[i], (VertexAttribute)attribute),
+				pOut);
+			pOut += VertexEncodingSize(encoding);
+		}
+	}
+}
+
+/*!
+ * \brief	narrows \a paIndices to \a indexType
+ *
+ * The caller has to make sure every index fits, 16 bit indices can only
+ * address the first 65536 vertices.
+ *
+ * \param	pIndicesOut receives indexCount * VertexFormat_GetIndexSize bytes
+ */
+void VertexFormat_EncodeIndices(
+	VkIndexType indexType,
+	const uint32_t* paIndices,
+	uint32_t indexCount,
+	void* pIndicesOut) {
+	assert(paIndices);
+	assert(pIndicesOut);
+
+	if (indexType == VK_INDEX_TYPE_UINT32) {
+		memcpy(pIndicesOut, paIndices, indexCount * sizeof(uint32_t));
+		return;
+	}
+
+	assert(indexType == VK_INDEX_TYPE_UINT16);
+	uint16_t* pOut = (uint16_t*)pIndicesOut;
+	for (uint32_t i = 0; i < indexCount; i++) {
+		assert(paIndices[i] <= UINT16_MAX);
+		pOut[i] = (uint16_t)paIndices[i];
+	}
+}
+
+// Private Interface!
+
+VkFormat VertexEncodingFormat(VertexEncoding encoding) {
+	switch (encoding) {
+	case VERTEX_ENCODING_FLOAT32:
+		return VK_FORMAT_R32G32B32_SFLOAT;
+	case VERTEX_ENCODING_FLOAT16:
+		return VK_FORMAT_R16G16B16A16_SFLOAT;
+	case VERTEX_ENCODING_UNORM8:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	default:
+		return VK_FORMAT_UNDEFINED;
+	}
+}
+
+uint32_t VertexEncodingSize(VertexEncoding encoding) {
+	switch (encoding) {
+	case VERTEX_ENCODING_FLOAT32:
+		return 3 * sizeof(float);
+	case VERTEX_ENCODING_FLOAT16:
+		return 4 * sizeof(uint16_t);
+	case VERTEX_ENCODING_UNORM8:
+		return 4 * sizeof(uint8_t);
+	default:
+		return 0;
+	}
+}
+
+const float* VertexAttributeData(const Vertex* pVertex, VertexAttribute attribute) {
+	switch (attribute) {
+	case VERTEX_ATTRIBUTE_POSITION:
+		return pVertex->position;
+	case VERTEX_ATTRIBUTE_COLOR:
+		return pVertex->color;
+	default:
+		assert(FALSE);
+		return NULL;
+	}
+}
+
+/*!
+ * \brief	writes three floats as \a encoding, a fourth component is set to 1
+ */
+void EncodeAttribute(VertexEncoding encoding, const float* pValues, uint8_t* pOut) {
+	switch (encoding) {
+	case VERTEX_ENCODING_NONE:
+		break;
+	case VERTEX_ENCODING_FLOAT32:
+		memcpy(pOut, pValues, 3 * sizeof(float));
+		break;
+	case VERTEX_ENCODING_FLOAT16: {
+		uint16_t aHalves[4];
+		for (uint32_t i = 0; i < 3; i++) {
+			aHalves[i] = FloatToHalf(pValues[i]);
+		}
+		aHalves[3] = FloatToHalf(1.f);
+		// the output may not be aligned for uint16_t
+		memcpy(pOut, aHalves, sizeof(aHalves));
+		break;
+	}
+	case VERTEX_ENCODING_UNORM8:
+		for (uint32_t i = 0; i < 3; i++) {
+			pOut[i] = FloatToUnorm8(pValues[i]);
+		}
+		pOut[3] = UINT8_MAX;
+		break;
+	default:
+		assert(FALSE);
+		break;
+	}
+}
+
+/*!
+ * \brief	converts to IEEE 754 half precision, rounding to nearest even
+ *
+ * Values too large for a half become infinity and tiny ones become halves
+ * denormals or zero.
+ */
+uint16_t FloatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t exponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (exponent == 0xff) {
+		// infinity stays infinity, any nan becomes a quiet nan
+		return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+
+	int32_t halfExponent = (int32_t)exponent - 127 + 15;
+	if (halfExponent >= 0x1f) {
+		return (uint16_t)(sign | 0x7c00);
+	}
+
+	if (halfExponent <= 0) {
+		if (halfExponent < -10) {
+			// rounds to zero even as a denormal
+			return (uint16_t)sign;
+		}
+
+		// denormal, shift the implicit leading one down into the mantissa
+		mantissa |= 0x800000;
+		uint32_t shift = (uint32_t)(14 - halfExponent);
+		uint32_t halfMantissa = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (halfMantissa & 1))) {
+			// may carry into the exponent, which is the right answer
+			halfMantissa++;
+		}
+		return (uint16_t)(sign | halfMantissa);
+	}
+
+	uint32_t half = sign | ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		// carries into the exponent and up to infinity when it has to
+		half++;
+	}
+	return (uint16_t)half;
+}
+
+uint8_t FloatToUnorm8(float value) {
+	if (!(value > 0.f)) {
+		// catches nan too
+		return 0;
+	}
+	if (value >= 1.f) {
+		return UINT8_MAX;
+	}
+	return (uint8_t)(value * 255.f + 0.5f);
+}
@@ -0,0 +1,80 @@
+#ifndef __VERTEX_FORMAT_H
+#define __VERTEX_FORMAT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif//__cplusplus
+
+// the full precision vertex meshes are authored in, VertexFormat_EncodeVertices
+// packs these into whatever layout a VertexFormat describes
+typedef struct vertex_t {
+	float position[3];
+	float color[3];
+} Vertex;
+
+// every attribute a vertex may have, doubles as its shader input location
+typedef enum vertex_attribute_t {
+	VERTEX_ATTRIBUTE_POSITION,
+	VERTEX_ATTRIBUTE_COLOR,
+	VERTEX_ATTRIBUTE_COUNT,
+} VertexAttribute;
+
+typedef enum vertex_encoding_t {
+	// the attribute isn't stored
+	VERTEX_ENCODING_NONE,
+	// VK_FORMAT_R32G32B32_SFLOAT, 12 bytes
+	VERTEX_ENCODING_FLOAT32,
+	// VK_FORMAT_R16G16B16A16_SFLOAT, 8 bytes. Padded to four components as
+	// three component half formats are rarely supported for vertex fetch
+	VERTEX_ENCODING_FLOAT16,
+	// VK_FORMAT_R8G8B8A8_UNORM, 4 bytes, for values in [0, 1]
+	VERTEX_ENCODING_UNORM8,
+} VertexEncoding;
+
+/*!
+ * Describes how a mesh's vertices and indices are laid out in memory.
+ *
+ * Attributes are packed in VertexAttribute order into a single interleaved
+ * binding, each one encoded as given by aEncodings.
+ */
+typedef struct vertex_format_t {
+	VertexEncoding aEncodings[VERTEX_ATTRIBUTE_COUNT];
+	VkIndexType indexType;
+} VertexFormat;
+
+// float positions and colors with 32 bit indices, 24 bytes a vertex
+extern const VertexFormat kVertexFormatFull;
+// half positions, RGBA8 colors and 16 bit indices, 12 bytes a vertex
+extern const VertexFormat kVertexFormatCompact;
+
+uint32_t VertexFormat_GetStride(const VertexFormat* pThis);
+uint32_t VertexFormat_GetAttributeOffset(
+	const VertexFormat* pThis,
+	VertexAttribute attribute);
+uint32_t VertexFormat_GetIndexSize(VkIndexType indexType);
+
+BOOL VertexFormat_IsSupported(
+	const VertexFormat* pThis,
+	VkPhysicalDevice physicalDevice);
+uint32_t VertexFormat_GetInputDescriptions(
+	const VertexFormat* pThis,
+	uint32_t binding,
+	VkVertexInputBindingDescription* pBindingDescriptionOut,
+	VkVertexInputAttributeDescription* aAttributeDescriptionsOut);
+
+void VertexFormat_EncodeVertices(
+	const VertexFormat* pThis,
+	const Vertex* paVertices,
+	uint32_t vertexCount,
+	void* pVerticesOut);
+void VertexFormat_EncodeIndices(
+	VkIndexType indexType,
+	const uint32_t* paIndices,
+	uint32_t indexCount,
+	void* pIndicesOut);
+
+#ifdef __cplusplus
+}
+#endif//__cplusplus
+
+#endif//__VERTEX_FORMAT_H
@@ -2,114 +2,408 @@
 
 #include "VulkanRenderer.h"
 
+#include "CommandRecorder.h"
+#include "DescriptorAllocator.h"
+#include "DeviceMemoryAllocator.h"
+#include "GpuProfiler.h"
+#include "JobSystem.h"
 #include "MemoryUtils.h"
+#include "Mesh.h"
+#include "PipelineCache.h"
+#include "PipelineManager.h"
+#include "PlatformSurface.h"
+#include "RenderCounters.h"
 #include "ShaderManager.h"
+#include "Thread.h"
+#include "UniformRing.h"
+#include "UploadManager.h"
 #include "Utils.h"
 
+#include <stddef.h>
+
 // timeout in nanoseconds
 #define FENCE_TIMEOUT 100000000
 
-typedef struct vertex_t {
-	float position [3];
-	float color [3];
-} Vertex;
+// the shaders the pipeline is built from
+#define MAIN_SHADER_NAME "main"
+// main.vert with each draw's UniformBlock pushed, see ShaderManager.h for variants
+#define PUSH_CONSTANT_SHADER_NAME "main.push_constants"
+
+// fewer draws than this aren't worth handing to another thread
+#define MIN_MESHES_PER_SECONDARY 32
+
+// the CMake build points this at the source tree so edits hot reload
+#ifndef SHADER_DIRECTORY
+#define SHADER_DIRECTORY "Resources/Shaders"
+#endif//SHADER_DIRECTORY
+
+// the one layer any validation level enables
+#define VALIDATION_LAYER_NAME "VK_LAYER_KHRONOS_validation"
+// longest value of VULKAN_RENDERER_VALIDATION_VARIABLE worth reading
+#define MAX_VALIDATION_VALUE_LENGTH 16
+
+// what each PresentPolicy asks of the swapchain and the frame loop
+typedef struct present_policy_settings_t {
+	// in order of preference, the last is always FIFO which every surface has
+	VkPresentModeKHR aPresentModes[3];
+	uint32_t presentModeCount;
+	// asked for on top of the surface's minimum
+	uint32_t extraImageCount;
+	// otherwise the cpu is only allowed one frame ahead of the gpu
+	BOOL allFramesInFlight;
+} PresentPolicySettings;
+
+// indexed by PresentPolicy
+const PresentPolicySettings kaPresentPolicySettings[] = {
+	// PRESENT_POLICY_LOWEST_LATENCY
+	{
+		{ VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR },
+		3,
+		1,
+		FALSE,
+	},
+	// PRESENT_POLICY_TEAR_FREE
+	{
+		{ VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR },
+		2,
+		1,
+		TRUE,
+	},
+	// PRESENT_POLICY_POWER_SAVING
+	{
+		{ VK_PRESENT_MODE_FIFO_KHR },
+		1,
+		0,
+		FALSE,
+	},
+	// PRESENT_POLICY_FIXED_REFRESH
+	{
+		{ VK_PRESENT_MODE_FIFO_KHR },
+		1,
+		1,
+		TRUE,
+	},
+};
+
+// matches the transforms block in main.vert, column major like glsl. every draw gets
+// its own from the uniform ring, or pushes it when pushConstantTransforms
+typedef struct uniform_block_t {
+	float modelView[16];
+	float projection[16];
+} UniformBlock;
 
 typedef struct swap_chain_buffer_t {
 	VkImage image;
 	VkImageView view;
+	VkFramebuffer framebuffer;
+	// per image rather than per frame, the frame's fence doesn't cover the
+	// present waiting on it. VK_NULL_HANDLE when headless
+	VkSemaphore renderCompleteSemaphore;
 } SwapChainBuffer;
 
+// what a swapchain rebuild replaced. frames recorded before the rebuild may
+// still be using it, so it's only destroyed once they have all finished
+typedef struct retired_swapchain_t {
+	// how many frames had been submitted when it was replaced
+	uint64_t retiredFrame;
+	VkSwapchainKHR swapChain;
+	uint32_t imageCount;
+	SwapChainBuffer* paBuffers;
+	VkImage depthImage;
+	DeviceMemoryAllocation depthImageMemory;
+	VkImageView depthImageView;
+} RetiredSwapchain;
+
+// headless renderers own their color images and read each one back to the host
+typedef struct offscreen_target_t {
+	DeviceMemoryAllocation imageMemory;
+	VkBuffer readbackBuffer;
+	// persistently mapped, see pMappedData
+	DeviceMemoryAllocation readbackMemory;
+} OffscreenTarget;
+
+// everything the cpu needs to record a frame while the gpu is still busy with
+// the previous ones. nothing in here may be touched until inFlightFence signals
+typedef struct frame_data_t {
+	VkCommandBuffer commandBuffer;
+	VkFence inFlightFence;
+	VkSemaphore imageAcquiredSemaphore;
+} FrameData;
+
 struct vulkan_renderer_t {
+	// the size of the render targets, set dynamically on every draw
 	uint32_t width;
 	uint32_t height;
+	// what VulkanRenderer_Resize last asked for, the surface usually decides
+	uint32_t requestedWidth;
+	uint32_t requestedHeight;
+
+	// not ours, shared with whatever else the application runs on it
+	JobSystem* pJobSystem;
 
 	VkInstance instance;
 	VkPhysicalDevice physicalDevice;
+	// only what the render counters need, and only where it's supported
+	VkPhysicalDeviceFeatures enabledFeatures;
+	// what the bindless descriptor set needs, chained into the device's
+	// creation when bindlessEnabled
+	BOOL bindlessEnabled;
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures;
+	// lets pipelines leave cull mode, front face and the depth test to each
+	// draw, chained into the device's creation when enabled
+	BOOL extendedDynamicStateEnabled;
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures;
+	// everything made from it goes when it's lost, and is made again on a new
+	// one the next frame. NULL while that keeps failing
 	VkDevice device;
+	BOOL deviceLost;
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapChain;
 
 	uint32_t queueFamilyIndex;
 
 	VkCommandPool commandPool;
+	// scene draws are recorded into secondaries across all cores, the
+	// frame's primary just executes them
+	CommandRecorder* pCommandRecorder;
+	// room for the most secondaries one recording returns
+	VkCommandBuffer* paSecondaryCommandBuffers;
+	// times each frame's passes on the cpu and gpu
+	GpuProfiler* pGpuProfiler;
+	// counts each frame's work per pass, while enabled
+	RenderCounters* pRenderCounters;
+	// carried over to the new counters when the device is re-created
+	BOOL renderCountersEnabled;
 
 	VkQueue mainQueue;
 
+	// uploads go through their own queue, a transfer only family when there is
+	// one, so streaming assets never holds up mainQueue
+	uint32_t transferQueueFamilyIndex;
+	uint32_t transferQueueIndex;
+	VkQueue transferQueue;
+	UploadManager* pUploadManager;
+
 	ShaderManager* pShaderManager;
-	VkShaderModule vertexShader;
-	VkShaderModule fragmentShader;
 	VkRenderPass renderPass;
-	VkDescriptorPool descriptorPool;
+	// every descriptor set comes from here, set 1 of the pipeline layout is
+	// its bindless set when bindlessEnabled
+	DescriptorAllocator* pDescriptorAllocator;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSet descriptorSet;
+	VkPipelineLayout pipelineLayout;
+	// every draw's pipeline comes from here, built in the background the
+	// first time a mesh's RenderState is seen and after shader reloads
+	PipelineManager* pPipelineManager;
+	// what every draw's pipeline shares, with each mesh's RenderState swapped
+	// in. Its own pipeline draws the meshes whose pipeline isn't built yet
+	PipelineDescription pipelineDescription;
+	// kept on disk so pipelines don't have to be compiled from scratch each run
+	PipelineCache* pPipelineCache;
+
+	// the most compact layout the device can fetch, every mesh uses it
+	VertexFormat vertexFormat;
+	uint32_t meshCount;
+	uint32_t meshCapacity;
+	Mesh** papMeshes;
+	// the meshes whose uploads have finished, gathered each frame before
+	// recording starts as Mesh_IsReady may only be called on this thread.
+	// shares meshCapacity
+	uint32_t drawMeshCount;
+	Mesh** papDrawMeshes;
+	// where each draw mesh's UniformBlock is in the uniform ring
+	uint32_t* paDrawUniformOffsets;
+	// what each draw mesh is drawn with
+	VkPipeline* paDrawPipelines;
+
+	DeviceMemoryAllocator* pMemoryAllocator;
+	// each draw's UniformBlock is pushed with it, using PUSH_CONSTANT_SHADER_NAME.
+	// decided by VulkanRenderer_LoadShadersJob
+	BOOL pushConstantTransforms;
+	// every draw's uniforms, bound as one dynamic uniform buffer. NULL when
+	// they're pushed instead
+	UniformRing* pUniformRing;
+	// column major, shared by every draw
+	float projection[16];
 
 	VkFormat surfaceFormat;
 	VkFormat depthBufferFormat;
 
+	VkImage depthImage;
+	DeviceMemoryAllocation depthImageMemory;
+	VkImageView depthImageView;
+
 	uint32_t swapChainImageCount;
 	SwapChainBuffer* paSwapChainBuffers;
 	uint32_t currentBuffer;
-
-	// TODO: Windows stuff - abstract out!
-	HINSTANCE hInstance;
-	HWND hWnd;
-
-	// debugging
-	PFN_vkCreateDebugReportCallbackEXT createDebugReportCallback;
-	PFN_vkDestroyDebugReportCallbackEXT destroyDebugReportCallback;
-	PFN_vkDebugReportMessageEXT debugReportMessage;
-	VkDebugReportCallbackEXT debugReportCallback;
+	// set by a resize or by the presentation engine, the swapchain is rebuilt
+	// before the next image is acquired
+	BOOL swapchainOutOfDate;
+	uint32_t retiredSwapchainCount;
+	uint32_t retiredSwapchainCapacity;
+	RetiredSwapchain* paRetiredSwapchains;
+
+	uint32_t frameCount;
+	FrameData* paFrames;
+	uint32_t currentFrame;
+	// how many frames have been submitted
+	uint64_t frameNumber;
+
+	PresentPolicy presentPolicy;
+	// how many of paFrames the policy lets the cpu use, never more than frameCount
+	uint32_t activeFrameCount;
+	// 0 when frames start as soon as they can
+	uint32_t frameInterval;
+	// when the next paced frame may start
+	uint64_t nextFrameTime;
+
+	// render to paSwapChainBuffers without a window, backed by paOffscreenTargets
+	BOOL headless;
+	OffscreenTarget* paOffscreenTargets;
+	// the offscreen target holding the most recently submitted frame
+	uint32_t lastRenderedBuffer;
+	BOOL hasRenderedFrame;
+
+	// when creation started, startup is timed from here up to the first frame
+	uint64_t startupBeginTime;
+
+	// debugging, the messenger only exists if debug utils are enabled
+	ValidationLevel validationLevel;
+	BOOL validationLayerEnabled;
+	BOOL debugUtilsEnabled;
+	PFN_vkDestroyDebugUtilsMessengerEXT destroyDebugUtilsMessenger;
+	VkDebugUtilsMessengerEXT debugUtilsMessenger;
 };
 
-const char* aszDebugLayerNames[] = {
-	"VK_LAYER_LUNARG_threading",
-	"VK_LAYER_LUNARG_mem_tracker",
-	"VK_LAYER_LUNARG_object_tracker",
-	"VK_LAYER_LUNARG_draw_state",
-	"VK_LAYER_LUNARG_param_checker",
-	"VK_LAYER_LUNARG_swapchain",
-	"VK_LAYER_LUNARG_device_limits",
-	"VK_LAYER_LUNARG_image",
-	"VK_LAYER_GOOGLE_unique_objects",
+// the values of VULKAN_RENDERER_VALIDATION_VARIABLE, by ValidationLevel
+const char* aszValidationLevelNames[VALIDATION_LEVEL_COUNT] = {
+	"off",
+	"errors",
+	"warnings",
+	"verbose",
 };
-size_t debugLayerCount = sizeof(aszDebugLayerNames) / sizeof(const char*);
 
+// initialization
+VulkanRenderer* VulkanRenderer_Allocate(
+	uint32_t width,
+	uint32_t height,
+	uint32_t framesInFlight,
+	ValidationLevel validationLevel,
+	JobSystem* pJobSystem);
+void VulkanRenderer_Initialize(
+	VulkanRenderer* pThis,
+	const PlatformSurface* pPlatformSurface);
+VkResult VulkanRenderer_CreateDevice(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreateDeviceObjects(VulkanRenderer* pThis, uint64_t phaseBeginTime);
+VkResult VulkanRenderer_CreateFrameObjects(
+	VulkanRenderer* pThis,
+	uint64_t* pPhaseBeginTime);
+VkResult VulkanRenderer_RecoverDevice(VulkanRenderer* pThis);
+BOOL VulkanRenderer_FindQueueFamily(
+	VulkanRenderer* pThis,
+	VkPhysicalDevice physicalDevice,
+	uint32_t* pQueueFamilyIndex);
+void SelectTransferQueue(
+	VkPhysicalDevice physicalDevice,
+	uint32_t graphicsQueueFamilyIndex,
+	uint32_t* pQueueFamilyIndex,
+	uint32_t* pQueueIndex);
+
+ValidationLevel ReadValidationLevel(ValidationLevel defaultLevel);
+void VulkanRenderer_FillMessengerCreateInfo(
+	VulkanRenderer* pThis,
+	VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo);
 void VulkanRenderer_SetupDebugging(VulkanRenderer* pThis);
-VkBool32 VulkanRenderer_DebugCallback(
-	VkDebugReportFlagsEXT flags,
-	VkDebugReportObjectTypeEXT objectType,
-	uint64_t object,
-	size_t location,
-	int32_t messageCode,
-	const char* pLayerPrefix,
-	const char* pMessage,
+VKAPI_ATTR VkBool32 VKAPI_CALL VulkanRenderer_DebugCallback(
+	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+	VkDebugUtilsMessageTypeFlagsEXT messageTypes,
+	const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
 	void* pUserData);
 
+// startup jobs, see VulkanRenderer_Initialize
+void VulkanRenderer_LoadShadersJob(void* pUserData);
+void VulkanRenderer_LoadPipelineCacheJob(void* pUserData);
+void VulkanRenderer_BuildPipelineJob(void* pUserData);
+uint64_t VulkanRenderer_EndStartupPhase(const char* szPhase, uint64_t phaseBeginTime);
+
 // creation
-void VulkanRenderer_CreateCommandPool(VulkanRenderer* pThis);
-void VulkanRenderer_CreateSurface(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreateCommandPool(VulkanRenderer* pThis);
+void VulkanRenderer_CreateSurface(
+	VulkanRenderer* pThis,
+	const PlatformSurface* pPlatformSurface);
 void VulkanRenderer_CacheSurfaceFormats(VulkanRenderer* pThis);
-void VulkanRenderer_CreateSwapchain(
+VkResult VulkanRenderer_CreateSwapchain(VulkanRenderer* pThis);
+VkResult VulkanRenderer_RecreateSwapchain(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreateOffscreenTargets(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreateDepthBuffer(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreateFramebuffers(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreateFrames(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreateImageView(
 	VulkanRenderer* pThis,
-	VkCommandBuffer setupCommandBuffer);
-void VulkanRenderer_CreateShaders(VulkanRenderer* pThis);
-void VulkanRenderer_CreateRenderPass(VulkanRenderer* pThis);
-void VulkanRenderer_CreateDescriptorSetLayout(VulkanRenderer* pThis);
+	VkImage image,
+	VkFormat format,
+	VkImageAspectFlags aspectMask,
+	VkImageView* pImageViewOut);
+VkResult VulkanRenderer_CreateRenderPass(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreateDescriptorSetLayout(VulkanRenderer* pThis);
+void VulkanRenderer_CreateUniformBuffer(VulkanRenderer* pThis);
 void VulkanRenderer_CreateDescriptorSet(VulkanRenderer* pThis);
-void VulkanRenderer_CreatePipelines(VulkanRenderer* pThis);
+VkResult VulkanRenderer_CreatePipelineLayout(VulkanRenderer* pThis);
+const char* VulkanRenderer_GetVertexShaderName(const VulkanRenderer* pThis);
+void VulkanRenderer_InitPipelineDescription(
+	VulkanRenderer* pThis,
+	PipelineDescription* pDescriptionOut);
+void VulkanRenderer_OnShaderReloaded(
+	void* pUserData,
+	const char* szShaderName,
+	ShaderStage stage);
 
 // destruction - there should be one for every creation above
+void VulkanRenderer_FreeDeviceObjects(VulkanRenderer* pThis);
 void VulkanRenderer_FreeSurface(VulkanRenderer* pThis);
 void VulkanRenderer_FreeSwapchain(VulkanRenderer* pThis);
+void VulkanRenderer_FreeRetiredSwapchains(
+	VulkanRenderer* pThis,
+	uint64_t finishedFrameCount);
+void VulkanRenderer_FreeOffscreenTargets(VulkanRenderer* pThis);
+void VulkanRenderer_FreeDepthBuffer(VulkanRenderer* pThis);
+void VulkanRenderer_FreeFramebuffers(VulkanRenderer* pThis);
+void VulkanRenderer_FreeFrames(VulkanRenderer* pThis);
+void VulkanRenderer_FreeUniformBuffer(VulkanRenderer* pThis);
+void VulkanRenderer_FreeDescriptorAllocator(VulkanRenderer* pThis);
+void VulkanRenderer_FreeRenderPass(VulkanRenderer* pThis);
+void VulkanRenderer_FreeDescriptorSetLayout(VulkanRenderer* pThis);
+void VulkanRenderer_FreePipelines(VulkanRenderer* pThis);
+void VulkanRenderer_FreeMeshes(VulkanRenderer* pThis);
+
+// per frame work
+void VulkanRenderer_RecordFrame(
+	VulkanRenderer* pThis,
+	VkCommandBuffer commandBuffer,
+	uint32_t imageIndex);
+void VulkanRenderer_RecordMeshes(
+	void* pUserData,
+	VkCommandBuffer commandBuffer,
+	uint32_t firstMesh,
+	uint32_t meshCount);
+void VulkanRenderer_RecordReadback(
+	VulkanRenderer* pThis,
+	VkCommandBuffer commandBuffer,
+	uint32_t imageIndex);
+VkResult VulkanRenderer_WaitForFence(VulkanRenderer* pThis, VkFence fence);
+VkResult VulkanRenderer_FailFrame(VulkanRenderer* pThis, VkResult result);
+void VulkanRenderer_PaceFrame(VulkanRenderer* pThis);
 
 // command buffer management
 // TODO: these want to be in a seperate command buffer management "class"
-VkCommandBuffer VulkanRenderer_SetupCommandBuffer(VulkanRenderer* pThis);
+VkResult VulkanRenderer_SetupCommandBuffer(
+	VulkanRenderer* pThis,
+	VkCommandBuffer* pCommandBufferOut);
 void VulkanRenderer_DestroyCommandBuffer(
 	VulkanRenderer* pThis,
 	VkCommandBuffer commandBuffer);
-VulkanRenderer_BeginCommandBuffer(VkCommandBuffer commandBuffer);
-VulkanRenderer_EndCommandBuffer(VkCommandBuffer commandBuffer);
+void VulkanRenderer_BeginCommandBuffer(VkCommandBuffer commandBuffer);
+void VulkanRenderer_EndCommandBuffer(VkCommandBuffer commandBuffer);
 
 void VulkanRenderer_ChangeImageLayout(
 	VulkanRenderer* pThis,
@@ -119,6 +413,12 @@ void VulkanRenderer_ChangeImageLayout(
 	VkImageLayout newImageLayout,
 	VkCommandBuffer setupCommandBuffer);
 VkFormat SelectDepthFormat(VkPhysicalDevice physicalDevice);
+BOOL FormatHasStencil(VkFormat format);
+BOOL InstanceExtensionIsAvailable(const char* szLayerName, const char* szExtensionName);
+uint32_t SelectAvailableLayers(
+	const char** aszRequestedLayers,
+	uint32_t requestedLayerCount,
+	const char** aszAvailableLayersOut);
 
 BOOL DeviceTypeIsSuperior(VkPhysicalDeviceType newType, VkPhysicalDeviceType oldType);
 
@@ -131,50 +431,637 @@ VkPhysicalDeviceType aDevicePrecidents[] = {
 	VK_PHYSICAL_DEVICE_TYPE_OTHER,
 };
 
+/*!
+ * \brief	creates a renderer that presents to a window
+ *
+ * \param	width the width of the swapchain images
+ * \param	height the height of the swapchain images
+ * \param	framesInFlight how many frames the cpu may record ahead of the gpu
+ * \param	validationLevel how much validation to run with, unless
+ *			VULKAN_RENDERER_VALIDATION_VARIABLE says otherwise
+ * \param	pPlatformSurface the window to present to, only needed during this
+ *			call. A headless one gives the same renderer as
+ *			VulkanRenderer_CreateHeadless
+ * \param	pJobSystem runs the renderer's parallel work, has to outlive it.
+ *			The renderer has to be used from its main thread
+ */
 VulkanRenderer* VulkanRenderer_Create(
 	uint32_t width,
 	uint32_t height,
-	HINSTANCE hInstance,
-	HWND hWnd) {
-	assert(hInstance);
-	assert(hWnd);
+	uint32_t framesInFlight,
+	ValidationLevel validationLevel,
+	const PlatformSurface* pPlatformSurface,
+	JobSystem* pJobSystem) {
+	assert(pPlatformSurface);
+
+	VulkanRenderer* pVulkanRenderer = VulkanRenderer_Allocate(
+		width,
+		height,
+		framesInFlight,
+		validationLevel,
+		pJobSystem);
+	if (PlatformSurface_GetType(pPlatformSurface) == PLATFORM_SURFACE_TYPE_HEADLESS) {
+		pVulkanRenderer->headless = TRUE;
+		pPlatformSurface = NULL;
+	}
+
+	VulkanRenderer_Initialize(pVulkanRenderer, pPlatformSurface);
+
+	return pVulkanRenderer;
+}
+
+/*!
+ * \brief	creates a renderer that draws into offscreen images instead of a window
+ *
+ * Needs no surface or swapchain, so it runs anywhere there's a Vulkan device
+ * including cpu implementations such as lavapipe. Every frame is copied to
+ * host memory once rendered, see VulkanRenderer_ReadPixels.
+ *
+ * \param	width the width of the offscreen color and depth targets
+ * \param	height the height of the offscreen color and depth targets
+ * \param	framesInFlight how many frames the cpu may record ahead of the gpu
+ * \param	validationLevel how much validation to run with, unless
+ *			VULKAN_RENDERER_VALIDATION_VARIABLE says otherwise
+ * \param	pJobSystem runs the renderer's parallel work, has to outlive it
+ */
+VulkanRenderer* VulkanRenderer_CreateHeadless(
+	uint32_t width,
+	uint32_t height,
+	uint32_t framesInFlight,
+	ValidationLevel validationLevel,
+	JobSystem* pJobSystem) {
+
+	VulkanRenderer* pVulkanRenderer = VulkanRenderer_Allocate(
+		width,
+		height,
+		framesInFlight,
+		validationLevel,
+		pJobSystem);
+	pVulkanRenderer->headless = TRUE;
+
+	VulkanRenderer_Initialize(pVulkanRenderer, NULL);
+
+	return pVulkanRenderer;
+}
+
+/*!
+ * \brief	records and submits one frame
+ *
+ * Only blocks if the gpu is still working on the frame that last used this
+ * frame's resources, so with N frames in flight the cpu can record up to N-1
+ * frames ahead of the gpu.
+ *
+ * An out of date swapchain is rebuilt and a lost device re-created, along
+ * with everything on it, before carrying on. Meshes are uploaded again, so
+ * they're missing from the first few frames after.
+ *
+ * \return	VK_SUCCESS if the frame was submitted, VK_NOT_READY if there was
+ *			nothing to render to or the device was lost and re-created, or a
+ *			failure that couldn't be recovered from. VK_ERROR_DEVICE_LOST
+ *			means the device couldn't be re-created and is tried again next
+ *			call, until then only VulkanRenderer_DestroyMesh and
+ *			VulkanRenderer_Destroy may be called. After any other failure
+ *			the renderer can only be destroyed
+ */
+VkResult VulkanRenderer_Render(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	// found lost outside of a frame, or re-creating it failed last time
+	if (pThis->deviceLost) {
+		// it logged why, the device is tried again next call whatever it was
+		if (VulkanRenderer_RecoverDevice(pThis) != VK_SUCCESS) {
+			return VK_ERROR_DEVICE_LOST;
+		}
+	}
+	assert(pThis->paFrames);
+
+	if (pThis->frameInterval) {
+		VulkanRenderer_PaceFrame(pThis);
+	}
+
+	FrameData* pFrame = &pThis->paFrames[pThis->currentFrame];
+
+	// wait for the gpu to release this frame's command buffers and semaphores
+	VkResult result = VulkanRenderer_WaitForFence(pThis, pFrame->inFlightFence);
+	if (result != VK_SUCCESS) {
+		return VulkanRenderer_FailFrame(pThis, result);
+	}
+	CommandRecorder_BeginFrame(pThis->pCommandRecorder, pThis->currentFrame);
+	if (pThis->pUniformRing) {
+		UniformRing_BeginFrame(pThis->pUniformRing, pThis->currentFrame);
+	}
+	DescriptorAllocator_BeginFrame(pThis->pDescriptorAllocator, pThis->currentFrame);
+	PipelineManager_BeginFrame(pThis->pPipelineManager, pThis->frameNumber);
+
+	// the frame that last used this slot and everything before it is done
+	if (pThis->frameNumber + 1 >= pThis->frameCount) {
+		VulkanRenderer_FreeRetiredSwapchains(
+			pThis,
+			pThis->frameNumber + 1 - pThis->frameCount);
+	}
+
+	// start copying meshes created since the last frame
+	UploadManager_Flush(pThis->pUploadManager);
+	if (UploadManager_IsDeviceLost(pThis->pUploadManager)) {
+		return VulkanRenderer_FailFrame(pThis, VK_ERROR_DEVICE_LOST);
+	}
+
+	if (pThis->headless) {
+		// each frame in flight has its own offscreen target
+		pThis->currentBuffer = pThis->currentFrame;
+	}
+	else {
+		// one rebuild if acquiring finds it out of date, if the new one is too
+		// the window's still changing and the next frame tries again
+		for (uint32_t attempt = 0;; attempt++) {
+			if (pThis->swapchainOutOfDate) {
+				result = VulkanRenderer_RecreateSwapchain(pThis);
+				if (result == VK_NOT_READY) {
+					// minimized, there's nothing to draw to until it's restored
+					return result;
+				}
+				if (result != VK_SUCCESS) {
+					return VulkanRenderer_FailFrame(pThis, result);
+				}
+			}
+
+			result = vkAcquireNextImageKHR(
+				pThis->device,
+				pThis->swapChain,
+				UINT64_MAX,
+				pFrame->imageAcquiredSemaphore,
+				VK_NULL_HANDLE,
+				&pThis->currentBuffer);
+			if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+				// nothing was acquired and the semaphore is untouched
+				pThis->swapchainOutOfDate = TRUE;
+				if (attempt == 0) {
+					continue;
+				}
+				return VK_NOT_READY;
+			}
+			if (result == VK_SUBOPTIMAL_KHR) {
+				// still presentable, draw this frame and rebuild before the next
+				pThis->swapchainOutOfDate = TRUE;
+				break;
+			}
+			if (result != VK_SUCCESS) {
+				return VulkanRenderer_FailFrame(pThis, result);
+			}
+			break;
+		}
+	}
+
+	// the fence says the gpu is done with it. reset before the fence, so a
+	// failure here leaves the fence signalled for the next wait on it
+	result = vkResetCommandBuffer(pFrame->commandBuffer, 0);
+	if (result != VK_SUCCESS) {
+		return VulkanRenderer_FailFrame(pThis, result);
+	}
+	// only reset once we know we'll submit work that signals it again
+	result = vkResetFences(pThis->device, 1, &pFrame->inFlightFence);
+	if (result != VK_SUCCESS) {
+		return VulkanRenderer_FailFrame(pThis, result);
+	}
+	VulkanRenderer_BeginCommandBuffer(pFrame->commandBuffer);
+	GpuProfiler_BeginFrame(pThis->pGpuProfiler, pThis->currentFrame, pFrame->commandBuffer);
+	RenderCounters_BeginFrame(pThis->pRenderCounters, pThis->currentFrame, pFrame->commandBuffer);
+	VulkanRenderer_RecordFrame(pThis, pFrame->commandBuffer, pThis->currentBuffer);
+	GpuProfiler_EndFrame(pThis->pGpuProfiler, pFrame->commandBuffer);
+	VulkanRenderer_EndCommandBuffer(pFrame->commandBuffer);
+
+	// the image can't be written until the presentation engine is done reading it
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+	VkSubmitInfo submitInfo = { 0 };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = NULL;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &pFrame->commandBuffer;
+	if (pThis->headless) {
+		// nothing to present, the fence is all we need
+		submitInfo.waitSemaphoreCount = 0;
+		submitInfo.pWaitSemaphores = NULL;
+		submitInfo.pWaitDstStageMask = NULL;
+		submitInfo.signalSemaphoreCount = 0;
+		submitInfo.pSignalSemaphores = NULL;
+	}
+	else {
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &pFrame->imageAcquiredSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores
+			= &pThis->paSwapChainBuffers[pThis->currentBuffer].renderCompleteSemaphore;
+	}
+
+	// the fence is already reset, so a failure here leaves the frame unusable
+	// until the device is re-created
+	result = vkQueueSubmit(pThis->mainQueue, 1, &submitInfo, pFrame->inFlightFence);
+	if (result != VK_SUCCESS) {
+		return VulkanRenderer_FailFrame(pThis, result);
+	}
+
+	if (!pThis->headless) {
+		VkPresentInfoKHR presentInfo = { 0 };
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.pNext = NULL;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores
+			= &pThis->paSwapChainBuffers[pThis->currentBuffer].renderCompleteSemaphore;
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &pThis->swapChain;
+		presentInfo.pImageIndices = &pThis->currentBuffer;
+		presentInfo.pResults = NULL;
+
+		result = vkQueuePresentKHR(pThis->mainQueue, &presentInfo);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+			pThis->swapchainOutOfDate = TRUE;
+		}
+		else if (result != VK_SUCCESS) {
+			return VulkanRenderer_FailFrame(pThis, result);
+		}
+	}
+
+	if (pThis->frameNumber == 0) {
+		VulkanRenderer_EndStartupPhase("first frame", pThis->startupBeginTime);
+	}
+	pThis->lastRenderedBuffer = pThis->currentBuffer;
+	pThis->hasRenderedFrame = TRUE;
+	pThis->currentFrame = (pThis->currentFrame + 1) % pThis->activeFrameCount;
+	pThis->frameNumber++;
+	return VK_SUCCESS;
+}
+
+/*!
+ * \brief	the profiler timing every frame's passes, owned by the renderer
+ *
+ * Frames show up in it once the gpu has finished them, a few frames after
+ * they were rendered. Replaced by a new one, without the history, if the
+ * device is lost.
+ */
+GpuProfiler* VulkanRenderer_GetProfiler(VulkanRenderer* pThis) {
+	assert(pThis);
+	return pThis->pGpuProfiler;
+}
+
+/*!
+ * \brief	the counters of every frame's passes, owned by the renderer
+ *
+ * Disabled until RenderCounters_SetEnabled. The scene is counted as
+ * VULKAN_RENDERER_SCENE_COUNTER_PASS. Replaced by new ones, enabled the
+ * same, if the device is lost.
+ */
+RenderCounters* VulkanRenderer_GetRenderCounters(VulkanRenderer* pThis) {
+	assert(pThis);
+	return pThis->pRenderCounters;
+}
+
+/*!
+ * \brief	where descriptor sets for the renderer's device come from
+ *
+ * Its bindless set, if it has one, is bound as set 1 of every draw. Replaced
+ * by a new one, with nothing in it, if the device is lost.
+ */
+DescriptorAllocator* VulkanRenderer_GetDescriptorAllocator(VulkanRenderer* pThis) {
+	assert(pThis);
+	return pThis->pDescriptorAllocator;
+}
+
+/*!
+ * \brief	rebuilds the swapchain for a new window size before the next frame
+ *
+ * The new swapchain is created from the old one, and the old one with its
+ * framebuffers and depth buffer is destroyed once the frames in flight that
+ * use it have finished. Nothing waits for the device to go idle. A zero size,
+ * such as a minimized window, skips rendering until the next resize.
+ *
+ * Presenting may also find the swapchain out of date, that's handled the
+ * same way without calling this.
+ */
+void VulkanRenderer_Resize(VulkanRenderer* pThis, uint32_t width, uint32_t height) {
+	assert(pThis);
+	assert(!pThis->headless && "headless renderers keep the size they were made with");
+
+	pThis->requestedWidth = width;
+	pThis->requestedHeight = height;
+	if (width != pThis->width || height != pThis->height) {
+		pThis->swapchainOutOfDate = TRUE;
+	}
+}
+
+/*!
+ * \brief	chooses how frames are presented and paced from the next frame on
+ *
+ * Picks the present mode and swapchain image count, rebuilding the swapchain
+ * if either changes, and how many of the renderer's frames in flight the cpu
+ * may record ahead. Headless renderers only use the pacing and frames in
+ * flight.
+ *
+ * \param	frameIntervalMicroseconds the least time between the start of two
+ *			frames, 0 to not pace the cpu at all. PRESENT_POLICY_FIXED_REFRESH
+ *			treats 0 as VULKAN_RENDERER_DEFAULT_FRAME_INTERVAL
+ */
+void VulkanRenderer_SetPresentPolicy(
+	VulkanRenderer* pThis,
+	PresentPolicy policy,
+	uint32_t frameIntervalMicroseconds) {
+	assert(pThis);
+	assert(policy < PRESENT_POLICY_COUNT);
+
+	const PresentPolicySettings* pOldSettings = &kaPresentPolicySettings[pThis->presentPolicy];
+	const PresentPolicySettings* pSettings = &kaPresentPolicySettings[policy];
+	if (pSettings->aPresentModes[0] != pOldSettings->aPresentModes[0]
+		|| pSettings->presentModeCount != pOldSettings->presentModeCount
+		|| pSettings->extraImageCount != pOldSettings->extraImageCount) {
+		pThis->swapchainOutOfDate = !pThis->headless;
+	}
+
+	pThis->presentPolicy = policy;
+	pThis->activeFrameCount = pSettings->allFramesInFlight ? pThis->frameCount : 1;
+	if (pThis->currentFrame >= pThis->activeFrameCount) {
+		pThis->currentFrame = 0;
+	}
+
+	if (policy == PRESENT_POLICY_FIXED_REFRESH && frameIntervalMicroseconds == 0) {
+		frameIntervalMicroseconds = VULKAN_RENDERER_DEFAULT_FRAME_INTERVAL;
+	}
+	pThis->frameInterval = frameIntervalMicroseconds;
+	pThis->nextFrameTime = GetTimeMicroseconds();
+}
+
+/*!
+ * \brief	copies the most recently rendered frame of a headless renderer to \a pPixels
+ *
+ * Waits for that frame to finish on the gpu, but not for any frames
+ * submitted after it.
+ *
+ * \param	pPixels receives width * height tightly packed R8G8B8A8 pixels
+ * \param	pixelBufferSize the size of \a pPixels in bytes
+ * \return	TRUE if a frame has been rendered since the device was last
+ *			lost and was copied
+ */
+BOOL VulkanRenderer_ReadPixels(
+	VulkanRenderer* pThis,
+	void* pPixels,
+	size_t pixelBufferSize) {
+	assert(pThis);
+	assert(pThis->headless);
+	assert(pPixels);
+	assert(pixelBufferSize >= (size_t)pThis->width * pThis->height * 4);
+
+	if (!pThis->hasRenderedFrame) {
+		return FALSE;
+	}
+
+	// in headless mode offscreen targets and frames map one to one
+	uint32_t targetIndex = pThis->lastRenderedBuffer;
+	if (VulkanRenderer_WaitForFence(pThis, pThis->paFrames[targetIndex].inFlightFence)
+		!= VK_SUCCESS) {
+		// the frame went with the device
+		return FALSE;
+	}
+
+	OffscreenTarget* pTarget = &pThis->paOffscreenTargets[targetIndex];
+
+	// the readback memory may not be coherent
+	DeviceMemoryAllocator_Invalidate(pThis->pMemoryAllocator, &pTarget->readbackMemory);
+
+	memcpy(
+		pPixels,
+		pTarget->readbackMemory.pMappedData,
+		(size_t)pThis->width * pThis->height * 4);
+	return TRUE;
+}
+
+void VulkanRenderer_Destroy(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	// already gone if it was lost and couldn't be re-created
+	if (pThis->device) {
+		VulkanRenderer_FreeDeviceObjects(pThis);
+	}
+	VulkanRenderer_FreeMeshes(pThis);
+	SAFE_FREE(pThis->paRetiredSwapchains);
+	if (!pThis->headless) {
+		VulkanRenderer_FreeSurface(pThis);
+	}
+	if (pThis->debugUtilsMessenger) {
+		pThis->destroyDebugUtilsMessenger(
+			pThis->instance,
+			pThis->debugUtilsMessenger,
+			NULL);
+	}
+	vkDestroyInstance(pThis->instance, NULL);
+	free(pThis);
+}
+
+/*!
+ * \brief	creates a mesh that's drawn every frame from when its upload finishes
+ *
+ * The vertices are stored in the most compact VertexFormat the device
+ * supports, falling back to full precision.
+ *
+ * \param	paVertices only needed during this call
+ * \param	paIndices three per triangle, only needed during this call
+ */
+Mesh* VulkanRenderer_CreateMesh(
+	VulkanRenderer* pThis,
+	const Vertex* paVertices,
+	uint32_t vertexCount,
+	const uint32_t* paIndices,
+	uint32_t indexCount) {
+	assert(pThis);
+	assert(pThis->device && "the device was lost and couldn't be re-created");
+
+	if (pThis->meshCount == pThis->meshCapacity) {
+		pThis->meshCapacity = pThis->meshCapacity ? pThis->meshCapacity * 2 : 8;
+		pThis->papMeshes = (Mesh**)realloc(
+			pThis->papMeshes,
+			sizeof(Mesh*) * pThis->meshCapacity);
+		assert(pThis->papMeshes);
+		pThis->papDrawMeshes = (Mesh**)realloc(
+			pThis->papDrawMeshes,
+			sizeof(Mesh*) * pThis->meshCapacity);
+		assert(pThis->papDrawMeshes);
+		pThis->paDrawUniformOffsets = (uint32_t*)realloc(
+			pThis->paDrawUniformOffsets,
+			sizeof(uint32_t) * pThis->meshCapacity);
+		assert(pThis->paDrawUniformOffsets);
+		pThis->paDrawPipelines = (VkPipeline*)realloc(
+			pThis->paDrawPipelines,
+			sizeof(VkPipeline) * pThis->meshCapacity);
+		assert(pThis->paDrawPipelines);
+	}
+
+	Mesh* pMesh = Mesh_Create(
+		pThis->device,
+		pThis->pMemoryAllocator,
+		pThis->pUploadManager,
+		&pThis->vertexFormat,
+		paVertices,
+		vertexCount,
+		paIndices,
+		indexCount);
+	pThis->papMeshes[pThis->meshCount++] = pMesh;
+	return pMesh;
+}
+
+/*!
+ * \brief	sets the column major projection every mesh is drawn with from the
+ *			next frame, identity until this is called
+ */
+void VulkanRenderer_SetProjection(VulkanRenderer* pThis, const float* pProjection) {
+	assert(pThis);
+	assert(pProjection);
+
+	memcpy(pThis->projection, pProjection, sizeof(pThis->projection));
+}
+
+/*!
+ * \brief	stops drawing \a pMesh and destroys it
+ *
+ * Waits for every frame in flight, as any of them may still be drawing it.
+ */
+void VulkanRenderer_DestroyMesh(VulkanRenderer* pThis, Mesh* pMesh) {
+	assert(pThis);
+	assert(pMesh);
+
+	for (uint32_t i = 0; i < pThis->meshCount; i++) {
+		if (pThis->papMeshes[i] != pMesh) {
+			continue;
+		}
+
+		// a lost device has nothing in flight, nor any frames if it couldn't
+		// be re-created
+		for (uint32_t frame = 0; frame < pThis->frameCount && pThis->paFrames; frame++) {
+			if (VulkanRenderer_WaitForFence(pThis, pThis->paFrames[frame].inFlightFence)
+				!= VK_SUCCESS) {
+				break;
+			}
+		}
+		Mesh_Destroy(pMesh);
+
+		// draw order doesn't matter, fill the hole with the last mesh
+		pThis->papMeshes[i] = pThis->papMeshes[--pThis->meshCount];
+		return;
+	}
+	assert(!"pMesh wasn't created by this renderer");
+}
+
+// Private Interface!
+
+VulkanRenderer* VulkanRenderer_Allocate(
+	uint32_t width,
+	uint32_t height,
+	uint32_t framesInFlight,
+	ValidationLevel validationLevel,
+	JobSystem* pJobSystem) {
+	assert(width > 0);
+	assert(height > 0);
+	assert(framesInFlight > 0);
+	assert(framesInFlight <= VULKAN_RENDERER_MAX_FRAMES_IN_FLIGHT);
+	assert(validationLevel < VALIDATION_LEVEL_COUNT);
+	assert(pJobSystem);
 
 	VulkanRenderer* pVulkanRenderer = (VulkanRenderer*)malloc(sizeof(VulkanRenderer));
 	memset(pVulkanRenderer, 0, sizeof(VulkanRenderer));
 
 	pVulkanRenderer->width = width;
 	pVulkanRenderer->height = height;
-	pVulkanRenderer->hInstance = hInstance;
-	pVulkanRenderer->hWnd = hWnd;
-
-	pVulkanRenderer->pShaderManager = ShaderManager_Create(
-		"Resources/Shaders",
-		".vert.spv",
-		".frag.spv");
+	pVulkanRenderer->requestedWidth = width;
+	pVulkanRenderer->requestedHeight = height;
+	pVulkanRenderer->frameCount = framesInFlight;
+	pVulkanRenderer->presentPolicy = PRESENT_POLICY_TEAR_FREE;
+	pVulkanRenderer->activeFrameCount = framesInFlight;
+	pVulkanRenderer->validationLevel = ReadValidationLevel(validationLevel);
+	pVulkanRenderer->pJobSystem = pJobSystem;
+	pVulkanRenderer->startupBeginTime = GetTimeMicroseconds();
+	for (uint32_t i = 0; i < 4; i++) {
+		pVulkanRenderer->projection[i * 4 + i] = 1.0f;
+	}
 
-	const char* aszInstanceExtensionNames[] = {
-		VK_KHR_SURFACE_EXTENSION_NAME,
-		VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
+	return pVulkanRenderer;
+}
 
-		// TODO: this is windows code, extract!
-		VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+/*!
+ * \brief	brings up vulkan for a renderer made by VulkanRenderer_Allocate
+ *
+ * Picks the physical device and everything about it that outlives a lost
+ * device, then creates the device and what lives on it, see
+ * VulkanRenderer_CreateDeviceObjects. Any failure here is fatal.
+ *
+ * \param	pPlatformSurface the window to present to, NULL if and only if
+ *			the renderer is headless
+ */
+void VulkanRenderer_Initialize(
+	VulkanRenderer* pVulkanRenderer,
+	const PlatformSurface* pPlatformSurface) {
+	assert(pVulkanRenderer);
+	assert(pVulkanRenderer->headless == (pPlatformSurface == NULL));
+
+	uint64_t phaseBeginTime = pVulkanRenderer->startupBeginTime;
+
+	const char* aszInstanceExtensionNames[4] = { 0 };
+	uint32_t instanceExtensionCount = 0;
+	if (!pVulkanRenderer->headless) {
+		aszInstanceExtensionNames[instanceExtensionCount++] = VK_KHR_SURFACE_EXTENSION_NAME;
+		aszInstanceExtensionNames[instanceExtensionCount++]
+			= PlatformSurface_GetInstanceExtension(pPlatformSurface);
+	}
 
+	// validation is skipped if the layer isn't installed, rather than failing
+	const char* aszValidationLayerNames[] = {
+		VALIDATION_LAYER_NAME,
 	};
-	uint32_t instanceExtensionCount = sizeof(aszInstanceExtensionNames) / sizeof(const char*);
+	const char* aszEnabledLayerNames[sizeof(aszValidationLayerNames) / sizeof(const char*)];
+	uint32_t enabledLayerCount = 0;
+	if (pVulkanRenderer->validationLevel != VALIDATION_LEVEL_OFF) {
+		enabledLayerCount = SelectAvailableLayers(
+			aszValidationLayerNames,
+			sizeof(aszValidationLayerNames) / sizeof(const char*),
+			aszEnabledLayerNames);
+		if (enabledLayerCount == 0) {
+			Log_Write(
+				LOG_SEVERITY_WARNING,
+				"renderer",
+				VALIDATION_LAYER_NAME " isn't installed, running without validation");
+		}
+	}
+
+	// the layer reports through debug utils, which it or the loader may provide
+	pVulkanRenderer->debugUtilsEnabled = enabledLayerCount > 0
+		&& (InstanceExtensionIsAvailable(NULL, VK_EXT_DEBUG_UTILS_EXTENSION_NAME)
+			|| InstanceExtensionIsAvailable(VALIDATION_LAYER_NAME, VK_EXT_DEBUG_UTILS_EXTENSION_NAME));
+	if (pVulkanRenderer->debugUtilsEnabled) {
+		aszInstanceExtensionNames[instanceExtensionCount++] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+	}
+
+	// only needed to ask devices whether they can do bindless and extended
+	// dynamic state
+	if (InstanceExtensionIsAvailable(NULL, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+		aszInstanceExtensionNames[instanceExtensionCount++]
+			= VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+	}
+
+	// chained so instance creation and destruction are reported on too
+	VkDebugUtilsMessengerCreateInfoEXT messengerCreateInfo = { 0 };
+	VulkanRenderer_FillMessengerCreateInfo(pVulkanRenderer, &messengerCreateInfo);
 
 	// initialize vulkan
 	VkInstanceCreateInfo createInfo = { 0 };
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	createInfo.pNext = NULL;
+	createInfo.pNext = pVulkanRenderer->debugUtilsEnabled ? &messengerCreateInfo : NULL;
 	createInfo.flags = 0;
 	createInfo.pApplicationInfo = NULL;
-	createInfo.enabledLayerCount = debugLayerCount;
-	createInfo.ppEnabledLayerNames = aszDebugLayerNames;
+	createInfo.enabledLayerCount = enabledLayerCount;
+	createInfo.ppEnabledLayerNames = aszEnabledLayerNames;
 	createInfo.enabledExtensionCount = instanceExtensionCount;
 	createInfo.ppEnabledExtensionNames = aszInstanceExtensionNames;
 	REQUIRE_VK_SUCCESS(
 		vkCreateInstance(&createInfo, NULL, &pVulkanRenderer->instance)
 	);
+	phaseBeginTime = VulkanRenderer_EndStartupPhase("instance", phaseBeginTime);
 
 	// get all the physical devices
 	// first find the numer of devices
@@ -196,9 +1083,11 @@ VulkanRenderer* VulkanRenderer_Create(
 			paPhysicalDevices)
 	);
 
-	VulkanRenderer_CreateSurface(pVulkanRenderer);
-
-	assert(pVulkanRenderer->surface);
+	// the surface decides which queues can present, so it has to exist first
+	if (!pVulkanRenderer->headless) {
+		VulkanRenderer_CreateSurface(pVulkanRenderer, pPlatformSurface);
+		assert(pVulkanRenderer->surface);
+	}
 
 	// find one we like
 	VkPhysicalDevice chosenDevice = NULL;
@@ -208,53 +1097,24 @@ VulkanRenderer* VulkanRenderer_Create(
 		VkPhysicalDeviceProperties deviceProperties;
 		vkGetPhysicalDeviceProperties(paPhysicalDevices[deviceIndex], &deviceProperties);
 
-		uint32_t queueFamilyPropertyCount;
-		vkGetPhysicalDeviceQueueFamilyProperties(
+		uint32_t queueIndex;
+		if (!VulkanRenderer_FindQueueFamily(
+			pVulkanRenderer,
 			paPhysicalDevices[deviceIndex],
-			&queueFamilyPropertyCount,
-			NULL);
-		VkQueueFamilyProperties* paQueueFamilyProperties
-			= (VkQueueFamilyProperties*)malloc(
-				sizeof(VkQueueFamilyProperties) * queueFamilyPropertyCount);
-
-		BOOL queueValid = FALSE;
-		uint32_t queueIndex = 0;
-		for (; queueIndex < queueFamilyPropertyCount; queueIndex++) {
-			VkBool32 supportsPresent;
-			REQUIRE_VK_SUCCESS(
-				vkGetPhysicalDeviceSurfaceSupportKHR(
-					paPhysicalDevices[deviceIndex],
-					queueIndex,
-					pVulkanRenderer->surface,
-					&supportsPresent)
-			);
+			&queueIndex)) {
 
-			// TODO: do this check when finding a queue
-			assert(supportsPresent);
-
-			if (supportsPresent
-				&& (paQueueFamilyProperties[queueIndex].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
-				
-				// if this queue supports presenting. I'll just pray that it does for now!
-				queueValid = TRUE;
-				break;
-			}
+			// can't draw with this one
+			continue;
 		}
 
-		if (!chosenDevice) {
-			chosenDevice = paPhysicalDevices[deviceIndex];
-			chosenDeviceProperties = deviceProperties;
-			chosenQueueIndex = queueIndex;
-		}
-		else {
-			if (DeviceTypeIsSuperior(
+		if (!chosenDevice
+			|| DeviceTypeIsSuperior(
 				deviceProperties.deviceType,
 				chosenDeviceProperties.deviceType)) {
 
-				chosenDevice = paPhysicalDevices[deviceIndex];
-				chosenDeviceProperties = deviceProperties;
-				chosenQueueIndex = queueIndex;
-			}
+			chosenDevice = paPhysicalDevices[deviceIndex];
+			chosenDeviceProperties = deviceProperties;
+			chosenQueueIndex = queueIndex;
 		}
 
 		// if we found a discreet GPU - that's probably ideal
@@ -262,277 +1122,768 @@ VulkanRenderer* VulkanRenderer_Create(
 			// we've struck gold!
 			break;
 		}
-
-		free(paQueueFamilyProperties);
 	}
+	assert(chosenDevice);
 
 	pVulkanRenderer->physicalDevice = chosenDevice;
+	pVulkanRenderer->queueFamilyIndex = chosenQueueIndex;
 	pVulkanRenderer->depthBufferFormat = SelectDepthFormat(chosenDevice);
+	pVulkanRenderer->validationLayerEnabled = enabledLayerCount > 0;
+	free(paPhysicalDevices);
+
+	SelectTransferQueue(
+		chosenDevice,
+		chosenQueueIndex,
+		&pVulkanRenderer->transferQueueFamilyIndex,
+		&pVulkanRenderer->transferQueueIndex);
+
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(chosenDevice, &supportedFeatures);
+	pVulkanRenderer->enabledFeatures.pipelineStatisticsQuery
+		= supportedFeatures.pipelineStatisticsQuery;
+	pVulkanRenderer->enabledFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+	pVulkanRenderer->enabledFeatures.occlusionQueryPrecise
+		= supportedFeatures.occlusionQueryPrecise;
+	pVulkanRenderer->bindlessEnabled = DescriptorAllocator_QueryBindlessSupport(
+		pVulkanRenderer->instance,
+		chosenDevice,
+		&pVulkanRenderer->descriptorIndexingFeatures);
+	Log_Write(
+		LOG_SEVERITY_INFO,
+		"renderer",
+		"bindless descriptors are %s",
+		pVulkanRenderer->bindlessEnabled ? "on" : "unsupported");
+	pVulkanRenderer->extendedDynamicStateEnabled = PipelineManager_QueryExtendedDynamicState(
+		pVulkanRenderer->instance,
+		chosenDevice,
+		&pVulkanRenderer->extendedDynamicStateFeatures);
+	Log_Write(
+		LOG_SEVERITY_INFO,
+		"renderer",
+		"extended dynamic state is %s",
+		pVulkanRenderer->extendedDynamicStateEnabled ? "on" : "unsupported");
+
+	pVulkanRenderer->vertexFormat = kVertexFormatCompact;
+	if (!VertexFormat_IsSupported(&kVertexFormatCompact, chosenDevice)) {
+		pVulkanRenderer->vertexFormat = kVertexFormatFull;
+	}
+
+	if (pVulkanRenderer->headless) {
+		// something every implementation can render to and we can read back
+		pVulkanRenderer->surfaceFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	}
+	else {
+		VulkanRenderer_CacheSurfaceFormats(pVulkanRenderer);
+	}
+
+	VulkanRenderer_SetupDebugging(pVulkanRenderer);
+
+	REQUIRE_VK_SUCCESS(VulkanRenderer_CreateDevice(pVulkanRenderer));
+	phaseBeginTime = VulkanRenderer_EndStartupPhase("device", phaseBeginTime);
+
+	// a window with no area yet, say minimized, gets its swapchain from
+	// VulkanRenderer_Render once it has one
+	REQUIRE_VK_SUCCESS(VulkanRenderer_CreateDeviceObjects(pVulkanRenderer, phaseBeginTime));
+
+	// nothing needs recording before the first frame, whose render pass
+	// transitions every attachment from undefined, so there is no setup
+	// submission to wait on
+	VulkanRenderer_EndStartupPhase("initialize", pVulkanRenderer->startupBeginTime);
+}
+
+/*!
+ * \brief	creates the logical device and gets its queues
+ *
+ * \return	what vkCreateDevice returned, device is NULL unless it succeeded
+ */
+VkResult VulkanRenderer_CreateDevice(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->physicalDevice);
+	assert(!pThis->device);
 
-	// make a logical device
-	float queuePriorities[1] = { 0.5f };
-	VkDeviceQueueCreateInfo deviceQueues[1] = {0};
+	float queuePriorities[2] = { 0.5f, 0.5f };
+	VkDeviceQueueCreateInfo deviceQueues[2] = {0};
 	deviceQueues[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 	deviceQueues[0].pNext = NULL;
 	deviceQueues[0].flags = 0;
-	deviceQueues[0].queueFamilyIndex = chosenQueueIndex;
+	deviceQueues[0].queueFamilyIndex = pThis->queueFamilyIndex;
 	deviceQueues[0].queueCount = 1;
 	deviceQueues[0].pQueuePriorities = queuePriorities;
+	uint32_t deviceQueueCount = 1;
+	if (pThis->transferQueueFamilyIndex != pThis->queueFamilyIndex) {
+		deviceQueues[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		deviceQueues[1].pNext = NULL;
+		deviceQueues[1].flags = 0;
+		deviceQueues[1].queueFamilyIndex = pThis->transferQueueFamilyIndex;
+		deviceQueues[1].queueCount = 1;
+		deviceQueues[1].pQueuePriorities = queuePriorities;
+		deviceQueueCount = 2;
+	}
+	else {
+		// a second queue in the graphics family if it has one
+		deviceQueues[0].queueCount = pThis->transferQueueIndex + 1;
+	}
 
-	const char* aszDeviceExtensionNames[] = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+	// device layers are ignored by current loaders, older ones want them to
+	// match the instance's
+	const char* aszLayerNames[] = {
+		VALIDATION_LAYER_NAME,
 	};
-	uint32_t deviceExtensionCount = sizeof(aszDeviceExtensionNames) / sizeof(const char*);
 
+	const char* aszDeviceExtensionNames[2 + DESCRIPTOR_ALLOCATOR_BINDLESS_EXTENSION_COUNT];
+	uint32_t deviceExtensionCount = 0;
+	// headless rendering never presents, so it doesn't need a swapchain
+	if (!pThis->headless) {
+		aszDeviceExtensionNames[deviceExtensionCount++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+	}
+	if (pThis->bindlessEnabled) {
+		for (uint32_t i = 0; i < DESCRIPTOR_ALLOCATOR_BINDLESS_EXTENSION_COUNT; i++) {
+			aszDeviceExtensionNames[deviceExtensionCount++] = kaszBindlessDeviceExtensions[i];
+		}
+	}
+	if (pThis->extendedDynamicStateEnabled) {
+		aszDeviceExtensionNames[deviceExtensionCount++]
+			= VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME;
+	}
+
+	// each optional feature struct is chained in front of the last
+	void* pFeatures = NULL;
+	if (pThis->bindlessEnabled) {
+		pThis->descriptorIndexingFeatures.pNext = pFeatures;
+		pFeatures = &pThis->descriptorIndexingFeatures;
+	}
+	if (pThis->extendedDynamicStateEnabled) {
+		pThis->extendedDynamicStateFeatures.pNext = pFeatures;
+		pFeatures = &pThis->extendedDynamicStateFeatures;
+	}
 
 	VkDeviceCreateInfo deviceCreateInfo = { 0 };
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceCreateInfo.pNext = NULL;
+	deviceCreateInfo.pNext = pFeatures;
 	deviceCreateInfo.flags = 0;
-	deviceCreateInfo.queueCreateInfoCount = 1;
+	deviceCreateInfo.queueCreateInfoCount = deviceQueueCount;
 	deviceCreateInfo.pQueueCreateInfos = deviceQueues;
-	deviceCreateInfo.enabledLayerCount = debugLayerCount; // don't turn any layers on for now
-	deviceCreateInfo.ppEnabledLayerNames = aszDebugLayerNames;
-	deviceCreateInfo.enabledExtensionCount = deviceExtensionCount; // no extensions
+	deviceCreateInfo.enabledLayerCount = pThis->validationLayerEnabled
+		? sizeof(aszLayerNames) / sizeof(const char*)
+		: 0;
+	deviceCreateInfo.ppEnabledLayerNames = aszLayerNames;
+	deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
 	deviceCreateInfo.ppEnabledExtensionNames = aszDeviceExtensionNames;
-	deviceCreateInfo.pEnabledFeatures = NULL; // no special features for now
-	REQUIRE_VK_SUCCESS(
-		vkCreateDevice(
-			chosenDevice,
-			&deviceCreateInfo,
-			NULL,
-			&pVulkanRenderer->device)
-	);
+	deviceCreateInfo.pEnabledFeatures = &pThis->enabledFeatures;
+	VkResult result = vkCreateDevice(
+		pThis->physicalDevice,
+		&deviceCreateInfo,
+		NULL,
+		&pThis->device);
+	if (result != VK_SUCCESS) {
+		pThis->device = NULL;
+		return result;
+	}
+
+	// grab the queue!
+	vkGetDeviceQueue(
+		pThis->device,
+		pThis->queueFamilyIndex,
+		0,
+		&pThis->mainQueue);
+	vkGetDeviceQueue(
+		pThis->device,
+		pThis->transferQueueFamilyIndex,
+		pThis->transferQueueIndex,
+		&pThis->transferQueue);
+
+	return VK_SUCCESS;
+}
+
+/*!
+ * \brief	creates everything that lives on the device, as startup and after
+ *			the device was lost
+ *
+ * Shader modules and the pipeline cache load on the JobSystem, and the
+ * pipeline compiles as soon as both are in and its layout exists. Meanwhile
+ * this thread creates the swapchain and everything else that needs the
+ * allocator or a command pool. Each phase's time is logged.
+ *
+ * If the swapchain can't be created, the window being minimized or the new
+ * device being lost already, it's left for VulkanRenderer_Render to try again.
+ *
+ * \param	phaseBeginTime when the first phase started
+ * \return	VK_SUCCESS, or what failed. Whatever was created is left for
+ *			VulkanRenderer_FreeDeviceObjects
+ */
+VkResult VulkanRenderer_CreateDeviceObjects(VulkanRenderer* pThis, uint64_t phaseBeginTime) {
+	assert(pThis);
+	assert(pThis->device);
+
+	// start on the file reads first, they're the slowest part of startup and
+	// need nothing but the device
+	pThis->pShaderManager = ShaderManager_Create(
+		pThis->device,
+		SHADER_DIRECTORY,
+		".vert.spv",
+		".frag.spv");
+	Job* pShadersJob = JobSystem_Run(
+		pThis->pJobSystem,
+		VulkanRenderer_LoadShadersJob,
+		pThis,
+		JOB_FLAG_NONE);
+	Job* pPipelineCacheJob = JobSystem_Run(
+		pThis->pJobSystem,
+		VulkanRenderer_LoadPipelineCacheJob,
+		pThis,
+		JOB_FLAG_NONE);
+
+	pThis->pMemoryAllocator = DeviceMemoryAllocator_Create(
+		pThis->physicalDevice,
+		pThis->device,
+		DEVICE_MEMORY_DEFAULT_BLOCK_SIZE,
+		DEVICE_MEMORY_STRATEGY_BUDDY);
+	pThis->pUploadManager = UploadManager_Create(
+		pThis->physicalDevice,
+		pThis->device,
+		pThis->transferQueue,
+		pThis->transferQueueFamilyIndex,
+		pThis->queueFamilyIndex,
+		pThis->pMemoryAllocator,
+		UPLOAD_MANAGER_DEFAULT_STAGING_SIZE);
+	pThis->pDescriptorAllocator = DescriptorAllocator_Create(
+		pThis->physicalDevice,
+		pThis->device,
+		pThis->frameCount,
+		pThis->bindlessEnabled);
+
+	// everything the pipeline needs besides its shaders and cache
+	VkResult result = VulkanRenderer_CreateRenderPass(pThis);
+	if (result == VK_SUCCESS) {
+		result = VulkanRenderer_CreateDescriptorSetLayout(pThis);
+	}
+	if (result == VK_SUCCESS) {
+		result = VulkanRenderer_CreatePipelineLayout(pThis);
+	}
+	if (result != VK_SUCCESS) {
+		// the loads use the device, so they have to finish before it's freed
+		JobSystem_Wait(pThis->pJobSystem, pShadersJob);
+		JobSystem_Wait(pThis->pJobSystem, pPipelineCacheJob);
+		return result;
+	}
+
+	Job* pPipelineJob = JobSystem_CreateJob(
+		pThis->pJobSystem,
+		VulkanRenderer_BuildPipelineJob,
+		pThis,
+		JOB_FLAG_NONE);
+	JobSystem_AddDependency(pThis->pJobSystem, pPipelineJob, pShadersJob);
+	JobSystem_AddDependency(pThis->pJobSystem, pPipelineJob, pPipelineCacheJob);
+	JobSystem_Release(pThis->pJobSystem, pShadersJob);
+	JobSystem_Release(pThis->pJobSystem, pPipelineCacheJob);
+	JobSystem_Submit(pThis->pJobSystem, pPipelineJob);
+	phaseBeginTime = VulkanRenderer_EndStartupPhase("layouts", phaseBeginTime);
+
+	// the allocator and command pool aren't thread safe, so the rest stays
+	// on this thread while the pipeline compiles
+	result = VulkanRenderer_CreateFrameObjects(pThis, &phaseBeginTime);
+
+	// helps compile if it's still going. after a failure too, the build has
+	// to be done before anything it uses is freed
+	JobSystem_Wait(pThis->pJobSystem, pPipelineJob);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	if (!PipelineManager_GetPipelineNow(pThis->pPipelineManager, &pThis->pipelineDescription)) {
+		Log_Write(LOG_SEVERITY_ERROR, "renderer", "failed to build the pipeline");
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	phaseBeginTime = VulkanRenderer_EndStartupPhase("pipeline wait", phaseBeginTime);
+
+	// the shaders job picked how transforms reach the shader
+	if (!pThis->pushConstantTransforms) {
+		VulkanRenderer_CreateUniformBuffer(pThis);
+		VulkanRenderer_CreateDescriptorSet(pThis);
+		VulkanRenderer_EndStartupPhase("uniforms", phaseBeginTime);
+	}
+
+#ifndef SHADER_MANAGER_EMBEDDED_SHADERS
+	// embedded shaders are for builds that shouldn't touch the shader files
+	ShaderManager_EnableHotReload(
+		pThis->pShaderManager,
+		VulkanRenderer_OnShaderReloaded,
+		pThis);
+#endif//SHADER_MANAGER_EMBEDDED_SHADERS
+
+	return VK_SUCCESS;
+}
+
+/*!
+ * \brief	creates what frames are recorded with and drawn into, the part of
+ *			VulkanRenderer_CreateDeviceObjects that overlaps the pipeline build
+ *
+ * \param	pPhaseBeginTime when the current startup phase started, moved on
+ *			as each one ends
+ */
+VkResult VulkanRenderer_CreateFrameObjects(
+	VulkanRenderer* pThis,
+	uint64_t* pPhaseBeginTime) {
+	assert(pThis);
+	assert(pPhaseBeginTime);
+
+	RETURN_VK_FAILURE(VulkanRenderer_CreateCommandPool(pThis));
+	VkResult result = VK_SUCCESS;
+	if (pThis->headless) {
+		RETURN_VK_FAILURE(VulkanRenderer_CreateOffscreenTargets(pThis));
+	}
+	else {
+		result = VulkanRenderer_CreateSwapchain(pThis);
+		pThis->swapchainOutOfDate = result != VK_SUCCESS;
+		pThis->deviceLost = result == VK_ERROR_DEVICE_LOST;
+	}
+	// without a swapchain these come with it, see VulkanRenderer_RecreateSwapchain
+	if (result == VK_SUCCESS) {
+		RETURN_VK_FAILURE(VulkanRenderer_CreateDepthBuffer(pThis));
+		RETURN_VK_FAILURE(VulkanRenderer_CreateFramebuffers(pThis));
+	}
+	*pPhaseBeginTime = VulkanRenderer_EndStartupPhase(
+		pThis->headless ? "offscreen targets" : "swapchain",
+		*pPhaseBeginTime);
+
+	RETURN_VK_FAILURE(VulkanRenderer_CreateFrames(pThis));
+	pThis->pCommandRecorder = CommandRecorder_Create(
+		pThis->device,
+		pThis->queueFamilyIndex,
+		pThis->frameCount,
+		pThis->pJobSystem);
+	pThis->paSecondaryCommandBuffers = SAFE_ALLOCATE_ARRAY(
+		VkCommandBuffer,
+		CommandRecorder_GetMaxChunkCount(pThis->pCommandRecorder));
+	pThis->pGpuProfiler = GpuProfiler_Create(
+		pThis->physicalDevice,
+		pThis->device,
+		pThis->queueFamilyIndex,
+		pThis->frameCount);
+	pThis->pRenderCounters = RenderCounters_Create(
+		pThis->device,
+		pThis->frameCount,
+		&pThis->enabledFeatures);
+	*pPhaseBeginTime = VulkanRenderer_EndStartupPhase("frames", *pPhaseBeginTime);
+
+	return VK_SUCCESS;
+}
+
+/*!
+ * \brief	replaces a lost device and everything made from it
+ *
+ * Meshes keep their handles and are uploaded again. The profiler and render
+ * counters are replaced, keeping only whether the counters are enabled.
+ *
+ * \return	VK_SUCCESS, or why the new device or something on it couldn't be
+ *			created, in which case the renderer is left without a device and
+ *			deviceLost stays set until this is tried again
+ */
+VkResult VulkanRenderer_RecoverDevice(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->deviceLost);
+
+	uint64_t beginTime = GetTimeMicroseconds();
 
-	VulkanRenderer_SetupDebugging(pVulkanRenderer);
+	// if the last attempt failed this is all gone already
+	if (pThis->device) {
+		Log_Write(LOG_SEVERITY_ERROR, "renderer", "the device was lost, re-creating it");
+		pThis->renderCountersEnabled = RenderCounters_IsEnabled(pThis->pRenderCounters);
+		VulkanRenderer_FreeDeviceObjects(pThis);
 
-	// grab the queue!
-	vkGetDeviceQueue(
-		pVulkanRenderer->device,
-		chosenQueueIndex,
-		0,
-		&pVulkanRenderer->mainQueue);
-	pVulkanRenderer->queueFamilyIndex = chosenQueueIndex;
+		// the last frame went with it
+		pThis->hasRenderedFrame = FALSE;
+		pThis->currentFrame = 0;
+	}
 
-	free(paPhysicalDevices);
+	VkResult result = VulkanRenderer_CreateDevice(pThis);
+	if (result != VK_SUCCESS) {
+		Log_Write(
+			LOG_SEVERITY_ERROR,
+			"renderer",
+			"failed to re-create the device: %s",
+			GetResultName(result));
+		return result;
+	}
+	pThis->deviceLost = FALSE;
+
+	result = VulkanRenderer_CreateDeviceObjects(pThis, beginTime);
+	if (result != VK_SUCCESS) {
+		Log_Write(
+			LOG_SEVERITY_ERROR,
+			"renderer",
+			"failed to re-create the device's objects: %s",
+			GetResultName(result));
+		VulkanRenderer_FreeDeviceObjects(pThis);
+		pThis->deviceLost = TRUE;
+		return result;
+	}
+	RenderCounters_SetEnabled(pThis->pRenderCounters, pThis->renderCountersEnabled);
+	for (uint32_t i = 0; i < pThis->meshCount; i++) {
+		Mesh_Recreate(
+			pThis->papMeshes[i],
+			pThis->device,
+			pThis->pMemoryAllocator,
+			pThis->pUploadManager);
+	}
 
-	VulkanRenderer_CacheSurfaceFormats(pVulkanRenderer);
-	VulkanRenderer_CreateCommandPool(pVulkanRenderer);
+	Log_Write(
+		LOG_SEVERITY_INFO,
+		"renderer",
+		"re-created the device in %.2fms",
+		(double)(GetTimeMicroseconds() - beginTime) / 1000.0);
+	return VK_SUCCESS;
+}
 
-	// TODO: this is all wrong!
-	// I need to begin the command buffer
-	// init the swap chain - it looks like the buffer is needed to move the images over
-	// "execute_pre_present_barrier" will need it for a vkCmdPipelineBarrier
-	// find whatever else needs info.cmd in the drawcube demo
+/*!
+ * \brief	caches the pipeline's modules in the shader manager
+ *
+ * Picks the push constant vertex shader when the variant loads, and the
+ * uniform ring's otherwise. Every device has the 128 bytes of push constants
+ * a UniformBlock needs, so a missing variant is the only reason to fall back.
+ */
+void VulkanRenderer_LoadShadersJob(void* pUserData) {
+	VulkanRenderer* pThis = (VulkanRenderer*)pUserData;
+	uint64_t beginTime = GetTimeMicroseconds();
 
-	VkCommandBuffer setupBuffer = VulkanRenderer_SetupCommandBuffer(pVulkanRenderer);
-	VulkanRenderer_BeginCommandBuffer(setupBuffer);
+	// released straight away, the manager keeps them until they're purged
+	VkShaderModule vertexShader = ShaderManager_AcquireShader(
+		pThis->pShaderManager,
+		PUSH_CONSTANT_SHADER_NAME,
+		SHADER_STAGE_VERTEX);
+	pThis->pushConstantTransforms = vertexShader != VK_NULL_HANDLE;
+	if (!pThis->pushConstantTransforms) {
+		vertexShader = ShaderManager_AcquireShader(
+			pThis->pShaderManager,
+			MAIN_SHADER_NAME,
+			SHADER_STAGE_VERTEX);
+	}
+	Log_Write(
+		LOG_SEVERITY_INFO,
+		"renderer",
+		"per draw transforms are %s",
+		pThis->pushConstantTransforms ? "push constants" : "in the uniform ring");
+	VkShaderModule fragmentShader = ShaderManager_AcquireShader(
+		pThis->pShaderManager,
+		MAIN_SHADER_NAME,
+		SHADER_STAGE_FRAGMENT);
+	ShaderManager_ReleaseShader(pThis->pShaderManager, vertexShader);
+	ShaderManager_ReleaseShader(pThis->pShaderManager, fragmentShader);
 
-	VulkanRenderer_CreateSurface(pVulkanRenderer); // TODO: move out of active cmd buffer
-	VulkanRenderer_CreateSwapchain(pVulkanRenderer, setupBuffer);
-	VulkanRenderer_CreateShaders(pVulkanRenderer);
-	VulkanRenderer_CreateRenderPass(pVulkanRenderer);
-	VulkanRenderer_CreateDescriptorSetLayout(pVulkanRenderer);
-	VulkanRenderer_CreateDescriptorSet(pVulkanRenderer);
-	// TODO: see what I have to do to make this NOT crash
-	VulkanRenderer_CreatePipelines(pVulkanRenderer);
+	VulkanRenderer_EndStartupPhase("shaders", beginTime);
+}
 
-	VulkanRenderer_EndCommandBuffer(setupBuffer);
+void VulkanRenderer_LoadPipelineCacheJob(void* pUserData) {
+	VulkanRenderer* pThis = (VulkanRenderer*)pUserData;
+	uint64_t beginTime = GetTimeMicroseconds();
 
-	// setup fence to submit the setup buffer
-	VkFenceCreateInfo fenceCreateInfo = { 0 };
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.pNext = NULL;
-	fenceCreateInfo.flags = 0;
-	VkFence setupFence;
-	vkCreateFence(pVulkanRenderer->device, &fenceCreateInfo, NULL, &setupFence);
+	pThis->pPipelineCache = PipelineCache_Create(
+		pThis->physicalDevice,
+		pThis->device,
+		PIPELINE_CACHE_DEFAULT_PATH);
 
-	VkSubmitInfo submitInfo = { 0 };
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.pNext = NULL;
-	submitInfo.waitSemaphoreCount = 0;
-	submitInfo.pWaitSemaphores = NULL;
-	submitInfo.pWaitDstStageMask = NULL;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &setupBuffer;
-	submitInfo.signalSemaphoreCount = 0;
-	submitInfo.pSignalSemaphores = NULL;
+	VulkanRenderer_EndStartupPhase("pipeline cache", beginTime);
+}
 
-	REQUIRE_VK_SUCCESS(
-		vkQueueSubmit(pVulkanRenderer->mainQueue, 1, &submitInfo, setupFence)
-	);
+/*!
+ * \brief	creates the pipeline manager and builds the pipeline every mesh
+ *			starts out with
+ *
+ * Only writes the manager and pThis->pipelineDescription, which nothing reads
+ * until the job is waited on.
+ */
+void VulkanRenderer_BuildPipelineJob(void* pUserData) {
+	VulkanRenderer* pThis = (VulkanRenderer*)pUserData;
+	uint64_t beginTime = GetTimeMicroseconds();
 
-	VkResult fenceResult;
-	do {
-		fenceResult = vkWaitForFences(
-			pVulkanRenderer->device,
-			1,
-			&setupFence,
-			VK_TRUE,
-			FENCE_TIMEOUT);
-	} while (fenceResult == VK_TIMEOUT);
+	pThis->pPipelineManager = PipelineManager_Create(
+		pThis->device,
+		pThis->pShaderManager,
+		pThis->pPipelineCache,
+		pThis->pJobSystem,
+		pThis->frameCount,
+		pThis->extendedDynamicStateEnabled);
 
-	VulkanRenderer_DestroyCommandBuffer(pVulkanRenderer, setupBuffer);
+	VulkanRenderer_InitPipelineDescription(pThis, &pThis->pipelineDescription);
+	PipelineManager_GetPipelineNow(pThis->pPipelineManager, &pThis->pipelineDescription);
 
-	return pVulkanRenderer;
+	VulkanRenderer_EndStartupPhase("pipeline", beginTime);
+}
+
+/*!
+ * \brief	writes how long a startup phase took
+ *
+ * \return	the time now, to begin the next phase with
+ */
+uint64_t VulkanRenderer_EndStartupPhase(const char* szPhase, uint64_t phaseBeginTime) {
+	uint64_t now = GetTimeMicroseconds();
+
+	Log_Write(
+		LOG_SEVERITY_INFO,
+		"startup",
+		"%s took %.2fms",
+		szPhase,
+		(double)(now - phaseBeginTime) / 1000.0);
+
+	return now;
 }
 
-void VulkanRenderer_Render(VulkanRenderer* pThis) {
+/*!
+ * \brief	finds a queue family on \a physicalDevice that we can render with
+ *
+ * Windowed renderers also need the family to be able to present to our surface.
+ *
+ * \param	pQueueFamilyIndex receives the index of the family we found
+ * \return	TRUE if a suitable family was found
+ */
+BOOL VulkanRenderer_FindQueueFamily(
+	VulkanRenderer* pThis,
+	VkPhysicalDevice physicalDevice,
+	uint32_t* pQueueFamilyIndex) {
 	assert(pThis);
+	assert(physicalDevice);
+	assert(pQueueFamilyIndex);
+
+	uint32_t queueFamilyPropertyCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(
+		physicalDevice,
+		&queueFamilyPropertyCount,
+		NULL);
+	VkQueueFamilyProperties* paQueueFamilyProperties = SAFE_ALLOCATE_ARRAY(
+		VkQueueFamilyProperties,
+		queueFamilyPropertyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(
+		physicalDevice,
+		&queueFamilyPropertyCount,
+		paQueueFamilyProperties);
+
+	BOOL queueValid = FALSE;
+	for (uint32_t queueIndex = 0; queueIndex < queueFamilyPropertyCount; queueIndex++) {
+		if (!(paQueueFamilyProperties[queueIndex].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+			continue;
+		}
 
-	VkPresentInfoKHR presentInfo = { 0 };
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.pNext = NULL;
-	presentInfo.waitSemaphoreCount = 0;
-	presentInfo.pWaitSemaphores = NULL;
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = &pThis->swapChain;
-	presentInfo.pImageIndices = &pThis->currentBuffer;
-	presentInfo.pResults = NULL;
+		if (!pThis->headless) {
+			VkBool32 supportsPresent;
+			REQUIRE_VK_SUCCESS(
+				vkGetPhysicalDeviceSurfaceSupportKHR(
+					physicalDevice,
+					queueIndex,
+					pThis->surface,
+					&supportsPresent)
+			);
+			if (!supportsPresent) {
+				continue;
+			}
+		}
 
-	// TODO: define fences, wait for fences (resource loading, drawing, &c)
+		*pQueueFamilyIndex = queueIndex;
+		queueValid = TRUE;
+		break;
+	}
 
-	REQUIRE_VK_SUCCESS(
-		vkQueuePresentKHR(pThis->mainQueue, &presentInfo)
-	);
+	SAFE_FREE(paQueueFamilyProperties);
+	return queueValid;
 }
 
-void VulkanRenderer_Destroy(VulkanRenderer* pThis) {
-	assert(pThis);
+/*!
+ * \brief	picks the queue uploads are submitted to
+ *
+ * Prefers a transfer only family, as those are usually backed by dedicated
+ * copy engines, then any other family, then a second queue in the graphics
+ * family and finally shares the graphics queue.
+ *
+ * \param	pQueueFamilyIndex receives the family of the chosen queue
+ * \param	pQueueIndex receives the queue's index within its family
+ */
+void SelectTransferQueue(
+	VkPhysicalDevice physicalDevice,
+	uint32_t graphicsQueueFamilyIndex,
+	uint32_t* pQueueFamilyIndex,
+	uint32_t* pQueueIndex) {
+	assert(physicalDevice);
+	assert(pQueueFamilyIndex);
+	assert(pQueueIndex);
+
+	uint32_t queueFamilyPropertyCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(
+		physicalDevice,
+		&queueFamilyPropertyCount,
+		NULL);
+	VkQueueFamilyProperties* paQueueFamilyProperties = SAFE_ALLOCATE_ARRAY(
+		VkQueueFamilyProperties,
+		queueFamilyPropertyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(
+		physicalDevice,
+		&queueFamilyPropertyCount,
+		paQueueFamilyProperties);
+
+	// graphics and compute queues can always transfer, even if they don't say so
+	const VkQueueFlags transferCapable
+		= VK_QUEUE_TRANSFER_BIT
+		| VK_QUEUE_GRAPHICS_BIT
+		| VK_QUEUE_COMPUTE_BIT;
+
+	*pQueueFamilyIndex = graphicsQueueFamilyIndex;
+	*pQueueIndex = paQueueFamilyProperties[graphicsQueueFamilyIndex].queueCount > 1 ? 1 : 0;
+	BOOL foundOtherFamily = FALSE;
+	for (uint32_t i = 0; i < queueFamilyPropertyCount; i++) {
+		VkQueueFlags queueFlags = paQueueFamilyProperties[i].queueFlags;
+		if (i == graphicsQueueFamilyIndex
+			|| paQueueFamilyProperties[i].queueCount == 0
+			|| !(queueFlags & transferCapable)) {
+
+			continue;
+		}
 
-	ShaderManager_Destroy(pThis->pShaderManager);
-	pThis->pShaderManager = NULL;
+		if (!(queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			// transfer only, can't do better than this
+			*pQueueFamilyIndex = i;
+			*pQueueIndex = 0;
+			break;
+		}
+		if (!foundOtherFamily) {
+			*pQueueFamilyIndex = i;
+			*pQueueIndex = 0;
+			foundOtherFamily = TRUE;
+		}
+	}
 
-	VulkanRenderer_FreeSurface(pThis);
-	vkDestroyCommandPool(pThis->device, pThis->commandPool, NULL);
-	vkDeviceWaitIdle(pThis->device);
-	vkDestroyDevice(pThis->device, NULL);
-	vkDestroyInstance(pThis->instance, NULL);
-	free(pThis);
+	SAFE_FREE(paQueueFamilyProperties);
 }
 
-// Private Interface!
+/*!
+ * \brief	the validation level \a VULKAN_RENDERER_VALIDATION_VARIABLE asks for
+ * \return	\a defaultLevel if the variable isn't set or isn't a level
+ */
+ValidationLevel ReadValidationLevel(ValidationLevel defaultLevel) {
+	char szValue[MAX_VALIDATION_VALUE_LENGTH];
+	if (!GetEnvironmentString(VULKAN_RENDERER_VALIDATION_VARIABLE, szValue, sizeof(szValue))) {
+		return defaultLevel;
+	}
+
+	for (uint32_t i = 0; i < VALIDATION_LEVEL_COUNT; i++) {
+		if (strcmp(szValue, aszValidationLevelNames[i]) == 0) {
+			return (ValidationLevel)i;
+		}
+	}
+	Log_Write(
+		LOG_SEVERITY_WARNING,
+		"renderer",
+		VULKAN_RENDERER_VALIDATION_VARIABLE " isn't off, errors, warnings or verbose, ignoring it");
+	return defaultLevel;
+}
+
+// reports what the renderer's validation level asks for
+void VulkanRenderer_FillMessengerCreateInfo(
+	VulkanRenderer* pThis,
+	VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo) {
+	pCreateInfo->sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	pCreateInfo->pNext = NULL;
+	pCreateInfo->flags = 0;
+	pCreateInfo->messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	pCreateInfo->messageType
+		= VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+		| VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
+	if (pThis->validationLevel >= VALIDATION_LEVEL_WARNINGS) {
+		pCreateInfo->messageSeverity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+		pCreateInfo->messageType |= VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	}
+	if (pThis->validationLevel >= VALIDATION_LEVEL_VERBOSE) {
+		pCreateInfo->messageSeverity
+			|= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT
+			| VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+	}
+	pCreateInfo->pfnUserCallback = VulkanRenderer_DebugCallback;
+	pCreateInfo->pUserData = pThis;
+}
 
 void VulkanRenderer_SetupDebugging(VulkanRenderer* pThis) {
 
 	assert(pThis);
 	assert(pThis->instance);
 
-	// TODO: only enable some layers
-	uint32_t layerPropertyCount;
-	REQUIRE_VK_SUCCESS(vkEnumerateInstanceLayerProperties(&layerPropertyCount, NULL));
-	VkLayerProperties* paLayerProperties
-		= SAFE_ALLOCATE_ARRAY(VkLayerProperties, layerPropertyCount);
-	REQUIRE_VK_SUCCESS(
-		vkEnumerateInstanceLayerProperties(
-			&layerPropertyCount, paLayerProperties));
-	OutputDebugStringA("Available Strings!\n");
-	for (uint32_t i = 0; i < layerPropertyCount; i++) {
-		OutputDebugStringA(paLayerProperties[i].layerName);
-		OutputDebugStringA(": ");
-		OutputDebugStringA(paLayerProperties[i].description);
-		OutputDebugStringA("\n");
+	if (!pThis->debugUtilsEnabled) {
+		return;
 	}
-	SAFE_FREE(paLayerProperties);
 
-	pThis->createDebugReportCallback
-		= (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(
+	PFN_vkCreateDebugUtilsMessengerEXT createDebugUtilsMessenger
+		= (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
 			pThis->instance,
-			"vkCreateDebugReportCallbackEXT");
-	assert(pThis->createDebugReportCallback);
+			"vkCreateDebugUtilsMessengerEXT");
+	assert(createDebugUtilsMessenger);
 
-	pThis->destroyDebugReportCallback
-		= (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(
+	pThis->destroyDebugUtilsMessenger
+		= (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
 			pThis->instance,
-			"vkDestroyDebugReportCallbackEXT");
-	assert(pThis->destroyDebugReportCallback);
-
-	//pThis->debugReportMessage
-	//	= (PFN_vkDebugReportMessageEXT)vkGetInstanceProcAddr(
-	//		pThis->instance,
-	//		"vkDebugReportMessageEXT");
-	//assert(pThis->debugReportCallback);
-
-	VkDebugReportCallbackCreateInfoEXT debugCreateInfo = { 0 };
-	debugCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CREATE_INFO_EXT;
-	debugCreateInfo.pNext = NULL;
-	debugCreateInfo.flags
-		= VK_DEBUG_REPORT_ERROR_BIT_EXT
-		| VK_DEBUG_REPORT_WARNING_BIT_EXT;
-	debugCreateInfo.pfnCallback = VulkanRenderer_DebugCallback;
-	debugCreateInfo.pUserData = pThis;
-	pThis->createDebugReportCallback(
-		pThis->instance,
-		&debugCreateInfo,
-		NULL,
-		&pThis->debugReportCallback);
-}
-VkBool32 VulkanRenderer_DebugCallback(
-	VkDebugReportFlagsEXT flags,
-	VkDebugReportObjectTypeEXT objectType,
-	uint64_t object,
-	size_t location,
-	int32_t messageCode,
-	const char* pLayerPrefix,
-	const char* pMessage,
+			"vkDestroyDebugUtilsMessengerEXT");
+	assert(pThis->destroyDebugUtilsMessenger);
+
+	VkDebugUtilsMessengerCreateInfoEXT messengerCreateInfo = { 0 };
+	VulkanRenderer_FillMessengerCreateInfo(pThis, &messengerCreateInfo);
+	REQUIRE_VK_SUCCESS(
+		createDebugUtilsMessenger(
+			pThis->instance,
+			&messengerCreateInfo,
+			NULL,
+			&pThis->debugUtilsMessenger)
+	);
+}
+VKAPI_ATTR VkBool32 VKAPI_CALL VulkanRenderer_DebugCallback(
+	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+	VkDebugUtilsMessageTypeFlagsEXT messageTypes,
+	const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
 	void* pUserData) {
-	VulkanRenderer* pThis = (VulkanRenderer*)pUserData;
-	if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) {
-		OutputDebugStringA("ERROR: ");
-		OutputDebugStringA(pLayerPrefix);
-		OutputDebugStringA(": ");
-		OutputDebugStringA(pMessage);
-		OutputDebugStringA("\n");
-	}
-	else if (flags & VK_DEBUG_REPORT_WARNING_BIT_EXT) {
-		OutputDebugStringA("WARNING: ");
-		OutputDebugStringA(pLayerPrefix);
-		OutputDebugStringA(": ");
-		OutputDebugStringA(pMessage);
-		OutputDebugStringA("\n");
+	LogSeverity severity = LOG_SEVERITY_DEBUG;
+	if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+		severity = LOG_SEVERITY_ERROR;
 	}
-	else {
+	else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+		severity = LOG_SEVERITY_WARNING;
 	}
+	else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+		severity = LOG_SEVERITY_INFO;
+	}
+
+	// called on whichever thread made the call, so this has to stay cheap
+	Log_Write(
+		severity,
+		messageTypes & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT ? "performance" : "validation",
+		"%s: %s",
+		pCallbackData->pMessageIdName ? pCallbackData->pMessageIdName : "",
+		pCallbackData->pMessage);
 
+	// the call that caused it carries on as normal
 	return VK_FALSE;
 }
 
-void VulkanRenderer_CreateCommandPool(VulkanRenderer* pThis) {
+VkResult VulkanRenderer_CreateCommandPool(VulkanRenderer* pThis) {
 	VkCommandPoolCreateInfo createInfo = { 0 };
 	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	createInfo.pNext = NULL;
 	createInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	createInfo.queueFamilyIndex = pThis->queueFamilyIndex;
 
-	REQUIRE_VK_SUCCESS(
+	RETURN_VK_FAILURE(
 		vkCreateCommandPool(
 			pThis->device,
 			&createInfo,
 			NULL,
 			&pThis->commandPool)
 	);
+
+	return VK_SUCCESS;
 }
 
-void VulkanRenderer_CreateSurface(VulkanRenderer* pThis) {
+void VulkanRenderer_CreateSurface(
+	VulkanRenderer* pThis,
+	const PlatformSurface* pPlatformSurface) {
 	assert(pThis);
-	assert(pThis->hInstance);
-	assert(pThis->hWnd);
+	assert(pPlatformSurface);
 	assert(pThis->instance);
 
-	// TODO: Win32 code here! abstract me!
-	VkWin32SurfaceCreateInfoKHR createInfo = { 0 };
-	createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-	createInfo.pNext = NULL;
-	createInfo.flags = 0;
-	createInfo.hinstance = pThis->hInstance;
-	createInfo.hwnd = pThis->hWnd;
-	REQUIRE_VK_SUCCESS(
-		vkCreateWin32SurfaceKHR(
-			pThis->instance,
-			&createInfo,
-			NULL,
-			&pThis->surface)
-	);
+	pThis->surface = PlatformSurface_CreateVkSurface(
+		pPlatformSurface,
+		pThis->instance);
 }
 
 void VulkanRenderer_CacheSurfaceFormats(VulkanRenderer* pThis) {
@@ -560,8 +1911,8 @@ void VulkanRenderer_CacheSurfaceFormats(VulkanRenderer* pThis) {
 			paSurfaceFormats)
 		);
 
+	// a single undefined format means the surface takes any, pick our own
 	if (formatCount == 1 && paSurfaceFormats[0].format == VK_FORMAT_UNDEFINED) {
-		assert(FALSE); // for now
 		pThis->surfaceFormat = VK_FORMAT_B8G8R8A8_UNORM;
 	}
 	else {
@@ -571,24 +1922,47 @@ void VulkanRenderer_CacheSurfaceFormats(VulkanRenderer* pThis) {
 	SAFE_FREE(paSurfaceFormats);
 }
 
-void VulkanRenderer_CreateSwapchain(
-	VulkanRenderer* pThis,
-	VkCommandBuffer setupCommandBuffer) {
+/*!
+ * \brief	creates the swapchain and its image views and semaphores at the surface's size
+ *
+ * Any existing swapchain is passed as the old one, and is left for the caller
+ * to destroy along with its views.
+ *
+ * \return	VK_NOT_READY without changing anything if the surface has no area,
+ *			or what failed, such as VK_ERROR_DEVICE_LOST. The existing swapchain
+ *			stays in place unless the new one got its images, in which case a
+ *			failure after leaves the new one half made for
+ *			VulkanRenderer_FreeSwapchain or another rebuild to replace
+ */
+VkResult VulkanRenderer_CreateSwapchain(VulkanRenderer* pThis) {
 	assert(pThis);
 	assert(pThis->physicalDevice);
 	assert(pThis->surface);
-	assert(setupCommandBuffer);
 
 	VkSurfaceCapabilitiesKHR surfaceCapabilities;
-	REQUIRE_VK_SUCCESS(
+	RETURN_VK_FAILURE(
 		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
 			pThis->physicalDevice,
 			pThis->surface,
 			&surfaceCapabilities)
 	);
 
+	VkExtent2D swapChainExtent;
+	// if width or height are -1, they both are -1
+	if (surfaceCapabilities.currentExtent.width == (uint32_t)-1) {
+		// set to our requested width and height
+		swapChainExtent.width = pThis->requestedWidth;
+		swapChainExtent.height = pThis->requestedHeight;
+	}
+	else {
+		swapChainExtent = surfaceCapabilities.currentExtent;
+	}
+	if (swapChainExtent.width == 0 || swapChainExtent.height == 0) {
+		return VK_NOT_READY;
+	}
+
 	uint32_t presentModeCount;
-	REQUIRE_VK_SUCCESS(
+	RETURN_VK_FAILURE(
 		vkGetPhysicalDeviceSurfacePresentModesKHR(
 			pThis->physicalDevice,
 			pThis->surface,
@@ -598,39 +1972,36 @@ void VulkanRenderer_CreateSwapchain(
 
 	VkPresentModeKHR* paPresentModes
 		= SAFE_ALLOCATE_ARRAY(VkPresentModeKHR, presentModeCount);
-	REQUIRE_VK_SUCCESS(
-		vkGetPhysicalDeviceSurfacePresentModesKHR(
-			pThis->physicalDevice,
-			pThis->surface,
-			&presentModeCount,
-			paPresentModes)
-	);
-
-	VkExtent2D swapChainExtent;
-	// if width or height are -1, they both are -1
-	if (surfaceCapabilities.currentExtent.width == (uint32_t)-1) {
-		// set to our defined width and height
-		swapChainExtent.width = pThis->width;
-		swapChainExtent.height = pThis->height;
-	}
-	else {
-		swapChainExtent = surfaceCapabilities.currentExtent;
+	VkResult result = vkGetPhysicalDeviceSurfacePresentModesKHR(
+		pThis->physicalDevice,
+		pThis->surface,
+		&presentModeCount,
+		paPresentModes);
+	if (result < VK_SUCCESS) {
+		SAFE_FREE(paPresentModes);
+		RETURN_VK_FAILURE(result);
 	}
-	
-	// Mailbox mode is the fastest, immediate is usually availalbe, and fifo is our fallback
+
+	// the policy's most preferred mode the surface has, fifo is always there
+	const PresentPolicySettings* pSettings = &kaPresentPolicySettings[pThis->presentPolicy];
 	VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
-	for (uint32_t i = 0; i < presentModeCount; i++) {
-		if (paPresentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-			swapchainPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-			break;
-		}
-		if (paPresentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-			swapchainPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+	BOOL foundPresentMode = FALSE;
+	for (uint32_t preference = 0;
+		preference < pSettings->presentModeCount && !foundPresentMode;
+		preference++) {
+		for (uint32_t i = 0; i < presentModeCount; i++) {
+			if (paPresentModes[i] == pSettings->aPresentModes[preference]) {
+				swapchainPresentMode = paPresentModes[i];
+				foundPresentMode = TRUE;
+				break;
+			}
 		}
 	}
+	SAFE_FREE(paPresentModes);
 
 	// figure out the number of images needed
-	uint32_t desiredNumberOfSwapChainImages = surfaceCapabilities.minImageCount + 1;
+	uint32_t desiredNumberOfSwapChainImages
+		= surfaceCapabilities.minImageCount + pSettings->extraImageCount;
 	if (
 		surfaceCapabilities.maxImageCount > 0
 		&& desiredNumberOfSwapChainImages > surfaceCapabilities.maxImageCount) {
@@ -639,8 +2010,8 @@ void VulkanRenderer_CreateSwapchain(
 		desiredNumberOfSwapChainImages = surfaceCapabilities.maxImageCount;
 	}
 
-	// I'm not quite sure what's going on here, but I can guess
-	// still haven't found the documentation for anything KHR
+	// present without rotating when the surface allows it, otherwise the
+	// presentation engine applies whatever the surface is at now
 	VkSurfaceTransformFlagBitsKHR preTransform;
 	if (surfaceCapabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) {
 		preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
@@ -662,7 +2033,8 @@ void VulkanRenderer_CreateSwapchain(
 	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapChainCreateInfo.imageArrayLayers = 1;
 	swapChainCreateInfo.presentMode = swapchainPresentMode;
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	// lets the presentation engine hand over images it still holds
+	swapChainCreateInfo.oldSwapchain = pThis->swapChain;
 	swapChainCreateInfo.clipped = VK_TRUE;
 	swapChainCreateInfo.imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
 	swapChainCreateInfo.imageUsage
@@ -672,36 +2044,47 @@ void VulkanRenderer_CreateSwapchain(
 	swapChainCreateInfo.queueFamilyIndexCount = 0;
 	swapChainCreateInfo.pQueueFamilyIndices = NULL;
 
-	REQUIRE_VK_SUCCESS(
+	VkSwapchainKHR swapChain;
+	RETURN_VK_FAILURE(
 		vkCreateSwapchainKHR(
 			pThis->device,
 			&swapChainCreateInfo,
 			NULL,
-			&pThis->swapChain)
+			&swapChain)
 	);
 
-	REQUIRE_VK_SUCCESS(
-		vkGetSwapchainImagesKHR(
+	// the new swapchain only replaces the old one once it has its images
+	uint32_t imageCount = 0;
+	result = vkGetSwapchainImagesKHR(pThis->device, swapChain, &imageCount, NULL);
+	VkImage* paSwapChainImages = NULL;
+	if (result == VK_SUCCESS) {
+		paSwapChainImages = SAFE_ALLOCATE_ARRAY(VkImage, imageCount);
+		result = vkGetSwapchainImagesKHR(
 			pThis->device,
-			pThis->swapChain,
-			&pThis->swapChainImageCount,
-			NULL)
-	);
+			swapChain,
+			&imageCount,
+			paSwapChainImages);
+	}
+	if (result != VK_SUCCESS) {
+		SAFE_FREE(paSwapChainImages);
+		vkDestroySwapchainKHR(pThis->device, swapChain, NULL);
+		RETURN_VK_FAILURE(result);
+	}
+	pThis->swapChain = swapChain;
+	pThis->swapChainImageCount = imageCount;
 
-	VkImage* paSwapChainImages = SAFE_ALLOCATE_ARRAY(VkImage, pThis->swapChainImageCount);
-	REQUIRE_VK_SUCCESS(
-		vkGetSwapchainImagesKHR(
-			pThis->device,
-			pThis->swapChain,
-			&pThis->swapChainImageCount,
-			paSwapChainImages)
-	);
+	VkSemaphoreCreateInfo semaphoreCreateInfo = { 0 };
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = NULL;
+	semaphoreCreateInfo.flags = 0;
 
+	// filled in place, so VulkanRenderer_FreeSwapchain can clean up after a failure
 	pThis->paSwapChainBuffers = SAFE_ALLOCATE_ARRAY(
 		SwapChainBuffer,
 		pThis->swapChainImageCount);
+	memset(pThis->paSwapChainBuffers, 0, sizeof(SwapChainBuffer) * pThis->swapChainImageCount);
 	for (uint32_t i = 0; i < pThis->swapChainImageCount; i++) {
-		SwapChainBuffer swapChainBuffer = { 0 };
+		SwapChainBuffer* pSwapChainBuffer = &pThis->paSwapChainBuffers[i];
 
 		VkImageViewCreateInfo colorImageViewCreate = { 0 };
 		colorImageViewCreate.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -720,82 +2103,395 @@ void VulkanRenderer_CreateSwapchain(
 		colorImageViewCreate.subresourceRange.layerCount = 1;
 		colorImageViewCreate.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
-		VulkanRenderer_ChangeImageLayout(
-			pThis,
-			swapChainBuffer.image,
-			VK_IMAGE_ASPECT_COLOR_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			setupCommandBuffer);
-		swapChainBuffer.image = paSwapChainImages[i];
-		colorImageViewCreate.image = swapChainBuffer.image;
-
-		REQUIRE_VK_SUCCESS(
-			vkCreateImageView(
+		// images are transitioned when they're acquired in VulkanRenderer_RecordFrame,
+		// touching them before they've been acquired is not allowed
+		pSwapChainBuffer->image = paSwapChainImages[i];
+		colorImageViewCreate.image = pSwapChainBuffer->image;
+
+		result = vkCreateImageView(
+			pThis->device,
+			&colorImageViewCreate,
+			NULL,
+			&pSwapChainBuffer->view);
+		if (result == VK_SUCCESS) {
+			result = vkCreateSemaphore(
 				pThis->device,
-				&colorImageViewCreate,
+				&semaphoreCreateInfo,
 				NULL,
-				&swapChainBuffer.view)
-		);
-
-		pThis->paSwapChainBuffers[i] = swapChainBuffer;
+				&pSwapChainBuffer->renderCompleteSemaphore);
+		}
+		if (result != VK_SUCCESS) {
+			SAFE_FREE(paSwapChainImages);
+			RETURN_VK_FAILURE(result);
+		}
 	}
 	pThis->currentBuffer = 0;
+	pThis->width = swapChainExtent.width;
+	pThis->height = swapChainExtent.height;
 
 	SAFE_FREE(paSwapChainImages);
-	SAFE_FREE(paPresentModes);
+	return VK_SUCCESS;
+}
+
+/*!
+ * \brief	replaces the swapchain and everything sized to it
+ *
+ * What's replaced is kept until the frames already submitted have finished
+ * with it, see VulkanRenderer_FreeRetiredSwapchains.
+ *
+ * \return	VK_NOT_READY if the surface has no area, or what failed. Either
+ *			way it's tried again next frame, and anything already replaced is
+ *			retired like it would have been on success
+ */
+VkResult VulkanRenderer_RecreateSwapchain(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(!pThis->headless);
+
+	RetiredSwapchain retired = { 0 };
+	retired.retiredFrame = pThis->frameNumber;
+	retired.swapChain = pThis->swapChain;
+	retired.imageCount = pThis->swapChainImageCount;
+	retired.paBuffers = pThis->paSwapChainBuffers;
+	retired.depthImage = pThis->depthImage;
+	retired.depthImageMemory = pThis->depthImageMemory;
+	retired.depthImageView = pThis->depthImageView;
+
+	VkResult result = VulkanRenderer_CreateSwapchain(pThis);
+	if (pThis->swapChain == retired.swapChain) {
+		// failed before anything was replaced
+		assert(result != VK_SUCCESS);
+		return result;
+	}
+
+	// the old depth buffer goes with the old swapchain
+	pThis->depthImage = VK_NULL_HANDLE;
+	memset(&pThis->depthImageMemory, 0, sizeof(DeviceMemoryAllocation));
+	pThis->depthImageView = VK_NULL_HANDLE;
+	if (pThis->retiredSwapchainCount == pThis->retiredSwapchainCapacity) {
+		pThis->retiredSwapchainCapacity = pThis->retiredSwapchainCapacity
+			? pThis->retiredSwapchainCapacity * 2
+			: 4;
+		pThis->paRetiredSwapchains = (RetiredSwapchain*)realloc(
+			pThis->paRetiredSwapchains,
+			sizeof(RetiredSwapchain) * pThis->retiredSwapchainCapacity);
+		assert(pThis->paRetiredSwapchains);
+	}
+	pThis->paRetiredSwapchains[pThis->retiredSwapchainCount++] = retired;
+
+	// still out of date after a failure, so whatever was made is replaced
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	RETURN_VK_FAILURE(VulkanRenderer_CreateDepthBuffer(pThis));
+	RETURN_VK_FAILURE(VulkanRenderer_CreateFramebuffers(pThis));
+	pThis->swapchainOutOfDate = FALSE;
+
+	// pipelines don't depend on the size, viewport and scissor are dynamic
+	return VK_SUCCESS;
 }
 
-void VulkanRenderer_CreateShaders(VulkanRenderer* pThis) {
+/*!
+ * \brief	creates the color images a headless renderer draws into
+ *
+ * These stand in for swapchain images, so there is one per frame in flight
+ * and each gets a host visible buffer to read it back into.
+ */
+VkResult VulkanRenderer_CreateOffscreenTargets(VulkanRenderer* pThis) {
 	assert(pThis);
-	assert(pThis->pShaderManager);
+	assert(pThis->headless);
 	assert(pThis->device);
 
-	ShaderCode vertexShaderCode = ShaderManager_GetVertexShader(
-		pThis->pShaderManager,
-		"main");
-	VkShaderModuleCreateInfo vertexShaderCreateInfo = { 0 };
-	vertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	vertexShaderCreateInfo.pNext = NULL;
-	vertexShaderCreateInfo.flags = 0;
-	vertexShaderCreateInfo.codeSize = vertexShaderCode.codeSize;
-	vertexShaderCreateInfo.pCode = vertexShaderCode.pCode;
-	REQUIRE_VK_SUCCESS(
-		vkCreateShaderModule(
+	pThis->swapChainImageCount = pThis->frameCount;
+	pThis->paSwapChainBuffers = SAFE_ALLOCATE_ARRAY(
+		SwapChainBuffer,
+		pThis->swapChainImageCount);
+	memset(pThis->paSwapChainBuffers, 0, sizeof(SwapChainBuffer) * pThis->swapChainImageCount);
+	pThis->paOffscreenTargets = SAFE_ALLOCATE_ARRAY(
+		OffscreenTarget,
+		pThis->swapChainImageCount);
+	memset(pThis->paOffscreenTargets, 0, sizeof(OffscreenTarget) * pThis->swapChainImageCount);
+
+	VkImageCreateInfo imageCreateInfo = { 0 };
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.pNext = NULL;
+	imageCreateInfo.flags = 0;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = pThis->surfaceFormat;
+	imageCreateInfo.extent.width = pThis->width;
+	imageCreateInfo.extent.height = pThis->height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage
+		= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+		| VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.queueFamilyIndexCount = 0;
+	imageCreateInfo.pQueueFamilyIndices = NULL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkBufferCreateInfo bufferCreateInfo = { 0 };
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = NULL;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = (VkDeviceSize)pThis->width * pThis->height * 4;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 0;
+	bufferCreateInfo.pQueueFamilyIndices = NULL;
+
+	for (uint32_t i = 0; i < pThis->swapChainImageCount; i++) {
+		SwapChainBuffer* pBuffer = &pThis->paSwapChainBuffers[i];
+		OffscreenTarget* pTarget = &pThis->paOffscreenTargets[i];
+
+		RETURN_VK_FAILURE(
+			vkCreateImage(
+				pThis->device,
+				&imageCreateInfo,
+				NULL,
+				&pBuffer->image)
+		);
+
+		BOOL allocated = DeviceMemoryAllocator_AllocateForImage(
+			pThis->pMemoryAllocator,
+			pBuffer->image,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&pTarget->imageMemory);
+		if (!allocated) {
+			Log_Write(LOG_SEVERITY_ERROR, "renderer", "out of memory for an offscreen target");
+			return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+		}
+
+		RETURN_VK_FAILURE(
+			VulkanRenderer_CreateImageView(
+				pThis,
+				pBuffer->image,
+				pThis->surfaceFormat,
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				&pBuffer->view)
+		);
+
+		RETURN_VK_FAILURE(
+			vkCreateBuffer(
+				pThis->device,
+				&bufferCreateInfo,
+				NULL,
+				&pTarget->readbackBuffer)
+		);
+
+		// the cpu reads this back, so cached memory is much faster when there is some
+		allocated = DeviceMemoryAllocator_AllocateForBuffer(
+			pThis->pMemoryAllocator,
+			pTarget->readbackBuffer,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+			&pTarget->readbackMemory);
+		if (!allocated) {
+			allocated = DeviceMemoryAllocator_AllocateForBuffer(
+				pThis->pMemoryAllocator,
+				pTarget->readbackBuffer,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+				&pTarget->readbackMemory);
+		}
+		if (!allocated) {
+			Log_Write(LOG_SEVERITY_ERROR, "renderer", "out of memory for a readback buffer");
+			return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+		}
+		assert(pTarget->readbackMemory.pMappedData);
+	}
+
+	return VK_SUCCESS;
+}
+
+/*!
+ * \brief	creates the depth buffer shared by every frame
+ *
+ * Sharing is safe because the render pass waits on the previous frame's
+ * depth writes before clearing it.
+ */
+VkResult VulkanRenderer_CreateDepthBuffer(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->device);
+	assert(pThis->depthBufferFormat != VK_FORMAT_UNDEFINED);
+
+	VkImageCreateInfo imageCreateInfo = { 0 };
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.pNext = NULL;
+	imageCreateInfo.flags = 0;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = pThis->depthBufferFormat;
+	imageCreateInfo.extent.width = pThis->width;
+	imageCreateInfo.extent.height = pThis->height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.queueFamilyIndexCount = 0;
+	imageCreateInfo.pQueueFamilyIndices = NULL;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	RETURN_VK_FAILURE(
+		vkCreateImage(
 			pThis->device,
-			&vertexShaderCreateInfo,
+			&imageCreateInfo,
 			NULL,
-			&pThis->vertexShader)
+			&pThis->depthImage)
 	);
 
-	ShaderCode fragmentShaderCode = ShaderManager_GetFragmentShader(
-		pThis->pShaderManager,
-		"main");
-	VkShaderModuleCreateInfo fragmentShaderCreateInfo = { 0 };
-	fragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	fragmentShaderCreateInfo.pNext = NULL;
-	fragmentShaderCreateInfo.flags = 0;
-	fragmentShaderCreateInfo.codeSize = fragmentShaderCode.codeSize;
-	fragmentShaderCreateInfo.pCode = fragmentShaderCode.pCode;
-	REQUIRE_VK_SUCCESS(
-		vkCreateShaderModule(
+	BOOL allocated = DeviceMemoryAllocator_AllocateForImage(
+		pThis->pMemoryAllocator,
+		pThis->depthImage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&pThis->depthImageMemory);
+	if (!allocated) {
+		Log_Write(LOG_SEVERITY_ERROR, "renderer", "out of memory for the depth buffer");
+		return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+	}
+
+	VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (FormatHasStencil(pThis->depthBufferFormat)) {
+		aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	RETURN_VK_FAILURE(
+		VulkanRenderer_CreateImageView(
+			pThis,
+			pThis->depthImage,
+			pThis->depthBufferFormat,
+			aspectMask,
+			&pThis->depthImageView)
+	);
+
+	return VK_SUCCESS;
+}
+
+/*!
+ * \brief	creates a framebuffer for each swapchain image or offscreen target
+ */
+VkResult VulkanRenderer_CreateFramebuffers(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->renderPass);
+	assert(pThis->depthImageView);
+	assert(pThis->paSwapChainBuffers);
+
+	for (uint32_t i = 0; i < pThis->swapChainImageCount; i++) {
+		SwapChainBuffer* pBuffer = &pThis->paSwapChainBuffers[i];
+
+		// must match the attachment order in VulkanRenderer_CreateRenderPass
+		VkImageView aAttachments[2] = {
+			pBuffer->view,
+			pThis->depthImageView,
+		};
+
+		VkFramebufferCreateInfo framebufferCreateInfo = { 0 };
+		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferCreateInfo.pNext = NULL;
+		framebufferCreateInfo.flags = 0;
+		framebufferCreateInfo.renderPass = pThis->renderPass;
+		framebufferCreateInfo.attachmentCount = 2;
+		framebufferCreateInfo.pAttachments = aAttachments;
+		framebufferCreateInfo.width = pThis->width;
+		framebufferCreateInfo.height = pThis->height;
+		framebufferCreateInfo.layers = 1;
+
+		RETURN_VK_FAILURE(
+			vkCreateFramebuffer(
+				pThis->device,
+				&framebufferCreateInfo,
+				NULL,
+				&pBuffer->framebuffer)
+		);
+	}
+
+	return VK_SUCCESS;
+}
+
+VkResult VulkanRenderer_CreateImageView(
+	VulkanRenderer* pThis,
+	VkImage image,
+	VkFormat format,
+	VkImageAspectFlags aspectMask,
+	VkImageView* pImageViewOut) {
+	assert(pThis);
+	assert(image);
+	assert(pImageViewOut);
+
+	VkImageViewCreateInfo imageViewCreate = { 0 };
+	imageViewCreate.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewCreate.pNext = NULL;
+	imageViewCreate.flags = 0;
+	imageViewCreate.image = image;
+	imageViewCreate.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCreate.format = format;
+	imageViewCreate.components.r = VK_COMPONENT_SWIZZLE_R;
+	imageViewCreate.components.g = VK_COMPONENT_SWIZZLE_G;
+	imageViewCreate.components.b = VK_COMPONENT_SWIZZLE_B;
+	imageViewCreate.components.a = VK_COMPONENT_SWIZZLE_A;
+	imageViewCreate.subresourceRange.aspectMask = aspectMask;
+	imageViewCreate.subresourceRange.baseMipLevel = 0;
+	imageViewCreate.subresourceRange.levelCount = 1;
+	imageViewCreate.subresourceRange.baseArrayLayer = 0;
+	imageViewCreate.subresourceRange.layerCount = 1;
+
+	RETURN_VK_FAILURE(
+		vkCreateImageView(
 			pThis->device,
-			&fragmentShaderCreateInfo,
+			&imageViewCreate,
 			NULL,
-			&pThis->fragmentShader)
+			pImageViewOut)
 	);
+	return VK_SUCCESS;
+}
+
+VkResult VulkanRenderer_CreateFrames(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->device);
+	assert(pThis->commandPool);
+	assert(pThis->frameCount > 0);
+
+	pThis->paFrames = SAFE_ALLOCATE_ARRAY(FrameData, pThis->frameCount);
+	memset(pThis->paFrames, 0, sizeof(FrameData) * pThis->frameCount);
+
+	// start signaled so the first wait on each frame returns immediately
+	VkFenceCreateInfo fenceCreateInfo = { 0 };
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.pNext = NULL;
+	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = { 0 };
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = NULL;
+	semaphoreCreateInfo.flags = 0;
 
-	ShaderManager_CleanupShaderCode(vertexShaderCode);
-	ShaderManager_CleanupShaderCode(fragmentShaderCode);
+	for (uint32_t i = 0; i < pThis->frameCount; i++) {
+		FrameData* pFrame = &pThis->paFrames[i];
 
-	assert(pThis->vertexShader);
-	assert(pThis->fragmentShader);
+		RETURN_VK_FAILURE(VulkanRenderer_SetupCommandBuffer(pThis, &pFrame->commandBuffer));
+
+		RETURN_VK_FAILURE(
+			vkCreateFence(
+				pThis->device,
+				&fenceCreateInfo,
+				NULL,
+				&pFrame->inFlightFence)
+		);
+		RETURN_VK_FAILURE(
+			vkCreateSemaphore(
+				pThis->device,
+				&semaphoreCreateInfo,
+				NULL,
+				&pFrame->imageAcquiredSemaphore)
+		);
+	}
+	pThis->currentFrame = 0;
 
-	// TODO: destroy vertex shader
-	// TODO: destroy fragment shader
+	return VK_SUCCESS;
 }
 
-void VulkanRenderer_CreateRenderPass(VulkanRenderer* pThis) {
+VkResult VulkanRenderer_CreateRenderPass(VulkanRenderer* pThis) {
 	assert(pThis);
 	assert(pThis->device);
 
@@ -807,20 +2503,24 @@ void VulkanRenderer_CreateRenderPass(VulkanRenderer* pThis) {
 	aRenderPassAttachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
 	aRenderPassAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	aRenderPassAttachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	aRenderPassAttachments[0].stencilLoadOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	aRenderPassAttachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	aRenderPassAttachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	aRenderPassAttachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	aRenderPassAttachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	// we clear every frame, so the old contents never matter
+	aRenderPassAttachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	// hand the image straight to the presentation engine, or to the readback copy
+	aRenderPassAttachments[0].finalLayout = pThis->headless
+		? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+		: VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	// zbuffer
 	aRenderPassAttachments[1].flags = 0;
 	aRenderPassAttachments[1].format = pThis->depthBufferFormat;
 	aRenderPassAttachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
 	aRenderPassAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	aRenderPassAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	aRenderPassAttachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-	aRenderPassAttachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
-	aRenderPassAttachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	aRenderPassAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	aRenderPassAttachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	aRenderPassAttachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	aRenderPassAttachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	aRenderPassAttachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference aColorAttachmentReferences[1] = { 0 };
@@ -843,6 +2543,23 @@ void VulkanRenderer_CreateRenderPass(VulkanRenderer* pThis) {
 	aSubpasses[0].preserveAttachmentCount = 0;
 	aSubpasses[0].pPreserveAttachments = NULL;
 
+	// wait for the previous user of the attachments (the presentation engine,
+	// or the last frame's depth tests) before we clear them
+	VkSubpassDependency aDependencies[1] = { 0 };
+	aDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	aDependencies[0].dstSubpass = 0;
+	aDependencies[0].srcStageMask
+		= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+		| VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	aDependencies[0].dstStageMask
+		= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+		| VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	aDependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	aDependencies[0].dstAccessMask
+		= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	aDependencies[0].dependencyFlags = 0;
+
 	VkRenderPassCreateInfo renderPassCreate = { 0 };
 	renderPassCreate.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassCreate.pNext = NULL;
@@ -851,25 +2568,28 @@ void VulkanRenderer_CreateRenderPass(VulkanRenderer* pThis) {
 	renderPassCreate.pAttachments = aRenderPassAttachments;
 	renderPassCreate.subpassCount = 1;
 	renderPassCreate.pSubpasses = aSubpasses;
-	renderPassCreate.dependencyCount = 0;
-	renderPassCreate.pDependencies = NULL;
+	renderPassCreate.dependencyCount = 1;
+	renderPassCreate.pDependencies = aDependencies;
 
-	REQUIRE_VK_SUCCESS(
+	RETURN_VK_FAILURE(
 		vkCreateRenderPass(
 			pThis->device,
 			&renderPassCreate,
 			NULL,
 			&pThis->renderPass)
 		);
+
+	return VK_SUCCESS;
 }
 
-void VulkanRenderer_CreateDescriptorSetLayout(VulkanRenderer* pThis) {
+VkResult VulkanRenderer_CreateDescriptorSetLayout(VulkanRenderer* pThis) {
 
 	// Descriptor Sets/Bindings: uniforms can be in sets and bindings:
 	// layout(set=0, binding=0) uniform blah{};
+	// the UBO is dynamic, so one set serves every draw through its offset
 	VkDescriptorSetLayoutBinding aLayoutBindings0[1] = { 0 };
 	aLayoutBindings0[0].binding = 0;
-	aLayoutBindings0[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	aLayoutBindings0[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	aLayoutBindings0[0].descriptorCount = 1;
 	aLayoutBindings0[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	aLayoutBindings0[0].pImmutableSamplers = NULL;
@@ -881,270 +2601,221 @@ void VulkanRenderer_CreateDescriptorSetLayout(VulkanRenderer* pThis) {
 	aDescriptorSetCreateInfos[0].bindingCount = 1;
 	aDescriptorSetCreateInfos[0].pBindings = aLayoutBindings0;
 
-	REQUIRE_VK_SUCCESS(
+	RETURN_VK_FAILURE(
 		vkCreateDescriptorSetLayout(
 			pThis->device,
 			aDescriptorSetCreateInfos,
 			NULL,
 			&pThis->descriptorSetLayout)
 		);
+
+	return VK_SUCCESS;
 }
 
-void VulkanRenderer_CreateDescriptorSet(VulkanRenderer* pThis) {
+/*!
+ * \brief	creates the uniform ring behind main.vert's UBO
+ *
+ * Each frame in flight has its own partition, refilled with every draw's
+ * matrices as the frame is recorded.
+ */
+void VulkanRenderer_CreateUniformBuffer(VulkanRenderer* pThis) {
 	assert(pThis);
 	assert(pThis->device);
-	assert(pThis->descriptorSetLayout);
+	assert(pThis->pMemoryAllocator);
 
-	VkDescriptorPoolSize aPoolSizes[1] = { 0 };
-	aPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	aPoolSizes[0].descriptorCount = 1;
+	pThis->pUniformRing = UniformRing_Create(
+		pThis->physicalDevice,
+		pThis->device,
+		pThis->pMemoryAllocator,
+		pThis->frameCount,
+		UNIFORM_RING_DEFAULT_FRAME_SIZE);
+}
 
-	VkDescriptorPoolCreateInfo poolCreateInfo = { 0 };
-	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolCreateInfo.pNext = NULL;
-	poolCreateInfo.flags = 0;
-	poolCreateInfo.maxSets = 1;
-	poolCreateInfo.poolSizeCount = 1;
-	poolCreateInfo.pPoolSizes = aPoolSizes;
+void VulkanRenderer_CreateDescriptorSet(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->device);
+	assert(pThis->descriptorSetLayout);
+	assert(pThis->pUniformRing);
+
+	pThis->descriptorSet = DescriptorAllocator_Allocate(
+		pThis->pDescriptorAllocator,
+		pThis->descriptorSetLayout);
+
+	// point binding 0 at the uniform buffer
+	// each draw moves the window along with its dynamic offset
+	VkDescriptorBufferInfo uniformBufferInfo = { 0 };
+	uniformBufferInfo.buffer = UniformRing_GetBuffer(pThis->pUniformRing);
+	uniformBufferInfo.offset = 0;
+	uniformBufferInfo.range = sizeof(UniformBlock);
+
+	VkWriteDescriptorSet descriptorSetWrite = { 0 };
+	descriptorSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorSetWrite.pNext = NULL;
+	descriptorSetWrite.dstSet = pThis->descriptorSet;
+	descriptorSetWrite.dstBinding = 0;
+	descriptorSetWrite.dstArrayElement = 0;
+	descriptorSetWrite.descriptorCount = 1;
+	descriptorSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorSetWrite.pImageInfo = NULL;
+	descriptorSetWrite.pBufferInfo = &uniformBufferInfo;
+	descriptorSetWrite.pTexelBufferView = NULL;
+
+	vkUpdateDescriptorSets(pThis->device, 1, &descriptorSetWrite, 0, NULL);
+}
 
-	REQUIRE_VK_SUCCESS(
-		vkCreateDescriptorPool(
-			pThis->device,
-			&poolCreateInfo,
-			NULL,
-			&pThis->descriptorPool)
-	);
-	assert(pThis->descriptorPool);
-
-	//// vkAllocateDescriptorSets
-	//VkDescriptorSetAllocateInfo descriptorAllocateInfo = { 0 };
-	//descriptorAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	//descriptorAllocateInfo.pNext = NULL;
-	//descriptorAllocateInfo.descriptorPool = pThis->descriptorPool;
-	//descriptorAllocateInfo.descriptorSetCount = 1;
-	//descriptorAllocateInfo.pSetLayouts = &pThis->descriptorSetLayout;
-
-	//REQUIRE_VK_SUCCESS(
-	//	vkAllocateDescriptorSets(
-	//		pThis->device,
-	//		NULL,
-	//		&pThis->descriptorSet)
-	//);
-	//assert(pThis->descriptorSet);
-
-	// TODO: use descriptor sets to load uniforms
-
-	// vkUpdateDescriptorSets
-	//VkWriteDescriptorSet descriptorSetWrites = { 0 };
-	//descriptorSetWrites.
-
-	//REQUIRE_VK_SUCCESS(
-	//	vkUpdateDescriptorSets(
-	//		pThis->device,
-	//		1,
-	//		)
-	//);
-}
-
-void VulkanRenderer_CreatePipelines(VulkanRenderer* pThis) {
+/*!
+ * \brief	creates the layout every pipeline uses, they're built by
+ *			VulkanRenderer_BuildPipelineJob and the pipeline manager
+ */
+VkResult VulkanRenderer_CreatePipelineLayout(VulkanRenderer* pThis) {
 	assert(pThis);
 	assert(pThis->device);
-	assert(pThis->renderPass);
 	assert(pThis->descriptorSetLayout);
 
-	VkPipelineShaderStageCreateInfo aShaderStageCreateInfo[2] = { 0 };
-	aShaderStageCreateInfo[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	aShaderStageCreateInfo[0].pNext = NULL;
-	aShaderStageCreateInfo[0].flags = 0;
-	aShaderStageCreateInfo[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-	aShaderStageCreateInfo[0].module = pThis->vertexShader;
-	aShaderStageCreateInfo[0].pName = "main";
-	aShaderStageCreateInfo[0].pSpecializationInfo = NULL;
-	aShaderStageCreateInfo[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	aShaderStageCreateInfo[1].pNext = NULL;
-	aShaderStageCreateInfo[1].flags = 0;
-	aShaderStageCreateInfo[1].stage = VK_SHADER_STAGE_VERTEX_BIT;
-	aShaderStageCreateInfo[1].module = pThis->fragmentShader;
-	aShaderStageCreateInfo[1].pName = "main";
-	aShaderStageCreateInfo[1].pSpecializationInfo = NULL;
-
-	// create the input binding
-	VkVertexInputBindingDescription inputBindingDescriptions[1] = { 0 };
-	inputBindingDescriptions[0].binding = 0;
-	inputBindingDescriptions[0].stride = sizeof(Vertex);
-	inputBindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-	// create vertex attribute descriptions
-	VkVertexInputAttributeDescription inputAttributeDescriptions[2] = { 0 };
-
-	// position attribute
-	inputAttributeDescriptions[0].location = 0;
-	inputAttributeDescriptions[0].binding = 0;
-	inputAttributeDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	inputAttributeDescriptions[0].offset = offsetof(Vertex, position);
-
-	// color attribute
-	inputAttributeDescriptions[1].location = 1;
-	inputAttributeDescriptions[1].binding = 0;
-	inputAttributeDescriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	inputAttributeDescriptions[1].offset = offsetof(Vertex, color);
-
-	VkPipelineVertexInputStateCreateInfo vertexInputStateInfo = { 0 };
-	vertexInputStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputStateInfo.pNext = NULL;
-	vertexInputStateInfo.flags = 0;
-	vertexInputStateInfo.vertexBindingDescriptionCount = 1;
-	vertexInputStateInfo.pVertexBindingDescriptions = inputBindingDescriptions;
-	vertexInputStateInfo.vertexAttributeDescriptionCount = 2;
-	vertexInputStateInfo.pVertexAttributeDescriptions = inputAttributeDescriptions;
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = { 0 };
-	inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssemblyState.pNext = NULL;
-	inputAssemblyState.flags = 0;
-	inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssemblyState.primitiveRestartEnable = VK_FALSE;
-
-	VkViewport aViewports[1] = { 0 };
-	aViewports[0].x = 0;
-	aViewports[0].y = 0;
-	aViewports[0].width = (float)pThis->width;
-	aViewports[0].height = (float)pThis->height;
-	aViewports[0].minDepth = 0.f;
-	aViewports[0].maxDepth = 1.f;
-
-	VkRect2D aScissors[1] = { 0 };
-	aScissors[0].extent.width = pThis->width;
-	aScissors[0].extent.height = pThis->height;
-	aScissors[0].offset.x = 0;
-	aScissors[0].offset.y = 0;
-
-	VkPipelineViewportStateCreateInfo viewportCreateInfo = { 0 };
-	viewportCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportCreateInfo.pNext = NULL;
-	viewportCreateInfo.flags = 0;
-	viewportCreateInfo.viewportCount = 1;
-	viewportCreateInfo.pViewports = aViewports;
-	viewportCreateInfo.scissorCount = 1;
-	viewportCreateInfo.pScissors = aScissors;
-
-	VkPipelineRasterizationStateCreateInfo rasterizationState = { 0 };
-	rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizationState.pNext = NULL;
-	rasterizationState.flags = 0;
-	rasterizationState.depthClampEnable = VK_TRUE;
-	rasterizationState.rasterizerDiscardEnable = VK_FALSE;
-	rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizationState.cullMode = VK_CULL_MODE_NONE; // TODO: actually do front-facing polys
-	rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizationState.depthBiasEnable = VK_FALSE;
-	rasterizationState.depthBiasConstantFactor = 0;
-	rasterizationState.depthBiasClamp = 0;
-	rasterizationState.depthBiasSlopeFactor = 0;
-	rasterizationState.lineWidth = 0;
-
-	VkPipelineMultisampleStateCreateInfo multisampleState;
-	multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampleState.pNext = NULL;
-	multisampleState.flags = 0;
-	multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampleState.sampleShadingEnable = VK_FALSE;
-	multisampleState.minSampleShading = 0;
-	multisampleState.pSampleMask = NULL;
-	multisampleState.alphaToCoverageEnable = VK_FALSE;
-	multisampleState.alphaToOneEnable = VK_FALSE;
-
-	VkPipelineDepthStencilStateCreateInfo depthStencilState = { 0 };
-	depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilState.pNext = NULL;
-	depthStencilState.flags = 0;
-	depthStencilState.depthTestEnable = VK_TRUE;
-	depthStencilState.depthWriteEnable = VK_TRUE;
-	depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-	depthStencilState.depthBoundsTestEnable = VK_FALSE;
-	depthStencilState.stencilTestEnable = VK_FALSE;
-	depthStencilState.front.failOp = VK_STENCIL_OP_KEEP;
-	depthStencilState.front.passOp = VK_STENCIL_OP_KEEP;
-	depthStencilState.front.depthFailOp = VK_STENCIL_OP_KEEP;
-	depthStencilState.front.compareOp = VK_COMPARE_OP_ALWAYS;
-	depthStencilState.back.failOp = VK_STENCIL_OP_KEEP;
-	depthStencilState.back.passOp = VK_STENCIL_OP_KEEP;
-	depthStencilState.back.depthFailOp = VK_STENCIL_OP_KEEP;
-	depthStencilState.back.compareOp = VK_COMPARE_OP_ALWAYS;
-	depthStencilState.minDepthBounds = 0;
-	depthStencilState.maxDepthBounds = 0;
-
-	VkPipelineColorBlendAttachmentState aColorBlendAttachments[1] = { 0 };
-	aColorBlendAttachments[0].blendEnable = VK_FALSE;
-	aColorBlendAttachments[0].srcColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-	aColorBlendAttachments[0].dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-	aColorBlendAttachments[0].colorBlendOp = VK_BLEND_OP_ADD;
-	aColorBlendAttachments[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	aColorBlendAttachments[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	aColorBlendAttachments[0].alphaBlendOp = VK_BLEND_OP_ADD;
-	aColorBlendAttachments[0].colorWriteMask = 0xf;
-
-	VkPipelineColorBlendStateCreateInfo colorBlendState = { 0 };
-	colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlendState.pNext = NULL;
-	colorBlendState.flags = 0;
-	colorBlendState.logicOpEnable = VK_FALSE;
-	colorBlendState.attachmentCount = 1;
-	colorBlendState.pAttachments = aColorBlendAttachments;
+	// the layout is made before the shaders job picks a vertex shader, so it
+	// suits both. whichever isn't used is never bound
+	VkPushConstantRange pushConstantRange = { 0 };
+	pushConstantRange.stageFlags = ShaderManager_GetStageFlag(SHADER_STAGE_VERTEX);
+	pushConstantRange.offset = 0;
+	// maxPushConstantsSize is at least 128, always enough for a UniformBlock
+	pushConstantRange.size = sizeof(UniformBlock);
+
+	VkDescriptorSetLayout aSetLayouts[2] = {
+		pThis->descriptorSetLayout,
+		DescriptorAllocator_GetBindlessLayout(pThis->pDescriptorAllocator),
+	};
 
 	VkPipelineLayoutCreateInfo pipelineLayoutCreate = { 0 };
 	pipelineLayoutCreate.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutCreate.pNext = NULL;
 	pipelineLayoutCreate.flags = 0;
-	pipelineLayoutCreate.setLayoutCount = 1;
-	pipelineLayoutCreate.pSetLayouts = &pThis->descriptorSetLayout;
-	pipelineLayoutCreate.pushConstantRangeCount = 0;
-	pipelineLayoutCreate.pPushConstantRanges = NULL;
+	pipelineLayoutCreate.setLayoutCount = pThis->bindlessEnabled ? 2 : 1;
+	pipelineLayoutCreate.pSetLayouts = aSetLayouts;
+	pipelineLayoutCreate.pushConstantRangeCount = 1;
+	pipelineLayoutCreate.pPushConstantRanges = &pushConstantRange;
 
-	VkPipelineLayout pipelineLayout;
-	REQUIRE_VK_SUCCESS(
+	RETURN_VK_FAILURE(
 		vkCreatePipelineLayout(
 			pThis->device,
 			&pipelineLayoutCreate,
 			NULL,
-			&pipelineLayout)
+			&pThis->pipelineLayout)
 		);
 
-	VkGraphicsPipelineCreateInfo pipelineCreateInfo = { 0 };
-	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineCreateInfo.pNext = NULL;
-	pipelineCreateInfo.flags = 0;
-	pipelineCreateInfo.stageCount = 2;
-	pipelineCreateInfo.pStages = aShaderStageCreateInfo;
-	pipelineCreateInfo.pVertexInputState = &vertexInputStateInfo;
-	pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
-	pipelineCreateInfo.pTessellationState = NULL;
-	pipelineCreateInfo.pViewportState = &viewportCreateInfo;
-	pipelineCreateInfo.pRasterizationState = &rasterizationState;
-	pipelineCreateInfo.pMultisampleState = &multisampleState;
-	pipelineCreateInfo.pDepthStencilState = &depthStencilState;
-	pipelineCreateInfo.pColorBlendState = &colorBlendState;
-	pipelineCreateInfo.pDynamicState = NULL;
-	pipelineCreateInfo.layout = pipelineLayout;
-	pipelineCreateInfo.renderPass = pThis->renderPass;
-	pipelineCreateInfo.subpass = 0;
-	pipelineCreateInfo.basePipelineHandle = 0;
-	pipelineCreateInfo.basePipelineIndex = 0;
-
-	VkPipeline graphicsPipeline;
-	REQUIRE_VK_SUCCESS(
-		vkCreateGraphicsPipelines(
-			pThis->device,
-			VK_NULL_HANDLE,
-			1,
-			&pipelineCreateInfo,
-			VK_NULL_HANDLE,
-			&graphicsPipeline)
-		);
+	return VK_SUCCESS;
+}
+
+// the vertex shader for how transforms reach it, once the shaders job has run
+const char* VulkanRenderer_GetVertexShaderName(const VulkanRenderer* pThis) {
+	return pThis->pushConstantTransforms ? PUSH_CONSTANT_SHADER_NAME : MAIN_SHADER_NAME;
+}
+
+/*!
+ * \brief	describes the pipeline every draw starts from, with kRenderStateOpaque
+ *
+ * Only reads state that's fixed once the shaders job has run.
+ */
+void VulkanRenderer_InitPipelineDescription(
+	VulkanRenderer* pThis,
+	PipelineDescription* pDescriptionOut) {
+	assert(pThis);
+	assert(pThis->pipelineLayout);
+	assert(pDescriptionOut);
+
+	PipelineDescription_Init(pDescriptionOut, pThis->renderPass, 0, pThis->pipelineLayout);
+	PipelineDescription_SetShaders(
+		pDescriptionOut,
+		VulkanRenderer_GetVertexShaderName(pThis),
+		MAIN_SHADER_NAME);
+	pDescriptionOut->vertexFormat = pThis->vertexFormat;
+}
+
+/*!
+ * \brief	rebuilds the pipelines that use a reloaded shader
+ *
+ * Runs on the shader manager's watching thread. The pipelines build on the
+ * JobSystem and are swapped in by the pipeline manager once they're done.
+ */
+void VulkanRenderer_OnShaderReloaded(
+	void* pUserData,
+	const char* szShaderName,
+	ShaderStage stage) {
+	VulkanRenderer* pThis = (VulkanRenderer*)pUserData;
+	assert(pThis);
+
+	PipelineManager_ReloadShader(pThis->pPipelineManager, szShaderName, stage);
+}
+
+/*!
+ * \brief	destroys the device and everything made from it, leaving meshes
+ *			without their buffers, see Mesh_FreeResources
+ *
+ * Works on a lost device too, nothing is in flight on one, and after
+ * VulkanRenderer_CreateDeviceObjects failed part way.
+ */
+void VulkanRenderer_FreeDeviceObjects(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->device);
+
+	// stops hot reloading and the builds it started before anything they
+	// use goes away
+	if (pThis->pPipelineManager) {
+		PipelineManager_StopBuilding(pThis->pPipelineManager);
+	}
+	ShaderManager_Destroy(pThis->pShaderManager);
+	pThis->pShaderManager = NULL;
+
+	// nothing can be freed while frames are still in flight
+	vkDeviceWaitIdle(pThis->device);
 
-	// TODO: destroy graphics pipeline
-	// TODO: destroy pipeline layout
-	// TODO: destroy render pass
+	for (uint32_t i = 0; i < pThis->meshCount; i++) {
+		Mesh_FreeResources(pThis->papMeshes[i]);
+	}
+	pThis->drawMeshCount = 0;
+	VulkanRenderer_FreePipelines(pThis);
+	// the cache is still good after a lost device, and it's what makes
+	// creating the new one quick
+	PipelineCache_Save(pThis->pPipelineCache);
+	PipelineCache_Destroy(pThis->pPipelineCache);
+	pThis->pPipelineCache = NULL;
+	// made last, so missing if creating the device's objects failed
+	if (pThis->pCommandRecorder) {
+		CommandRecorder_Destroy(pThis->pCommandRecorder);
+		pThis->pCommandRecorder = NULL;
+	}
+	if (pThis->pGpuProfiler) {
+		GpuProfiler_Destroy(pThis->pGpuProfiler);
+		pThis->pGpuProfiler = NULL;
+	}
+	if (pThis->pRenderCounters) {
+		RenderCounters_Destroy(pThis->pRenderCounters);
+		pThis->pRenderCounters = NULL;
+	}
+	SAFE_FREE(pThis->paSecondaryCommandBuffers);
+	VulkanRenderer_FreeFrames(pThis);
+	VulkanRenderer_FreeDescriptorAllocator(pThis);
+	VulkanRenderer_FreeDescriptorSetLayout(pThis);
+	VulkanRenderer_FreeUniformBuffer(pThis);
+	VulkanRenderer_FreeFramebuffers(pThis);
+	VulkanRenderer_FreeDepthBuffer(pThis);
+	VulkanRenderer_FreeRetiredSwapchains(pThis, UINT64_MAX);
+	if (pThis->headless) {
+		VulkanRenderer_FreeOffscreenTargets(pThis);
+	}
+	else {
+		VulkanRenderer_FreeSwapchain(pThis);
+	}
+	VulkanRenderer_FreeRenderPass(pThis);
+	vkDestroyCommandPool(pThis->device, pThis->commandPool, NULL);
+	pThis->commandPool = VK_NULL_HANDLE;
+	UploadManager_Destroy(pThis->pUploadManager);
+	pThis->pUploadManager = NULL;
+	DeviceMemoryAllocator_Destroy(pThis->pMemoryAllocator);
+	pThis->pMemoryAllocator = NULL;
+	vkDestroyDevice(pThis->device, NULL);
+	pThis->device = NULL;
+	pThis->mainQueue = NULL;
+	pThis->transferQueue = NULL;
 }
 
 void VulkanRenderer_FreeSurface(VulkanRenderer* pThis) {
@@ -1153,17 +2824,606 @@ void VulkanRenderer_FreeSurface(VulkanRenderer* pThis) {
 }
 
 void VulkanRenderer_FreeSwapchain(VulkanRenderer* pThis) {
-	// TODO: see if anything in paSwapChainBuffers needs to be explicitly destroyed
+	// the images belong to the swapchain, but the views are ours
+	for (uint32_t i = 0; i < pThis->swapChainImageCount; i++) {
+		vkDestroyImageView(pThis->device, pThis->paSwapChainBuffers[i].view, NULL);
+		vkDestroySemaphore(
+			pThis->device,
+			pThis->paSwapChainBuffers[i].renderCompleteSemaphore,
+			NULL);
+	}
 	SAFE_FREE(pThis->paSwapChainBuffers);
 	pThis->swapChainImageCount = 0;
 	vkDestroySwapchainKHR(pThis->device, pThis->swapChain, NULL);
 	pThis->swapChain = NULL;
 }
 
-VkCommandBuffer VulkanRenderer_SetupCommandBuffer(VulkanRenderer* pThis) {
+/*!
+ * \brief	destroys the swapchains replaced before \a finishedFrameCount frames
+ *			had been submitted
+ *
+ * \param	finishedFrameCount how many frames the gpu is known to be done with
+ */
+void VulkanRenderer_FreeRetiredSwapchains(
+	VulkanRenderer* pThis,
+	uint64_t finishedFrameCount) {
+	assert(pThis);
+
+	uint32_t keptCount = 0;
+	for (uint32_t i = 0; i < pThis->retiredSwapchainCount; i++) {
+		RetiredSwapchain* pRetired = &pThis->paRetiredSwapchains[i];
+		if (pRetired->retiredFrame > finishedFrameCount) {
+			pThis->paRetiredSwapchains[keptCount++] = *pRetired;
+			continue;
+		}
+
+		for (uint32_t image = 0; image < pRetired->imageCount; image++) {
+			vkDestroyFramebuffer(pThis->device, pRetired->paBuffers[image].framebuffer, NULL);
+			vkDestroyImageView(pThis->device, pRetired->paBuffers[image].view, NULL);
+			vkDestroySemaphore(
+				pThis->device,
+				pRetired->paBuffers[image].renderCompleteSemaphore,
+				NULL);
+		}
+		SAFE_FREE(pRetired->paBuffers);
+		vkDestroySwapchainKHR(pThis->device, pRetired->swapChain, NULL);
+
+		vkDestroyImageView(pThis->device, pRetired->depthImageView, NULL);
+		vkDestroyImage(pThis->device, pRetired->depthImage, NULL);
+		DeviceMemoryAllocator_Free(pThis->pMemoryAllocator, &pRetired->depthImageMemory);
+	}
+	pThis->retiredSwapchainCount = keptCount;
+}
+
+void VulkanRenderer_FreeUniformBuffer(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	// never made with push constant transforms
+	if (pThis->pUniformRing) {
+		UniformRing_Destroy(pThis->pUniformRing);
+		pThis->pUniformRing = NULL;
+	}
+}
+
+void VulkanRenderer_FreeDescriptorAllocator(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	// takes every set with it
+	DescriptorAllocator_Destroy(pThis->pDescriptorAllocator);
+	pThis->pDescriptorAllocator = NULL;
+	pThis->descriptorSet = VK_NULL_HANDLE;
+}
+
+void VulkanRenderer_FreeRenderPass(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	vkDestroyRenderPass(pThis->device, pThis->renderPass, NULL);
+	pThis->renderPass = VK_NULL_HANDLE;
+}
+
+void VulkanRenderer_FreeDescriptorSetLayout(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	vkDestroyDescriptorSetLayout(pThis->device, pThis->descriptorSetLayout, NULL);
+	pThis->descriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void VulkanRenderer_FreePipelines(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	// only made once the pipeline layout exists
+	if (pThis->pPipelineManager) {
+		PipelineManager_Destroy(pThis->pPipelineManager);
+		pThis->pPipelineManager = NULL;
+	}
+	vkDestroyPipelineLayout(pThis->device, pThis->pipelineLayout, NULL);
+	pThis->pipelineLayout = VK_NULL_HANDLE;
+}
+
+void VulkanRenderer_FreeMeshes(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	for (uint32_t i = 0; i < pThis->meshCount; i++) {
+		Mesh_Destroy(pThis->papMeshes[i]);
+	}
+	SAFE_FREE(pThis->papMeshes);
+	SAFE_FREE(pThis->papDrawMeshes);
+	SAFE_FREE(pThis->paDrawUniformOffsets);
+	SAFE_FREE(pThis->paDrawPipelines);
+	pThis->meshCount = 0;
+	pThis->drawMeshCount = 0;
+	pThis->meshCapacity = 0;
+}
+
+void VulkanRenderer_FreeOffscreenTargets(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->headless);
+
+	for (uint32_t i = 0; i < pThis->swapChainImageCount; i++) {
+		SwapChainBuffer* pBuffer = &pThis->paSwapChainBuffers[i];
+		OffscreenTarget* pTarget = &pThis->paOffscreenTargets[i];
+
+		vkDestroyBuffer(pThis->device, pTarget->readbackBuffer, NULL);
+		DeviceMemoryAllocator_Free(pThis->pMemoryAllocator, &pTarget->readbackMemory);
+
+		vkDestroyImageView(pThis->device, pBuffer->view, NULL);
+		vkDestroyImage(pThis->device, pBuffer->image, NULL);
+		DeviceMemoryAllocator_Free(pThis->pMemoryAllocator, &pTarget->imageMemory);
+	}
+	SAFE_FREE(pThis->paOffscreenTargets);
+	SAFE_FREE(pThis->paSwapChainBuffers);
+	pThis->swapChainImageCount = 0;
+}
+
+void VulkanRenderer_FreeDepthBuffer(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	vkDestroyImageView(pThis->device, pThis->depthImageView, NULL);
+	pThis->depthImageView = VK_NULL_HANDLE;
+	vkDestroyImage(pThis->device, pThis->depthImage, NULL);
+	pThis->depthImage = VK_NULL_HANDLE;
+	DeviceMemoryAllocator_Free(pThis->pMemoryAllocator, &pThis->depthImageMemory);
+}
+
+void VulkanRenderer_FreeFramebuffers(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	for (uint32_t i = 0; i < pThis->swapChainImageCount; i++) {
+		vkDestroyFramebuffer(
+			pThis->device,
+			pThis->paSwapChainBuffers[i].framebuffer,
+			NULL);
+		pThis->paSwapChainBuffers[i].framebuffer = VK_NULL_HANDLE;
+	}
+}
+
+void VulkanRenderer_FreeFrames(VulkanRenderer* pThis) {
+	assert(pThis);
+
+	if (!pThis->paFrames) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < pThis->frameCount; i++) {
+		FrameData* pFrame = &pThis->paFrames[i];
+		vkDestroySemaphore(pThis->device, pFrame->imageAcquiredSemaphore, NULL);
+		vkDestroyFence(pThis->device, pFrame->inFlightFence, NULL);
+		VulkanRenderer_DestroyCommandBuffer(pThis, pFrame->commandBuffer);
+	}
+	SAFE_FREE(pThis->paFrames);
+}
+
+/*!
+ * \brief	records the work for a single frame into \a commandBuffer
+ * \param	commandBuffer a command buffer that's already begun
+ * \param	imageIndex the swapchain image or offscreen target to render into
+ */
+void VulkanRenderer_RecordFrame(
+	VulkanRenderer* pThis,
+	VkCommandBuffer commandBuffer,
+	uint32_t imageIndex) {
+	assert(pThis);
+	assert(commandBuffer);
+	assert(imageIndex < pThis->swapChainImageCount);
+
+	SwapChainBuffer* pBuffer = &pThis->paSwapChainBuffers[imageIndex];
+
+	VkClearValue aClearValues[2] = { 0 };
+	aClearValues[0].color.float32[0] = 0.f;
+	aClearValues[0].color.float32[1] = 0.f;
+	aClearValues[0].color.float32[2] = 0.2f;
+	aClearValues[0].color.float32[3] = 1.f;
+	aClearValues[1].depthStencil.depth = 1.f;
+	aClearValues[1].depthStencil.stencil = 0;
+
+	VkRenderPassBeginInfo renderPassBegin = { 0 };
+	renderPassBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBegin.pNext = NULL;
+	renderPassBegin.renderPass = pThis->renderPass;
+	renderPassBegin.framebuffer = pBuffer->framebuffer;
+	renderPassBegin.renderArea.offset.x = 0;
+	renderPassBegin.renderArea.offset.y = 0;
+	renderPassBegin.renderArea.extent.width = pThis->width;
+	renderPassBegin.renderArea.extent.height = pThis->height;
+	renderPassBegin.clearValueCount = 2;
+	renderPassBegin.pClearValues = aClearValues;
+
+	// meshes whose pipeline is still building are drawn with the default one
+	VkPipeline defaultPipeline = PipelineManager_GetPipeline(
+		pThis->pPipelineManager,
+		&pThis->pipelineDescription);
+	// built at startup, and a failed reload keeps the old one
+	assert(defaultPipeline);
+	PipelineDescription description = pThis->pipelineDescription;
+	VkPipeline pipeline = defaultPipeline;
+
+	// meshes still uploading are skipped until they're ready. without push
+	// constants each one drawn gets its matrices written to the uniform ring
+	pThis->drawMeshCount = 0;
+	for (uint32_t i = 0; i < pThis->meshCount; i++) {
+		if (!Mesh_IsReady(pThis->papMeshes[i])) {
+			continue;
+		}
+
+		// neighbouring meshes usually share a state, only look up changes
+		const RenderState* pRenderState = Mesh_GetRenderState(pThis->papMeshes[i]);
+		if (memcmp(pRenderState, &description.renderState, sizeof(RenderState)) != 0) {
+			description.renderState = *pRenderState;
+			pipeline = PipelineManager_GetPipeline(pThis->pPipelineManager, &description);
+		}
+		pThis->paDrawPipelines[pThis->drawMeshCount] = pipeline ? pipeline : defaultPipeline;
+
+		if (pThis->pushConstantTransforms) {
+			pThis->papDrawMeshes[pThis->drawMeshCount++] = pThis->papMeshes[i];
+			continue;
+		}
+
+		UniformBlock* pUniforms = (UniformBlock*)UniformRing_Allocate(
+			pThis->pUniformRing,
+			sizeof(UniformBlock),
+			&pThis->paDrawUniformOffsets[pThis->drawMeshCount]);
+		if (!pUniforms) {
+			Log_Write(
+				LOG_SEVERITY_WARNING,
+				"renderer",
+				"the uniform ring is full, %u meshes weren't drawn",
+				pThis->meshCount - i);
+			break;
+		}
+		memcpy(
+			pUniforms->modelView,
+			Mesh_GetTransform(pThis->papMeshes[i]),
+			sizeof(pUniforms->modelView));
+		memcpy(pUniforms->projection, pThis->projection, sizeof(pUniforms->projection));
+
+		pThis->papDrawMeshes[pThis->drawMeshCount++] = pThis->papMeshes[i];
+	}
+	if (pThis->pUniformRing) {
+		UniformRing_Flush(pThis->pUniformRing);
+	}
+
+	// everything in the render pass comes from secondaries
+	uint32_t sceneScope = GpuProfiler_BeginScope(pThis->pGpuProfiler, commandBuffer, "scene");
+	RenderCounters_BeginPass(
+		pThis->pRenderCounters,
+		commandBuffer,
+		VULKAN_RENDERER_SCENE_COUNTER_PASS,
+		"scene");
+	vkCmdBeginRenderPass(
+		commandBuffer,
+		&renderPassBegin,
+		VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = { 0 };
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.pNext = NULL;
+	inheritanceInfo.renderPass = pThis->renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = pBuffer->framebuffer;
+	RenderCounters_FillInheritance(pThis->pRenderCounters, &inheritanceInfo);
+
+	uint32_t secondaryCount = CommandRecorder_Record(
+		pThis->pCommandRecorder,
+		&inheritanceInfo,
+		pThis->drawMeshCount,
+		MIN_MESHES_PER_SECONDARY,
+		VulkanRenderer_RecordMeshes,
+		pThis,
+		pThis->paSecondaryCommandBuffers);
+	if (secondaryCount > 0) {
+		vkCmdExecuteCommands(
+			commandBuffer,
+			secondaryCount,
+			pThis->paSecondaryCommandBuffers);
+	}
+
+	vkCmdEndRenderPass(commandBuffer);
+	RenderCounters_EndPass(pThis->pRenderCounters, commandBuffer);
+	GpuProfiler_EndScope(pThis->pGpuProfiler, commandBuffer, sceneScope);
+
+	if (pThis->headless) {
+		// the render pass leaves the image in TRANSFER_SRC, copy it out for the host
+		uint32_t readbackScope = GpuProfiler_BeginScope(
+			pThis->pGpuProfiler,
+			commandBuffer,
+			"readback");
+		VulkanRenderer_RecordReadback(pThis, commandBuffer, imageIndex);
+		GpuProfiler_EndScope(pThis->pGpuProfiler, commandBuffer, readbackScope);
+	}
+}
+
+/*!
+ * \brief	draws a range of papDrawMeshes into a secondary, on any recording thread
+ *
+ * Secondaries inherit no state, so each binds the bindless set and sets the
+ * viewport and scissor, and the pipeline, depth bias and whatever else is
+ * dynamic whenever it changes between meshes. Each mesh's transforms are
+ * either pushed, the projection once per secondary, or the one descriptor set
+ * is bound again with the mesh's dynamic offset.
+ */
+void VulkanRenderer_RecordMeshes(
+	void* pUserData,
+	VkCommandBuffer commandBuffer,
+	uint32_t firstMesh,
+	uint32_t meshCount) {
+	const VulkanRenderer* pThis = (const VulkanRenderer*)pUserData;
+
+	VkViewport viewport = { 0 };
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = (float)pThis->width;
+	viewport.height = (float)pThis->height;
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = { 0 };
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	scissor.extent.width = pThis->width;
+	scissor.extent.height = pThis->height;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	if (pThis->bindlessEnabled) {
+		VkDescriptorSet bindlessSet = DescriptorAllocator_GetBindlessSet(
+			pThis->pDescriptorAllocator);
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			pThis->pipelineLayout,
+			1,
+			1,
+			&bindlessSet,
+			0,
+			NULL);
+	}
+	if (pThis->pushConstantTransforms) {
+		vkCmdPushConstants(
+			commandBuffer,
+			pThis->pipelineLayout,
+			VK_SHADER_STAGE_VERTEX_BIT,
+			offsetof(UniformBlock, projection),
+			sizeof(pThis->projection),
+			pThis->projection);
+	}
+	// the first mesh sets everything, the rest only what changes
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	PipelineDescription description = pThis->pipelineDescription;
+	float depthBiasConstantFactor = 0.f;
+	float depthBiasSlopeFactor = 0.f;
+	for (uint32_t i = firstMesh; i < firstMesh + meshCount; i++) {
+		const Mesh* pMesh = pThis->papDrawMeshes[i];
+		if (pThis->paDrawPipelines[i] != boundPipeline) {
+			boundPipeline = pThis->paDrawPipelines[i];
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boundPipeline);
+		}
+
+		const RenderState* pRenderState = Mesh_GetRenderState(pMesh);
+		if (i == firstMesh
+			|| memcmp(pRenderState, &description.renderState, sizeof(RenderState)) != 0) {
+			description.renderState = *pRenderState;
+			PipelineManager_RecordDynamicState(
+				pThis->pPipelineManager,
+				commandBuffer,
+				&description);
+		}
+
+		float constantFactor;
+		float slopeFactor;
+		Mesh_GetDepthBias(pMesh, &constantFactor, &slopeFactor);
+		if (i == firstMesh
+			|| constantFactor != depthBiasConstantFactor
+			|| slopeFactor != depthBiasSlopeFactor) {
+			depthBiasConstantFactor = constantFactor;
+			depthBiasSlopeFactor = slopeFactor;
+			// clamping needs the depthBiasClamp feature
+			vkCmdSetDepthBias(commandBuffer, constantFactor, 0.f, slopeFactor);
+		}
+
+		if (pThis->pushConstantTransforms) {
+			vkCmdPushConstants(
+				commandBuffer,
+				pThis->pipelineLayout,
+				VK_SHADER_STAGE_VERTEX_BIT,
+				0,
+				sizeof(float) * 16,
+				Mesh_GetTransform(pMesh));
+		}
+		else {
+			vkCmdBindDescriptorSets(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				pThis->pipelineLayout,
+				0,
+				1,
+				&pThis->descriptorSet,
+				1,
+				&pThis->paDrawUniformOffsets[i]);
+		}
+		Mesh_RecordDraw(pMesh, commandBuffer);
+	}
+}
+
+/*!
+ * \brief	copies offscreen target \a imageIndex into its host visible readback buffer
+ */
+void VulkanRenderer_RecordReadback(
+	VulkanRenderer* pThis,
+	VkCommandBuffer commandBuffer,
+	uint32_t imageIndex) {
+	assert(pThis);
+	assert(pThis->headless);
+	assert(commandBuffer);
+
+	SwapChainBuffer* pBuffer = &pThis->paSwapChainBuffers[imageIndex];
+	OffscreenTarget* pTarget = &pThis->paOffscreenTargets[imageIndex];
+
+	// the layout transition happened at the end of the render pass
+	VkImageMemoryBarrier imageBarrier = { 0 };
+	imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageBarrier.pNext = NULL;
+	imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.image = pBuffer->image;
+	imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageBarrier.subresourceRange.baseMipLevel = 0;
+	imageBarrier.subresourceRange.levelCount = 1;
+	imageBarrier.subresourceRange.baseArrayLayer = 0;
+	imageBarrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0,
+		NULL,
+		0,
+		NULL,
+		1,
+		&imageBarrier);
+
+	VkBufferImageCopy copyRegion = { 0 };
+	copyRegion.bufferOffset = 0;
+	copyRegion.bufferRowLength = 0; // tightly packed
+	copyRegion.bufferImageHeight = 0;
+	copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copyRegion.imageSubresource.mipLevel = 0;
+	copyRegion.imageSubresource.baseArrayLayer = 0;
+	copyRegion.imageSubresource.layerCount = 1;
+	copyRegion.imageOffset.x = 0;
+	copyRegion.imageOffset.y = 0;
+	copyRegion.imageOffset.z = 0;
+	copyRegion.imageExtent.width = pThis->width;
+	copyRegion.imageExtent.height = pThis->height;
+	copyRegion.imageExtent.depth = 1;
+
+	vkCmdCopyImageToBuffer(
+		commandBuffer,
+		pBuffer->image,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		pTarget->readbackBuffer,
+		1,
+		&copyRegion);
+
+	// make the copy visible to the host once the frame's fence signals
+	VkBufferMemoryBarrier bufferBarrier = { 0 };
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.pNext = NULL;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = pTarget->readbackBuffer;
+	bufferBarrier.offset = 0;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0,
+		0,
+		NULL,
+		1,
+		&bufferBarrier,
+		0,
+		NULL);
+}
+
+/*!
+ * \brief	holds the frame back until frameInterval has passed since the last one started
+ *
+ * Sleeps most of the way and spins the last millisecond, as sleeps are only
+ * good to a millisecond or so.
+ */
+void VulkanRenderer_PaceFrame(VulkanRenderer* pThis) {
+	assert(pThis);
+	assert(pThis->frameInterval);
+
+	uint64_t now = GetTimeMicroseconds();
+	if (pThis->nextFrameTime > now + 1000) {
+		Thread_Sleep((uint32_t)((pThis->nextFrameTime - now) / 1000) - 1);
+	}
+	while (now < pThis->nextFrameTime) {
+		now = GetTimeMicroseconds();
+	}
+
+	// a frame that ran long starts the schedule over rather than rushing
+	// the next few to catch up
+	pThis->nextFrameTime += pThis->frameInterval;
+	if (pThis->nextFrameTime < now) {
+		pThis->nextFrameTime = now + pThis->frameInterval;
+	}
+}
+
+/*!
+ * \brief	blocks until \a fence is signaled
+ *
+ * \return	VK_SUCCESS, or VK_ERROR_DEVICE_LOST which is noted for the next
+ *			frame to recover from
+ */
+VkResult VulkanRenderer_WaitForFence(VulkanRenderer* pThis, VkFence fence) {
+	assert(pThis);
+	assert(fence);
+
+	VkResult fenceResult;
+	do {
+		fenceResult = vkWaitForFences(
+			pThis->device,
+			1,
+			&fence,
+			VK_TRUE,
+			FENCE_TIMEOUT);
+	} while (fenceResult == VK_TIMEOUT);
+	if (fenceResult == VK_ERROR_DEVICE_LOST) {
+		pThis->deviceLost = TRUE;
+		return fenceResult;
+	}
+	REQUIRE_VK_SUCCESS(fenceResult);
+	return VK_SUCCESS;
+}
+
+/*!
+ * \brief	gives up on the frame being rendered because of \a result
+ *
+ * A lost device is re-created straight away, so only the frame is lost.
+ *
+ * \return	VK_NOT_READY if the device was lost and has been re-created,
+ *			otherwise the failure to hand back from VulkanRenderer_Render
+ */
+VkResult VulkanRenderer_FailFrame(VulkanRenderer* pThis, VkResult result) {
+	assert(pThis);
+	assert(result != VK_SUCCESS);
+
+	if (result == VK_ERROR_DEVICE_LOST) {
+		pThis->deviceLost = TRUE;
+	}
+	if (!pThis->deviceLost) {
+		Log_Write(
+			LOG_SEVERITY_ERROR,
+			"renderer",
+			"failed to render a frame: %s",
+			GetResultName(result));
+		return result;
+	}
+
+	// it logged why, the device is tried again next call whatever it was
+	result = VulkanRenderer_RecoverDevice(pThis);
+	return result == VK_SUCCESS ? VK_NOT_READY : VK_ERROR_DEVICE_LOST;
+}
+
+VkResult VulkanRenderer_SetupCommandBuffer(
+	VulkanRenderer* pThis,
+	VkCommandBuffer* pCommandBufferOut) {
 	assert(pThis);
 	assert(pThis->commandPool);
 	assert(pThis->device);
+	assert(pCommandBufferOut);
 
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
 	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1172,15 +3432,14 @@ VkCommandBuffer VulkanRenderer_SetupCommandBuffer(VulkanRenderer* pThis) {
 	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 	commandBufferAllocateInfo.commandBufferCount = 1;
 
-	VkCommandBuffer commandBuffer;
-	REQUIRE_VK_SUCCESS(
+	RETURN_VK_FAILURE(
 		vkAllocateCommandBuffers(
 			pThis->device,
 			&commandBufferAllocateInfo,
-			&commandBuffer)
+			pCommandBufferOut)
 	);
 
-	return commandBuffer;
+	return VK_SUCCESS;
 }
 
 void VulkanRenderer_DestroyCommandBuffer(
@@ -1197,7 +3456,7 @@ void VulkanRenderer_DestroyCommandBuffer(
 		&commandBuffer);
 }
 
-VulkanRenderer_BeginCommandBuffer(VkCommandBuffer commandBuffer) {
+void VulkanRenderer_BeginCommandBuffer(VkCommandBuffer commandBuffer) {
 	// put in setup commands
 	VkCommandBufferBeginInfo beginInfo = { 0 };
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1206,7 +3465,7 @@ VulkanRenderer_BeginCommandBuffer(VkCommandBuffer commandBuffer) {
 	REQUIRE_VK_SUCCESS(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 }
 
-VulkanRenderer_EndCommandBuffer(VkCommandBuffer commandBuffer) {
+void VulkanRenderer_EndCommandBuffer(VkCommandBuffer commandBuffer) {
 	REQUIRE_VK_SUCCESS(vkEndCommandBuffer(commandBuffer));
 }
 
@@ -1300,6 +3559,74 @@ VkFormat SelectDepthFormat(VkPhysicalDevice physicalDevice) {
 	return VK_FORMAT_D16_UNORM;
 }
 
+BOOL FormatHasStencil(VkFormat format) {
+	return format == VK_FORMAT_D32_SFLOAT_S8_UINT
+		|| format == VK_FORMAT_D24_UNORM_S8_UINT
+		|| format == VK_FORMAT_D16_UNORM_S8_UINT;
+}
+
+/*!
+ * \brief	whether \a szExtensionName can be enabled on an instance
+ * \param	szLayerName the layer that would provide it, NULL for the loader
+ *			and drivers
+ */
+BOOL InstanceExtensionIsAvailable(const char* szLayerName, const char* szExtensionName) {
+	assert(szExtensionName);
+
+	uint32_t extensionCount;
+	REQUIRE_VK_SUCCESS(
+		vkEnumerateInstanceExtensionProperties(szLayerName, &extensionCount, NULL));
+	VkExtensionProperties* paExtensions
+		= SAFE_ALLOCATE_ARRAY(VkExtensionProperties, extensionCount);
+	REQUIRE_VK_SUCCESS(
+		vkEnumerateInstanceExtensionProperties(szLayerName, &extensionCount, paExtensions));
+
+	BOOL found = FALSE;
+	for (uint32_t i = 0; i < extensionCount; i++) {
+		if (strcmp(paExtensions[i].extensionName, szExtensionName) == 0) {
+			found = TRUE;
+			break;
+		}
+	}
+
+	SAFE_FREE(paExtensions);
+	return found;
+}
+
+/*!
+ * \brief	filters \a aszRequestedLayers down to the layers installed on this machine
+ * \param	aszAvailableLayersOut receives the layers that exist, must hold \a requestedLayerCount entries
+ * \return	the number of layers written to \a aszAvailableLayersOut
+ */
+uint32_t SelectAvailableLayers(
+	const char** aszRequestedLayers,
+	uint32_t requestedLayerCount,
+	const char** aszAvailableLayersOut) {
+	assert(aszRequestedLayers);
+	assert(aszAvailableLayersOut);
+
+	uint32_t layerPropertyCount;
+	REQUIRE_VK_SUCCESS(vkEnumerateInstanceLayerProperties(&layerPropertyCount, NULL));
+	VkLayerProperties* paLayerProperties
+		= SAFE_ALLOCATE_ARRAY(VkLayerProperties, layerPropertyCount);
+	REQUIRE_VK_SUCCESS(
+		vkEnumerateInstanceLayerProperties(
+			&layerPropertyCount, paLayerProperties));
+
+	uint32_t availableLayerCount = 0;
+	for (uint32_t i = 0; i < requestedLayerCount; i++) {
+		for (uint32_t j = 0; j < layerPropertyCount; j++) {
+			if (strcmp(aszRequestedLayers[i], paLayerProperties[j].layerName) == 0) {
+				aszAvailableLayersOut[availableLayerCount++] = aszRequestedLayers[i];
+				break;
+			}
+		}
+	}
+
+	SAFE_FREE(paLayerProperties);
+	return availableLayerCount;
+}
+
 /*!
 * \brief	Determine if the \a newType of device is better than the \a oldType
 * \param	newType the new type of device
@@ -6,17 +6,103 @@
 extern "C" {
 #endif//__cplusplus
 
+#include "DescriptorAllocator.h"
+#include "GpuProfiler.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "PlatformSurface.h"
+#include "RenderCounters.h"
+
 typedef struct vulkan_renderer_t VulkanRenderer;
 
+// how many frames the cpu may record ahead of the gpu
+#define VULKAN_RENDERER_DEFAULT_FRAMES_IN_FLIGHT 2
+#define VULKAN_RENDERER_MAX_FRAMES_IN_FLIGHT 4
+
+// how frames are paced and presented, trading latency against smoothness and power
+typedef enum present_policy_t {
+	// presents as soon as a frame is done, tearing if it has to, and keeps
+	// the cpu a single frame ahead so input is sampled as late as possible
+	PRESENT_POLICY_LOWEST_LATENCY,
+	// never tears, and lets the cpu run every frame in flight ahead for the
+	// most throughput. the default
+	PRESENT_POLICY_TEAR_FREE,
+	// waits for vblank with as few images and frames queued as possible
+	PRESENT_POLICY_POWER_SAVING,
+	// waits for vblank and starts frames at an even interval, so animation
+	// stays smooth at the cost of some latency
+	PRESENT_POLICY_FIXED_REFRESH,
+	PRESENT_POLICY_COUNT,
+} PresentPolicy;
+
+// how often PRESENT_POLICY_FIXED_REFRESH starts a frame unless told otherwise, 60Hz
+#define VULKAN_RENDERER_DEFAULT_FRAME_INTERVAL 16667
+
+// the pass the scene is counted as by VulkanRenderer_GetRenderCounters
+#define VULKAN_RENDERER_SCENE_COUNTER_PASS 0
+
+// how much the renderer is checked by VK_LAYER_KHRONOS_validation. every
+// level but off costs a large multiple of cpu time per Vulkan call
+typedef enum validation_level_t {
+	// no layers at all
+	VALIDATION_LEVEL_OFF,
+	VALIDATION_LEVEL_ERRORS,
+	// errors, warnings and performance warnings
+	VALIDATION_LEVEL_WARNINGS,
+	// everything the layer has to say, including info
+	VALIDATION_LEVEL_VERBOSE,
+	VALIDATION_LEVEL_COUNT,
+} ValidationLevel;
+
+// off in release builds, where it would only slow things down
+#ifdef NDEBUG
+#define VULKAN_RENDERER_DEFAULT_VALIDATION VALIDATION_LEVEL_OFF
+#else//NDEBUG
+#define VULKAN_RENDERER_DEFAULT_VALIDATION VALIDATION_LEVEL_WARNINGS
+#endif//NDEBUG
+
+// set to off, errors, warnings or verbose to override the level a renderer
+// is created with, so validation can be turned on without rebuilding
+#define VULKAN_RENDERER_VALIDATION_VARIABLE "VULKAN_RENDERER_VALIDATION"
+
 VulkanRenderer* VulkanRenderer_Create(
 	uint32_t width,
 	uint32_t height,
-	// TODO: get these win32 things out of here!
-	HINSTANCE hInstance,
-	HWND hWnd);
-void VulkanRenderer_Render(VulkanRenderer* pThis);
+	uint32_t framesInFlight,
+	ValidationLevel validationLevel,
+	const PlatformSurface* pPlatformSurface,
+	JobSystem* pJobSystem);
+VulkanRenderer* VulkanRenderer_CreateHeadless(
+	uint32_t width,
+	uint32_t height,
+	uint32_t framesInFlight,
+	ValidationLevel validationLevel,
+	JobSystem* pJobSystem);
+VkResult VulkanRenderer_Render(VulkanRenderer* pThis);
+void VulkanRenderer_Resize(VulkanRenderer* pThis, uint32_t width, uint32_t height);
+void VulkanRenderer_SetPresentPolicy(
+	VulkanRenderer* pThis,
+	PresentPolicy policy,
+	uint32_t frameIntervalMicroseconds);
+BOOL VulkanRenderer_ReadPixels(
+	VulkanRenderer* pThis,
+	void* pPixels,
+	size_t pixelBufferSize);
 void VulkanRenderer_Destroy(VulkanRenderer* pThis);
 
+Mesh* VulkanRenderer_CreateMesh(
+	VulkanRenderer* pThis,
+	const Vertex* paVertices,
+	uint32_t vertexCount,
+	const uint32_t* paIndices,
+	uint32_t indexCount);
+void VulkanRenderer_DestroyMesh(VulkanRenderer* pThis, Mesh* pMesh);
+void VulkanRenderer_SetProjection(VulkanRenderer* pThis, const float* pProjection);
+
+GpuProfiler* VulkanRenderer_GetProfiler(VulkanRenderer* pThis);
+RenderCounters* VulkanRenderer_GetRenderCounters(VulkanRenderer* pThis);
+DescriptorAllocator* VulkanRenderer_GetDescriptorAllocator(VulkanRenderer* pThis);
+
 #ifdef __cplusplus
 }
 #endif//__cplusplus
@@ -3,6 +3,7 @@
 
 #include "Win32VulkanTest.h"
 
+#include "Log.h"
 #include "VulkanRenderer.h"
 
 static const int kDefaultWidth = 640;
@@ -10,7 +11,9 @@ static const int kDefaultHeight = 480;
 
 typedef struct {
 	HWND hWindow;
+	PlatformSurface* pPlatformSurface;
 	BOOL running;
+	JobSystem* pJobSystem;
 	VulkanRenderer* pVulkanRenderer;
 } ApplicationData;
 
@@ -29,6 +32,15 @@ LRESULT CALLBACK WindowProc(
 	case WM_PAINT:
 		// Render
 		break;
+	case WM_SIZE:
+		// sent while the window is being created, before there's a renderer
+		if (pAppData && pAppData->pVulkanRenderer) {
+			VulkanRenderer_Resize(
+				pAppData->pVulkanRenderer,
+				LOWORD(lParam),
+				HIWORD(lParam));
+		}
+		break;
 	default:
 		break;
 	}
@@ -82,6 +94,8 @@ INT WinMain(
 		exit(1);
 	}
 
+	Log_Initialize(LOG_SEVERITY_INFO);
+
 	ApplicationData appData = { 0 };
 	appData.hWindow = hWindow;
 	appData.running = TRUE;
@@ -89,11 +103,30 @@ INT WinMain(
 	RECT clientRect;
 	BOOL gotClientRect = GetClientRect(hWindow, &clientRect);
 	assert(gotClientRect);
+	appData.pPlatformSurface = PlatformSurface_CreateWin32(hInstance, hWindow);
+	// this thread becomes the job system's main thread
+	appData.pJobSystem = JobSystem_Create(JOB_SYSTEM_DEFAULT_WORKERS);
 	appData.pVulkanRenderer = VulkanRenderer_Create(
 		clientRect.right - clientRect.left,
 		clientRect.bottom - clientRect.top,
-		hInstance,
-		hWindow);
+		VULKAN_RENDERER_DEFAULT_FRAMES_IN_FLIGHT,
+		VULKAN_RENDERER_DEFAULT_VALIDATION,
+		appData.pPlatformSurface,
+		appData.pJobSystem);
+
+	// the matrices start out as identity, so this is in clip space
+	const Vertex aTriangleVertices[] = {
+		{ { 0.f, -0.5f, 0.5f }, { 1.f, 0.f, 0.f } },
+		{ { 0.5f, 0.5f, 0.5f }, { 0.f, 1.f, 0.f } },
+		{ { -0.5f, 0.5f, 0.5f }, { 0.f, 0.f, 1.f } },
+	};
+	const uint32_t aTriangleIndices[] = { 0, 1, 2 };
+	VulkanRenderer_CreateMesh(
+		appData.pVulkanRenderer,
+		aTriangleVertices,
+		sizeof(aTriangleVertices) / sizeof(Vertex),
+		aTriangleIndices,
+		sizeof(aTriangleIndices) / sizeof(uint32_t));
 
 	SetWindowLongPtr(hWindow, GWLP_USERDATA, (LONG_PTR)&appData);
 
@@ -108,14 +141,26 @@ INT WinMain(
 			}
 		}
 
+		// jobs that have to touch the window run here
+		JobSystem_RunMainThreadJobs(appData.pJobSystem);
+
 		// Game Stuff
-		VulkanRenderer_Render(appData.pVulkanRenderer);
+		// a lost device is re-created by the renderer, anything worse ends the app
+		VkResult result = VulkanRenderer_Render(appData.pVulkanRenderer);
+		if (result < VK_SUCCESS && result != VK_ERROR_DEVICE_LOST) {
+			appData.running = FALSE;
+		}
 	}
 
 	VulkanRenderer_Destroy(appData.pVulkanRenderer);
 	appData.pVulkanRenderer = NULL;
+	JobSystem_Destroy(appData.pJobSystem);
+	appData.pJobSystem = NULL;
+	PlatformSurface_Destroy(appData.pPlatformSurface);
+	appData.pPlatformSurface = NULL;
 	DestroyWindow(appData.hWindow);
 	appData.hWindow = NULL;
+	Log_Shutdown();
 
 	return 0;
 }
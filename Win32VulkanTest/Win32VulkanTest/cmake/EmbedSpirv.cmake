@@ -0,0 +1,56 @@
+# Writes a SPIR-V module out as a C array of words, so it can be compiled in.
+#
+#   cmake -DINPUT=<module.spv> -DOUTPUT=<module.inc> -DSYMBOL=<array name> -P EmbedSpirv.cmake
+#
+# The words are read little endian, which is how glslangValidator writes them
+# on every host we build on, and written as numbers so the array is correct
+# whatever the target's byte order.
+
+cmake_policy(SET CMP0007 NEW)
+
+if(NOT INPUT OR NOT OUTPUT OR NOT SYMBOL)
+	message(FATAL_ERROR "EmbedSpirv.cmake needs INPUT, OUTPUT and SYMBOL")
+endif()
+
+file(READ "${INPUT}" SPIRV_HEX HEX)
+string(LENGTH "${SPIRV_HEX}" SPIRV_HEX_LENGTH)
+math(EXPR SPIRV_REMAINDER "${SPIRV_HEX_LENGTH} % 8")
+if(SPIRV_HEX_LENGTH EQUAL 0 OR NOT SPIRV_REMAINDER EQUAL 0)
+	message(FATAL_ERROR "${INPUT} isn't a whole number of SPIR-V words")
+endif()
+
+# aabbccdd in the file is the word 0xddccbbaa
+string(REGEX REPLACE
+	"([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])"
+	"0x\\4\\3\\2\\1;"
+	SPIRV_WORDS
+	"${SPIRV_HEX}")
+list(GET SPIRV_WORDS 0 SPIRV_MAGIC)
+if(NOT SPIRV_MAGIC STREQUAL "0x07230203")
+	message(FATAL_ERROR "${INPUT} isn't SPIR-V")
+endif()
+
+# eight words a line
+set(SPIRV_ARRAY "")
+set(SPIRV_COLUMN 0)
+foreach(SPIRV_WORD IN LISTS SPIRV_WORDS)
+	if(SPIRV_WORD STREQUAL "")
+		continue()
+	endif()
+	if(SPIRV_COLUMN EQUAL 0)
+		string(APPEND SPIRV_ARRAY "\t${SPIRV_WORD},")
+	else()
+		string(APPEND SPIRV_ARRAY " ${SPIRV_WORD},")
+	endif()
+	math(EXPR SPIRV_COLUMN "(${SPIRV_COLUMN} + 1) % 8")
+	if(SPIRV_COLUMN EQUAL 0)
+		string(APPEND SPIRV_ARRAY "\n")
+	endif()
+endforeach()
+if(NOT SPIRV_COLUMN EQUAL 0)
+	string(APPEND SPIRV_ARRAY "\n")
+endif()
+
+file(WRITE "${OUTPUT}"
+	"// generated from ${INPUT} by EmbedSpirv.cmake, don't edit\n"
+	"static const uint32_t ${SYMBOL}[] = {\n${SPIRV_ARRAY}};\n")
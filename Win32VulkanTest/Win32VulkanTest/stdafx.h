@@ -5,23 +5,50 @@
 
 #pragma once
 
+#ifdef _WIN32
+
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 
+#ifndef VK_USE_PLATFORM_WIN32_KHR
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif//VK_USE_PLATFORM_WIN32_KHR
 #define NOMINMAX // remove windows' min() and max()
 
 // Windows Header Files:
 #include <windows.h>
 
 // C RunTime Header Files
-#include <stdlib.h>
 #include <malloc.h>
-#include <memory.h>
 #include <tchar.h>
 
+#else//_WIN32
+
+// other platforms choose their window systems with CMake's VULKAN_TEST_WSI,
+// which defines the matching VK_USE_PLATFORM_*_KHR, or none at all for a
+// headless build
+
+typedef int BOOL;
+#define TRUE 1
+#define FALSE 0
+
+#endif//_WIN32
+
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+
 // TODO: reference additional headers your program requires here
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <vulkan/vulkan.h>
-#pragma comment(lib, "vulkan-1.lib")
+
+#ifndef _WIN32
+// the msvc crt names the rest of the code uses
+#define _strdup strdup
+
+static inline int fopen_s(FILE** ppFile, const char* szFileName, const char* szMode) {
+	*ppFile = fopen(szFileName, szMode);
+	return *ppFile != NULL ? 0 : 1;
+}
+#endif//_WIN32